@@ -2,7 +2,11 @@
 
 param ( 
     [switch] $AllowWarnings,
-    [switch] $LeaveOldArtifacts
+    [switch] $LeaveOldArtifacts,
+    # Also build misc\floodserver.c, a local IRC server for load tests.
+    [switch] $FloodServer,
+    # Most verbose log level compiled in: 1 (error) to 5 (spam).
+    [ValidateRange(1, 5)] [int] $LogCompileLevel = 5
 )
 
 $output_dir = "built"
@@ -30,5 +34,9 @@ if ($AllowWarnings) {
 # * [4820] Padding inserted after data member (winsock2.h causes these).
 # * [5045] Notes where compiler may insert Qspectre protection (potential perf cost).
 #cl main.c msgqueue.c log.c terminalutils.c stringutils.c screen_framework.c msgutils.c handlers.c ws2_32.lib /Qspectre /DWIN32_LEAN_AND_MEAN /DTERMUTILS_DEBUG_ASSERT /Wall /wd4820 /wd5045 $warnings_as_errors /Fe: "$outfilename";
-cl src\*.c ws2_32.lib /I"include" /Qspectre /DWIN32_LEAN_AND_MEAN /DTERMUTILS_DEBUG_ASSERT /Wall /wd4820 /wd5045 $warnings_as_errors /Fo"$output_dir\" /Fe"$output_dir\$exe_filename";
+cl src\*.c ws2_32.lib /I"include" /Qspectre /DWIN32_LEAN_AND_MEAN /DTERMUTILS_DEBUG_ASSERT /DLOG_COMPILE_LEVEL=$LogCompileLevel /Wall /wd4820 /wd5045 $warnings_as_errors /Fo"$output_dir\" /Fe"$output_dir\$exe_filename";
 #/link /out:"$output_dir\$exe_filename";
+
+if ($FloodServer) {
+    cl misc\floodserver.c ws2_32.lib /DWIN32_LEAN_AND_MEAN /O2 /Fo"$output_dir\" /Fe"$output_dir\floodserver.exe";
+}
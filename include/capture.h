@@ -0,0 +1,57 @@
+// Raw traffic captures: everything the server sent, chunk by chunk as recv()
+// returned it, with when it arrived. misc/replay.c feeds a capture back through
+// the client without a network, to reproduce and time what it did.
+//
+// The file starts with CAPTURE_MAGIC, the timestamps' ticks per second (an
+// int64), and the wall-clock time the capture started (an int64, seconds since
+// the epoch). Then come chunks, each its timestamp (i64, ticks since the
+// capture started), its length (u32) and its bytes. All integers are
+// little-endian, whatever the machine that wrote them.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CAPTURE_MAGIC "ATHCAP01"
+#define CAPTURE_MAGIC_LEN 8
+
+// Longest chunk a capture can hold.
+#define CAPTURE_CHUNK_MAXLEN (64 * 1024)
+
+typedef struct capture_header {
+    int64_t ticks_per_s;
+    int64_t start_time;
+} capture_header;
+
+// A chunk read back by capture_read().
+typedef struct capture_chunk {
+    // Since the capture started.
+    int64_t ticks;
+    const char *data;
+    size_t len;
+} capture_chunk;
+
+// Starts capturing to 'path', replacing it. Returns false if it can't be
+// written.
+bool capture_start(const char *const path);
+
+// Adds what one recv() returned. Does nothing unless capturing. Only one
+// thread may call it. Chunks are buffered, and flushed as they're added at
+// most once a second, so a killed client's capture may lack its last second or
+// so (and end cut short).
+void capture_chunk_received(const char *const data, size_t len);
+
+// Stops capturing and closes the file. Call once capture_chunk_received()
+// can't be called anymore.
+void capture_stop(void);
+
+// Reads the header. Returns false if 'in' isn't a capture.
+bool capture_read_header(FILE *const in, capture_header *const h);
+
+// Reads the next chunk into 'chunk', with its bytes in 'buf'. Returns 1 if one
+// was read, 0 at the end of the file, and -1 if the file is cut short or
+// corrupt, e.g. because the client was killed while capturing.
+int capture_read(FILE *const in, capture_chunk *const chunk, char *const buf,
+        size_t bufsize);
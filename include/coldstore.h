@@ -0,0 +1,123 @@
+// Compressed in-memory history for a screen. Once lines fall out of a screen's
+// recent window, the screenlog seals them into blocks of about
+// COLD_BLOCK_RAW_BYTES and hands them here, where each block is packed into a
+// single buffer and compressed with LZ4 (see lz4block.h). Generated channel
+// traffic came out 1.67x smaller this way, block overhead included, so the
+// same budget holds about two thirds more history before anything has to go
+// to disk.
+//
+// Each block also keeps the visible width of every line, uncompressed, so row
+// counts and scroll positions are computed without touching the compressed
+// data. A block is only decompressed when its lines are actually needed (drawn,
+// previewed or spilled), into a small cache of COLD_CACHE_BLOCKS blocks shared
+// by every screen.
+//
+// Lines are addressed by the sequence number the screenlog gave them. Blocks
+// only grow at the back (seal) and shrink from the front (drop), like the
+// screenlog itself.
+#pragma once
+
+#include "scrrecord.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Roughly how many bytes of records go into one block. Big enough to give the
+// compressor some history to match against, small enough that decompressing
+// one to draw a page is cheap.
+#define COLD_BLOCK_RAW_BYTES (1024 * 64)
+
+// Decompressed blocks kept around, across all screens.
+#define COLD_CACHE_BLOCKS 4
+
+// A nick the lines of a block refer to, and how many of them do.
+typedef struct cold_nick_ref {
+    uint32_t nick;
+    uint32_t refs;
+} cold_nick_ref;
+
+typedef struct cold_block {
+    // LZ4-compressed records, or the raw records if they didn't compress.
+    uint8_t *data;
+    uint32_t data_len;
+    uint32_t raw_len;
+    bool compressed;
+    uint32_t first_seq;
+    uint32_t n_lines;
+    // Visible width of each line (see scrrec_width()), LEB128-encoded.
+    uint8_t *widths;
+    uint32_t widths_len;
+    // The nick references the block's lines hold, kept apart from the records
+    // so they're released even if the block can't be decompressed.
+    cold_nick_ref *nicks;
+    uint32_t n_nicks;
+    // Total rows of the block's lines at 'rows_cols' columns. Computed the
+    // first time the block is needed at a given width.
+    int rows_cols;
+    int64_t rows;
+    // Process-wide unique id, so cache entries never outlive their block.
+    uint64_t id;
+} cold_block;
+
+typedef struct coldstore {
+    // Live blocks are [first, end), oldest first.
+    cold_block *blocks;
+    size_t first;
+    size_t end;
+    size_t cap;
+    uint32_t n_lines;
+    // Heap held by the blocks: compressed data, widths, nick lists and
+    // headers.
+    int64_t bytes;
+    // What the blocks' records take uncompressed, for reporting.
+    int64_t raw_bytes;
+    // Total rows of every block at 'total_cols' columns.
+    int total_cols;
+    int64_t total_rows;
+} coldstore;
+
+// Releases every block, giving back their nick references, and zeroes the
+// store.
+void cold_free(coldstore *const cs);
+
+size_t cold_count_blocks(const coldstore *const cs);
+
+// Seals 'n' records, numbered 'first_seq' onward, into a new block at the back.
+// 'first_seq' must follow on from the newest line already in the store. The
+// records' bodies are freed; their nick references are kept by the block.
+void cold_seal(coldstore *const cs, uint32_t first_seq,
+        const scrrec *const recs, size_t n);
+
+// Removes the oldest block, giving back its nick references. The store must
+// not be empty.
+void cold_drop_front(coldstore *const cs);
+
+// Returns the records of the 'i'th live block (0 is the oldest), decompressing
+// it if it isn't cached, and writes their number to 'n'. Valid until the next
+// call to any cold_*() function. Returns NULL if the block is corrupt.
+const scrrec *cold_get_block(coldstore *const cs, size_t i, size_t *const n);
+
+// Returns the record with sequence number 'seq', or NULL if it isn't in the
+// store. Valid as for cold_get_block().
+const scrrec *cold_get_seq(coldstore *const cs, uint32_t seq);
+
+// Total rows of every line in the store at 'cols' columns.
+int64_t cold_total_rows(coldstore *const cs, int cols);
+
+// Locates the row that is 'rows_back' rows above the end of the newest line in
+// the store (1 is the last row of the newest line). On success, 'i_block' and
+// 'i_line' are the block and line within it containing the row, and
+// 'row_in_line' the row within that line. Returns false if the store has fewer
+// rows than that. Never decompresses anything.
+bool cold_find_row_from_end(coldstore *const cs, int cols, int64_t rows_back,
+        size_t *const i_block, size_t *const i_line,
+        int64_t *const row_in_line);
+
+// Total rows of the lines from sequence number 'seq' through the newest, at
+// 'cols' columns. Returns 0 if 'seq' isn't in the store.
+int64_t cold_rows_from(coldstore *const cs, int cols, uint32_t seq);
+
+// Recomputes every line's width after the way lines are drawn changed (e.g.,
+// the timestamp format). Decompresses every block, so it's O(n).
+void cold_refresh_widths(coldstore *const cs);
@@ -0,0 +1,85 @@
+// Messages compiled for display.
+//
+// Screen messages arrive as strings mixing visible text, ANSI SGR escapes and
+// IRC formatting codes (bold, colour, ...). Rather than translating the IRC
+// codes and skipping over escapes on every frame, each message is compiled
+// once, when it enters a screenlog, into:
+//      * its visible text, with every escape and control byte removed, so one
+//        byte is one column and wrapping is plain arithmetic, and
+//      * spans: the ANSI escapes to emit before a given column of the text,
+//        with IRC codes already translated. However many codes change the
+//        formatting between two characters, the span holds one SGR sequence
+//        with only what ends up different, or nothing if nothing does.
+// Rendering is then a series of memcpy()s alternating text runs and escapes.
+//
+// The escapes themselves are interned in a table shared by every line, since
+// a channel only ever uses a handful of distinct colour and style changes. A
+// span is just a column and an index into that table, which keeps a colourful
+// line about the size of its source string. The table never forgets an
+// escape, since lines anywhere in the scrollback may use it, so it's capped.
+// Once it's full, new escapes are kept in the lines using them instead, and go
+// when they do.
+//
+// A compiled line is a single allocation: the fmtline header, followed by its
+// spans and its null-terminated text, and then, if it has any, its own escapes
+// (a u16 of their total size, then each one's u8 length and bytes).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest visible text a line can have; the rest is dropped. Well beyond
+// anything the server can send in one message.
+#define FMTLINE_TEXT_MAXLEN UINT16_MAX
+
+// IRC formatting control codes.
+#define IRC_FMT_BOLD 0x02
+#define IRC_FMT_ITALIC 0x1D
+#define IRC_FMT_UNDERLINE 0x1F
+#define IRC_FMT_STRIKETH 0x1E
+#define IRC_FMT_RESET 0x0F
+#define IRC_FMT_COLOR 0x03
+#define IRC_FMT_COLOR_HEX 0x04
+#define IRC_FMT_COLOR_REV 0x16
+
+typedef struct fmtline_span {
+    // Column of the text the escape is emitted before. May equal the text
+    // length for escapes trailing the last visible character.
+    uint16_t at;
+    // Index in the escape table, or FMTLINE_ESC_LOCAL and the offset of the
+    // escape among the line's own.
+    uint16_t esc;
+} fmtline_span;
+
+#define FMTLINE_ESC_LOCAL 0x8000
+// Set in escs_len if the line has escapes of its own.
+#define FMTLINE_HAS_LOCAL 0x80000000u
+
+typedef struct fmtline {
+    uint16_t text_len;
+    uint16_t n_spans;
+    // Total length of the line's escapes, for sizing render buffers, and
+    // FMTLINE_HAS_LOCAL.
+    uint32_t escs_len;
+} fmtline;
+
+// Compiles 'msg'. The result is malloc()ed; free it with free().
+fmtline *fmtline_compile(const char *const msg);
+
+// Total bytes of the allocation.
+size_t fmtline_size(const fmtline *const line);
+
+const fmtline_span *fmtline_spans(const fmtline *const line);
+const char *fmtline_text(const fmtline *const line);
+
+// Bytes fmtline_render() writes for the whole line.
+size_t fmtline_ansi_len(const fmtline *const line);
+
+// Writes columns ['start', 'end') of the line to 'buf' as ANSI text. Escapes
+// before 'start' are replayed first so the text is formatted the same as if
+// the line were written from the beginning, and escapes trailing the text are
+// only written if 'end' is the end of the line. Does not null-terminate.
+// Returns the number of bytes written, which is at most
+// fmtline_ansi_len(line).
+size_t fmtline_render(const fmtline *const line, size_t start, size_t end,
+        char *const buf, size_t bufsize);
@@ -0,0 +1,79 @@
+// Decides when the main loop draws a frame.
+//
+// Anything that changes what's on screen marks the part of the UI it changed
+// as dirty. framesched_take() then says whether to draw: only if something is
+// dirty, and only once a refresh interval has passed since the last frame,
+// unless a keystroke asked for the frame (typing never waits on the cap).
+// Marks made between frames are merged, so a flood of thousands of lines a
+// second still draws at most the capped number of frames.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FRAMESCHED_DEFAULT_FPS 60
+#define FRAMESCHED_MAX_FPS 1000
+
+// Parts of the UI, for marking what changed.
+#define FRAME_DIRTY_TABS 0x01
+#define FRAME_DIRTY_HEADER 0x02
+#define FRAME_DIRTY_LOG 0x04
+#define FRAME_DIRTY_INPUT 0x08
+#define FRAME_DIRTY_ALL 0x0F
+
+// What became of a frame framesched_take() said to draw.
+typedef enum frame_outcome {
+    FRAME_WRITTEN,
+    // Written as one synchronized update (DEC mode 2026), which the terminal
+    // shows only once it has all of it.
+    FRAME_WRITTEN_SYNCED,
+    // Nothing on screen changed, so there was nothing to write.
+    FRAME_UNCHANGED,
+    // Not (completely) written, e.g. because writing to the console failed.
+    FRAME_DROPPED,
+    // Never presented, because a newer frame replaced it first (see
+    // renderthread.h).
+    FRAME_SKIPPED,
+    FRAME_N_OUTCOMES
+} frame_outcome;
+
+typedef struct framesched_stats {
+    uint64_t frames;
+    // Frames drawn right away for input, of the above.
+    uint64_t urgent_frames;
+    // Calls to framesched_mark*(), most of which don't cause a frame of their
+    // own.
+    uint64_t marks;
+    // Marks made while a frame was already due, and merged into it.
+    uint64_t coalesced;
+    // Frames by outcome, as told by framesched_frame_done().
+    uint64_t written;
+    uint64_t synced;
+    uint64_t unchanged;
+    uint64_t dropped;
+    uint64_t skipped;
+} framesched_stats;
+
+// Marks 'parts' (FRAME_DIRTY_*) as needing a redraw.
+void framesched_mark(uint32_t parts);
+
+// Same, and makes the next frame due right away regardless of the cap.
+void framesched_mark_urgent(uint32_t parts);
+
+// If a frame is due at 'now_us' (a monotonic clock, in microseconds), returns
+// the parts to redraw and clears them. Otherwise returns 0.
+uint32_t framesched_take(uint64_t now_us);
+
+// How long the main loop can wait for input before the next frame is due, in
+// milliseconds (rounded up): 0 if one is due now, 'idle_ms' if nothing is
+// dirty.
+uint32_t framesched_wait_ms(uint64_t now_us, uint32_t idle_ms);
+
+// Records what became of the frame last taken, for the stats.
+void framesched_frame_done(frame_outcome outcome);
+
+// Sets the most frames drawn per second, 1 to FRAMESCHED_MAX_FPS.
+void framesched_set_max_fps(int fps);
+int framesched_get_max_fps(void);
+
+const framesched_stats *framesched_get_stats(void);
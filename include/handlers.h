@@ -4,10 +4,12 @@
 #include "msgutils.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <winsock2.h>
 
 // Dispatches to a specific ircmsg handler by reading 'ircm->command'.
-bool handle_ircmsg(ircmsg *const ircm, const_str ts); 
+// 'ts' is when the message arrived, in seconds since the epoch.
+bool handle_ircmsg(ircmsg *const ircm, int64_t ts);
 
 // Dispatches to a specific localcmd handler by reading 'cmd_str'.
-bool handle_user_command(char *msg, const_str nick, SOCKET sock, const_str ts);
+bool handle_user_command(char *msg, const_str nick, SOCKET sock, int64_t ts);
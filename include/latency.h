@@ -0,0 +1,104 @@
+// Where the time goes between a line arriving and it being on screen.
+//
+// Each message is stamped with a monotonic clock (latency_now_us()) as it
+// goes through the client: when recv() returned it, when the receive thread
+// submitted it to QUEUE_IN, when the main loop took it, when its parsing and
+// then its handling began, when it went into a screenlog, and when the first
+// frame with it was shown. The time between each stamp and the next is
+// counted, per stage, in a histogram; '!stats latency' shows their
+// percentiles, and so does the end of a run.
+//
+// The histograms are HDR-style: exact up to LATENCY_HIST_SUB_COUNT
+// microseconds, and past that, each power of two is split into
+// LATENCY_HIST_SUB_COUNT buckets, so every value is kept to within about 3%
+// whatever its size, in a fixed amount of memory.
+//
+// Only the main thread calls anything here but latency_now_us(). Lines go to
+// the showing stage only if they went into the active screen; any other
+// screen's lines aren't shown until it is. If frames stop being shown, only
+// the most recent lines (up to 64K) are kept waiting for one; older ones are
+// never counted in the showing and total stages.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Buckets per power of two, and so the precision of the histograms.
+#define LATENCY_HIST_SUB_BITS 5
+#define LATENCY_HIST_SUB_COUNT (1 << LATENCY_HIST_SUB_BITS)
+// Values are counted up to 2^LATENCY_HIST_MAX_BITS microseconds (over an
+// hour); anything longer is counted as that.
+#define LATENCY_HIST_MAX_BITS 32
+#define LATENCY_HIST_BUCKETS \
+    ((LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1) * \
+     LATENCY_HIST_SUB_COUNT)
+
+// Long enough for any line from latency_describe().
+#define LATENCY_DESC_SIZE 128
+
+// The time between one stamp and the next.
+typedef enum latency_stage {
+    // recv() returning to being submitted to QUEUE_IN.
+    LATENCY_FRAMING,
+    // Submitted to being taken from QUEUE_IN by the main loop.
+    LATENCY_QUEUED,
+    // Taken to its parsing beginning, behind the messages taken with it.
+    LATENCY_WAITING,
+    LATENCY_PARSING,
+    // Handling beginning to going into a screenlog, or to handling ending if
+    // it went into none.
+    LATENCY_HANDLING,
+    // Going into the active screen's screenlog to the first frame shown with
+    // it.
+    LATENCY_SHOWING,
+    // recv() returning to the first frame shown with it.
+    LATENCY_TOTAL,
+    LATENCY_N_STAGES
+} latency_stage;
+
+typedef struct latency_hist {
+    uint64_t count;
+    uint64_t max_us;
+    uint64_t buckets[LATENCY_HIST_BUCKETS];
+} latency_hist;
+
+// Monotonic clock for the stamps, in microseconds. Any thread may call it.
+uint64_t latency_now_us(void);
+
+// A message taken from QUEUE_IN at 't_dequeue' is about to be parsed.
+// 't_recv' and 't_submit' are the stamps it carries (see msgqueue.h), 0 if
+// it carries none.
+void latency_msg_begin(uint64_t t_recv, uint64_t t_submit,
+        uint64_t t_dequeue);
+
+// It was parsed, and its handling begins.
+void latency_msg_parsed(void);
+
+// It went into a screenlog, the active screen's if 'active'. Called for
+// every line delivered; does nothing outside latency_msg_begin() and
+// latency_msg_end(), or for a message's second line.
+void latency_msg_inserted(bool active);
+
+// It's handled, or was dropped as unparsable.
+void latency_msg_end(void);
+
+// A frame is being composed. Returns its number, for latency_frame_shown().
+uint64_t latency_frame_composed(void);
+
+// The frame numbered 'frame' was shown at 't_shown'. So was everything put
+// into the active screen before it was composed, whether or not that was
+// shown in an earlier frame that was skipped or dropped.
+void latency_frame_shown(uint64_t frame, uint64_t t_shown);
+
+// Forgets everything counted so far, e.g. to measure only what follows.
+void latency_reset(void);
+
+const latency_hist *latency_get_hist(latency_stage stage);
+
+// The value (in microseconds) at or below which 'p' (0 to 1) of those in
+// 'hist' are, as the top of the bucket it falls in. 0 if 'hist' is empty.
+uint64_t latency_hist_percentile(const latency_hist *const hist, double p);
+
+// Writes a line with the stage's name, count, and p50/p99/p999/max.
+void latency_describe(latency_stage stage, char *const buf, size_t size);
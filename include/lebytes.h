@@ -0,0 +1,19 @@
+// Little-endian integers in byte buffers, for the file formats that promise
+// them whatever the machine (see capture.h and logbin.h).
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+void lebytes_put_u16(char *const p, uint16_t v);
+void lebytes_put_u32(char *const p, uint32_t v);
+void lebytes_put_u64(char *const p, uint64_t v);
+
+uint16_t lebytes_get_u16(const char *const p);
+uint32_t lebytes_get_u32(const char *const p);
+uint64_t lebytes_get_u64(const char *const p);
+
+// Reads exactly 'len' bytes. Returns false if the file ends first.
+bool lebytes_read_exact(FILE *const in, char *const buf, size_t len);
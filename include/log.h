@@ -1,5 +1,33 @@
+// Leveled logging to a file (or stdout).
+//
+// By default each call writes its line right away, on the calling thread.
+// Once log_start_writer() has been called, a call only copies its line into a
+// ring of its own thread's, with no lock and no I/O, and a background thread
+// writes the rings out in batches, in the order the lines were logged. A ring
+// that fills up because its thread logs faster than the writer keeps up drops
+// the lines that don't fit, and the writer says how many (see
+// log_dropped_count()), so memory stays bounded and no thread ever waits on
+// the log.
+//
+// With log_init_binary(), lines aren't formatted at all where they're logged:
+// each is stored as its call site's id and its raw arguments, to be formatted
+// later by misc/logdecode.c (see logbin.h). That's why log_fmt() is a macro:
+// it gives each call site a log_site of its own, which remembers what its
+// format string takes the first time it's used.
+//
+// Each module has a level of its own, so e.g. the parser can log at SPAM while
+// everything else stays at WARNING. A file's calls are its LOG_MODULE's; define
+// it before including this header. The macros check the level before their
+// arguments are evaluated, so a line that isn't logged costs a compare, and
+// calls above LOG_COMPILE_LEVEL (e.g. /DLOG_COMPILE_LEVEL=3 for INFO) aren't
+// compiled in at all.
 #pragma once
 
+#include "logbin.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 typedef enum {
@@ -10,15 +38,121 @@ typedef enum {
     LOGLEVEL_SPAM = 5
 } loglevel;
 
+typedef enum logmodule {
+    // Whatever isn't in one of the others.
+    LOGMODULE_GENERAL,
+    // Parsing IRC messages (msgutils).
+    LOGMODULE_PARSER,
+    // Receiving from the server and splitting it into messages.
+    LOGMODULE_RECV,
+    // Screens, screenlogs and drawing them.
+    LOGMODULE_SCREEN,
+    // Handling IRC messages and user commands.
+    LOGMODULE_HANDLERS,
+    LOGMODULE_COUNT
+} logmodule;
+
+#ifndef LOG_MODULE
+#define LOG_MODULE LOGMODULE_GENERAL
+#endif
+
+// Most verbose level that can be logged at all.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOGLEVEL_SPAM
+#endif
+
+// Longest line kept while the writer runs, including the null terminator;
+// longer ones are cut short.
+#define LOG_RECORD_MAXLEN 512
+
+// Room log_describe_levels() needs.
+#define LOG_LEVELS_DESC_SIZE 128
+
+// A log_fmt() call site. Zeroed until its first call.
+typedef struct log_site {
+    // 0 until registered, then 1 while being registered, then 2.
+    volatile long state;
+    uint32_t id;
+    const char *fmt;
+    // Whether its format can be logged in binary, and the arguments it takes.
+    bool binary;
+    logbin_format args;
+    // Whether the binary log has its format yet. Only touched by whatever
+    // writes the log.
+    bool written;
+} log_site;
+
 // Must be called before using any log functions. If log_to is NULL, logs will
 // be written to stdout.
 void log_init(FILE *const log_to);
 
+// Same, but writes the binary format, so 'log_to' must have been opened in
+// binary mode.
+void log_init_binary(FILE *const log_to);
+
+// Sets every module's level.
 void set_logger_level(loglevel level);
 
+void log_set_module_level(logmodule module, loglevel level);
+loglevel log_module_level(logmodule module);
+
+// Sets levels from a list like "warning,parser=spam,recv=dev": a bare level
+// sets every module's, 'module=level' one module's. Items are separated by
+// commas or spaces and applied in order. Sets nothing and returns false if any
+// isn't understood.
+bool log_set_levels(const char *const spec);
+
+// Writes each module's level, as log_set_levels() takes them, into 'buf'; cut
+// short if it has fewer than LOG_LEVELS_DESC_SIZE bytes.
+void log_describe_levels(char *const buf, size_t bufsize);
+
+// Read by the macros below; change them with the functions above.
+extern volatile loglevel log_module_levels[LOGMODULE_COUNT];
+
+#define log_enabled(module, severity)                                         \
+    ((severity) <= LOG_COMPILE_LEVEL &&                                       \
+     (severity) <= log_module_levels[(module)])
+
 void set_log_file(FILE *const log_to);
 
-void log(loglevel severity, const char *const msg);
+#define log(severity, msg) log_in(LOG_MODULE, (severity), (msg))
+
+#define log_fmt(severity, ...) log_fmt_in(LOG_MODULE, (severity), __VA_ARGS__)
+
+// Same, but for 'module' rather than the file's LOG_MODULE.
+#define log_in(module, severity, msg)                                         \
+    do {                                                                      \
+        if (log_enabled((module), (severity)))                                \
+            log_msg((severity), (msg));                                       \
+    } while (0)
+
+#define log_fmt_in(module, severity, ...)                                     \
+    do {                                                                      \
+        if (log_enabled((module), (severity))) {                              \
+            static log_site log_site_ = { 0 };                                \
+            log_fmt_at(&log_site_, (severity), __VA_ARGS__);                  \
+        }                                                                     \
+    } while (0)
+
+// What the macros call, once they've checked the level. For log_fmt_at(),
+// 'site' must be the same every time for the same format string.
+void log_msg(loglevel severity, const char *const msg);
+void log_fmt_at(log_site *const site, loglevel severity,
+        const char *const fmt_str, ...);
+
+// Starts the background writer. Returns false, leaving logging synchronous, if
+// it couldn't be started. Don't change the log file while it runs.
+bool log_start_writer(void);
+
+// Writes out what's left in the rings and stops the writer; logging is
+// synchronous again. Call once no other thread logs anymore, or their lines
+// may be lost.
+void log_stop_writer(void);
 
-void log_fmt(loglevel severity, const char *const fmt_str, ...);
+// Writes a line to 'out' the way the text log does, e.g. to turn a binary log
+// back into text.
+void log_write_text(FILE *const out, loglevel severity, const char *const text);
 
+// Lines dropped since the writer was started because their thread's ring was
+// full.
+uint64_t log_dropped_count(void);
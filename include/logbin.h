@@ -0,0 +1,130 @@
+// The binary log format (see log_init_binary()).
+//
+// A binary log line is only a call site's id, its level, the thread, a
+// timestamp and the raw arguments; the format string goes in the file once per
+// call site, the first time it logs. Formatting is left to whoever reads the
+// log, e.g. misc/logdecode.c, which prints it as the text log would have been.
+//
+// The file starts with LOGBIN_MAGIC and the timestamps' ticks per second (an
+// int64). Then come records, each starting with its type:
+//      LOGBIN_REC_SITE: site id (u32), format length (u16), format
+//      LOGBIN_REC_LINE: site id (u32), level (u8), thread id (u32),
+//                       timestamp (i64), arguments length (u16), arguments
+// The arguments are each argument in the format's order: 4 bytes for an int
+// and for a '*' width or precision, 8 for anything long, size_t, double or
+// pointer, and for a string its length (u16) and its bytes. All integers are
+// little-endian, whatever the machine that wrote them.
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define LOGBIN_MAGIC "ATHLOGB1"
+#define LOGBIN_MAGIC_LEN 8
+
+#define LOGBIN_REC_SITE 'S'
+#define LOGBIN_REC_LINE 'L'
+
+// Most arguments, '*'s included, a format can take and still be logged in
+// binary; one that takes more is logged formatted, as a string.
+#define LOGBIN_MAX_ARGS 16
+
+typedef enum logbin_arg_type {
+    LOGBIN_ARG_INT,
+    LOGBIN_ARG_LONG,
+    LOGBIN_ARG_ULONG,
+    LOGBIN_ARG_LLONG,
+    LOGBIN_ARG_SIZE,
+    LOGBIN_ARG_DOUBLE,
+    LOGBIN_ARG_PTR,
+    LOGBIN_ARG_STR
+} logbin_arg_type;
+
+typedef enum logbin_length {
+    LOGBIN_LENGTH_NONE,
+    LOGBIN_LENGTH_SHORT,
+    LOGBIN_LENGTH_LONG,
+    LOGBIN_LENGTH_LLONG,
+    LOGBIN_LENGTH_SIZE,
+    LOGBIN_LENGTH_LDOUBLE
+} logbin_length;
+
+// One conversion spec of a format string, e.g. "%-8.*s".
+typedef struct logbin_spec {
+    // Everything between the '%' and the length modifier, e.g. "-8.*".
+    const char *flags;
+    size_t flags_len;
+    bool width_star;
+    bool precision_star;
+    // The precision given as a number, or -1.
+    int precision;
+    logbin_length length;
+    char conv;
+} logbin_spec;
+
+// The arguments a format string takes.
+typedef struct logbin_format {
+    int n_args;
+    uint8_t types[LOGBIN_MAX_ARGS];
+    // For each string: the most characters it shows, or -1 for all of them.
+    // Taken from the argument before it for '%.*s'.
+    int16_t str_precision[LOGBIN_MAX_ARGS];
+    bool str_precision_arg[LOGBIN_MAX_ARGS];
+    // Bytes the arguments take other than the strings' characters.
+    size_t fixed_size;
+} logbin_format;
+
+// A record read back by logbin_read().
+typedef struct logbin_record {
+    char type;
+    uint32_t site_id;
+    // LOGBIN_REC_LINE only.
+    uint8_t level;
+    uint32_t thread_id;
+    int64_t ticks;
+    // The site's format, or the line's arguments.
+    const char *data;
+    size_t len;
+} logbin_record;
+
+// Works out the arguments 'fmt' takes. Returns false if it takes any the
+// binary format can't hold, like "%n" or wide strings, or too many.
+bool logbin_parse_format(const char *const fmt, logbin_format *const f);
+
+// Stores the arguments in 'args', as described by 'f', in 'buf'. Strings are
+// cut short if they don't all fit in 'size'. Returns the bytes stored.
+size_t logbin_encode_args(const logbin_format *const f, va_list args,
+        char *const buf, size_t size);
+
+// Stores the one string argument of the format "%s", cut short if it doesn't
+// fit in 'size'. Returns the bytes stored.
+size_t logbin_encode_str(const char *const str, char *const buf, size_t size);
+
+// Parses the spec after the '%' at 'p' into 's'. Returns where the spec ends.
+const char *logbin_parse_spec(const char *p, logbin_spec *const s);
+
+// The argument (a logbin_arg_type) a spec takes, not counting '*'s, or -1 if
+// none can be stored.
+int logbin_spec_arg_type(const logbin_spec *const s);
+
+// Bytes an argument of 'type' takes, or for a string, its length.
+size_t logbin_arg_size(int type);
+
+void logbin_write_header(FILE *const out, int64_t ticks_per_s);
+void logbin_write_site(FILE *const out, uint32_t site_id,
+        const char *const fmt);
+void logbin_write_line(FILE *const out, uint32_t site_id, uint8_t level,
+        uint32_t thread_id, int64_t ticks, const char *const args,
+        size_t args_len);
+
+// Reads the header. Returns false if 'in' isn't a binary log.
+bool logbin_read_header(FILE *const in, int64_t *const ticks_per_s);
+
+// Reads the next record into 'rec', with its data in 'buf'. Returns 1 if one
+// was read, 0 at the end of the file, and -1 if the file is cut short or
+// corrupt.
+int logbin_read(FILE *const in, logbin_record *const rec, char *const buf,
+        size_t bufsize);
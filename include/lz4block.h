@@ -0,0 +1,25 @@
+// Codec for the LZ4 block format (no frame header, checksums or
+// dictionaries), written from the format description so it can be built with
+// the rest of the tree without another dependency. The output can be read by
+// any LZ4 implementation's block decompressor and vice versa.
+//
+// Compression is the simple single-pass greedy matcher: about as fast as the
+// reference implementation's fast mode, and near its ratio on chat text.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest output lz4_compress() can produce for 'n' input bytes.
+size_t lz4_compress_bound(size_t n);
+
+// Compresses 'n' bytes of 'src' into 'dst'. Returns the compressed length, or 0
+// if it wouldn't fit in 'dst_cap' bytes.
+size_t lz4_compress(const uint8_t *const src, size_t n,
+        uint8_t *const dst, size_t dst_cap);
+
+// Decompresses 'n' bytes of 'src', which must expand to exactly 'raw_len'
+// bytes, into 'dst'. Returns false if the input is malformed.
+bool lz4_decompress(const uint8_t *const src, size_t n,
+        uint8_t *const dst, size_t raw_len);
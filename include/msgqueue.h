@@ -27,10 +27,15 @@
 #include "athena_types.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct msgnode {
     char* msg;
     struct msgnode* next;
+    // When the message was received and submitted to QUEUE_IN
+    // (latency_now_us()), or 0 if nobody stamped it; see latency.h.
+    uint64_t t_recv;
+    uint64_t t_submit;
 };
 
 typedef struct msglist {
@@ -4,6 +4,7 @@
 #include "msgqueue.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct ircmsg {
     char *source;
@@ -32,6 +33,18 @@ ircmsg* msgutils_ircmsg_parse(char *raw_msg);
 
 void msgutils_ircmsg_free(ircmsg *ircm);
 
+// Splits what's been received so far, the '*len' bytes in 'buf', into
+// messages: each one ending in CRLF is added to 'msgs', null-terminated rather
+// than CRLF-terminated, and whatever follows the last CRLF is moved to the
+// start of 'buf' for the next recv() to complete. '*len' is set to what's
+// left.
+void msgutils_frame_msgs(char *const buf, int *const len, msglist *const msgs);
+
 bool msgutils_get_timestamp(
         char *const buf, size_t bufsize, bool utc, timestamp_format format);
 
+// Same as msgutils_get_timestamp(), for the time 't' (seconds since the epoch)
+// instead of now.
+bool msgutils_format_timestamp(char *const buf, size_t bufsize,
+        int64_t t, bool utc, timestamp_format format);
+
@@ -0,0 +1,48 @@
+// Process-wide table of interned nicks (and other message sources, like server
+// names), so scrollback records can refer to who sent them with a 4-byte id
+// instead of carrying a copy of the name.
+//
+// Lookups follow IRC case mapping (rfc1459: A-Z and []\^ fold to a-z and
+// {}|~), so "Nick[away]" and "nick{AWAY}" are the same entry. The entry shows
+// the most recently seen spelling.
+//
+// Entries are reference counted. Every id returned by nicktab_intern() holds a
+// reference that must be given back with nicktab_release(); once the last one
+// is, the entry is freed and its id may be handed out again.
+//
+// Each entry also caches what's needed to draw the nick: its colour escape,
+// picked from a palette by the hash of the case-folded nick so a nick always
+// gets the same colour, and the user@host it was last seen with.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Id for "no nick". It isn't reference counted, and nicktab_name() returns an
+// empty string for it.
+#define NICKTAB_NONE 0
+
+// Returns the id of 'name', adding it if it's new, with one reference taken.
+// Returns NICKTAB_NONE for a NULL or empty name.
+uint32_t nicktab_intern(const char *const name);
+
+// Same as nicktab_intern() for a message source, "nick!user@host" or just a
+// name. The nick is interned and the user@host, if any, remembered with it.
+uint32_t nicktab_intern_source(const char *const source);
+
+void nicktab_ref(uint32_t id);
+void nicktab_release(uint32_t id);
+
+const char *nicktab_name(uint32_t id);
+size_t nicktab_len(uint32_t id);
+
+// Returns the user@host the nick was last seen with, or an empty string.
+const char *nicktab_userhost(uint32_t id);
+
+// Returns the nick's colour escape and writes its length to 'len'. Empty for
+// NICKTAB_NONE.
+const char *nicktab_color_esc(uint32_t id, size_t *const len);
+
+// Number of live entries, and approximate heap bytes used by the table.
+size_t nicktab_count(void);
+int64_t nicktab_bytes(void);
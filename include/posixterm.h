@@ -0,0 +1,52 @@
+// The terminal on Unix-likes: raw-mode input, its size, and writing frames.
+//
+// posixterm_open() puts the TTY in raw mode, so keys arrive as they're pressed
+// and unechoed, and turns on SGR (1006) mouse reporting for the wheel. Input
+// is read without blocking and decoded into the same key events the Windows
+// console's records map to (see termkeys.h).
+//
+// The size is read once when opened and then only again after SIGWINCH, so
+// posixterm_get_size() costs nothing per frame. The signal also wakes up a
+// poll() on the descriptors from posixterm_pollfds(), which a main loop polls
+// along with its sockets.
+#pragma once
+
+// TODO: platform-specific code
+#ifndef _WIN32
+
+#include "termkeys.h"
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Number of descriptors posixterm_pollfds() fills in.
+#define POSIXTERM_N_POLLFDS 2
+
+// Puts the terminal on stdin/stdout in raw mode. Returns false, changing
+// nothing, if stdin isn't a terminal or its mode can't be changed.
+bool posixterm_open(void);
+
+// Puts the terminal back the way posixterm_open() found it.
+void posixterm_close(void);
+
+// Fills in 'fds' with POSIXTERM_N_POLLFDS descriptors to poll for reading:
+// one is readable when there's input, the other after the terminal was
+// resized. Either way, call posixterm_read_events() and posixterm_get_size().
+void posixterm_pollfds(struct pollfd *const fds);
+
+// Reads what input there is without blocking and stores up to 'max_events'
+// events in 'events'. Returns how many. An ESC with nothing after it waits
+// TERMKEYS_ESC_TIMEOUT_MS for the rest of a sequence before it counts as the
+// Escape key.
+size_t posixterm_read_events(termkey_event *const events, size_t max_events);
+
+// Gets the terminal's size as of the last SIGWINCH. Returns true if it
+// changed since the last call (or this is the first).
+bool posixterm_get_size(int *const rows, int *const cols);
+
+// Writes all 'len' bytes at 'buf' to the terminal, waiting as needed. Returns
+// false if writing failed.
+bool posixterm_write(const char *const buf, size_t len);
+
+#endif
@@ -0,0 +1,97 @@
+// Lays out the UI and turns it into the bytes that show it on a terminal.
+//
+// Drawing a frame takes two steps. Composing it formats the tab line, the
+// channel header, the active screen's log and its input line for a terminal of
+// a given size, into a render_snapshot: a copy of everything the frame shows,
+// which no longer refers to any screen. Presenting the snapshot then turns it
+// into only what the terminal needs to go from the last frame to this one (see
+// vtgrid.h).
+//
+// Composing reads the screens, so it happens wherever they're changed.
+// Presenting touches nothing but the snapshot and a vtgrid, so it can happen on
+// another thread, which keeps message handling from ever waiting on the
+// terminal (see renderthread.h).
+//
+// Where the bytes go is up to the caller: the client writes them to the
+// console, and misc/render_bench.c feeds them to a vtgrid standing in for a
+// terminal, which needs no TTY at all.
+#pragma once
+
+#include "screen_framework.h"
+#include "vtgrid.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest prompt shown; longer ones are cut short.
+#define RENDER_PROMPT_MAXLEN 64
+
+// Everything a frame shows, as of when it was composed.
+typedef struct render_snapshot {
+    int term_rows;
+    int term_cols;
+    // Rows taken by each part, top to bottom.
+    int rows_tabline;
+    int rows_header;
+    int rows_screenbuf;
+    int rows_uiline;
+    // The formatted tab line, header and log, null-terminated.
+    char *statbuf;
+    char *headbuf;
+    char *screenbuf;
+    char prompt[RENDER_PROMPT_MAXLEN];
+    char inputbuf[UI_INPUT_BUF_SIZE];
+    // Whether to send the frame as a synchronized update (see vtgrid.h).
+    bool sync_output;
+    // From latency_frame_composed(), to say when it's shown.
+    uint64_t latency_frame;
+} render_snapshot;
+
+typedef struct renderer {
+    // What the terminal shows, and the frame, for renderer_draw().
+    vtgrid grid;
+    render_snapshot snapshot;
+
+    // The formatted parts of the UI, kept between frames so only the dirty
+    // ones are formatted again.
+    char *screenbuf;
+    char *statbuf;
+    char *headbuf;
+    // Widths of what's in the buffers, and how many rows the log was
+    // formatted for, as of the last time each was formatted.
+    int tabs_len;
+    int header_len;
+    int rows_screenbuf_drawn;
+    // Versions (see screen_tabs_version()) of the tab bar and header in the
+    // buffers, and the width they were formatted for.
+    uint32_t tabs_version;
+    uint32_t header_version;
+    int status_cols;
+} renderer;
+
+void renderer_init(renderer *const r);
+void renderer_free(renderer *const r);
+
+// Allocates room in 'snap' for the biggest frame renderer_compose() makes.
+void render_snapshot_init(render_snapshot *const snap);
+void render_snapshot_free(render_snapshot *const snap);
+
+// Composes a frame of the whole UI for a terminal of 'term_rows' by
+// 'term_cols' into 'snap'. The log is formatted again only if FRAME_DIRTY_LOG
+// is in 'dirty', and the tab bar and header only if they changed since they
+// were last formatted; the rest is as last composed. 'snap->sync_output' is
+// left for the caller to set.
+void renderer_compose(renderer *const r, uint32_t dirty,
+        int term_rows, int term_cols, render_snapshot *const snap);
+
+// Draws 'snap' into 'g', which knows what the terminal shows, and returns what
+// to write to the terminal, with its length in 'len', which is 0 if nothing
+// changed. Valid until the next call with the same grid.
+const char *render_present(vtgrid *const g, const render_snapshot *const snap,
+        size_t *const len);
+
+// Composes and presents a frame on the calling thread, with the renderer's
+// own snapshot and grid.
+const char *renderer_draw(renderer *const r, uint32_t dirty,
+        int term_rows, int term_cols, size_t *const len);
@@ -0,0 +1,51 @@
+// Presents frames and writes them to the console on a thread of its own.
+//
+// The main thread composes each frame (see render.h) into a snapshot it gets
+// from renderthread_begin_frame(), and hands it over with
+// renderthread_publish(). That takes only as long as swapping two pointers
+// under a lock: the render thread turns the snapshot into what changed and
+// writes it, however long the console takes, while the main thread goes back
+// to handling messages and input.
+//
+// There are three snapshots: the one being composed, the one published and
+// waiting, and the one being presented. If a snapshot is published while the
+// last one is still waiting, the waiting one is never presented; since each
+// snapshot holds the whole frame, the newer one shows everything it would
+// have. So however slow the console, the main thread never waits for it, and
+// what's presented is never more than a frame behind.
+//
+// What became of each frame is kept until the main thread passes it on to
+// framesched with renderthread_report_outcomes(), so only the main thread
+// ever touches framesched.
+#pragma once
+
+#include "render.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// TODO: platform-specific code
+#include <windows.h>
+
+// Starts the render thread, which writes frames to 'h_out'. 'utf8' is as for
+// vtgrid. Returns false if the thread couldn't be started.
+bool renderthread_start(HANDLE h_out, bool utf8);
+
+// Presents the frame last published, if it wasn't already, and stops the
+// thread.
+void renderthread_stop(void);
+
+// The snapshot to compose the next frame into. The main thread has it to
+// itself until renderthread_publish().
+render_snapshot *renderthread_begin_frame(void);
+
+// Hands the snapshot from renderthread_begin_frame() to the render thread to
+// present.
+void renderthread_publish(void);
+
+// Passes what became of the frames presented (or skipped) since the last call
+// on to framesched_frame_done(). Returns the number (render_snapshot's
+// latency_frame) of the last frame presented, whether it was written,
+// unchanged or dropped, or 0 if none was yet; nothing composed before it is
+// still on its way to the console.
+uint64_t renderthread_report_outcomes(void);
@@ -0,0 +1,65 @@
+// Prefix-sum index over the number of terminal rows each screenlog entry
+// occupies when wrapped to the current width. Backed by a Fenwick (binary
+// indexed) tree, so finding the entry that contains a given row, or the row at
+// which a given entry starts, is O(log n) regardless of how much history the
+// screen holds.
+//
+// Entries are addressed by "slot". Slots only ever grow at the back (append)
+// and shrink from the front (evict), matching how the screenlog is used. Each
+// slot caches the on-screen length of its entry, which doesn't depend on the
+// terminal width, so a resize only has to recompute row counts from that cache
+// instead of rescanning every message.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct rowindex {
+    // 1-based Fenwick tree over the row counts of slots [0, cap).
+    int64_t *tree;
+    // On-screen (visible) character count of each slot's entry.
+    size_t *vislen;
+    // Caller-owned pointer for each slot (e.g., the screenlog node).
+    void **items;
+    size_t cap;
+    // Slots before 'first' have been evicted and count as zero rows.
+    size_t first;
+    // One past the newest slot.
+    size_t end;
+    // Terminal width the row counts in 'tree' were computed for.
+    int cols;
+    int64_t total_rows;
+} rowindex;
+
+// Releases all memory held by the index and zeroes it. The items themselves
+// are not touched.
+void rowidx_free(rowindex *const idx);
+
+// Number of live entries in the index.
+size_t rowidx_count(const rowindex *const idx);
+
+// Adds an entry to the back of the index. 'vislen' is the number of visible
+// characters the entry takes on screen (see scrrec_width()).
+void rowidx_append(rowindex *const idx, void *item, size_t vislen);
+
+// Removes the oldest entry. The index must not be empty.
+void rowidx_evict_front(rowindex *const idx);
+
+// Recomputes every row count for the new width. A no-op if 'cols' hasn't
+// changed. This is O(n) from the cached visible lengths, with no string scans.
+void rowidx_set_cols(rowindex *const idx, int cols);
+
+// Recomputes every row count after the caller updated entries' 'vislen' in
+// place (e.g., because the way they're drawn changed). O(n).
+void rowidx_refresh(rowindex *const idx);
+
+// Returns the item of the entry containing 'row' (0 is the first row of the
+// oldest entry) and writes the row within that entry to 'row_in_item'.
+// Returns NULL if 'row' is out of range.
+void *rowidx_find_row(const rowindex *const idx, int64_t row,
+        int64_t *const row_in_item);
+
+// Returns the number of rows occupied by all entries older than the 'n'th
+// live entry (0 is the oldest).
+int64_t rowidx_rows_before(const rowindex *const idx, size_t n);
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "athena_types.h"
+#include "msgutils.h"
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 // Includes prefix
 #define CHANNEL_NAME_MAXLEN 50
@@ -12,10 +14,43 @@
 // for formatting. 1024 is generous, but these should get re-used.
 #define SCREENMSG_BUF_SIZE 1024
 
-// TODO: very small for now for testing. Probably 1MB is a better default.
-// TODO: also need a global max and global tracking.
+// What a screen message is, which decides how it's decorated when drawn. See
+// scrmgr_deliver_msg().
+typedef enum screen_msg_kind {
+    // Shown as is, with any formatting it carries.
+    SCREEN_MSG_TEXT,
+    // From the server: "[ts] source: text".
+    SCREEN_MSG_SERVER,
+    // Chat: "[ts] <nick> text".
+    SCREEN_MSG_PRIVMSG,
+    // Chat sent by the user, with their nick highlighted.
+    SCREEN_MSG_PRIVMSG_SELF,
+    // Chat the user tried to send but couldn't: "(Not Sent) [ts] <nick> text".
+    SCREEN_MSG_NOT_SENT
+} screen_msg_kind;
+
+// Per-screen cap on scrollback. In practice the global budget below is what
+// limits memory; this just keeps one runaway screen from taking all of it.
 // TODO: in header or impl?
-#define SCREENLOG_DEFAULT_MAX_BYTES 1024 * 10
+#define SCREENLOG_DEFAULT_MAX_BYTES (1024LL * 1024 * 64)
+
+// How much of a screen's newest scrollback is kept as is, by default. Older
+// lines are compressed in blocks (see coldstore.h), which makes them smaller
+// but costs a decompression to draw them. The per-screen cap above counts the
+// compressed size.
+#define SCREENLOG_DEFAULT_HOT_BYTES (1024LL * 1024)
+
+// Hot budget that never compresses anything. See scrmgr_set_screen_limits().
+#define SCREENLOG_HOT_UNLIMITED (-1LL)
+
+// Default process-wide cap on scrollback across all screens, search indexes
+// included. When exceeded, lines are evicted from the screens viewed least
+// recently first, then the oldest lines are dropped from the biggest indexes.
+#define SCREENLOG_GLOBAL_MAX_BYTES (1024LL * 1024 * 256)
+
+// Global eviction never takes a screen below this much scrollback, so a quiet
+// channel always keeps its recent context.
+#define SCREENLOG_RESERVE_BYTES (1024LL * 64)
 
 // TODO: Re-eval this. Effectively it's the max # of characters user can type.
 #define UI_INPUT_BUF_SIZE 200
@@ -26,22 +61,100 @@ typedef struct screen_ui_state {
     const char* prompt;
     char inputbuf[UI_INPUT_BUF_SIZE];
     size_t i_inputbuf;
+    // Number of rows scrolled up from the newest message.
     int scroll;
     bool scroll_at_top;
+    // Rows the message area had on the last frame; used for paging.
+    int rows_visible;
 } screen_ui_state;
 
+// Scrollback memory used by one screen. See scrmgr_get_mem_usage().
+typedef struct screen_mem_usage {
+    const char *name;
+    // Everything held, compressed lines counted at their compressed size.
+    int64_t bytes;
+    int64_t max_bytes;
+    int64_t hot_max_bytes;
+    int n_msgs;
+    // The compressed part of the above, and what it would take uncompressed.
+    int n_cold_msgs;
+    int64_t cold_bytes;
+    int64_t cold_raw_bytes;
+    // Heap used by the screen's search index, on top of 'bytes'.
+    int64_t index_bytes;
+    bool active;
+} screen_mem_usage;
+
+// Most hits scrmgr_search() returns at once.
+#define SCREEN_SEARCH_MAX_HITS 20
+#define SCREEN_SEARCH_PREVIEW_MAXLEN 80
+
+// One line matched by scrmgr_search().
+typedef struct screen_search_hit {
+    // Sequence number of the line within its screen; pass to
+    // scrmgr_scroll_to_seq().
+    uint32_t seq;
+    // False if the line was evicted and couldn't be spilled to disk.
+    bool available;
+    // The line without formatting, truncated.
+    char preview[SCREEN_SEARCH_PREVIEW_MAXLEN];
+} screen_search_hit;
+
 // TODO: re-eval if this is correct API
 bool scrmgr_create_or_switch(const_str channel_name);
 
 // 'deliver_to' is the name of the screen (i.e., "#channel" or "home").
 void scrmgr_deliver_copy(const_str deliver_to, const_str msg);
 
+// Same as scrmgr_deliver_copy(), but the message isn't added to the search
+// index. For the client's own feedback (command output, search results).
+void scrmgr_deliver_local_copy(const_str deliver_to, const_str msg);
+
+// Delivers a message by its parts rather than as a formatted string. Only
+// 'from' (interned) and 'text' are stored; the timestamp, nick colours etc.
+// are added when the line is drawn, using the current theme and timestamp
+// format. 'ts' is in seconds since the epoch. 'from' is a message source,
+// "nick!user@host" or a plain name, or NULL.
+void scrmgr_deliver_msg(const_str deliver_to, screen_msg_kind kind,
+        int64_t ts, const_str from, const_str text);
+
+// Changes how timestamps are shown, for every line already in memory as well
+// as new ones. Lines spilled to disk keep the format they were drawn with.
+void scrmgr_set_timestamp_format(timestamp_format format);
+
 // Only the active screen's UI state can be accessed. This could be changed, but
 // I'll wait until there's a use case.
 screen_ui_state *const scrmgr_get_active_ui_state(void);
 
 const_str scrmgr_get_active_name(void);
 
+// Scrolls the active screen so that 'row' (counting wrapped rows from the top
+// of its log, starting at 0) is the first visible row. O(log n).
+void scrmgr_scroll_to_row(int64_t row);
+
+// Finds lines in the active screen's history containing every word in 'query',
+// case-insensitive, newest first. Only lines delivered this session are
+// indexed, though that includes any spilled to disk since and still kept there
+// (see SPILL_MAX_SEGMENTS), and a screen's index is kept no bigger than its
+// scrollback cap by dropping its oldest lines from it. Returns the number
+// of hits written to 'hits', at most SCREEN_SEARCH_MAX_HITS.
+size_t scrmgr_search(const_str query, screen_search_hit *const hits,
+        size_t max_hits);
+
+// Scrolls the active screen so that the line with sequence number 'seq' (see
+// scrmgr_search()) is at the top of the view. Returns false if the line is no
+// longer available.
+bool scrmgr_scroll_to_seq(uint32_t seq);
+
+// Scrolls the active screen up (positive) or down (negative) by whole pages of
+// the message area.
+void scrmgr_scroll_pages(int n_pages);
+
+// Jumps to the oldest (including history spilled to disk) or newest message of
+// the active screen.
+void scrmgr_scroll_home(void);
+void scrmgr_scroll_end(void);
+
 // Returns false if there is no screen in that index
 bool scrmgr_show_index(int i_scr);
 
@@ -55,9 +168,42 @@ bool scrmgr_show_name_startswith(const_str prefix);
 
 bool scrmgr_set_topic(const_str scr_name, const_str topic);
 
+// Populates 'usage' for the screen in slot 'i_scr'. Returns false if there is
+// no screen in that slot.
+bool scrmgr_get_mem_usage(int i_scr, screen_mem_usage *const usage);
+
+// Total scrollback bytes held across every screen, search indexes included.
+int64_t scrmgr_get_total_mem_bytes(void);
+
+int64_t scrmgr_get_global_max_bytes(void);
+
+// Sets the process-wide scrollback budget, evicting from the coldest screens
+// right away if the new budget is already exceeded.
+void scrmgr_set_global_max_bytes(int64_t max_bytes);
+
+// Sets how much scrollback the screen called 'scr_name' keeps in memory
+// ('max_bytes') and how much of the newest of it stays uncompressed
+// ('hot_max_bytes', or SCREENLOG_HOT_UNLIMITED to stop compressing). A smaller
+// hot budget trades drawing speed deep in the history for holding more of it.
+// Lines already compressed stay that way. Evicts right away if the screen is
+// now over its cap. Returns false if there's no such screen.
+bool scrmgr_set_screen_limits(const_str scr_name, int64_t max_bytes,
+        int64_t hot_max_bytes);
+
+// Writes the tab bar, one tab per screen, and returns how many columns it
+// takes. It's kept to one row: when the tabs don't all fit, only those around
+// the active one are laid out, with a '<' or '>' where more are cut off.
 int screen_fmt_tabs(char *buf, size_t bufsize, int term_cols);
+// Writes the active screen's topic and returns how many columns it takes.
 int screen_fmt_header(char *buf, size_t bufsize, int term_cols);
 
+// Bumped every time what screen_fmt_tabs() or screen_fmt_header() writes
+// changes (a screen opens, gets unread lines, becomes active, a new topic...),
+// so callers can keep what they wrote and format it again only when the
+// version or the terminal's width is different. Never 0.
+uint32_t screen_tabs_version(void);
+uint32_t screen_header_version(void);
+
 // Writes the section (according to scroll) of the active screen's message log
 // that will fit in the specified number of rows and columns to the global
 // screen buffer.
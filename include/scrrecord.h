@@ -0,0 +1,46 @@
+// Scrollback records: what a screenlog stores for each message.
+//
+// Instead of one string with the timestamp, brackets, nick colour and text all
+// baked in as ANSI, a record keeps what the message is: when it arrived, what
+// kind of message it is, who sent it (as an interned nick id, see nicktab.h)
+// and its own text, compiled for display (see fmtline.h). The decorated line
+// is only put together when it's drawn, from the current theme and timestamp
+// format, so none of those bytes are stored per line, and changing either one
+// applies to the whole history at once.
+#pragma once
+
+#include "fmtline.h"
+#include "msgutils.h"
+#include "screen_framework.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct scrrec {
+    // Seconds since the epoch. Not shown for SCREEN_MSG_TEXT.
+    int64_t ts;
+    // The message's own text, without decoration. Owned by the record.
+    fmtline *body;
+    // Interned sender, or NICKTAB_NONE.
+    uint32_t nick;
+    // A screen_msg_kind.
+    uint8_t kind;
+} scrrec;
+
+// Sets how timestamps are written from now on. Records' widths change with it,
+// so row counts computed from scrrec_width() must be redone.
+void scrrec_set_timestamp_format(timestamp_format format);
+
+// Visible width of the whole decorated line.
+size_t scrrec_width(const scrrec *const rec);
+
+// Bytes scrrec_render() writes for the whole line.
+size_t scrrec_ansi_len(const scrrec *const rec);
+
+// Writes columns ['start', 'end') of the decorated line to 'buf' as ANSI text,
+// following the same rules as fmtline_render().
+size_t scrrec_render(const scrrec *const rec, size_t start, size_t end,
+        char *const buf, size_t bufsize);
+
+// Copies the visible text of the decorated line to 'buf', truncating to fit.
+void scrrec_copy_text(const scrrec *const rec, char *const buf, size_t bufsize);
@@ -0,0 +1,73 @@
+// Incremental inverted index for full-text search over a screen's scrollback.
+//
+// Lines are identified by a caller-assigned id that must increase with every
+// line added (the screenlog uses the line's sequence number). Text is split
+// into tokens: runs of ASCII letters/digits plus any non-ASCII bytes, so UTF-8
+// words stay whole. Tokens are case-folded, and one-character tokens are
+// skipped. Each token maps to a posting list of the ids of the lines it
+// appears in, in ascending order, so adding a line is O(tokens) and a query is
+// an intersection of sorted lists that doesn't look at any line text.
+//
+// Nothing is removed line by line. Once old lines are no longer wanted,
+// srchidx_prune() drops them all at once by rebuilding the index.
+//
+// Text should have IRC and ANSI formatting stripped before being added.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longer tokens are truncated to this many bytes, both when indexing and
+// when querying, so they still match.
+#define SRCHIDX_TOKEN_MAXLEN 32
+
+// Most tokens a query may contain; the rest are ignored.
+#define SRCHIDX_QUERY_MAX_TOKENS 8
+
+typedef struct srchidx_posting {
+    uint32_t *ids;
+    uint32_t n;
+    uint32_t cap;
+} srchidx_posting;
+
+typedef struct srchidx_slot {
+    // Offset of the token in the key arena, or UINT32_MAX if empty.
+    uint32_t key;
+    uint32_t hash;
+    srchidx_posting posting;
+} srchidx_slot;
+
+typedef struct searchindex {
+    // Open-addressed hash table from token to posting list.
+    srchidx_slot *slots;
+    size_t cap_slots;
+    size_t n_tokens;
+
+    // Null-terminated tokens, back to back.
+    char *keys;
+    size_t keys_len;
+    size_t keys_cap;
+
+    // Ids below this were pruned; 0 until the first srchidx_prune().
+    uint32_t min_id;
+
+    // Approximate heap bytes used.
+    int64_t bytes;
+} searchindex;
+
+void srchidx_free(searchindex *const idx);
+
+// Indexes 'text' under 'id'. 'id' must be greater than every id added before.
+void srchidx_add(searchindex *const idx, uint32_t id, const char *const text);
+
+// Drops every id below 'min_id', and the tokens left without any. Rebuilds the
+// whole index, so it costs about as much as the index is big; prune a lot at
+// once rather than a little at a time.
+void srchidx_prune(searchindex *const idx, uint32_t min_id);
+
+// Finds the lines containing every token in 'query', newest first. Writes up
+// to 'max_hits' ids to 'hits' and returns how many were written. Returns 0 if
+// the query has no searchable tokens.
+size_t srchidx_query(const searchindex *const idx, const char *const query,
+        uint32_t *const hits, size_t max_hits);
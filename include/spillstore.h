@@ -0,0 +1,140 @@
+// Disk-backed history for a screen. Lines evicted from a screenlog are appended
+// here instead of being freed, and read back through memory-mapped views when
+// the user scrolls past the oldest line still held in memory.
+//
+// Each screen gets a directory under SPILL_ROOT_DIR containing:
+//      * Append-only segment files ("000000.seg", "000001.seg", ...), each a
+//        sequence of records: [u32 size][u32 vislen][size bytes of msg + \0].
+//        A new segment is started once the current one reaches
+//        SPILL_SEGMENT_MAX_BYTES.
+//      * An append-only "index" file with one [u32 seg][u32 offset][i64 rec]
+//        entry per block of up to SPILL_BLOCK_RECS records. This is the sparse
+//        index: finding record N means a binary search for its block and
+//        hopping over at most SPILL_BLOCK_RECS - 1 record headers, and rows
+//        are summed per block, so seeking deep into history never touches the
+//        records in between.
+//      * An append-only "widths" file with each record's u32 vislen, in
+//        record order from the oldest record kept. A block's rows at any
+//        width are counted from its SPILL_BLOCK_RECS widths here, so finding
+//        a row reads no segment but the one holding it.
+//
+// Once a new segment would make more than SPILL_MAX_SEGMENTS, the oldest are
+// deleted down to SPILL_KEEP_SEGMENTS, and the index and widths files are
+// rewritten without them. Records keep their numbers; the ones deleted are
+// just gone (see spill_first()).
+//
+// History persists across sessions; opening a screen with the same name picks
+// up its index again. Names differing only in case share a directory; names
+// with characters a directory can't have get a hash of the name appended, so
+// that they don't share one with another name.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <windows.h>
+
+#define SPILL_ROOT_DIR "scrollback"
+#define SPILL_BLOCK_RECS 64
+#define SPILL_SEGMENT_MAX_BYTES (1024 * 1024 * 64)
+// About 1 GB of history per screen, dropped a quarter at a time so the
+// rewrites of the index and widths files are rare.
+#define SPILL_MAX_SEGMENTS 16
+#define SPILL_KEEP_SEGMENTS 12
+#define SPILL_MAX_VIEWS 4
+#define SPILL_PATH_MAXLEN 260
+
+typedef struct spill_block {
+    uint32_t seg;
+    // Byte offset of the block's first record within its segment.
+    uint32_t offset;
+    // Index of the block's first record across the whole store.
+    int64_t first_rec;
+    uint32_t n_recs;
+    // Total rows of the block's records at 'rows_cols' columns. Computed the
+    // first time the block is needed at a given width.
+    int rows_cols;
+    int64_t rows;
+} spill_block;
+
+// A read-only mapping of (a prefix of) one segment file.
+typedef struct spill_view {
+    HANDLE h_file;
+    HANDLE h_map;
+    const char *base;
+    uint64_t size;
+    uint32_t seg;
+    uint64_t last_used;
+} spill_view;
+
+typedef struct spillstore {
+    char dir[SPILL_PATH_MAXLEN];
+    // The directory and index are only touched on the first append or read.
+    bool opened;
+    // Set if the directory or files could not be opened; evicted lines are
+    // then dropped like before.
+    bool disabled;
+
+    FILE *seg_out;
+    // False until the first append of a session, so that every session
+    // starts a new block.
+    bool block_open;
+    uint32_t seg_out_num;
+    uint32_t seg_out_size;
+    FILE *idx_out;
+    FILE *wid_out;
+    FILE *wid_in;
+
+    spill_block *blocks;
+    size_t n_blocks;
+    size_t cap_blocks;
+    // Index of the oldest record kept, and one past the newest.
+    int64_t first_rec;
+    int64_t n_recs;
+
+    spill_view views[SPILL_MAX_VIEWS];
+    uint64_t view_clock;
+} spillstore;
+
+// Sets up the store for the screen called 'name'. Nothing is created on disk
+// until the first spill_append().
+void spill_init(spillstore *const sp, const char *const name);
+
+// Closes all files and views and frees the block index.
+void spill_close(spillstore *const sp);
+
+// Appends one line. 'vislen' is its width in columns (see scrrec_width()).
+void spill_append(spillstore *const sp, const char *const msg, size_t vislen);
+
+// Number of lines in the store, including those from previous sessions.
+int64_t spill_count(spillstore *const sp);
+
+// Index of the oldest line still in the store. Older ones were deleted to keep
+// it within SPILL_MAX_SEGMENTS.
+int64_t spill_first(spillstore *const sp);
+
+// Must be called before a batch of spill_find_row_from_end()/spill_get()
+// calls.
+void spill_begin_read(spillstore *const sp);
+
+// Locates the row that is 'rows_back' rows above the end of the newest line in
+// the store (1 is the last row of the newest line), counting back no further
+// than spill_first(). On success, 'rec' is the index of the line containing it
+// and 'row_in_rec' the row within that line. Returns false if the store has
+// fewer rows than that, in which case 'total_rows' holds how many it does
+// have.
+bool spill_find_row_from_end(spillstore *const sp, int cols, int64_t rows_back,
+        int64_t *const rec, int64_t *const row_in_rec,
+        int64_t *const total_rows);
+
+// Total rows of the lines from index 'rec' through the newest, at 'cols'
+// columns. Used to scroll a given line into view. Returns 0 if 'rec' is out of
+// range.
+int64_t spill_rows_from(spillstore *const sp, int cols, int64_t rec);
+
+// Returns the null-terminated line at index 'rec' (0 is the oldest ever
+// appended), pointing straight into the mapped segment, or NULL on failure or
+// if it was deleted. The pointer is only valid until the next call into the
+// store: any call that reads may remap or unmap the view it points into.
+const char *spill_get(spillstore *const sp, int64_t rec, size_t *const vislen);
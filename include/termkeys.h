@@ -0,0 +1,99 @@
+// Keys, mouse wheel and replies, decoded from the bytes a terminal sends.
+//
+// A Unix terminal in raw mode sends plain characters as themselves and
+// everything else as escape sequences: "\033[5~" for Page Up, "\033[<64;10;5M"
+// for the wheel scrolled up (SGR 1006 mouse reporting), "\033[?2026;1$y" for a
+// reply to a query (see termreply.h). The decoder is a state machine fed bytes
+// as they arrive, so a sequence split across reads decodes the same as one that
+// arrives whole.
+//
+// A lone ESC byte is ambiguous: it's either the Escape key or the start of a
+// sequence still on its way. The decoder holds on to it until
+// termkeys_flush(), which callers make once no more bytes arrived for a short
+// while (TERMKEYS_ESC_TIMEOUT_MS).
+//
+// The Windows console reports keys as records instead, which map straight to
+// the same events.
+#pragma once
+
+#include "termreply.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// How long to wait for the rest of a sequence after an ESC before taking it
+// for the Escape key.
+#define TERMKEYS_ESC_TIMEOUT_MS 25
+
+// Most numeric parameters of one sequence looked at; the rest are ignored.
+#define TERMKEYS_MAX_PARAMS 8
+
+typedef enum termkey_kind {
+    // A character, one byte at a time (UTF-8 characters take several events).
+    TERMKEY_CHAR,
+    TERMKEY_ENTER,
+    TERMKEY_TAB,
+    TERMKEY_BACKSPACE,
+    TERMKEY_ESCAPE,
+    TERMKEY_UP,
+    TERMKEY_DOWN,
+    TERMKEY_LEFT,
+    TERMKEY_RIGHT,
+    TERMKEY_HOME,
+    TERMKEY_END,
+    TERMKEY_INSERT,
+    TERMKEY_DELETE,
+    TERMKEY_PAGE_UP,
+    TERMKEY_PAGE_DOWN,
+    TERMKEY_WHEEL_UP,
+    TERMKEY_WHEEL_DOWN,
+    // A reply to termreply_query_mode(), in 'mode' and 'status'.
+    TERMKEY_MODE_REPORT
+} termkey_kind;
+
+typedef struct termkey_event {
+    termkey_kind kind;
+    // For TERMKEY_CHAR.
+    char ch;
+    // Set for a key pressed with Alt, which terminals send led by an ESC.
+    bool alt;
+    // For TERMKEY_MODE_REPORT.
+    int mode;
+    termreply_mode_status status;
+} termkey_event;
+
+typedef enum termkeys_state {
+    TERMKEYS_GROUND,
+    // After an ESC.
+    TERMKEYS_ESC,
+    // After "ESC [" and "ESC O".
+    TERMKEYS_CSI,
+    TERMKEYS_SS3
+} termkeys_state;
+
+// A zeroed decoder is ready to use.
+typedef struct termkeys_decoder {
+    termkeys_state state;
+    // Of the CSI sequence being read: its parameters, the private marker
+    // ('<', '?' or 0) before them and the intermediate ('$' or 0) after.
+    int params[TERMKEYS_MAX_PARAMS];
+    int n_params;
+    bool param_started;
+    char private_marker;
+    char intermediate;
+} termkeys_decoder;
+
+// Decodes the 'len' bytes at 's', storing up to 'max_events' events in
+// 'events'. Returns how many were stored; events past 'max_events' are
+// dropped. An incomplete sequence at the end is kept for the next call.
+size_t termkeys_decode(termkeys_decoder *const dec, const char *const s,
+        size_t len, termkey_event *const events, size_t max_events);
+
+// Takes a held ESC as the Escape key. Returns the number of events stored in
+// 'events' (room for one is enough), 0 if nothing was held. A sequence cut
+// short after more than the ESC is dropped.
+size_t termkeys_flush(termkeys_decoder *const dec,
+        termkey_event *const events, size_t max_events);
+
+// Whether the decoder is holding bytes of a sequence still to come.
+bool termkeys_pending(const termkeys_decoder *const dec);
@@ -0,0 +1,29 @@
+// Replies a terminal sends to queries, picked out of console input.
+//
+// Some things about a terminal can only be learned by asking it: a query
+// written to its output is answered with an escape sequence that arrives as
+// input, as if it had been typed. This writes the queries; termkeys.h picks
+// the replies out of typed characters, so they can be acted on rather than end
+// up in the input line.
+#pragma once
+
+#include <stddef.h>
+
+// DEC private modes asked about.
+#define TERMREPLY_MODE_SYNC_OUTPUT 2026
+
+// Longest query termreply_query_mode() writes, with the null term.
+#define TERMREPLY_QUERY_MAXLEN 16
+
+// What a terminal says about a DEC private mode (DECRPM).
+typedef enum termreply_mode_status {
+    TERMREPLY_MODE_NOT_RECOGNIZED = 0,
+    TERMREPLY_MODE_SET = 1,
+    TERMREPLY_MODE_RESET = 2,
+    TERMREPLY_MODE_PERMANENTLY_SET = 3,
+    TERMREPLY_MODE_PERMANENTLY_RESET = 4
+} termreply_mode_status;
+
+// Writes the query asking about DEC private mode 'mode' (DECRQM) to 'buf',
+// null-terminated. Returns its length, or 0 if it doesn't fit.
+size_t termreply_query_mode(char *const buf, size_t bufsize, int mode);
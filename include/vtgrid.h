@@ -0,0 +1,141 @@
+// Cell-grid model of the terminal, for drawing frames as differences.
+//
+// A frame is written into the grid's back buffer as the same ANSI stream that
+// would otherwise go straight to the terminal: text, newlines, SGR escapes and
+// a few cursor and erase sequences. vtgrid_present() then compares it cell by
+// cell with the front buffer, the frame the terminal is showing, and returns
+// only what it takes to turn one into the other: cursor moves, style changes
+// and the cells that differ. A frame where nothing changed costs nothing to
+// present, and one new message costs about one line, instead of every frame
+// clearing the screen and printing all of it again.
+//
+// When the frame says which rows scroll as a block (see
+// vtgrid_set_scroll_region()), content that moved up or down there since the
+// last frame is moved on the terminal with a scroll region and SU/SD, so a new
+// message costs its own rows rather than every row above it.
+//
+// The grid knows as much about how the terminal lays out text as drawing needs:
+// lines wrap at the last column, and with UTF-8 on, a multi-byte character
+// takes one cell, or two for wide (CJK, emoji) characters. Zero-width
+// characters aren't supported and are dropped.
+//
+// That's also enough to stand in for a terminal: a vtgrid that's only ever
+// written to, never begun or presented, holds in its back buffer what a
+// terminal would show after being sent the same bytes (see vtgrid_hash()).
+#pragma once
+
+#include "vtstyle.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct vtcell {
+    // The character's bytes, zero-padded. All zero for the right half of a
+    // wide character.
+    char ch[4];
+    vtstyle style;
+} vtcell;
+
+typedef struct vtgrid_stats {
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t cells;
+    // Frames that moved the scroll region rather than repaint it.
+    uint64_t scrolls;
+    // Bytes and changed cells of the last frame presented.
+    size_t last_bytes;
+    size_t last_cells;
+} vtgrid_stats;
+
+typedef struct vtgrid {
+    int rows;
+    int cols;
+    // Treat bytes as UTF-8, rather than each byte being a character of the
+    // console's code page.
+    bool utf8;
+    // Wrap each frame vtgrid_present() returns in synchronized update markers
+    // (DEC mode 2026), for terminals that support them: they then show the
+    // frame once it's complete, rather than as it's drawn.
+    bool sync_output;
+    // What the terminal shows, and the frame being written.
+    vtcell *front;
+    vtcell *back;
+    // False until the terminal is known to show 'front', e.g. after a resize.
+    bool front_valid;
+
+    // Where vtgrid_write() puts the next character, and with what style. Set
+    // once a character has been written to the last column, which wraps the
+    // next one to the next row like a terminal does.
+    int row;
+    int col;
+    bool wrap_pending;
+    vtstyle pen;
+    // Rows [margin_top, margin_bottom) that SU and SD scroll, set by DECSTBM.
+    int margin_top;
+    int margin_bottom;
+
+    // Rows [scroll_top, scroll_bottom) of the frame that scroll as a block, or
+    // equal if none.
+    int scroll_top;
+    int scroll_bottom;
+
+    // Where to leave the terminal's cursor after presenting, or -1.
+    int cursor_row;
+    int cursor_col;
+
+    // The terminal's cursor (row -1 if unknown) and SGR state as of the last
+    // vtgrid_present().
+    int term_row;
+    int term_col;
+    vtstyle term_pen;
+
+    // The bytes vtgrid_present() returns. Reserved by vtgrid_resize() for a
+    // typical frame, so presenting one doesn't allocate.
+    char *out;
+    size_t out_len;
+    size_t out_cap;
+
+    vtgrid_stats stats;
+} vtgrid;
+
+void vtgrid_free(vtgrid *const g);
+
+// Sets the grid's size. A change of size repaints everything on the next
+// vtgrid_present().
+void vtgrid_resize(vtgrid *const g, int rows, int cols);
+
+// Forgets what the terminal shows, so the next vtgrid_present() repaints
+// everything. For when something else wrote to the terminal.
+void vtgrid_invalidate(vtgrid *const g);
+
+// Starts a frame: blanks the back buffer, homes the writer and resets its pen.
+void vtgrid_begin(vtgrid *const g);
+
+// Writes 'len' bytes of terminal output into the back buffer. Understands
+// text, \r and \n (as a new line), SGR and the CUP (H), CHA (G), CUF (C), CNL
+// (E), EL (K), ED (J), DECSTBM (r), SU (S) and SD (T) sequences; any other
+// escape is skipped. Text past the last row is dropped.
+void vtgrid_write(vtgrid *const g, const char *const s, size_t len);
+void vtgrid_puts(vtgrid *const g, const char *const s);
+
+// Tells vtgrid_present() that rows [top, bottom) of this frame hold content
+// that scrolls as a block, like a message log, so it can move what the
+// terminal already shows there instead of drawing it again. Reset by
+// vtgrid_begin().
+void vtgrid_set_scroll_region(vtgrid *const g, int top, int bottom);
+
+// Sets where the cursor is left once the frame is presented. -1 leaves it
+// wherever drawing ended.
+void vtgrid_set_cursor(vtgrid *const g, int row, int col);
+
+// Compares the back buffer with the front and returns what to write to the
+// terminal to show the new frame, with its length in 'len', which is 0 if
+// nothing changed. The back buffer becomes the front. Valid until the next
+// call.
+const char *vtgrid_present(vtgrid *const g, size_t *const len);
+
+// Hashes the size and the back buffer's cells, e.g. to compare what a vtgrid
+// standing in for a terminal shows with a known-good hash. The same cells hash
+// the same on every platform.
+uint64_t vtgrid_hash(const vtgrid *const g);
@@ -0,0 +1,62 @@
+// Text styles (SGR state) and the escapes that change them.
+//
+// A vtstyle is everything SGR sets: the foreground, the background and the
+// attributes. Knowing the style a terminal is in, or that a stream has left
+// so far, lets a change be written as one sequence holding only what differs,
+// e.g. "\033[1;38;5;214m" rather than a reset followed by an escape for each
+// attribute, and nothing at all when the style doesn't change.
+//
+// A zeroed vtstyle is the terminal's default style.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A vtstyle colour is VTCOLOR_DEFAULT, VTCOLOR_256 | an index in the 256-colour
+// table (0-15 being the basic and bright colours), or VTCOLOR_RGB | 0xRRGGBB.
+#define VTCOLOR_DEFAULT 0
+#define VTCOLOR_256 0x01000000u
+#define VTCOLOR_RGB 0x02000000u
+// A colour that isn't known, such as one set by whatever was written before a
+// piece of text. vtstyle_sgr() always sets a colour that's unknown in 'from',
+// and leaves one that's unknown in 'to' as it is.
+#define VTCOLOR_UNKNOWN 0x04000000u
+
+#define VTATTR_BOLD 0x01
+#define VTATTR_DIM 0x02
+#define VTATTR_ITALIC 0x04
+#define VTATTR_UNDERLINE 0x08
+#define VTATTR_BLINK 0x10
+#define VTATTR_REVERSE 0x20
+#define VTATTR_HIDDEN 0x40
+#define VTATTR_STRIKE 0x80
+
+// Longest sequence vtstyle_sgr() writes.
+#define VTSTYLE_SGR_MAXLEN 64
+
+typedef struct vtstyle {
+    uint32_t fg;
+    uint32_t bg;
+    uint32_t attrs;
+} vtstyle;
+
+bool vtstyle_eq(const vtstyle *const a, const vtstyle *const b);
+
+// Applies the parameters of an SGR sequence ("\033[<params>m") to 'style'. A
+// missing parameter is -1, which means 0 like an empty one does.
+void vtstyle_apply_sgr(vtstyle *const style, const int *const params,
+        int n_params);
+
+// Applies the 'len' bytes at 'esc' to 'style' if they're exactly one SGR
+// sequence. Returns false, leaving 'style' as it was, if they're anything
+// else.
+bool vtstyle_apply_escape(vtstyle *const style, const char *const esc,
+        size_t len);
+
+// Writes the shortest SGR sequence that takes a terminal in style 'from' to
+// style 'to' into 'buf', which must have room for VTSTYLE_SGR_MAXLEN bytes:
+// either what changed, or a reset and what 'to' sets, whichever is shorter.
+// Returns its length, which is 0 if there's nothing to change.
+size_t vtstyle_sgr(const vtstyle *const from, const vtstyle *const to,
+        char *const buf);
@@ -0,0 +1,578 @@
+// A stand-in IRC server for load-testing the client on one machine. It takes
+// one client, welcomes it once it has sent NICK and USER, and then floods it
+// with synthetic traffic at a set rate:
+//      floodserver -c 20 -r 2000 -d 30
+//      athena-irc 127.0.0.1 6667
+//
+// The traffic is the mix a busy network sends: PRIVMSGs across the channels,
+// some with heavy colour and formatting, storms of JOINs and QUITs, and a MOTD
+// and NAMES for every channel up front. Every few milliseconds a PING goes out
+// carrying when it was sent; the client answers PINGs once everything
+// received before them is on screen, so the time to the PONG is how long the
+// client takes to show a line, queues included. Percentiles of that are
+// reported at the end.
+//
+// With -ramp, the rate goes up by a quarter every few seconds until the
+// client can't keep up: until the 99th percentile goes over the limit, too
+// many PINGs go unanswered, or the client stops reading and what's sent piles
+// up here. The last rate it kept up with is the most it can sustain.
+//
+// Options (defaults in brackets):
+//      -p <port>       port to listen on, on 127.0.0.1 [6667]
+//      -c <n>          channels [10]
+//      -r <n>          messages per second [1000]
+//      -d <seconds>    how long to flood [20]
+//      -colour <pct>   share of messages heavy with colour [20]
+//      -storm <s>      a JOIN/QUIT storm every this many seconds, or 0 [5]
+//      -motd <n>       MOTD lines [200]
+//      -names <n>      nicks in each channel's NAMES [300]
+//      -probe <ms>     time between PINGs [20]
+//      -ramp <s>       raise the rate every this many seconds, until -d ends
+//      -limit <ms>     99th percentile a rate must stay under to count as kept
+//                      up with [100]
+//      -seed <n>       for the traffic, which is otherwise the same every run
+//
+// Build from the repo root:
+//      cl misc\floodserver.c ws2_32.lib /DWIN32_LEAN_AND_MEAN /O2
+// or with build.ps1 -FloodServer.
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// TODO: platform-specific code
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#define SERVER_NAME "flood.localhost"
+#define LINE_MAXLEN 512
+#define RECV_BUF_LEN 4096
+// What's generated but not yet taken by the client. Past this, it's not
+// keeping up, and generating stops until it catches up.
+#define BACKLOG_MAX (8 * 1024 * 1024)
+#define N_NICKS 1000
+// Lines in a JOIN/QUIT storm, half of them each.
+#define STORM_LINES 400
+// Messages generated at once, at most, so PINGs and reading aren't held up.
+#define BURST_MAX 2000
+// How much bigger the rate gets each step with -ramp.
+#define RAMP_FACTOR 1.25
+// Share of a step's PINGs that must be answered for it to count as kept up
+// with.
+#define MIN_ANSWERED 0.9
+// How long to wait for PONGs to straggle in at the end of a step.
+#define STEP_GRACE_MS 500
+
+typedef struct flood_config {
+    int port;
+    int n_channels;
+    double rate;
+    int duration_s;
+    int colour_pct;
+    int storm_s;
+    int motd_lines;
+    int names;
+    int probe_ms;
+    int ramp_s;
+    int limit_ms;
+    uint32_t seed;
+} flood_config;
+
+// One rate, held for a while: the whole run, or one step of -ramp.
+typedef struct flood_step {
+    double rate;
+    uint64_t n_msgs;
+    uint64_t n_bytes;
+    uint64_t n_probes;
+    // Round trips of the answered PINGs, in microseconds.
+    int64_t *rtts;
+    size_t n_rtts;
+    size_t rtts_cap;
+    size_t peak_backlog;
+    // Whether generating stopped because the backlog was full.
+    bool stalled;
+} flood_step;
+
+static flood_config s_cfg = {
+    .port = 6667, .n_channels = 10, .rate = 1000, .duration_s = 20,
+    .colour_pct = 20, .storm_s = 5, .motd_lines = 200, .names = 300,
+    .probe_ms = 20, .ramp_s = 0, .limit_ms = 100, .seed = 1
+};
+
+static SOCKET s_client = INVALID_SOCKET;
+static char s_nick[LINE_MAXLEN] = "";
+static bool s_got_user = false;
+static bool s_quit = false;
+
+// What's generated and not yet sent.
+static char *s_out = NULL;
+static size_t s_out_len = 0;
+static size_t s_out_cap = 0;
+
+static char s_in[RECV_BUF_LEN];
+static size_t s_in_len = 0;
+
+static flood_step *s_step = NULL;
+// When the step that PINGs were sent in started, to tell late answers from
+// a previous step's.
+static int64_t s_step_start_us = 0;
+static uint32_t s_rand_state = 1;
+
+static bool parse_args(int argc, char *argv[]);
+static SOCKET accept_client(void);
+
+// Sends the welcome, the MOTD, and JOINs, topics and NAMES for every channel.
+static void send_welcome(void);
+// Floods at 'rate' for 'secs' into 'step'.
+static void run_step(flood_step *const step, double rate, int secs);
+static void report_step(const flood_step *const step, bool kept_up);
+// Whether the client kept up with 'step'.
+static bool kept_up(const flood_step *const step);
+
+static void gen_privmsg(void);
+static void gen_storm(void);
+static void gen_line(const char *const fmt, ...);
+
+// Sends what it can without blocking.
+static void flush_out(void);
+// Waits up to 'timeout_us' for the client to send something, and handles it.
+static void poll_client(int64_t timeout_us);
+static void handle_client_line(char *const line);
+
+// Of a step's round trips, once they're sorted at its end.
+static int64_t percentile(const flood_step *const step, double p);
+static int compare_rtts(const void *a, const void *b);
+static void *grow(void *buf, size_t *const cap, size_t need, size_t size);
+static uint32_t next_rand(void);
+static int64_t now_us(void);
+
+int main(int argc, char *argv[]) {
+    if (!parse_args(argc, argv)) {
+        printf("Usage: floodserver [-p port] [-c channels] [-r msgs/s] "
+                "[-d seconds] [-colour pct] [-storm s] [-motd lines] "
+                "[-names nicks] [-probe ms] [-ramp s] [-limit ms] "
+                "[-seed n]\n");
+        return 23;
+    }
+    s_rand_state = s_cfg.seed;
+
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        printf("WSAStartup() failed.\n");
+        return 23;
+    }
+    s_client = accept_client();
+    if (s_client == INVALID_SOCKET) {
+        WSACleanup();
+        return 23;
+    }
+
+    // Registration: nothing's sent until the client has said who it is.
+    while (!s_quit && (s_nick[0] == '\0' || !s_got_user))
+        poll_client(100000);
+    if (!s_quit) {
+        printf("%s registered.\n", s_nick);
+        send_welcome();
+    }
+
+    printf("%8s %9s %8s %9s %8s %8s %8s %8s %8s %9s  %s\n", "msgs/s",
+            "sent", "MB", "answered", "p50 ms", "p99 ms", "p999 ms",
+            "max ms", "backlog", "stalled", "kept up");
+    double best = 0;
+    int secs_left = s_cfg.duration_s;
+    double rate = s_cfg.rate;
+    while (!s_quit && secs_left > 0) {
+        int secs = s_cfg.ramp_s > 0 && s_cfg.ramp_s < secs_left
+                 ? s_cfg.ramp_s : secs_left;
+        flood_step step;
+        memset(&step, 0, sizeof(step));
+        run_step(&step, rate, secs);
+        bool ok = kept_up(&step);
+        report_step(&step, ok);
+        free(step.rtts);
+        if (!ok && s_cfg.ramp_s > 0) break;
+        if (ok && rate > best) best = rate;
+
+        secs_left -= secs;
+        if (s_cfg.ramp_s > 0) rate *= RAMP_FACTOR;
+    }
+    if (s_cfg.ramp_s > 0) {
+        if (best > 0) printf("Most sustained: %.0f msgs/s\n", best);
+        else printf("Not even the first rate was kept up with.\n");
+    }
+
+    closesocket(s_client);
+    WSACleanup();
+    free(s_out);
+    return 0;
+}
+
+static bool parse_args(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) return false;
+        const char *const opt = argv[i];
+        long long v = strtoll(argv[i + 1], NULL, 10);
+        if (v < 0) return false;
+        if (strcmp(opt, "-p") == 0 && v > 0 && v < 65536) s_cfg.port = (int) v;
+        else if (strcmp(opt, "-c") == 0 && v > 0) s_cfg.n_channels = (int) v;
+        else if (strcmp(opt, "-r") == 0 && v > 0) s_cfg.rate = (double) v;
+        else if (strcmp(opt, "-d") == 0 && v > 0) s_cfg.duration_s = (int) v;
+        else if (strcmp(opt, "-colour") == 0 && v <= 100)
+            s_cfg.colour_pct = (int) v;
+        else if (strcmp(opt, "-storm") == 0) s_cfg.storm_s = (int) v;
+        else if (strcmp(opt, "-motd") == 0) s_cfg.motd_lines = (int) v;
+        else if (strcmp(opt, "-names") == 0) s_cfg.names = (int) v;
+        else if (strcmp(opt, "-probe") == 0 && v > 0) s_cfg.probe_ms = (int) v;
+        else if (strcmp(opt, "-ramp") == 0 && v > 0) s_cfg.ramp_s = (int) v;
+        else if (strcmp(opt, "-limit") == 0 && v > 0) s_cfg.limit_ms = (int) v;
+        else if (strcmp(opt, "-seed") == 0) s_cfg.seed = (uint32_t) v;
+        else return false;
+    }
+    return true;
+}
+
+static SOCKET accept_client(void) {
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        printf("socket() failed: %d\n", WSAGetLastError());
+        return INVALID_SOCKET;
+    }
+    BOOL reuse = TRUE;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char *) &reuse,
+            sizeof(reuse));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short) s_cfg.port);
+    if (bind(listener, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+        listen(listener, 1) != 0)
+    {
+        printf("Can't listen on 127.0.0.1:%d: %d\n", s_cfg.port,
+                WSAGetLastError());
+        closesocket(listener);
+        return INVALID_SOCKET;
+    }
+    printf("Listening on 127.0.0.1:%d.\n", s_cfg.port);
+
+    SOCKET client = accept(listener, NULL, NULL);
+    closesocket(listener);
+    if (client == INVALID_SOCKET) {
+        printf("accept() failed: %d\n", WSAGetLastError());
+        return INVALID_SOCKET;
+    }
+
+    // Never block on the client: what it doesn't take piles up in s_out,
+    // which is how not keeping up shows.
+    u_long nonblocking = 1;
+    ioctlsocket(client, FIONBIO, &nonblocking);
+    return client;
+}
+
+static void send_welcome(void) {
+    gen_line(":%s 001 %s :Welcome to the flood, %s", SERVER_NAME, s_nick,
+            s_nick);
+    gen_line(":%s 375 %s :- %s Message of the Day -", SERVER_NAME, s_nick,
+            SERVER_NAME);
+    for (int i = 0; i < s_cfg.motd_lines; i++) {
+        gen_line(":%s 372 %s :- \x03%02u\x02%d\x02\x03 lines of the MOTD, "
+                "\x1Fthis\x1F one being about nothing in particular.",
+                SERVER_NAME, s_nick, next_rand() % 16, i);
+    }
+    gen_line(":%s 376 %s :End of /MOTD command.", SERVER_NAME, s_nick);
+
+    for (int c = 0; c < s_cfg.n_channels; c++) {
+        gen_line(":%s!~%s@localhost JOIN #flood%d", s_nick, s_nick, c);
+        gen_line(":%s 332 %s #flood%d :\x02Flood\x02 channel %d: "
+                "\x03" "04load\x03, \x03" "09more load\x03", SERVER_NAME,
+                s_nick, c, c);
+
+        // As many nicks to a line as fit.
+        char names[LINE_MAXLEN];
+        size_t len = 0;
+        for (int i = 0; i < s_cfg.names; i++) {
+            char nick[32];
+            int n = sprintf_s(nick, sizeof(nick), "%snick%u",
+                    i % 10 == 0 ? "@" : "", (unsigned) (i % N_NICKS));
+            if (len + (size_t) n + 1 > 400) {
+                names[len] = '\0';
+                gen_line(":%s 353 %s = #flood%d :%s", SERVER_NAME, s_nick, c,
+                        names);
+                len = 0;
+            }
+            if (len > 0) names[len++] = ' ';
+            memcpy(names + len, nick, (size_t) n);
+            len += (size_t) n;
+        }
+        names[len] = '\0';
+        if (len > 0) {
+            gen_line(":%s 353 %s = #flood%d :%s", SERVER_NAME, s_nick, c,
+                    names);
+        }
+        gen_line(":%s 366 %s #flood%d :End of /NAMES list.", SERVER_NAME,
+                s_nick, c);
+    }
+}
+
+static void run_step(flood_step *const step, double rate, int secs) {
+    s_step = step;
+    step->rate = rate;
+    int64_t start = now_us();
+    s_step_start_us = start;
+    int64_t end = start + (int64_t) secs * 1000000;
+    int64_t next_probe = start;
+    int64_t next_storm = start + (int64_t) s_cfg.storm_s * 1000000;
+    uint64_t seq = 0;
+
+    int64_t now = start;
+    while (!s_quit && now < end) {
+        // Catch up with the rate, unless the client is behind already.
+        uint64_t due = (uint64_t) ((double) (now - start) * rate / 1e6);
+        for (int i = 0; i < BURST_MAX && step->n_msgs < due; i++) {
+            if (s_out_len >= BACKLOG_MAX) {
+                step->stalled = true;
+                break;
+            }
+            gen_privmsg();
+        }
+        if (s_cfg.storm_s > 0 && now >= next_storm) {
+            gen_storm();
+            next_storm += (int64_t) s_cfg.storm_s * 1000000;
+        }
+        if (now >= next_probe) {
+            gen_line("PING :flood %llu %lld", (unsigned long long) seq++,
+                    (long long) now);
+            step->n_probes++;
+            next_probe += (int64_t) s_cfg.probe_ms * 1000;
+        }
+
+        flush_out();
+        if (s_out_len > step->peak_backlog) step->peak_backlog = s_out_len;
+        poll_client(1000);
+        now = now_us();
+    }
+
+    // Answers to the last PINGs are still on their way.
+    int64_t grace_end = now_us() + STEP_GRACE_MS * 1000;
+    while (!s_quit && now_us() < grace_end) {
+        flush_out();
+        poll_client(1000);
+    }
+    s_step = NULL;
+    qsort(step->rtts, step->n_rtts, sizeof(*step->rtts), compare_rtts);
+}
+
+static bool kept_up(const flood_step *const step) {
+    if (step->stalled || step->n_probes == 0) return false;
+    if ((double) step->n_rtts < MIN_ANSWERED * (double) step->n_probes)
+        return false;
+    return percentile(step, 0.99) < (int64_t) s_cfg.limit_ms * 1000;
+}
+
+static void report_step(const flood_step *const step, bool ok) {
+    printf("%8.0f %9llu %8.1f %4llu/%-4llu %8.2f %8.2f %8.2f %8.2f %7zuK "
+            "%9s  %s\n", step->rate, (unsigned long long) step->n_msgs,
+            (double) step->n_bytes / 1e6, (unsigned long long) step->n_rtts,
+            (unsigned long long) step->n_probes,
+            (double) percentile(step, 0.5) / 1000,
+            (double) percentile(step, 0.99) / 1000,
+            (double) percentile(step, 0.999) / 1000,
+            (double) percentile(step, 1.0) / 1000,
+            step->peak_backlog / 1024, step->stalled ? "yes" : "no",
+            ok ? "yes" : "NO");
+}
+
+static void gen_privmsg(void) {
+    static const char *const WORDS[] = {
+        "flood", "load", "the", "server", "says", "hello", "again", "and",
+        "more", "lines", "of", "text", "caf\xC3\xA9",
+        "\xE6\xBC\xA2\xE5\xAD\x97", "\xF0\x9F\x8C\x90", "to", "fill", "the",
+        "screen"
+    };
+    static const int N_WORDS = sizeof(WORDS) / sizeof(WORDS[0]);
+
+    bool colourful = (int) (next_rand() % 100) < s_cfg.colour_pct;
+    char text[LINE_MAXLEN];
+    size_t len = 0;
+    int n_words = 3 + next_rand() % 20;
+    for (int i = 0; i < n_words && len < 300; i++) {
+        const char *const word = WORDS[next_rand() % N_WORDS];
+        int n;
+        if (colourful) {
+            // Foreground and background, and bold, italic or underline.
+            static const char FMTS[] = { '\x02', '\x1D', '\x1F' };
+            char fmt = FMTS[next_rand() % 3];
+            n = sprintf_s(text + len, sizeof(text) - len,
+                    "%c\x03%02u,%02u%s\x0F", fmt, next_rand() % 16,
+                    next_rand() % 16, word);
+        }
+        else {
+            n = sprintf_s(text + len, sizeof(text) - len, "%s", word);
+        }
+        len += (size_t) n;
+        if (i + 1 < n_words) text[len++] = ' ';
+    }
+    text[len] = '\0';
+
+    unsigned nick = next_rand() % N_NICKS;
+    gen_line(":nick%u!~user%u@host%u.flood PRIVMSG #flood%u :%s", nick, nick,
+            nick % 97, next_rand() % (unsigned) s_cfg.n_channels, text);
+    if (s_step != NULL) s_step->n_msgs++;
+}
+
+static void gen_storm(void) {
+    // A netsplit coming back, then going again.
+    for (int i = 0; i < STORM_LINES / 2; i++) {
+        unsigned nick = next_rand() % N_NICKS;
+        gen_line(":nick%u!~user%u@host%u.flood JOIN #flood%u", nick, nick,
+                nick % 97, next_rand() % (unsigned) s_cfg.n_channels);
+    }
+    for (int i = 0; i < STORM_LINES / 2; i++) {
+        unsigned nick = next_rand() % N_NICKS;
+        gen_line(":nick%u!~user%u@host%u.flood QUIT :*.net *.split", nick,
+                nick, nick % 97);
+    }
+}
+
+static void gen_line(const char *const fmt, ...) {
+    s_out = grow(s_out, &s_out_cap, s_out_len + LINE_MAXLEN + 2, 1);
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(s_out + s_out_len, LINE_MAXLEN - 1, fmt, args);
+    va_end(args);
+    if (n < 0) return;
+    // Cut short, as a server would.
+    if (n > LINE_MAXLEN - 2) n = LINE_MAXLEN - 2;
+    s_out[s_out_len + n] = '\r';
+    s_out[s_out_len + n + 1] = '\n';
+    s_out_len += (size_t) n + 2;
+    if (s_step != NULL) s_step->n_bytes += (uint64_t) n + 2;
+}
+
+static void flush_out(void) {
+    size_t sent = 0;
+    while (sent < s_out_len) {
+        size_t chunk = s_out_len - sent;
+        if (chunk > 64 * 1024) chunk = 64 * 1024;
+        int n = send(s_client, s_out + sent, (int) chunk, 0);
+        if (n == SOCKET_ERROR) {
+            if (WSAGetLastError() != WSAEWOULDBLOCK) {
+                printf("send() failed: %d\n", WSAGetLastError());
+                s_quit = true;
+            }
+            break;
+        }
+        sent += (size_t) n;
+    }
+    memmove(s_out, s_out + sent, s_out_len - sent);
+    s_out_len -= sent;
+}
+
+static void poll_client(int64_t timeout_us) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(s_client, &readable);
+    struct timeval timeout = {
+        (long) (timeout_us / 1000000), (long) (timeout_us % 1000000)
+    };
+    if (select(0, &readable, NULL, NULL, &timeout) <= 0) return;
+
+    int n = recv(s_client, s_in + s_in_len,
+            (int) (sizeof(s_in) - s_in_len - 1), 0);
+    if (n <= 0) {
+        if (n == 0 || WSAGetLastError() != WSAEWOULDBLOCK) {
+            printf("The client disconnected.\n");
+            s_quit = true;
+        }
+        return;
+    }
+    s_in_len += (size_t) n;
+    s_in[s_in_len] = '\0';
+
+    char *line = s_in;
+    char *eol;
+    while ((eol = strstr(line, "\r\n")) != NULL) {
+        *eol = '\0';
+        handle_client_line(line);
+        line = eol + 2;
+    }
+    s_in_len -= (size_t) (line - s_in);
+    memmove(s_in, line, s_in_len);
+    // A line too long to ever end is thrown away.
+    if (s_in_len == sizeof(s_in) - 1) s_in_len = 0;
+}
+
+static void handle_client_line(char *const line) {
+    if (strncmp(line, "NICK ", 5) == 0) {
+        strcpy_s(s_nick, sizeof(s_nick), line + 5);
+    }
+    else if (strncmp(line, "USER ", 5) == 0) {
+        s_got_user = true;
+    }
+    else if (strncmp(line, "PONG ", 5) == 0) {
+        // PONG :flood <seq> <when the PING was sent>
+        const char *const tag = strstr(line, "flood ");
+        unsigned long long seq;
+        long long sent;
+        if (tag == NULL || sscanf_s(tag, "flood %llu %lld", &seq, &sent) != 2)
+            return;
+        if (s_step == NULL || sent < s_step_start_us) return;
+        s_step->rtts = grow(s_step->rtts, &s_step->rtts_cap,
+                s_step->n_rtts + 1, sizeof(*s_step->rtts));
+        s_step->rtts[s_step->n_rtts++] = now_us() - sent;
+    }
+    else if (strncmp(line, "PING ", 5) == 0) {
+        gen_line(":%s PONG %s %s", SERVER_NAME, SERVER_NAME, line + 5);
+    }
+    else if (strncmp(line, "JOIN ", 5) == 0) {
+        gen_line(":%s!~%s@localhost JOIN %s", s_nick, s_nick, line + 5);
+    }
+    else if (strncmp(line, "QUIT", 4) == 0) {
+        printf("The client quit.\n");
+        s_quit = true;
+    }
+}
+
+static int64_t percentile(const flood_step *const step, double p) {
+    if (step->n_rtts == 0) return 0;
+    size_t i = (size_t) (p * (double) (step->n_rtts - 1) + 0.5);
+    return step->rtts[i];
+}
+
+static int compare_rtts(const void *a, const void *b) {
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void *grow(void *buf, size_t *const cap, size_t need, size_t size) {
+    if (need <= *cap) return buf;
+    size_t new_cap = *cap == 0 ? 4096 : *cap;
+    while (new_cap < need) new_cap *= 2;
+    void *grown = realloc(buf, new_cap * size);
+    if (grown == NULL) {
+        printf("FATAL: out of memory.\n");
+        exit(23);
+    }
+    *cap = new_cap;
+    return grown;
+}
+
+static uint32_t next_rand(void) {
+    // Not rand(), which differs between C runtimes.
+    s_rand_state = s_rand_state * 1103515245u + 12345u;
+    return s_rand_state >> 16;
+}
+
+static int64_t now_us(void) {
+    static LARGE_INTEGER freq = { 0 };
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return (t.QuadPart / freq.QuadPart) * 1000000 +
+           (t.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+}
@@ -0,0 +1,273 @@
+// Turns a binary log (see logbin.h) back into the text log it stands for, line
+// for line:
+//      logdecode athena.binlog > athena.log
+// With -t, each line starts with when it was logged, in seconds since the
+// first line, and the id of the thread that logged it:
+//      logdecode -t athena.binlog
+//
+// Build from the repo root:
+//      cl misc\logdecode.c src\lebytes.c src\log.c src\logbin.c
+//          src\terminalutils.c /I"include" /DWIN32_LEAN_AND_MEAN /O2
+#include "lebytes.h"
+#include "log.h"
+#include "logbin.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Room for the biggest record a binary log can hold, the line it makes, and
+// a string argument with its null term.
+#define RECORD_BUF_SIZE (UINT16_MAX + 1)
+#define LINE_BUF_SIZE (UINT16_MAX + 1)
+#define STR_BUF_SIZE (UINT16_MAX + 1)
+
+// Longest conversion spec rebuilt for rendering, e.g. "%-+#020.*llu".
+#define SPEC_MAXLEN 32
+
+// Formats by call site id.
+static char **s_sites = NULL;
+static uint32_t s_sites_cap = 0;
+
+// Where render() puts a string argument to hand to snprintf().
+static char *s_str_buf = NULL;
+
+static void set_site(uint32_t id, const char *const fmt, size_t len);
+
+// Formats 'fmt' with the arguments stored by logbin_encode_args() into 'out',
+// as snprintf() would have. Returns the length of the result.
+static size_t render(const char *const fmt, const char *const args,
+        size_t args_len, char *const out, size_t outsize);
+
+int main(int argc, char *argv[]) {
+    log_init(stderr);
+
+    bool times = argc >= 2 && strcmp(argv[1], "-t") == 0;
+    const char *path = argc >= 2 ? argv[argc - 1] : NULL;
+    if (path == NULL || (times && argc < 3)) {
+        log(LOGLEVEL_ERROR, "Usage: logdecode [-t] <binary log>");
+        return 23;
+    }
+
+    FILE *in = NULL;
+    if (fopen_s(&in, path, "rb") != 0 || in == NULL) {
+        log_fmt(LOGLEVEL_ERROR, "Can't open '%s'.", path);
+        return 23;
+    }
+
+    int64_t ticks_per_s = 0;
+    if (!logbin_read_header(in, &ticks_per_s) || ticks_per_s <= 0) {
+        log_fmt(LOGLEVEL_ERROR, "'%s' isn't a binary log.", path);
+        fclose(in);
+        return 23;
+    }
+
+    s_str_buf = malloc(STR_BUF_SIZE);
+    if (s_str_buf == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[logdecode] FATAL: out of memory.");
+        exit(23);
+    }
+
+    static char record_buf[RECORD_BUF_SIZE];
+    static char line[LINE_BUF_SIZE];
+    logbin_record rec;
+    bool first = true;
+    int64_t first_ticks = 0;
+    uint64_t n_lines = 0;
+    int result;
+    while ((result = logbin_read(in, &rec, record_buf, sizeof(record_buf)))
+           > 0)
+    {
+        if (rec.type == LOGBIN_REC_SITE) {
+            set_site(rec.site_id, rec.data, rec.len);
+            continue;
+        }
+
+        const char *fmt = rec.site_id < s_sites_cap ? s_sites[rec.site_id]
+                                                    : NULL;
+        if (fmt == NULL) {
+            log_fmt(LOGLEVEL_WARNING, "Line %llu is from call site %lu, "
+                    "which the log never defined.",
+                    (unsigned long long) n_lines, (unsigned long) rec.site_id);
+            fmt = "<unknown call site>";
+        }
+
+        size_t len = 0;
+        if (times) {
+            if (first) first_ticks = rec.ticks;
+            first = false;
+            len = (size_t) sprintf_s(line, sizeof(line), "[%12.6f] [%5lu] ",
+                    (double) (rec.ticks - first_ticks) / (double) ticks_per_s,
+                    (unsigned long) rec.thread_id);
+        }
+        render(fmt, rec.data, rec.len, line + len, sizeof(line) - len);
+        log_write_text(stdout, (loglevel) rec.level, line);
+        n_lines++;
+    }
+
+    if (result < 0)
+        log_fmt(LOGLEVEL_WARNING, "The log is cut short or corrupt after line "
+                "%llu.", (unsigned long long) n_lines);
+    fclose(in);
+    free(s_str_buf);
+    return result < 0 ? 1 : 0;
+}
+
+static void set_site(uint32_t id, const char *const fmt, size_t len) {
+    if (id >= s_sites_cap) {
+        uint32_t cap = s_sites_cap == 0 ? 256 : s_sites_cap;
+        while (cap <= id) cap *= 2;
+        char **sites = realloc(s_sites, cap * sizeof(*sites));
+        if (sites == NULL) {
+            // TODO: communicate fatal error
+            log(LOGLEVEL_ERROR, "[logdecode] FATAL: out of memory.");
+            exit(23);
+        }
+        memset(sites + s_sites_cap, 0,
+                (cap - s_sites_cap) * sizeof(*sites));
+        s_sites = sites;
+        s_sites_cap = cap;
+    }
+
+    char *copy = malloc(len + 1);
+    if (copy == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[logdecode] FATAL: out of memory.");
+        exit(23);
+    }
+    memcpy(copy, fmt, len);
+    copy[len] = '\0';
+    free(s_sites[id]);
+    s_sites[id] = copy;
+}
+
+static size_t render(const char *const fmt, const char *const args,
+        size_t args_len, char *const out, size_t outsize)
+{
+    assert(fmt != NULL);
+    assert(args != NULL || args_len == 0);
+    assert(out != NULL);
+    assert(outsize > 0);
+
+    size_t len = 0;
+    size_t i_arg = 0;
+    const char *p = fmt;
+    while (*p != '\0' && len + 1 < outsize) {
+        if (*p != '%') {
+            out[len++] = *p++;
+            continue;
+        }
+
+        logbin_spec s;
+        const char *spec_start = p;
+        p = logbin_parse_spec(p + 1, &s);
+        if (s.conv == '%') {
+            out[len++] = '%';
+            continue;
+        }
+
+        int stars[2];
+        int n_stars = s.width_star + s.precision_star;
+        int type = logbin_spec_arg_type(&s);
+        bool ok = type >= 0;
+        for (int i = 0; ok && i < n_stars; i++) {
+            ok = i_arg + 4 <= args_len;
+            if (ok) stars[i] = (int) lebytes_get_u32(args + i_arg);
+            i_arg += 4;
+        }
+        size_t size = logbin_arg_size(type);
+        ok = ok && i_arg + size <= args_len;
+        if (!ok) {
+            // Cut short or not from this format; show the spec as it is.
+            size_t spec_len = (size_t) (p - spec_start);
+            if (spec_len > outsize - 1 - len) spec_len = outsize - 1 - len;
+            memcpy(out + len, spec_start, spec_len);
+            len += spec_len;
+            continue;
+        }
+
+        // The same spec, with the length modifier the stored value needs.
+        char conv_spec[SPEC_MAXLEN];
+        const char *length = "";
+        if (type == LOGBIN_ARG_LONG || type == LOGBIN_ARG_ULONG ||
+            type == LOGBIN_ARG_LLONG || type == LOGBIN_ARG_SIZE)
+        {
+            length = "ll";
+        }
+        size_t flags_len = s.flags_len < SPEC_MAXLEN - 8 ? s.flags_len
+                                                         : SPEC_MAXLEN - 8;
+        sprintf_s(conv_spec, sizeof(conv_spec), "%%%.*s%s%c", (int) flags_len,
+                s.flags, length, s.conv);
+
+        char *const dst = out + len;
+        size_t room = outsize - len;
+        int n = 0;
+        uint64_t v = 0;
+        switch (type) {
+        case LOGBIN_ARG_INT: {
+            uint32_t bits = lebytes_get_u32(args + i_arg);
+            // Signed or not, the same bits.
+            if (n_stars == 0) n = snprintf(dst, room, conv_spec, (int) bits);
+            else if (n_stars == 1)
+                n = snprintf(dst, room, conv_spec, stars[0], (int) bits);
+            else
+                n = snprintf(dst, room, conv_spec, stars[0], stars[1],
+                        (int) bits);
+            i_arg += 4;
+            break;
+        }
+        case LOGBIN_ARG_DOUBLE: {
+            v = lebytes_get_u64(args + i_arg);
+            double d;
+            memcpy(&d, &v, sizeof(d));
+            if (n_stars == 0) n = snprintf(dst, room, conv_spec, d);
+            else if (n_stars == 1)
+                n = snprintf(dst, room, conv_spec, stars[0], d);
+            else n = snprintf(dst, room, conv_spec, stars[0], stars[1], d);
+            i_arg += 8;
+            break;
+        }
+        case LOGBIN_ARG_PTR: {
+            void *ptr = (void *) (uintptr_t) lebytes_get_u64(args + i_arg);
+            if (n_stars == 0) n = snprintf(dst, room, conv_spec, ptr);
+            else if (n_stars == 1)
+                n = snprintf(dst, room, conv_spec, stars[0], ptr);
+            else n = snprintf(dst, room, conv_spec, stars[0], stars[1], ptr);
+            i_arg += 8;
+            break;
+        }
+        case LOGBIN_ARG_STR: {
+            size_t str_len = lebytes_get_u16(args + i_arg);
+            i_arg += 2;
+            if (str_len > args_len - i_arg) str_len = args_len - i_arg;
+            char *const str = s_str_buf;
+            memcpy(str, args + i_arg, str_len);
+            str[str_len] = '\0';
+            i_arg += str_len;
+            if (n_stars == 0) n = snprintf(dst, room, conv_spec, str);
+            else if (n_stars == 1)
+                n = snprintf(dst, room, conv_spec, stars[0], str);
+            else n = snprintf(dst, room, conv_spec, stars[0], stars[1], str);
+            break;
+        }
+        default: {
+            // Any of the 64-bit integers.
+            long long ll = (long long) lebytes_get_u64(args + i_arg);
+            if (n_stars == 0) n = snprintf(dst, room, conv_spec, ll);
+            else if (n_stars == 1)
+                n = snprintf(dst, room, conv_spec, stars[0], ll);
+            else n = snprintf(dst, room, conv_spec, stars[0], stars[1], ll);
+            i_arg += 8;
+        }
+        }
+
+        if (n < 0) n = 0;
+        len += (size_t) n < room ? (size_t) n : room - 1;
+    }
+    out[len] = '\0';
+    return len;
+}
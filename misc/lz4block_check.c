@@ -0,0 +1,337 @@
+// Checks the LZ4 block codec (lz4block.h) and times it on chat-like text.
+//
+// Round trips: inputs of every length up to past the compressor's end limits,
+// runs, short periods (overlapping matches), incompressible bytes (long
+// literal runs) and generated chat text longer than the 64 KB match window
+// are compressed and decompressed again. Each must come back the same, be
+// refused with one byte less room than it needs or with the wrong raw length,
+// and never write past the end of the output. Hand-made blocks written from
+// the format description check that the decoder reads what any other LZ4
+// writer would.
+//
+// Corrupt input: every truncation of a compressed block must be refused, and
+// every single-bit flip and a run of random garbage must decode to false or to
+// something, but never write out of bounds.
+//
+// Build from the repo root:
+//      cl misc\lz4block_check.c src\lz4block.c /I"include" /O2
+#include "lz4block.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Bytes past the end of every output buffer, which must stay untouched.
+#define CANARY_LEN 64
+#define CANARY 0xA5
+#define CHAT_TEXT_LEN (1024 * 256)
+#define RANDOM_TEXT_LEN (1024 * 70)
+#define RUN_TEXT_LEN (1024 * 100)
+// Longest input tried at every length.
+#define MAX_SHORT_LEN 64
+// Input whose compressed form gets every bit flipped.
+#define FLIP_TEXT_LEN (1024 * 4)
+#define GARBAGE_RUNS 100000
+#define GARBAGE_MAXLEN 64
+#define BENCH_ROUNDS 200
+
+// Allocates 'n' bytes followed by the canary.
+static uint8_t *alloc_guarded(size_t n);
+static bool canary_intact(const uint8_t *const buf, size_t n);
+
+// Returns the number of failures, printing the first few.
+static int check_round_trip(const char *name, const uint8_t *const src,
+        size_t n);
+static int check_vector(const char *name, const uint8_t *const block,
+        size_t block_len, const char *want);
+static int check_truncations(const uint8_t *const src, size_t n);
+static int check_bit_flips(const uint8_t *const src, size_t n);
+static int check_garbage(void);
+
+static void bench(const uint8_t *const src, size_t n);
+
+// Not rand(), which differs between C runtimes.
+static uint32_t next_rand(void);
+static size_t make_chat_text(uint8_t *const buf, size_t n);
+
+static uint32_t s_rand_state = 1;
+static int s_n_reported;
+
+int main(void) {
+    uint8_t *const chat = malloc(CHAT_TEXT_LEN);
+    uint8_t *const noise = malloc(RANDOM_TEXT_LEN);
+    uint8_t *const runs = malloc(RUN_TEXT_LEN);
+    if (chat == NULL || noise == NULL || runs == NULL) {
+        printf("out of memory\n");
+        return 2;
+    }
+    size_t chat_len = make_chat_text(chat, CHAT_TEXT_LEN);
+    for (size_t i = 0; i < RANDOM_TEXT_LEN; i++)
+        noise[i] = (uint8_t) next_rand();
+
+    int n_failed = 0;
+    n_failed += check_round_trip("empty", NULL, 0);
+    for (size_t len = 1; len <= MAX_SHORT_LEN; len++) {
+        n_failed += check_round_trip("short chat", chat, len);
+        n_failed += check_round_trip("short noise", noise, len);
+        memset(runs, 'a', len);
+        n_failed += check_round_trip("short run", runs, len);
+    }
+    for (size_t period = 1; period <= 20; period++) {
+        for (size_t i = 0; i < RUN_TEXT_LEN; i++)
+            runs[i] = (uint8_t) ('a' + i % period);
+        n_failed += check_round_trip("period", runs, RUN_TEXT_LEN);
+    }
+    memset(runs, 0, RUN_TEXT_LEN);
+    n_failed += check_round_trip("zeroes", runs, RUN_TEXT_LEN);
+    n_failed += check_round_trip("noise", noise, RANDOM_TEXT_LEN);
+    n_failed += check_round_trip("chat", chat, chat_len);
+    printf("round trips: %d failed\n", n_failed);
+
+    // Literals only, then a match overlapping itself, then a match and
+    // literal run long enough to need extra length bytes.
+    static const uint8_t HELLO[] = { 0x50, 'h', 'e', 'l', 'l', 'o' };
+    static const uint8_t OVERLAP[] = {
+        0x13, 'a', 0x01, 0x00, 0x50, 'b', 'c', 'd', 'e', 'f'
+    };
+    static const uint8_t LONG[] = {
+        0xFF, 0x01, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l',
+        'm', 'n', 'o', 'p', 0x10, 0x00, 0x00, 0x10, 'x'
+    };
+    int n_vec_failed = 0;
+    n_vec_failed += check_vector("literals", HELLO, sizeof(HELLO), "hello");
+    n_vec_failed += check_vector("overlap", OVERLAP, sizeof(OVERLAP),
+            "aaaaaaaabcdef");
+    n_vec_failed += check_vector("long lengths", LONG, sizeof(LONG),
+            "abcdefghijklmnop" "abcdefghijklmnop" "abcx");
+    printf("format vectors: %d failed\n", n_vec_failed);
+    n_failed += n_vec_failed;
+
+    int n_corrupt_failed = check_truncations(chat, FLIP_TEXT_LEN);
+    n_corrupt_failed += check_bit_flips(chat, FLIP_TEXT_LEN);
+    n_corrupt_failed += check_garbage();
+    printf("corrupt input: %d failed\n\n", n_corrupt_failed);
+    n_failed += n_corrupt_failed;
+
+    bench(chat, chat_len);
+
+    free(chat);
+    free(noise);
+    free(runs);
+    return n_failed == 0 ? 0 : 1;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static uint8_t *alloc_guarded(size_t n) {
+    uint8_t *const buf = malloc(n + CANARY_LEN);
+    if (buf == NULL) {
+        printf("out of memory\n");
+        exit(2);
+    }
+    memset(buf, CANARY, n + CANARY_LEN);
+    return buf;
+}
+
+static bool canary_intact(const uint8_t *const buf, size_t n) {
+    for (size_t i = 0; i < CANARY_LEN; i++) {
+        if (buf[n + i] != CANARY) return false;
+    }
+    return true;
+}
+
+static int check_round_trip(const char *name, const uint8_t *const src,
+        size_t n)
+{
+    size_t cap = lz4_compress_bound(n);
+    uint8_t *const packed = alloc_guarded(cap);
+    uint8_t *const out = alloc_guarded(n + 1);
+    int n_failed = 0;
+
+    size_t packed_len = lz4_compress(src, n, packed, cap);
+    bool ok = packed_len > 0 && canary_intact(packed, cap) &&
+        lz4_decompress(packed, packed_len, out, n) &&
+        (n == 0 || memcmp(out, src, n) == 0) && canary_intact(out, n);
+    if (!ok) n_failed++;
+
+    // Wrong raw lengths, both ways.
+    if (packed_len > 0) {
+        memset(out, CANARY, n + 1 + CANARY_LEN);
+        if (n > 0 && (lz4_decompress(packed, packed_len, out, n - 1) ||
+            !canary_intact(out, n - 1)))
+        {
+            n_failed++;
+        }
+        if (lz4_decompress(packed, packed_len, out, n + 1)) n_failed++;
+    }
+
+    // One byte short of the room it needs.
+    if (packed_len > 0) {
+        memset(packed, CANARY, cap + CANARY_LEN);
+        if (lz4_compress(src, n, packed, packed_len - 1) != 0 ||
+            !canary_intact(packed, packed_len - 1))
+        {
+            n_failed++;
+        }
+    }
+
+    if (n_failed > 0 && s_n_reported++ < 5)
+        printf("%s, %zu bytes: packed to %zu, failed\n", name, n, packed_len);
+    free(packed);
+    free(out);
+    return n_failed;
+}
+
+static int check_vector(const char *name, const uint8_t *const block,
+        size_t block_len, const char *want)
+{
+    size_t n = strlen(want);
+    uint8_t *const out = alloc_guarded(n);
+    bool ok = lz4_decompress(block, block_len, out, n) &&
+        memcmp(out, want, n) == 0 && canary_intact(out, n);
+    free(out);
+    if (!ok) printf("%s: not decoded to \"%s\"\n", name, want);
+    return ok ? 0 : 1;
+}
+
+static int check_truncations(const uint8_t *const src, size_t n) {
+    size_t cap = lz4_compress_bound(n);
+    uint8_t *const packed = malloc(cap);
+    uint8_t *const out = alloc_guarded(n);
+    if (packed == NULL) exit(2);
+    size_t packed_len = lz4_compress(src, n, packed, cap);
+
+    int n_failed = 0;
+    for (size_t len = 0; len < packed_len; len++) {
+        // Exactly 'len' bytes, so reading past them is caught by tools too.
+        uint8_t *const cut = malloc(len + 1);
+        if (cut == NULL) exit(2);
+        memcpy(cut, packed, len);
+        bool accepted = lz4_decompress(cut, len, out, n);
+        if (accepted || !canary_intact(out, n)) {
+            if (n_failed++ < 3) printf("truncated to %zu: accepted\n", len);
+        }
+        free(cut);
+    }
+    free(packed);
+    free(out);
+    return n_failed;
+}
+
+static int check_bit_flips(const uint8_t *const src, size_t n) {
+    size_t cap = lz4_compress_bound(n);
+    uint8_t *const packed = malloc(cap);
+    uint8_t *const out = alloc_guarded(n);
+    if (packed == NULL) exit(2);
+    size_t packed_len = lz4_compress(src, n, packed, cap);
+
+    int n_failed = 0, n_refused = 0, n_flips = 0;
+    for (size_t i = 0; i < packed_len; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            packed[i] ^= (uint8_t) (1 << bit);
+            n_flips++;
+            if (!lz4_decompress(packed, packed_len, out, n)) n_refused++;
+            if (!canary_intact(out, n)) {
+                if (n_failed++ < 3)
+                    printf("bit %d of byte %zu: wrote past the end\n", bit, i);
+                memset(out + n, CANARY, CANARY_LEN);
+            }
+            packed[i] ^= (uint8_t) (1 << bit);
+        }
+    }
+    // Flipping a literal gives another valid block, so not all are refused.
+    printf("bit flips: %d of %d refused\n", n_refused, n_flips);
+    free(packed);
+    free(out);
+    return n_failed;
+}
+
+static int check_garbage(void) {
+    uint8_t block[GARBAGE_MAXLEN];
+    uint8_t *const out = alloc_guarded(GARBAGE_MAXLEN * 4);
+    int n_failed = 0;
+    for (int run = 0; run < GARBAGE_RUNS; run++) {
+        size_t len = next_rand() % GARBAGE_MAXLEN;
+        size_t raw_len = next_rand() % (GARBAGE_MAXLEN * 4);
+        for (size_t i = 0; i < len; i++) block[i] = (uint8_t) next_rand();
+        memset(out, CANARY, GARBAGE_MAXLEN * 4 + CANARY_LEN);
+        lz4_decompress(block, len, out, raw_len);
+        if (!canary_intact(out, raw_len) && n_failed++ < 3)
+            printf("garbage run %d: wrote past the end\n", run);
+    }
+    free(out);
+    return n_failed;
+}
+
+static void bench(const uint8_t *const src, size_t n) {
+    size_t cap = lz4_compress_bound(n);
+    uint8_t *const packed = malloc(cap);
+    uint8_t *const out = malloc(n);
+    if (packed == NULL || out == NULL) exit(2);
+
+    size_t packed_len = 0;
+    clock_t start = clock();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+        packed_len = lz4_compress(src, n, packed, cap);
+    clock_t mid = clock();
+    bool ok = true;
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+        ok = lz4_decompress(packed, packed_len, out, n) && ok;
+    clock_t end = clock();
+
+    double mb = (double) n * BENCH_ROUNDS / (1024.0 * 1024.0);
+    printf("chat text: %zu bytes to %zu (%.2fx)%s\n", n, packed_len,
+            (double) n / packed_len, ok ? "" : ", NOT DECODED");
+    printf("compress   %8.1f MB/s\n",
+            mb / ((double) (mid - start) / CLOCKS_PER_SEC));
+    printf("decompress %8.1f MB/s\n",
+            mb / ((double) (end - mid) / CLOCKS_PER_SEC));
+    free(packed);
+    free(out);
+}
+
+static uint32_t next_rand(void) {
+    s_rand_state = s_rand_state * 1103515245u + 12345u;
+    return s_rand_state >> 16;
+}
+
+static size_t make_chat_text(uint8_t *const buf, size_t n) {
+    // Lines as the screenlog keeps them: a time, a nick and some words.
+    static const char *const NICKS[] = {
+        "alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi"
+    };
+    static const char *const WORDS[] = {
+        "the", "server", "is", "down", "again", "did", "you", "see", "that",
+        "build", "passed", "on", "my", "machine", "lol", "ok", "caf\xC3\xA9",
+        "\xE6\xBC\xA2\xE5\xAD\x97", "https://example.org/a/b?c=", "brb", "yes",
+        "no", "maybe", "tomorrow", "meeting", "at", "noon", "thanks"
+    };
+    static const size_t N_NICKS = sizeof(NICKS) / sizeof(NICKS[0]);
+    static const size_t N_WORDS = sizeof(WORDS) / sizeof(WORDS[0]);
+
+    size_t len = 0;
+    for (unsigned line = 0; ; line++) {
+        char text[512];
+        int text_len = snprintf(text, sizeof(text), "%02u:%02u <%s>",
+                line / 60 % 24, line % 60, NICKS[next_rand() % N_NICKS]);
+        int n_words = 2 + (int) (next_rand() % 14);
+        for (int i = 0; i < n_words; i++) {
+            text_len += snprintf(text + text_len, sizeof(text) - text_len,
+                    " %s", WORDS[next_rand() % N_WORDS]);
+            // A number here and there, as in links and times.
+            if (next_rand() % 8 == 0) {
+                text_len += snprintf(text + text_len,
+                        sizeof(text) - text_len, "%u", next_rand() % 1000);
+            }
+        }
+        text[text_len++] = '\n';
+        if (len + (size_t) text_len > n) break;
+        memcpy(buf + len, text, (size_t) text_len);
+        len += (size_t) text_len;
+    }
+    return len;
+}
@@ -0,0 +1,318 @@
+// Draws the UI without a terminal, to time it and to catch changes in what it
+// draws.
+//
+// Frames come from the client's own renderer (render.h) and go, instead of to
+// the console, into a vtgrid standing in for a terminal. Each scenario feeds
+// synthetic scrollback, scrolling or resizes and reports the time and bytes per
+// frame, and a hash of what the terminal showed after every frame. After each
+// frame, the terminal's cells are also checked against what the renderer
+// thinks they are, which catches frames that draw something other than
+// intended.
+//
+// Given a file of hashes, the scenarios' are checked against it, and written
+// to it if it doesn't exist yet, so a change that draws anything differently
+// fails the run. The hashes of the current renderer are kept next to this file;
+// a change that is meant to draw differently should update them:
+//      render_bench misc\render_bench.golden
+//
+// The content is generated the same way every run, and timestamps are drawn in
+// UTC, so the hashes don't depend on the machine. Build from the repo root with
+// every source but main.c:
+//      cl misc\render_bench.c src\coldstore.c src\fmtline.c src\framesched.c
+//          src\latency.c src\lebytes.c src\log.c src\logbin.c src\lz4block.c
+//          src\msgqueue.c src\msgutils.c src\nicktab.c src\render.c
+//          src\rowindex.c src\screen_framework.c src\scrrecord.c
+//          src\searchindex.c src\spillstore.c src\stringutils.c
+//          src\terminalutils.c src\termreply.c src\vtgrid.c src\vtstyle.c
+//          /I"include" /DWIN32_LEAN_AND_MEAN /O2
+#include "framesched.h"
+#include "log.h"
+#include "render.h"
+#include "screen_framework.h"
+#include "vtgrid.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ROWS 50
+#define BENCH_COLS 120
+// Lines in scrollback before the first scenario.
+#define BENCH_BACKLOG 500
+#define MSG_MAXLEN 512
+#define GOLDEN_LINE_MAXLEN 128
+
+typedef struct scenario_result {
+    const char *name;
+    int frames;
+    int64_t ns;
+    int64_t bytes;
+    // Frames after which the terminal didn't show what the renderer drew.
+    int mismatches;
+    // Of what the terminal showed after each frame.
+    uint64_t hash;
+} scenario_result;
+
+// Sizes cycled through by the resize scenario.
+static const int RESIZES[][2] = {
+    { 50, 120 }, { 40, 100 }, { 60, 160 }, { 24, 80 }, { 50, 120 }
+};
+#define N_RESIZES (sizeof(RESIZES) / sizeof(RESIZES[0]))
+
+static renderer s_renderer;
+// The stand-in for the terminal.
+static vtgrid s_term;
+static int s_rows = BENCH_ROWS;
+static int s_cols = BENCH_COLS;
+static uint32_t s_rand_state = 1;
+static int64_t s_msg_time = 1700000000;
+
+static scenario_result s_results[16];
+static int s_n_results = 0;
+
+// Draws a frame of the parts in 'dirty' and shows it on the terminal.
+static void frame(scenario_result *const res, uint32_t dirty);
+static scenario_result *begin_scenario(const char *name);
+
+// Adds a random line to the active screen, in the mix of formatting a busy
+// channel has.
+static void add_msg(void);
+static void type_char(char c);
+static uint32_t next_rand(void);
+static int64_t now_ns(void);
+
+// Checks the results against the hashes in 'path', or writes them there if
+// it doesn't exist. Returns the number of mismatches.
+static int check_golden(const char *path);
+
+int main(int argc, char *argv[]) {
+    log_init(stderr);
+    set_logger_level(LOGLEVEL_WARNING);
+
+    // TODO: platform-specific code
+    _putenv_s("TZ", "UTC");
+    _tzset();
+
+    renderer_init(&s_renderer);
+    s_renderer.grid.utf8 = true;
+    s_term.utf8 = true;
+
+    scrmgr_create_or_switch("#render-bench");
+    scrmgr_set_topic("#render-bench",
+            "\033[1mRender bench\033[0m: synthetic scrollback, "
+            "\033[38;5;214mcolours\033[0m and wide characters \xE6\xBC\xA2");
+    for (int i = 0; i < BENCH_BACKLOG; i++) add_msg();
+
+    scenario_result *res = begin_scenario("full repaint");
+    for (int i = 0; i < 100; i++) {
+        vtgrid_invalidate(&s_renderer.grid);
+        frame(res, FRAME_DIRTY_ALL);
+    }
+
+    res = begin_scenario("unchanged");
+    for (int i = 0; i < 1000; i++) frame(res, FRAME_DIRTY_ALL);
+
+    res = begin_scenario("1 msg/frame");
+    for (int i = 0; i < 500; i++) {
+        add_msg();
+        frame(res, FRAME_DIRTY_LOG);
+    }
+
+    res = begin_scenario("10 msg/frame");
+    for (int i = 0; i < 300; i++) {
+        for (int j = 0; j < 10; j++) add_msg();
+        frame(res, FRAME_DIRTY_LOG);
+    }
+
+    res = begin_scenario("typing");
+    const char *typed = "the quick brown fox jumps over the lazy dog, twice. ";
+    for (int i = 0; i < 150; i++) {
+        type_char(typed[i % strlen(typed)]);
+        frame(res, FRAME_DIRTY_INPUT);
+    }
+
+    res = begin_scenario("page up");
+    for (int i = 0; i < 50; i++) {
+        scrmgr_scroll_pages(1);
+        frame(res, FRAME_DIRTY_LOG);
+    }
+
+    res = begin_scenario("page down");
+    for (int i = 0; i < 50; i++) {
+        scrmgr_scroll_pages(-1);
+        frame(res, FRAME_DIRTY_LOG);
+    }
+
+    res = begin_scenario("resize");
+    for (int i = 0; i < 100; i++) {
+        s_rows = RESIZES[i % N_RESIZES][0];
+        s_cols = RESIZES[i % N_RESIZES][1];
+        frame(res, FRAME_DIRTY_ALL);
+    }
+
+    printf("%-14s %7s %10s %11s %10s  %-16s\n", "scenario", "frames",
+            "ns/frame", "bytes/frame", "mismatches", "hash");
+    int n_failed = 0;
+    for (int i = 0; i < s_n_results; i++) {
+        const scenario_result *const r = &s_results[i];
+        printf("%-14s %7d %10.0f %11.1f %10d  %016llx\n", r->name, r->frames,
+                (double) r->ns / r->frames, (double) r->bytes / r->frames,
+                r->mismatches, (unsigned long long) r->hash);
+        n_failed += r->mismatches;
+    }
+    if (argc > 1) n_failed += check_golden(argv[1]);
+
+    renderer_free(&s_renderer);
+    vtgrid_free(&s_term);
+    return n_failed == 0 ? 0 : 1;
+}
+
+static void frame(scenario_result *const res, uint32_t dirty) {
+    size_t len = 0;
+    int64_t start = now_ns();
+    const char *out = renderer_draw(&s_renderer, dirty, s_rows, s_cols, &len);
+    res->ns += now_ns() - start;
+    res->bytes += (int64_t) len;
+    res->frames++;
+
+    // A terminal keeps what it shows when resized until it's drawn over; the
+    // renderer repaints everything after a resize anyway.
+    if (s_term.rows != s_rows || s_term.cols != s_cols)
+        vtgrid_resize(&s_term, s_rows, s_cols);
+    vtgrid_write(&s_term, out, len);
+
+    size_t n_cells = (size_t) s_rows * s_cols;
+    if (memcmp(s_term.back, s_renderer.grid.front,
+                n_cells * sizeof(vtcell)) != 0)
+    {
+        if (res->mismatches++ == 0) {
+            printf("%s: frame %d shows something other than was drawn\n",
+                    res->name, res->frames);
+        }
+    }
+    res->hash = (res->hash ^ vtgrid_hash(&s_term)) * 1099511628211ull;
+}
+
+static scenario_result *begin_scenario(const char *name) {
+    if (s_n_results == sizeof(s_results) / sizeof(s_results[0])) {
+        printf("Too many scenarios.\n");
+        exit(23);
+    }
+    scenario_result *const res = &s_results[s_n_results++];
+    memset(res, 0, sizeof(*res));
+    res->name = name;
+    res->hash = 14695981039346656037ull;
+    return res;
+}
+
+static void add_msg(void) {
+    static const char *const WORDS[] = {
+        "the", "render", "frame", "scroll", "terminal", "cell", "grid",
+        "\xE6\xBC\xA2\xE5\xAD\x97", "caf\xC3\xA9", "\xF0\x9F\x8C\x90",
+        "buffer", "escape", "colour", "diff", "a", "of", "to", "and"
+    };
+    static const int N_WORDS = sizeof(WORDS) / sizeof(WORDS[0]);
+
+    char text[MSG_MAXLEN];
+    size_t len = 0;
+    int n_words = 1 + next_rand() % 24;
+    for (int i = 0; i < n_words && len < MSG_MAXLEN - 32; i++) {
+        const char *word = WORDS[next_rand() % N_WORDS];
+        // Some words in colour, bold or underlined, as IRC formats them.
+        uint32_t fmt = next_rand() % 10;
+        if (fmt == 0) {
+            len += sprintf_s(text + len, MSG_MAXLEN - len, "\x03%02u%s\x03",
+                    next_rand() % 16, word);
+        }
+        else if (fmt == 1) {
+            len += sprintf_s(text + len, MSG_MAXLEN - len, "\x02%s\x02", word);
+        }
+        else if (fmt == 2) {
+            len += sprintf_s(text + len, MSG_MAXLEN - len, "\x1F%s\x1F", word);
+        }
+        else {
+            len += sprintf_s(text + len, MSG_MAXLEN - len, "%s", word);
+        }
+        if (i + 1 < n_words) text[len++] = ' ';
+    }
+    text[len] = '\0';
+
+    char from[32];
+    sprintf_s(from, sizeof(from), "nick%u!~user@host", next_rand() % 40);
+    uint32_t kind = next_rand() % 10;
+    scrmgr_deliver_msg("#render-bench",
+            kind == 0 ? SCREEN_MSG_SERVER
+            : kind == 1 ? SCREEN_MSG_PRIVMSG_SELF : SCREEN_MSG_PRIVMSG,
+            s_msg_time, from, text);
+    s_msg_time += next_rand() % 3;
+}
+
+static void type_char(char c) {
+    screen_ui_state *const st = scrmgr_get_active_ui_state();
+    if (st->i_inputbuf + 1 >= UI_INPUT_BUF_SIZE) st->i_inputbuf = 0;
+    st->inputbuf[st->i_inputbuf++] = c;
+    st->inputbuf[st->i_inputbuf] = '\0';
+}
+
+static uint32_t next_rand(void) {
+    // Not rand(), which differs between C runtimes.
+    s_rand_state = s_rand_state * 1103515245u + 12345u;
+    return s_rand_state >> 16;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int check_golden(const char *path) {
+    FILE *f = NULL;
+    if (fopen_s(&f, path, "r") != 0 || f == NULL) {
+        if (fopen_s(&f, path, "w") != 0 || f == NULL) {
+            printf("Can't open '%s' for write.\n", path);
+            return 1;
+        }
+        for (int i = 0; i < s_n_results; i++) {
+            fprintf(f, "%016llx %s\n",
+                    (unsigned long long) s_results[i].hash,
+                    s_results[i].name);
+        }
+        fclose(f);
+        printf("\nWrote hashes to '%s'.\n", path);
+        return 0;
+    }
+
+    int n_failed = 0;
+    int n_checked = 0;
+    char line[GOLDEN_LINE_MAXLEN];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strlen(line) < 18) continue;
+        unsigned long long want = strtoull(line, NULL, 16);
+        const char *name = line + 17;
+
+        bool found = false;
+        for (int i = 0; i < s_n_results; i++) {
+            if (strcmp(s_results[i].name, name) != 0) continue;
+            found = true;
+            n_checked++;
+            if (s_results[i].hash != want) {
+                printf("%s: hash %016llx, want %016llx\n", name,
+                        (unsigned long long) s_results[i].hash, want);
+                n_failed++;
+            }
+        }
+        if (!found) {
+            printf("%s: no such scenario\n", name);
+            n_failed++;
+        }
+    }
+    fclose(f);
+    printf("\nChecked %d hashes against '%s': %d differ.\n", n_checked, path,
+            n_failed);
+    return n_failed;
+}
@@ -0,0 +1,310 @@
+// Feeds a capture of what a server sent (see capture.h; start the client with
+// a capture file to make one) back through the client, with no network and no
+// terminal, to reproduce what it did and time it:
+//      replay athena.cap
+// Chunks go through the same framing, parsing, handling and screens the client
+// uses, and frames are drawn when the frame scheduler says, into a vtgrid
+// standing in for the terminal. By default chunks are fed as fast as they're
+// handled; with -r, at the pace they were recorded, which also reports how
+// long each chunk took from when it arrived until it was handled and, if a
+// frame was due, drawn:
+//      replay -r athena.cap 50 120
+//
+// Replays are deterministic: the scheduler and the messages' timestamps go by
+// the capture's clock, not the wall clock, and timestamps are drawn in UTC, so
+// the same capture always ends with the same screen hash. Each chunk's
+// messages are parsed and then handled as a batch, rather than one at a time
+// as the client does, to keep clock reads out of the stages' times.
+//
+// Build from the repo root with every source but main.c:
+//      cl misc\replay.c src\capture.c src\coldstore.c src\fmtline.c
+//          src\framesched.c src\handlers.c src\latency.c src\lebytes.c
+//          src\log.c src\logbin.c src\lz4block.c src\msgqueue.c
+//          src\msgutils.c src\nicktab.c src\render.c src\rowindex.c
+//          src\screen_framework.c src\scrrecord.c src\searchindex.c
+//          src\spillstore.c src\stringutils.c src\terminalutils.c
+//          src\termreply.c src\vtgrid.c src\vtstyle.c ws2_32.lib /I"include"
+//          /DWIN32_LEAN_AND_MEAN /O2
+#include "capture.h"
+#include "framesched.h"
+#include "handlers.h"
+#include "log.h"
+#include "msgqueue.h"
+#include "msgutils.h"
+#include "render.h"
+#include "vtgrid.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// TODO: platform-specific code
+#include <windows.h>
+
+#define DEFAULT_ROWS 50
+#define DEFAULT_COLS 120
+// Room for a chunk and the partial message left over from the one before.
+#define FRAME_BUF_LEN (CAPTURE_CHUNK_MAXLEN * 2)
+
+typedef enum stage {
+    STAGE_FRAMING,
+    STAGE_PARSING,
+    STAGE_HANDLING,
+    STAGE_COMPOSING,
+    STAGE_PRESENTING,
+    N_STAGES
+} stage;
+
+static const char *const STAGE_NAMES[N_STAGES] = {
+    "framing", "parsing", "handling", "composing", "presenting"
+};
+
+static renderer s_renderer;
+// The stand-in for the terminal.
+static vtgrid s_term;
+static int s_rows = DEFAULT_ROWS;
+static int s_cols = DEFAULT_COLS;
+
+static int64_t s_stage_ns[N_STAGES];
+static uint64_t s_n_msgs = 0;
+static uint64_t s_n_unparsed = 0;
+static uint64_t s_n_frames = 0;
+static uint64_t s_frame_bytes = 0;
+
+// A chunk's messages, parsed.
+static ircmsg **s_parsed = NULL;
+static size_t s_parsed_cap = 0;
+
+// Frames, parses and handles one chunk. 'ts' is when it arrived, in seconds
+// since the epoch.
+static void replay_chunk(char *const frame_buf, int *const frame_len,
+        const capture_chunk *const chunk, int64_t ts);
+// Draws a frame if the scheduler says one is due at 'now_us'.
+static void maybe_draw(uint64_t now_us);
+static void reserve_parsed(size_t n);
+static int64_t now_ns(void);
+// Waits until 'until_ns' (see now_ns()).
+static void wait_until(int64_t until_ns);
+
+int main(int argc, char *argv[]) {
+    log_init(stderr);
+    set_logger_level(LOGLEVEL_WARNING);
+
+    int i_arg = 1;
+    bool recorded_speed = argc > i_arg && strcmp(argv[i_arg], "-r") == 0;
+    if (recorded_speed) i_arg++;
+    if (argc <= i_arg) {
+        log(LOGLEVEL_ERROR, "Usage: replay [-r] <capture> [rows] [cols]");
+        return 23;
+    }
+    const char *const path = argv[i_arg++];
+    if (argc > i_arg) s_rows = atoi(argv[i_arg++]);
+    if (argc > i_arg) s_cols = atoi(argv[i_arg++]);
+    if (s_rows < 3 || s_cols < 10) {
+        log(LOGLEVEL_ERROR, "The terminal needs at least 3 rows and 10 "
+                "columns.");
+        return 23;
+    }
+
+    FILE *in = NULL;
+    if (fopen_s(&in, path, "rb") != 0 || in == NULL) {
+        log_fmt(LOGLEVEL_ERROR, "Can't open '%s'.", path);
+        return 23;
+    }
+    capture_header header;
+    if (!capture_read_header(in, &header) || header.ticks_per_s <= 0) {
+        log_fmt(LOGLEVEL_ERROR, "'%s' isn't a capture.", path);
+        fclose(in);
+        return 23;
+    }
+
+    _putenv_s("TZ", "UTC");
+    _tzset();
+    init_msg_queues();
+    renderer_init(&s_renderer);
+    s_renderer.grid.utf8 = true;
+    s_term.utf8 = true;
+    vtgrid_resize(&s_term, s_rows, s_cols);
+
+    static char chunk_buf[CAPTURE_CHUNK_MAXLEN];
+    static char frame_buf[FRAME_BUF_LEN];
+    int frame_len = 0;
+    capture_chunk chunk;
+    uint64_t n_chunks = 0;
+    uint64_t n_bytes = 0;
+    int64_t recorded_ns = 0;
+    // From when a chunk arrived until it was handled and drawn, at recorded
+    // speed.
+    int64_t total_lag_ns = 0;
+    int64_t max_lag_ns = 0;
+
+    int64_t start = now_ns();
+    int result;
+    while ((result = capture_read(in, &chunk, chunk_buf, sizeof(chunk_buf)))
+           > 0)
+    {
+        // The capture's clock, in ns since it started.
+        int64_t at_ns = (int64_t) ((double) chunk.ticks * 1e9
+                / (double) header.ticks_per_s);
+        if (recorded_speed) wait_until(start + at_ns);
+
+        replay_chunk(frame_buf, &frame_len, &chunk,
+                header.start_time + at_ns / 1000000000);
+        maybe_draw((uint64_t) (at_ns / 1000));
+
+        if (recorded_speed) {
+            int64_t lag = now_ns() - (start + at_ns);
+            total_lag_ns += lag;
+            if (lag > max_lag_ns) max_lag_ns = lag;
+        }
+        recorded_ns = at_ns;
+        n_chunks++;
+        n_bytes += chunk.len;
+    }
+    // Whatever's still waiting on the frame cap.
+    maybe_draw((uint64_t) (recorded_ns / 1000) + 1000000);
+    int64_t elapsed = now_ns() - start;
+    fclose(in);
+
+    if (result < 0) {
+        log_fmt(LOGLEVEL_WARNING, "The capture is cut short or corrupt after "
+                "chunk %llu.", (unsigned long long) n_chunks);
+    }
+
+    double secs = (double) elapsed / 1e9;
+    printf("%llu chunks, %llu bytes, %llu messages (%llu unparsable), "
+            "%llu frames\n", (unsigned long long) n_chunks,
+            (unsigned long long) n_bytes, (unsigned long long) s_n_msgs,
+            (unsigned long long) s_n_unparsed,
+            (unsigned long long) s_n_frames);
+    printf("Recorded over %.3f s, replayed in %.3f s: %.0f msgs/s, "
+            "%.2f MB/s\n", (double) recorded_ns / 1e9, secs,
+            (double) s_n_msgs / secs, (double) n_bytes / secs / 1e6);
+    if (recorded_speed && n_chunks > 0) {
+        printf("Chunk arrival to handled: %.3f ms mean, %.3f ms max\n",
+                (double) total_lag_ns / (double) n_chunks / 1e6,
+                (double) max_lag_ns / 1e6);
+    }
+
+    int64_t total_ns = 0;
+    for (int i = 0; i < N_STAGES; i++) total_ns += s_stage_ns[i];
+    printf("\n%-11s %10s %6s %12s\n", "stage", "ms", "share", "per");
+    for (int i = 0; i < N_STAGES; i++) {
+        bool per_frame = i == STAGE_COMPOSING || i == STAGE_PRESENTING;
+        uint64_t n = per_frame ? s_n_frames : s_n_msgs;
+        printf("%-11s %10.3f %5.1f%% %9.0f ns/%s\n", STAGE_NAMES[i],
+                (double) s_stage_ns[i] / 1e6,
+                total_ns > 0 ? 100.0 * s_stage_ns[i] / total_ns : 0.0,
+                n > 0 ? (double) s_stage_ns[i] / n : 0.0,
+                per_frame ? "frame" : "msg");
+    }
+    printf("%.1f bytes/frame written\n", s_n_frames > 0
+            ? (double) s_frame_bytes / s_n_frames : 0.0);
+    printf("\nScreen hash: %016llx\n",
+            (unsigned long long) vtgrid_hash(&s_term));
+
+    free(s_parsed);
+    renderer_free(&s_renderer);
+    vtgrid_free(&s_term);
+    return result < 0 ? 1 : 0;
+}
+
+static void replay_chunk(char *const frame_buf, int *const frame_len,
+        const capture_chunk *const chunk, int64_t ts)
+{
+    if (*frame_len + chunk->len >= FRAME_BUF_LEN) {
+        log(LOGLEVEL_ERROR, "[replay] A message is longer than any the "
+                "client can receive; dropping what's been received.");
+        *frame_len = 0;
+    }
+
+    // As the receiving thread hands messages to the main loop.
+    int64_t t0 = now_ns();
+    memcpy(frame_buf + *frame_len, chunk->data, chunk->len);
+    *frame_len += (int) chunk->len;
+    msglist msgs = { .head = NULL, .tail = NULL, .count = 0 };
+    msgutils_frame_msgs(frame_buf, frame_len, &msgs);
+    if (msgs.count > 0) msglist_submit(QUEUE_IN, &msgs);
+    msglist msgs_in = msg_queue_takeall(QUEUE_IN);
+
+    int64_t t1 = now_ns();
+    reserve_parsed((size_t) msgs_in.count);
+    size_t n_parsed = 0;
+    for (struct msgnode *node = msgs_in.head; node != NULL;
+            node = node->next)
+    {
+        ircmsg *const ircm = msgutils_ircmsg_parse(node->msg);
+        if (ircm != NULL) s_parsed[n_parsed++] = ircm;
+    }
+
+    int64_t t2 = now_ns();
+    for (size_t i = 0; i < n_parsed; i++) {
+        handle_ircmsg(s_parsed[i], ts);
+        msgutils_ircmsg_free(s_parsed[i]);
+    }
+    int64_t t3 = now_ns();
+
+    // Answers, such as PONGs, have nowhere to go.
+    msglist msgs_out = msg_queue_takeall(QUEUE_OUT);
+    msglist_free(&msgs_out);
+
+    s_stage_ns[STAGE_FRAMING] += t1 - t0;
+    s_stage_ns[STAGE_PARSING] += t2 - t1;
+    s_stage_ns[STAGE_HANDLING] += t3 - t2;
+    s_n_msgs += (uint64_t) msgs_in.count;
+    s_n_unparsed += (uint64_t) msgs_in.count - n_parsed;
+    msglist_free(&msgs_in);
+}
+
+static void maybe_draw(uint64_t now_us) {
+    uint32_t dirty = framesched_take(now_us);
+    if (dirty == 0) return;
+
+    int64_t t0 = now_ns();
+    renderer_compose(&s_renderer, dirty, s_rows, s_cols,
+            &s_renderer.snapshot);
+    int64_t t1 = now_ns();
+    size_t len = 0;
+    const char *out = render_present(&s_renderer.grid, &s_renderer.snapshot,
+            &len);
+    int64_t t2 = now_ns();
+
+    vtgrid_write(&s_term, out, len);
+    framesched_frame_done(len > 0 ? FRAME_WRITTEN : FRAME_UNCHANGED);
+    s_stage_ns[STAGE_COMPOSING] += t1 - t0;
+    s_stage_ns[STAGE_PRESENTING] += t2 - t1;
+    s_frame_bytes += len;
+    s_n_frames++;
+}
+
+static void reserve_parsed(size_t n) {
+    if (n <= s_parsed_cap) return;
+    size_t cap = s_parsed_cap == 0 ? 256 : s_parsed_cap;
+    while (cap < n) cap *= 2;
+    ircmsg **parsed = realloc(s_parsed, cap * sizeof(*parsed));
+    if (parsed == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[replay] FATAL: out of memory.");
+        exit(23);
+    }
+    s_parsed = parsed;
+    s_parsed_cap = cap;
+}
+
+static int64_t now_ns(void) {
+    // TODO: platform-specific code
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (int64_t) ((double) now.QuadPart * 1e9 / (double) freq.QuadPart);
+}
+
+static void wait_until(int64_t until_ns) {
+    int64_t left = until_ns - now_ns();
+    // Sleep() is only good to a millisecond or so; spin the rest.
+    if (left > 2000000) Sleep((DWORD) ((left - 1000000) / 1000000));
+    while (now_ns() < until_ns) continue;
+}
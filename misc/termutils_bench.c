@@ -0,0 +1,245 @@
+// Checks and times the terminalutils "_buf" helpers.
+//
+// Every helper is checked against the escape it's documented to write, for
+// every value it takes (and, for the 256-colour ones, some it doesn't) and
+// every buffer size from 0 up to past the longest sequence: same return value,
+// same bytes (null term included), and nothing written past them. Then each
+// is timed writing into a buffer with room.
+//
+// Build from the repo root, without TERMUTILS_DEBUG_ASSERT, since too small
+// buffers are tested on purpose:
+//      cl misc\termutils_bench.c src\terminalutils.c /I"include" /O2
+#include "terminalutils.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Buffer sizes tried, from 0 up to this.
+#define MAX_TESTED_LEN 16
+#define BENCH_ITERATIONS 20000000
+#define CANARY '\x7F'
+
+typedef size_t (*helper_fn)(char *const buf, size_t maxlen, int arg);
+
+typedef struct helper {
+    const char *name;
+    helper_fn fn;
+    // Values of 'arg' the helper takes: [0, n_args).
+    int n_args;
+    // Writes the escape the helper should write for 'arg' to 'buf'.
+    void (*expect)(char *const buf, size_t bufsize, int arg);
+} helper;
+
+static size_t bold(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_bold_buf(buf, maxlen, arg != 0);
+}
+static size_t faint(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_faint_buf(buf, maxlen, arg != 0);
+}
+static size_t italic(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_italic_buf(buf, maxlen, arg != 0);
+}
+static size_t underline(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_underline_buf(buf, maxlen, arg != 0);
+}
+static size_t blinking(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_blinking_buf(buf, maxlen, arg != 0);
+}
+static size_t inverse(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_inverse_buf(buf, maxlen, arg != 0);
+}
+static size_t hidden(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_hidden_buf(buf, maxlen, arg != 0);
+}
+static size_t striketh(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_striketh_buf(buf, maxlen, arg != 0);
+}
+static size_t text_color(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_text_color_buf(buf, maxlen, (termutils_color) arg);
+}
+static size_t bg_color(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_bg_color_buf(buf, maxlen, (termutils_color) arg);
+}
+static size_t text_color_256(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_text_color_256_buf(buf, maxlen, arg);
+}
+static size_t bg_color_256(char *const buf, size_t maxlen, int arg) {
+    return termutils_set_bg_color_256_buf(buf, maxlen, arg);
+}
+static size_t reset_text_color(char *const buf, size_t maxlen, int arg) {
+    (void) arg;
+    return termutils_reset_text_color_buf(buf, maxlen);
+}
+static size_t reset_bg_color(char *const buf, size_t maxlen, int arg) {
+    (void) arg;
+    return termutils_reset_bg_color_buf(buf, maxlen);
+}
+static size_t reset_all(char *const buf, size_t maxlen, int arg) {
+    (void) arg;
+    return termutils_reset_all_buf(buf, maxlen);
+}
+static size_t reset_cursor_color(char *const buf, size_t maxlen, int arg) {
+    (void) arg;
+    return termutils_reset_cursor_color_buf(buf, maxlen);
+}
+
+// The SGR parameter for turning a mode on ('arg' 1) or off ('arg' 0).
+static void expect_mode(char *const buf, size_t bufsize, int on, int off,
+        int arg)
+{
+    sprintf_s(buf, bufsize, "\033[%dm", arg ? on : off);
+}
+static void expect_bold(char *const buf, size_t bufsize, int arg) {
+    expect_mode(buf, bufsize, 1, 22, arg);
+}
+static void expect_faint(char *const buf, size_t bufsize, int arg) {
+    expect_mode(buf, bufsize, 2, 22, arg);
+}
+static void expect_italic(char *const buf, size_t bufsize, int arg) {
+    expect_mode(buf, bufsize, 3, 23, arg);
+}
+static void expect_underline(char *const buf, size_t bufsize, int arg) {
+    expect_mode(buf, bufsize, 4, 24, arg);
+}
+static void expect_blinking(char *const buf, size_t bufsize, int arg) {
+    expect_mode(buf, bufsize, 5, 25, arg);
+}
+static void expect_inverse(char *const buf, size_t bufsize, int arg) {
+    expect_mode(buf, bufsize, 7, 27, arg);
+}
+static void expect_hidden(char *const buf, size_t bufsize, int arg) {
+    expect_mode(buf, bufsize, 8, 28, arg);
+}
+static void expect_striketh(char *const buf, size_t bufsize, int arg) {
+    expect_mode(buf, bufsize, 9, 29, arg);
+}
+
+// 30-37, then 90-97 for the bright colours, then 39 for the default; the
+// background's are 10 more.
+static void expect_basic_color(char *const buf, size_t bufsize, int base,
+        int arg)
+{
+    int code = arg == TERMUTILS_COLOR_DEFAULT ? 9
+        : arg < 8 ? arg : 60 + arg - 8;
+    sprintf_s(buf, bufsize, "\033[%dm", base + code);
+}
+static void expect_text_color(char *const buf, size_t bufsize, int arg) {
+    expect_basic_color(buf, bufsize, 30, arg);
+}
+static void expect_bg_color(char *const buf, size_t bufsize, int arg) {
+    expect_basic_color(buf, bufsize, 40, arg);
+}
+static void expect_text_color_256(char *const buf, size_t bufsize, int arg) {
+    sprintf_s(buf, bufsize, "\033[38;5;%dm", arg);
+}
+static void expect_bg_color_256(char *const buf, size_t bufsize, int arg) {
+    sprintf_s(buf, bufsize, "\033[48;5;%dm", arg);
+}
+static void expect_reset_text_color(char *const buf, size_t bufsize, int arg) {
+    (void) arg;
+    strcpy_s(buf, bufsize, "\033[39m");
+}
+static void expect_reset_bg_color(char *const buf, size_t bufsize, int arg) {
+    (void) arg;
+    strcpy_s(buf, bufsize, "\033[49m");
+}
+static void expect_reset_all(char *const buf, size_t bufsize, int arg) {
+    (void) arg;
+    strcpy_s(buf, bufsize, "\033[0m");
+}
+static void expect_reset_cursor_color(char *const buf, size_t bufsize,
+        int arg)
+{
+    (void) arg;
+    strcpy_s(buf, bufsize, "\x1b]112\x07");
+}
+
+static const helper HELPERS[] = {
+    { "set_bold_buf", bold, 2, expect_bold },
+    { "set_faint_buf", faint, 2, expect_faint },
+    { "set_italic_buf", italic, 2, expect_italic },
+    { "set_underline_buf", underline, 2, expect_underline },
+    { "set_blinking_buf", blinking, 2, expect_blinking },
+    { "set_inverse_buf", inverse, 2, expect_inverse },
+    { "set_hidden_buf", hidden, 2, expect_hidden },
+    { "set_striketh_buf", striketh, 2, expect_striketh },
+    { "set_text_color_buf", text_color, TERMUTILS_COLOR_DEFAULT + 1,
+        expect_text_color },
+    { "set_bg_color_buf", bg_color, TERMUTILS_COLOR_DEFAULT + 1,
+        expect_bg_color },
+    { "set_text_color_256_buf", text_color_256, 256, expect_text_color_256 },
+    { "set_bg_color_256_buf", bg_color_256, 256, expect_bg_color_256 },
+    { "reset_text_color_buf", reset_text_color, 1, expect_reset_text_color },
+    { "reset_bg_color_buf", reset_bg_color, 1, expect_reset_bg_color },
+    { "reset_all_buf", reset_all, 1, expect_reset_all },
+    { "reset_cursor_color_buf", reset_cursor_color, 1,
+        expect_reset_cursor_color },
+};
+#define N_HELPERS (sizeof(HELPERS) / sizeof(HELPERS[0]))
+
+// Returns the number of mismatches, printing the first few.
+static int check(const helper *const h);
+static double bench(const helper *const h);
+
+int main(void) {
+    int n_failed = 0;
+    for (size_t i = 0; i < N_HELPERS; i++) n_failed += check(&HELPERS[i]);
+    printf("%d mismatches\n\n", n_failed);
+
+    printf("%-24s %8s\n", "helper", "ns/call");
+    for (size_t i = 0; i < N_HELPERS; i++) {
+        printf("%-24s %8.2f\n", HELPERS[i].name, bench(&HELPERS[i]));
+    }
+    return n_failed == 0 ? 0 : 1;
+}
+
+static int check(const helper *const h) {
+    // The 256-colour helpers print any other index as it is, as long as it
+    // fits their longest sequence.
+    bool is_256 = h->fn == text_color_256 || h->fn == bg_color_256;
+    int first_arg = is_256 ? -99 : 0;
+    int end_arg = is_256 ? 1000 : h->n_args;
+
+    int n_failed = 0;
+    for (int arg = first_arg; arg < end_arg; arg++) {
+        char want[MAX_TESTED_LEN + 1];
+        h->expect(want, sizeof(want), arg);
+        size_t want_len = strlen(want);
+
+        for (size_t maxlen = 0; maxlen <= MAX_TESTED_LEN; maxlen++) {
+            char got[MAX_TESTED_LEN + 2];
+            memset(got, CANARY, sizeof(got));
+            size_t len = h->fn(got, maxlen, arg);
+
+            // The 256-colour helpers want room for their longest sequence
+            // whatever the colour.
+            bool fits = (!is_256 || maxlen > 11) && want_len < maxlen;
+            size_t n_cmp = fits ? want_len + 1 : 0;
+            bool ok = len == (fits ? want_len : 0) &&
+                memcmp(got, want, n_cmp) == 0;
+            for (size_t i = n_cmp; i < sizeof(got); i++)
+                ok = ok && got[i] == CANARY;
+
+            if (!ok && n_failed++ < 3) {
+                printf("%s(%d) maxlen %zu: returned %zu, want %zu\n",
+                        h->name, arg, maxlen, len, fits ? want_len : 0);
+            }
+        }
+    }
+    return n_failed;
+}
+
+static double bench(const helper *const h) {
+    // Summing the lengths keeps the calls from being optimized out.
+    char buf[64];
+    size_t total = 0;
+    clock_t start = clock();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+        total += h->fn(buf, sizeof(buf), i % h->n_args);
+    clock_t end = clock();
+
+    if (total == 0) printf("(nothing written)\n");
+    return (double) (end - start) / CLOCKS_PER_SEC * 1e9 / BENCH_ITERATIONS;
+}
@@ -0,0 +1,124 @@
+#define LOG_MODULE LOGMODULE_RECV
+
+#include "capture.h"
+
+#include "lebytes.h"
+#include "log.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// TODO: platform-specific code
+#include <windows.h>
+
+// Bytes before a chunk's data: its timestamp and length.
+#define CHUNK_HEAD_LEN 12
+
+// Chunks are written through a buffer this big, and flushed at most this
+// often, so the receive thread doesn't wait on the disk for each recv().
+#define CAPTURE_BUF_SIZE (256 * 1024)
+#define CAPTURE_FLUSH_INTERVAL_MS 1000
+
+static FILE *s_out = NULL;
+// When the capture started and was last flushed (QueryPerformanceCounter()),
+// and its ticks per second.
+static int64_t s_start_ticks = 0;
+static int64_t s_flush_ticks = 0;
+static int64_t s_ticks_per_s = 0;
+
+bool capture_start(const char *const path) {
+    assert(path != NULL);
+    assert(s_out == NULL);
+
+    if (fopen_s(&s_out, path, "wb") != 0 || s_out == NULL) {
+        log_fmt(LOGLEVEL_ERROR, "[capture] Can't open '%s' for write.", path);
+        s_out = NULL;
+        return false;
+    }
+
+    // Failing leaves stdio's own buffer, which only writes more often.
+    setvbuf(s_out, NULL, _IOFBF, CAPTURE_BUF_SIZE);
+
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    s_start_ticks = now.QuadPart;
+    s_flush_ticks = now.QuadPart;
+    s_ticks_per_s = freq.QuadPart;
+
+    char buf[CAPTURE_MAGIC_LEN + 16];
+    memcpy(buf, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN);
+    lebytes_put_u64(buf + CAPTURE_MAGIC_LEN, (uint64_t) freq.QuadPart);
+    lebytes_put_u64(buf + CAPTURE_MAGIC_LEN + 8, (uint64_t) time(NULL));
+    fwrite(buf, 1, sizeof(buf), s_out);
+    fflush(s_out);
+    log_fmt(LOGLEVEL_INFO, "[capture] Capturing what the server sends to "
+            "'%s'.", path);
+    return true;
+}
+
+void capture_chunk_received(const char *const data, size_t len) {
+    if (s_out == NULL) return;
+    assert(data != NULL);
+    assert(len <= CAPTURE_CHUNK_MAXLEN);
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+
+    char head[CHUNK_HEAD_LEN];
+    lebytes_put_u64(head, (uint64_t) (now.QuadPart - s_start_ticks));
+    lebytes_put_u32(head + 8, (uint32_t) len);
+    fwrite(head, 1, sizeof(head), s_out);
+    fwrite(data, 1, len, s_out);
+    // What was received up to a moment ago survives the client being killed,
+    // which is when a capture is most wanted.
+    if ((now.QuadPart - s_flush_ticks) * 1000 >=
+        s_ticks_per_s * CAPTURE_FLUSH_INTERVAL_MS)
+    {
+        fflush(s_out);
+        s_flush_ticks = now.QuadPart;
+    }
+}
+
+void capture_stop(void) {
+    if (s_out == NULL) return;
+    fclose(s_out);
+    s_out = NULL;
+}
+
+bool capture_read_header(FILE *const in, capture_header *const h) {
+    assert(in != NULL);
+    assert(h != NULL);
+
+    char buf[CAPTURE_MAGIC_LEN + 16];
+    if (!lebytes_read_exact(in, buf, sizeof(buf)) ||
+        memcmp(buf, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0)
+    {
+        return false;
+    }
+    h->ticks_per_s = (int64_t) lebytes_get_u64(buf + CAPTURE_MAGIC_LEN);
+    h->start_time = (int64_t) lebytes_get_u64(buf + CAPTURE_MAGIC_LEN + 8);
+    return true;
+}
+
+int capture_read(FILE *const in, capture_chunk *const chunk, char *const buf,
+        size_t bufsize)
+{
+    assert(in != NULL);
+    assert(chunk != NULL);
+    assert(buf != NULL);
+
+    char head[CHUNK_HEAD_LEN];
+    size_t n = fread(head, 1, sizeof(head), in);
+    if (n == 0 && feof(in)) return 0;
+    if (n != sizeof(head)) return -1;
+
+    chunk->ticks = (int64_t) lebytes_get_u64(head);
+    chunk->len = lebytes_get_u32(head + 8);
+    if (chunk->len > bufsize || !lebytes_read_exact(in, buf, chunk->len))
+        return -1;
+    chunk->data = buf;
+    return 1;
+}
@@ -0,0 +1,503 @@
+#define LOG_MODULE LOGMODULE_SCREEN
+
+#include "coldstore.h"
+
+#include "fmtline.h"
+#include "log.h"
+#include "lz4block.h"
+#include "nicktab.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COLDSTORE_INITIAL_BLOCKS 16
+
+// How a record is laid out in a block: this header, then its fmtline, padded
+// so the next header is 8-byte aligned. Decompressed blocks are used in place,
+// so the fmtlines must stay aligned.
+typedef struct cold_rec_hdr {
+    int64_t ts;
+    uint32_t nick;
+    uint8_t kind;
+    uint8_t pad[3];
+} cold_rec_hdr;
+
+typedef struct cold_cache_entry {
+    // 0 if the entry is unused.
+    uint64_t block_id;
+    uint8_t *raw;
+    size_t raw_cap;
+    scrrec *recs;
+    size_t recs_cap;
+    size_t n;
+    uint64_t last_used;
+} cold_cache_entry;
+
+static cold_cache_entry s_cache[COLD_CACHE_BLOCKS];
+static uint64_t s_cache_clock = 0;
+static uint64_t s_next_block_id = 1;
+
+// Scratch space for packing and compressing a block being sealed.
+static uint8_t *s_packbuf = NULL;
+static size_t s_packbuf_size = 0;
+static uint8_t *s_compbuf = NULL;
+static size_t s_compbuf_size = 0;
+static uint8_t *s_widthbuf = NULL;
+static size_t s_widthbuf_size = 0;
+static uint8_t *s_nickbuf = NULL;
+static size_t s_nickbuf_size = 0;
+
+static size_t rec_size(const scrrec *const rec);
+
+// Returns the block's records through the cache, or NULL if it's corrupt.
+static const scrrec *load_block(const cold_block *const b);
+
+// Splits a decompressed block into records pointing into it.
+static bool parse_block(const cold_block *const b,
+        cold_cache_entry *const entry);
+
+static void uncache_block(uint64_t id);
+
+// Encodes the widths of 'n' records into a new allocation.
+static uint8_t *encode_widths(const scrrec *const recs, size_t n,
+        uint32_t *const len);
+static size_t read_width(const uint8_t *const widths, size_t *const pos);
+
+// Collects the nicks of 'n' records, each once with how many refer to it,
+// into a new allocation.
+static cold_nick_ref *collect_nicks(const scrrec *const recs, size_t n,
+        uint32_t *const n_nicks);
+static int compare_nick_ids(const void *a, const void *b);
+
+static int64_t rows_for(size_t width, int cols);
+static int64_t block_rows(cold_block *const b, int cols);
+
+// Returns the live block holding 'seq', or NULL.
+static cold_block *find_block(coldstore *const cs, uint32_t seq);
+
+static int64_t block_bytes(const cold_block *const b);
+
+static void *realloc_or_die(void *ptr, size_t size);
+static void grow_scratch(uint8_t **const buf, size_t *const size,
+        size_t needed);
+
+void cold_free(coldstore *const cs) {
+    assert(cs != NULL);
+    while (cs->first < cs->end) cold_drop_front(cs);
+    free(cs->blocks);
+    memset(cs, 0, sizeof(*cs));
+}
+
+size_t cold_count_blocks(const coldstore *const cs) {
+    assert(cs->end >= cs->first);
+    return cs->end - cs->first;
+}
+
+void cold_seal(coldstore *const cs, uint32_t first_seq,
+        const scrrec *const recs, size_t n)
+{
+    assert(cs != NULL);
+    assert(recs != NULL);
+    assert(n > 0);
+    assert(cs->first == cs->end ||
+           cs->blocks[cs->end - 1].first_seq +
+           cs->blocks[cs->end - 1].n_lines == first_seq);
+
+    size_t raw_len = 0;
+    for (size_t i = 0; i < n; i++) raw_len += rec_size(&recs[i]);
+    assert(raw_len <= UINT32_MAX);
+
+    grow_scratch(&s_packbuf, &s_packbuf_size, raw_len);
+    size_t off = 0;
+    for (size_t i = 0; i < n; i++) {
+        cold_rec_hdr hdr = { 0 };
+        hdr.ts = recs[i].ts;
+        hdr.nick = recs[i].nick;
+        hdr.kind = recs[i].kind;
+        memcpy(s_packbuf + off, &hdr, sizeof(hdr));
+
+        size_t size = rec_size(&recs[i]), body = fmtline_size(recs[i].body);
+        memcpy(s_packbuf + off + sizeof(hdr), recs[i].body, body);
+        memset(s_packbuf + off + sizeof(hdr) + body, 0,
+                size - sizeof(hdr) - body);
+        off += size;
+    }
+    assert(off == raw_len);
+
+    grow_scratch(&s_compbuf, &s_compbuf_size, lz4_compress_bound(raw_len));
+    size_t comp_len =
+        lz4_compress(s_packbuf, raw_len, s_compbuf, s_compbuf_size);
+
+    if (cs->end == cs->cap) {
+        if (cs->first > 0) {
+            memmove(cs->blocks, cs->blocks + cs->first,
+                    (cs->end - cs->first) * sizeof(*cs->blocks));
+            cs->end -= cs->first;
+            cs->first = 0;
+        }
+        else {
+            size_t new_cap =
+                cs->cap == 0 ? COLDSTORE_INITIAL_BLOCKS : cs->cap * 2;
+            cs->blocks = (cold_block *) realloc_or_die(
+                    cs->blocks, new_cap * sizeof(*cs->blocks));
+            cs->cap = new_cap;
+        }
+    }
+
+    cold_block *const b = &cs->blocks[cs->end++];
+    memset(b, 0, sizeof(*b));
+    b->compressed = comp_len > 0 && comp_len < raw_len;
+    b->data_len = (uint32_t) (b->compressed ? comp_len : raw_len);
+    b->data = (uint8_t *) realloc_or_die(NULL, b->data_len);
+    memcpy(b->data, b->compressed ? s_compbuf : s_packbuf, b->data_len);
+    b->raw_len = (uint32_t) raw_len;
+    b->first_seq = first_seq;
+    b->n_lines = (uint32_t) n;
+    b->widths = encode_widths(recs, n, &b->widths_len);
+    b->nicks = collect_nicks(recs, n, &b->n_nicks);
+    b->id = s_next_block_id++;
+
+    cs->n_lines += (uint32_t) n;
+    cs->bytes += block_bytes(b);
+    cs->raw_bytes += raw_len;
+    if (cs->total_cols > 0) cs->total_rows += block_rows(b, cs->total_cols);
+
+    for (size_t i = 0; i < n; i++) free(recs[i].body);
+}
+
+void cold_drop_front(coldstore *const cs) {
+    assert(cs != NULL);
+    assert(cs->first < cs->end);
+
+    cold_block *const b = &cs->blocks[cs->first];
+    for (uint32_t i = 0; i < b->n_nicks; i++) {
+        for (uint32_t r = 0; r < b->nicks[i].refs; r++)
+            nicktab_release(b->nicks[i].nick);
+    }
+    uncache_block(b->id);
+
+    if (cs->total_cols > 0) cs->total_rows -= block_rows(b, cs->total_cols);
+    cs->n_lines -= b->n_lines;
+    cs->bytes -= block_bytes(b);
+    cs->raw_bytes -= b->raw_len;
+    free(b->data);
+    free(b->widths);
+    free(b->nicks);
+    memset(b, 0, sizeof(*b));
+    cs->first++;
+
+    assert(cs->total_rows >= 0);
+    assert(cs->bytes >= 0);
+
+    if (cs->first == cs->end) cs->first = cs->end = 0;
+}
+
+const scrrec *cold_get_block(coldstore *const cs, size_t i, size_t *const n) {
+    assert(cs != NULL);
+    assert(i < cold_count_blocks(cs));
+    assert(n != NULL);
+
+    const cold_block *const b = &cs->blocks[cs->first + i];
+    *n = b->n_lines;
+    return load_block(b);
+}
+
+const scrrec *cold_get_seq(coldstore *const cs, uint32_t seq) {
+    assert(cs != NULL);
+    const cold_block *const b = find_block(cs, seq);
+    if (b == NULL) return NULL;
+
+    const scrrec *const recs = load_block(b);
+    return recs != NULL ? &recs[seq - b->first_seq] : NULL;
+}
+
+int64_t cold_total_rows(coldstore *const cs, int cols) {
+    assert(cs != NULL);
+    assert(cols > 0);
+    if (cs->total_cols != cols) {
+        cs->total_cols = cols;
+        cs->total_rows = 0;
+        for (size_t i = cs->first; i < cs->end; i++)
+            cs->total_rows += block_rows(&cs->blocks[i], cols);
+    }
+    return cs->total_rows;
+}
+
+bool cold_find_row_from_end(coldstore *const cs, int cols, int64_t rows_back,
+        size_t *const i_block, size_t *const i_line,
+        int64_t *const row_in_line)
+{
+    assert(cs != NULL);
+    assert(cols > 0);
+    assert(rows_back > 0);
+    if (rows_back > cold_total_rows(cs, cols)) return false;
+
+    int64_t below = 0;
+    for (size_t i = cs->end; i-- > cs->first; ) {
+        cold_block *const b = &cs->blocks[i];
+        int64_t rows = block_rows(b, cols);
+        if (below + rows < rows_back) {
+            below += rows;
+            continue;
+        }
+
+        // Row counted from the top of the block.
+        int64_t row = rows - (rows_back - below);
+        size_t pos = 0;
+        for (uint32_t line = 0; line < b->n_lines; line++) {
+            int64_t line_rows = rows_for(read_width(b->widths, &pos), cols);
+            if (row < line_rows) {
+                *i_block = i - cs->first;
+                *i_line = line;
+                *row_in_line = row;
+                return true;
+            }
+            row -= line_rows;
+        }
+        assert(false);
+        break;
+    }
+    return false;
+}
+
+int64_t cold_rows_from(coldstore *const cs, int cols, uint32_t seq) {
+    assert(cs != NULL);
+    assert(cols > 0);
+    cold_block *const b = find_block(cs, seq);
+    if (b == NULL) return 0;
+
+    int64_t rows = 0;
+    size_t pos = 0;
+    for (uint32_t line = 0; line < b->n_lines; line++) {
+        size_t width = read_width(b->widths, &pos);
+        if (line >= seq - b->first_seq) rows += rows_for(width, cols);
+    }
+    for (cold_block *later = b + 1; later < cs->blocks + cs->end; later++)
+        rows += block_rows(later, cols);
+    return rows;
+}
+
+void cold_refresh_widths(coldstore *const cs) {
+    assert(cs != NULL);
+    for (size_t i = cs->first; i < cs->end; i++) {
+        cold_block *const b = &cs->blocks[i];
+        const scrrec *const recs = load_block(b);
+        if (recs == NULL) continue;
+
+        cs->bytes -= block_bytes(b);
+        free(b->widths);
+        b->widths = encode_widths(recs, b->n_lines, &b->widths_len);
+        b->rows_cols = 0;
+        cs->bytes += block_bytes(b);
+    }
+    cs->total_cols = 0;
+    cs->total_rows = 0;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static size_t rec_size(const scrrec *const rec) {
+    size_t size = sizeof(cold_rec_hdr) + fmtline_size(rec->body);
+    return (size + 7) & ~(size_t) 7;
+}
+
+static const scrrec *load_block(const cold_block *const b) {
+    cold_cache_entry *entry = NULL;
+    for (int i = 0; i < COLD_CACHE_BLOCKS; i++) {
+        if (s_cache[i].block_id == b->id) {
+            s_cache[i].last_used = ++s_cache_clock;
+            return s_cache[i].recs;
+        }
+        if (entry == NULL || s_cache[i].last_used < entry->last_used)
+            entry = &s_cache[i];
+    }
+
+    entry->block_id = 0;
+    if (entry->raw_cap < b->raw_len) {
+        entry->raw = (uint8_t *) realloc_or_die(entry->raw, b->raw_len);
+        entry->raw_cap = b->raw_len;
+    }
+    if (entry->recs_cap < b->n_lines) {
+        entry->recs = (scrrec *) realloc_or_die(
+                entry->recs, b->n_lines * sizeof(*entry->recs));
+        entry->recs_cap = b->n_lines;
+    }
+
+    bool ok = true;
+    if (b->compressed)
+        ok = lz4_decompress(b->data, b->data_len, entry->raw, b->raw_len);
+    else
+        memcpy(entry->raw, b->data, b->raw_len);
+    if (!ok || !parse_block(b, entry)) {
+        log_fmt(LOGLEVEL_ERROR, "[coldstore load_block()] Block of lines "
+                "%u-%u is corrupt.", b->first_seq,
+                b->first_seq + b->n_lines - 1);
+        return NULL;
+    }
+
+    entry->block_id = b->id;
+    entry->n = b->n_lines;
+    entry->last_used = ++s_cache_clock;
+    return entry->recs;
+}
+
+static bool parse_block(const cold_block *const b,
+        cold_cache_entry *const entry)
+{
+    size_t off = 0;
+    for (uint32_t i = 0; i < b->n_lines; i++) {
+        if (b->raw_len - off < sizeof(cold_rec_hdr) + sizeof(fmtline))
+            return false;
+
+        cold_rec_hdr hdr;
+        memcpy(&hdr, entry->raw + off, sizeof(hdr));
+        fmtline *const body = (fmtline *) (entry->raw + off + sizeof(hdr));
+        if (b->raw_len - off - sizeof(hdr) < fmtline_size(body)) return false;
+
+        scrrec *const rec = &entry->recs[i];
+        rec->ts = hdr.ts;
+        rec->body = body;
+        rec->nick = hdr.nick;
+        rec->kind = hdr.kind;
+        off += rec_size(rec);
+    }
+    return off == b->raw_len;
+}
+
+static void uncache_block(uint64_t id) {
+    for (int i = 0; i < COLD_CACHE_BLOCKS; i++) {
+        if (s_cache[i].block_id == id) {
+            s_cache[i].block_id = 0;
+            s_cache[i].last_used = 0;
+        }
+    }
+}
+
+static uint8_t *encode_widths(const scrrec *const recs, size_t n,
+        uint32_t *const len)
+{
+    // At most 10 bytes per width.
+    grow_scratch(&s_widthbuf, &s_widthbuf_size, n * 10);
+    size_t pos = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t width = scrrec_width(&recs[i]);
+        while (width >= 0x80) {
+            s_widthbuf[pos++] = (uint8_t) (width | 0x80);
+            width >>= 7;
+        }
+        s_widthbuf[pos++] = (uint8_t) width;
+    }
+
+    uint8_t *widths = (uint8_t *) realloc_or_die(NULL, pos);
+    memcpy(widths, s_widthbuf, pos);
+    *len = (uint32_t) pos;
+    return widths;
+}
+
+static cold_nick_ref *collect_nicks(const scrrec *const recs, size_t n,
+        uint32_t *const n_nicks)
+{
+    grow_scratch(&s_nickbuf, &s_nickbuf_size, n * sizeof(uint32_t));
+    uint32_t *const ids = (uint32_t *) s_nickbuf;
+    size_t n_ids = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (recs[i].nick != NICKTAB_NONE) ids[n_ids++] = recs[i].nick;
+    }
+    *n_nicks = 0;
+    if (n_ids == 0) return NULL;
+
+    // Sorted, each nick's references are one run.
+    qsort(ids, n_ids, sizeof(*ids), compare_nick_ids);
+    size_t n_distinct = 1;
+    for (size_t i = 1; i < n_ids; i++) {
+        if (ids[i] != ids[i - 1]) n_distinct++;
+    }
+
+    cold_nick_ref *const nicks = (cold_nick_ref *) realloc_or_die(NULL,
+            n_distinct * sizeof(*nicks));
+    size_t k = 0;
+    for (size_t i = 0; i < n_ids; i++) {
+        if (i > 0 && ids[i] == ids[i - 1]) {
+            nicks[k - 1].refs++;
+            continue;
+        }
+        nicks[k].nick = ids[i];
+        nicks[k].refs = 1;
+        k++;
+    }
+    assert(k == n_distinct);
+    *n_nicks = (uint32_t) n_distinct;
+    return nicks;
+}
+
+static int compare_nick_ids(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static size_t read_width(const uint8_t *const widths, size_t *const pos) {
+    size_t width = 0;
+    int shift = 0;
+    uint8_t b;
+    do {
+        b = widths[(*pos)++];
+        width |= (size_t) (b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return width;
+}
+
+static int64_t rows_for(size_t width, int cols) {
+    return width / cols + (width % cols == 0 ? 0 : 1);
+}
+
+static int64_t block_rows(cold_block *const b, int cols) {
+    if (b->rows_cols != cols) {
+        b->rows = 0;
+        size_t pos = 0;
+        for (uint32_t i = 0; i < b->n_lines; i++)
+            b->rows += rows_for(read_width(b->widths, &pos), cols);
+        b->rows_cols = cols;
+    }
+    return b->rows;
+}
+
+static cold_block *find_block(coldstore *const cs, uint32_t seq) {
+    if (cs->first == cs->end || seq < cs->blocks[cs->first].first_seq)
+        return NULL;
+
+    // Last block starting at or before 'seq'.
+    size_t lo = cs->first, hi = cs->end;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cs->blocks[mid].first_seq <= seq) lo = mid;
+        else hi = mid;
+    }
+    cold_block *const b = &cs->blocks[lo];
+    return seq - b->first_seq < b->n_lines ? b : NULL;
+}
+
+static int64_t block_bytes(const cold_block *const b) {
+    return (int64_t) b->data_len + b->widths_len +
+           (int64_t) (b->n_nicks * sizeof(*b->nicks)) + sizeof(*b);
+}
+
+static void *realloc_or_die(void *ptr, size_t size) {
+    void *new_ptr = realloc(ptr, size);
+    if (new_ptr == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[coldstore] FATAL: out of memory.");
+        exit(23);
+    }
+    return new_ptr;
+}
+
+static void grow_scratch(uint8_t **const buf, size_t *const size,
+        size_t needed)
+{
+    if (needed <= *size) return;
+    *buf = (uint8_t *) realloc_or_die(*buf, needed);
+    *size = needed;
+}
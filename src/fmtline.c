@@ -0,0 +1,501 @@
+#define LOG_MODULE LOGMODULE_SCREEN
+
+#include "fmtline.h"
+
+#include "log.h"
+#include "vtstyle.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Span escape indices are 15 bits; the top one marks a line's own escapes.
+#define ESC_TABLE_MAX (FMTLINE_ESC_LOCAL - 1)
+// A line's own escapes are found by a 15-bit offset, and each is at most a
+// u8 long.
+#define LOCAL_ESCS_MAX (FMTLINE_ESC_LOCAL - 1)
+#define LOCAL_ESC_MAXLEN UINT8_MAX
+// The u16 size ahead of a line's own escapes.
+#define LOCAL_SIZE_BYTES 2
+#define ESC_TABLE_INITIAL_SLOTS 256
+
+typedef struct esc_entry {
+    char *bytes;
+    uint32_t len;
+    uint32_t hash;
+} esc_entry;
+
+static const unsigned int irc_to_ansi256_color[] = {
+    [0] =  7, [1] =232, [2] =  4, [3] =  2, [4] =  1, [5] = 94, [6] = 93,
+    [7] =214, [8] =  3, [9] = 82, [10]=  6, [11]= 51, [12]= 33, [13]=201,
+    [14]=243, [15]=253
+};
+
+// Interned escape runs. Entries are never removed, so an index stays valid
+// for as long as the lines using it. 's_esc_slots' is an open-addressed hash
+// of entry index + 1, with 0 for empty.
+static esc_entry *s_esc_entries = NULL;
+static size_t s_n_escs = 0;
+static size_t s_esc_entries_cap = 0;
+static uint16_t *s_esc_slots = NULL;
+static size_t s_esc_slots_cap = 0;
+
+// Scratch space for fmtline_compile(), grown as needed and reused, so
+// compiling only allocates the result.
+static char *s_text = NULL;
+static size_t s_text_cap = 0;
+static char *s_escs = NULL;
+static size_t s_escs_cap = 0;
+static fmtline_span *s_spans = NULL;
+static size_t s_spans_cap = 0;
+// The escapes of the line being compiled that didn't fit in the table.
+static char *s_local = NULL;
+static size_t s_local_cap = 0;
+static size_t s_local_len = 0;
+
+static bool is_digit(char c);
+
+// Applies the IRC code at 'src[*i_src]' to 'style', advancing '*i_src' past
+// the code and its parameters.
+static void apply_irc_code(const char *const src, size_t *const i_src,
+        size_t srclen, vtstyle *const style);
+
+// Interns the 'len' escape bytes at 'esc' and appends a span for them before
+// column 'at'. Does nothing if 'len' is 0. If the table is full, the escape is
+// kept with the line instead. Returns the number of escape bytes the span
+// renders, which is 0 if there was no room for it there either and the escape
+// was dropped.
+static size_t push_span(size_t *const n_spans, size_t at,
+        const char *const esc, size_t len);
+
+// Returns the index of the escape, adding it if it's new, or ESC_TABLE_MAX if
+// the table is full.
+static size_t intern_esc(const char *const esc, size_t len);
+
+static void grow_esc_slots(void);
+
+// The bytes of the escape 'span' stands for, and their length in '*len'.
+static const char *span_esc(const fmtline *const line,
+        const fmtline_span *const span, size_t *const len);
+
+// The line's own escapes, after their u16 size.
+static const char *local_escs(const fmtline *const line);
+
+// Grows '*buf' to hold at least 'size' bytes.
+static void reserve(void **buf, size_t *const cap, size_t size);
+
+fmtline *fmtline_compile(const char *const msg) {
+    assert(msg != NULL);
+
+    size_t msglen = strlen(msg);
+    reserve((void **) &s_text, &s_text_cap, msglen + 1);
+
+    // Formatting is tracked as the style it leaves, and written before the
+    // next visible character as one sequence with what changed since the
+    // last one, however many codes it took to get there. Colours set before
+    // the line (by its decoration) aren't known, so they're only written once
+    // the line sets them.
+    const vtstyle inherited = { VTCOLOR_UNKNOWN, VTCOLOR_UNKNOWN, 0 };
+    vtstyle written = inherited, style = inherited;
+    // Escapes other than SGR are collected in 's_escs' as they are until the
+    // next visible character, and go in the same span.
+    size_t text_len = 0, pending = 0, escs_len = 0, n_spans = 0;
+    s_local_len = 0;
+    for (size_t i = 0; i < msglen; ) {
+        unsigned char c = (unsigned char) msg[i];
+        switch (c) {
+        case IRC_FMT_BOLD:
+        case IRC_FMT_ITALIC:
+        case IRC_FMT_UNDERLINE:
+        case IRC_FMT_STRIKETH:
+        case IRC_FMT_RESET:
+        case IRC_FMT_COLOR:
+            apply_irc_code(msg, &i, msglen, &style);
+            break;
+        case '\033': {
+            // Runs up to and including the terminating 'm'. Anything that
+            // isn't SGR is copied through as-is.
+            size_t esc_end = i;
+            while (esc_end < msglen && msg[esc_end++] != 'm') {}
+            if (!vtstyle_apply_escape(&style, msg + i, esc_end - i)) {
+                reserve((void **) &s_escs, &s_escs_cap,
+                        pending + esc_end - i);
+                memcpy(s_escs + pending, msg + i, esc_end - i);
+                pending += esc_end - i;
+            }
+            i = esc_end;
+            break;
+        }
+        default:
+            // Other control codes (including hex colour and reverse, which
+            // aren't supported yet) take up no space and aren't written.
+            if (c < ' ' || text_len == FMTLINE_TEXT_MAXLEN) {
+                i++;
+                break;
+            }
+
+            reserve((void **) &s_escs, &s_escs_cap,
+                    pending + VTSTYLE_SGR_MAXLEN);
+            pending += vtstyle_sgr(&written, &style, s_escs + pending);
+            written = style;
+            escs_len += push_span(&n_spans, text_len, s_escs, pending);
+            pending = 0;
+            s_text[text_len++] = msg[i++];
+        }
+    }
+    // Formatting after the last character has nothing to apply to, and the
+    // line is followed by a reset wherever it's drawn.
+    escs_len += push_span(&n_spans, text_len, s_escs, pending);
+    // At most one span per column, plus one trailing.
+    assert(n_spans <= (size_t) FMTLINE_TEXT_MAXLEN + 1);
+    if (n_spans > UINT16_MAX) n_spans = UINT16_MAX;
+
+    size_t size = sizeof(fmtline) + n_spans * sizeof(fmtline_span)
+        + text_len + 1;
+    if (s_local_len > 0) size += LOCAL_SIZE_BYTES + s_local_len;
+    fmtline *line = (fmtline *) malloc(size);
+    if (line == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[fmtline_compile()] FATAL: out of memory.");
+        exit(23);
+    }
+
+    line->text_len = (uint16_t) text_len;
+    line->n_spans = (uint16_t) n_spans;
+    line->escs_len = (uint32_t) escs_len;
+    if (n_spans > 0) {
+        memcpy((char *) fmtline_spans(line), s_spans,
+                n_spans * sizeof(*s_spans));
+    }
+    memcpy((char *) fmtline_text(line), s_text, text_len);
+    ((char *) fmtline_text(line))[text_len] = '\0';
+    if (s_local_len > 0) {
+        line->escs_len |= FMTLINE_HAS_LOCAL;
+        uint16_t local_size = (uint16_t) s_local_len;
+        char *const local = (char *) local_escs(line);
+        memcpy(local - LOCAL_SIZE_BYTES, &local_size, LOCAL_SIZE_BYTES);
+        memcpy(local, s_local, s_local_len);
+    }
+
+    assert(fmtline_size(line) == size);
+    return line;
+}
+
+size_t fmtline_size(const fmtline *const line) {
+    assert(line != NULL);
+    size_t size = sizeof(fmtline) + line->n_spans * sizeof(fmtline_span)
+        + line->text_len + 1;
+    if (line->escs_len & FMTLINE_HAS_LOCAL) {
+        uint16_t local_size;
+        memcpy(&local_size, local_escs(line) - LOCAL_SIZE_BYTES,
+                LOCAL_SIZE_BYTES);
+        size += LOCAL_SIZE_BYTES + local_size;
+    }
+    return size;
+}
+
+const fmtline_span *fmtline_spans(const fmtline *const line) {
+    return (const fmtline_span *) (line + 1);
+}
+
+const char *fmtline_text(const fmtline *const line) {
+    return (const char *) (fmtline_spans(line) + line->n_spans);
+}
+
+size_t fmtline_ansi_len(const fmtline *const line) {
+    return (size_t) line->text_len + (line->escs_len & ~FMTLINE_HAS_LOCAL);
+}
+
+size_t fmtline_render(const fmtline *const line, size_t start, size_t end,
+        char *const buf, size_t bufsize)
+{
+    assert(line != NULL);
+    assert(buf != NULL);
+    assert(start <= end);
+    assert(end <= line->text_len);
+
+    const fmtline_span *const spans = fmtline_spans(line);
+    const char *const text = fmtline_text(line);
+    size_t n_spans = line->n_spans, k = 0, i_buf = 0;
+
+    // Only called with room for the whole line; anything else is a sizing
+    // bug in the caller.
+    assert(bufsize >= fmtline_ansi_len(line));
+    if (bufsize < fmtline_ansi_len(line)) return 0;
+
+    // Replay everything that applies before the first column written.
+    for (; k < n_spans && spans[k].at <= start; k++) {
+        size_t len = 0;
+        const char *const esc = span_esc(line, &spans[k], &len);
+        memcpy(buf + i_buf, esc, len);
+        i_buf += len;
+    }
+
+    size_t pos = start;
+    while (pos < end) {
+        size_t run_end = (k < n_spans && spans[k].at < end) ? spans[k].at : end;
+        memcpy(buf + i_buf, text + pos, run_end - pos);
+        i_buf += run_end - pos;
+        pos = run_end;
+
+        if (pos < end) {
+            assert(spans[k].at == pos);
+            size_t len = 0;
+            const char *const esc = span_esc(line, &spans[k], &len);
+            memcpy(buf + i_buf, esc, len);
+            i_buf += len;
+            k++;
+        }
+    }
+
+    if (end == line->text_len) {
+        for (; k < n_spans; k++) {
+            size_t len = 0;
+            const char *const esc = span_esc(line, &spans[k], &len);
+            memcpy(buf + i_buf, esc, len);
+            i_buf += len;
+        }
+    }
+
+    return i_buf;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static void apply_irc_code(const char *const src, size_t *const i_src,
+        size_t srclen, vtstyle *const style)
+{
+    assert(src != NULL);
+    assert(i_src != NULL);
+    assert(style != NULL);
+    assert(srclen > *i_src);
+
+    size_t n_read = 1;
+    switch(src[*i_src]) {
+    case IRC_FMT_COLOR:
+        size_t max_inc = srclen - (*i_src + 1), curr_inc = 1;
+        int color1 = -1, color2 = -1;
+        do {
+            if (max_inc == 0) break;
+            char c = src[*i_src + curr_inc];
+            if (is_digit(c)) {
+                color1 = (int)c - (int)'0';
+                n_read++;
+            }
+            else break;
+
+            if (++curr_inc > max_inc) break;
+
+            c = src[*i_src + curr_inc];
+            if (is_digit(c)) {
+                color1 *= 10;
+                color1 += (int)c - (int)'0';
+                n_read++;
+                c = src[*i_src + ++curr_inc];
+            }
+            if (c != ',' || ++curr_inc > max_inc) break;
+
+            c = src[*i_src + curr_inc];
+            if (is_digit(c)) {
+                color2 = (int)c - (int)'0';
+                n_read += 2; // Include the comma if it was a delimiter
+            }
+            else break;
+
+            if (++curr_inc > max_inc) break;
+
+            c = src[*i_src + curr_inc];
+            if (is_digit(c)) {
+                color2 *= 10;
+                color2 += (int)c - (int)'0';
+                n_read++;
+            }
+        } while (0);
+        assert(color1 < 100);
+        assert(color2 < 100);
+
+        // TODO: fix this when the full ANSI color map array is filled out
+        if (color1 < 0) {
+            style->fg = style->bg = VTCOLOR_DEFAULT;
+        }
+        else {
+            int ansi256 = color1 > 15 ? 141 : irc_to_ansi256_color[color1];
+            assert(ansi256 < 256);
+            style->fg = VTCOLOR_256 | (uint32_t) ansi256;
+            if (color2 >= 0) {
+                ansi256 = color2 > 15 ? 82 : irc_to_ansi256_color[color2];
+                assert(ansi256 < 256);
+                style->bg = VTCOLOR_256 | (uint32_t) ansi256;
+            }
+        }
+        break;
+    case IRC_FMT_BOLD:
+        style->attrs ^= VTATTR_BOLD;
+        break;
+    case IRC_FMT_ITALIC:
+        style->attrs ^= VTATTR_ITALIC;
+        break;
+    case IRC_FMT_UNDERLINE:
+        style->attrs ^= VTATTR_UNDERLINE;
+        break;
+    case IRC_FMT_STRIKETH:
+        style->attrs ^= VTATTR_STRIKE;
+        break;
+    case IRC_FMT_RESET:
+        style->fg = style->bg = VTCOLOR_DEFAULT;
+        style->attrs = 0;
+        break;
+    default:
+        assert(false);
+    }
+    *i_src += n_read;
+    assert(*i_src <= srclen);
+}
+
+static size_t push_span(size_t *const n_spans, size_t at,
+        const char *const esc, size_t len)
+{
+    assert(at <= FMTLINE_TEXT_MAXLEN);
+    if (len == 0) return 0;
+
+    size_t i_esc = intern_esc(esc, len);
+    if (i_esc == ESC_TABLE_MAX) {
+        if (len > LOCAL_ESC_MAXLEN ||
+            s_local_len + 1 + len > LOCAL_ESCS_MAX)
+        {
+            static bool s_warned = false;
+            if (!s_warned) {
+                log(LOGLEVEL_WARNING, "[fmtline push_span()] A line has more "
+                        "formatting than it has room for; some was dropped.");
+                s_warned = true;
+            }
+            return 0;
+        }
+        reserve((void **) &s_local, &s_local_cap, s_local_len + 1 + len);
+        i_esc = FMTLINE_ESC_LOCAL | s_local_len;
+        s_local[s_local_len++] = (char) (unsigned char) len;
+        memcpy(s_local + s_local_len, esc, len);
+        s_local_len += len;
+    }
+
+    reserve((void **) &s_spans, &s_spans_cap,
+            (*n_spans + 1) * sizeof(*s_spans));
+    s_spans[*n_spans].at = (uint16_t) at;
+    s_spans[*n_spans].esc = (uint16_t) i_esc;
+    (*n_spans)++;
+    return len;
+}
+
+static size_t intern_esc(const char *const esc, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) esc[i];
+        hash *= 16777619u;
+    }
+
+    if (s_esc_slots_cap > 0) {
+        size_t mask = s_esc_slots_cap - 1;
+        for (size_t i = hash & mask; s_esc_slots[i] != 0; i = (i + 1) & mask) {
+            const esc_entry *const e = &s_esc_entries[s_esc_slots[i] - 1];
+            if (e->hash == hash && e->len == len &&
+                memcmp(e->bytes, esc, len) == 0)
+            {
+                return s_esc_slots[i] - 1;
+            }
+        }
+    }
+
+    if (s_n_escs == ESC_TABLE_MAX) {
+        static bool s_warned = false;
+        if (!s_warned) {
+            log(LOGLEVEL_WARNING, "[fmtline intern_esc()] Escape table is "
+                    "full; new escapes will be kept with each line using "
+                    "them.");
+            s_warned = true;
+        }
+        return ESC_TABLE_MAX;
+    }
+
+    // Keep the load factor under 1/2 so probes stay short.
+    if ((s_n_escs + 1) * 2 > s_esc_slots_cap) grow_esc_slots();
+    reserve((void **) &s_esc_entries, &s_esc_entries_cap,
+            (s_n_escs + 1) * sizeof(*s_esc_entries));
+
+    esc_entry *const e = &s_esc_entries[s_n_escs];
+    e->bytes = (char *) malloc(len);
+    if (e->bytes == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[fmtline intern_esc()] FATAL: out of memory.");
+        exit(23);
+    }
+    memcpy(e->bytes, esc, len);
+    e->len = (uint32_t) len;
+    e->hash = hash;
+
+    size_t mask = s_esc_slots_cap - 1, i = hash & mask;
+    while (s_esc_slots[i] != 0) i = (i + 1) & mask;
+    s_esc_slots[i] = (uint16_t) (s_n_escs + 1);
+    return s_n_escs++;
+}
+
+static void grow_esc_slots(void) {
+    size_t new_cap = s_esc_slots_cap == 0
+        ? ESC_TABLE_INITIAL_SLOTS : s_esc_slots_cap * 2;
+    uint16_t *slots = (uint16_t *) calloc(new_cap, sizeof(*slots));
+    if (slots == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[fmtline grow_esc_slots()] FATAL: out of memory.");
+        exit(23);
+    }
+
+    size_t mask = new_cap - 1;
+    for (size_t i_esc = 0; i_esc < s_n_escs; i_esc++) {
+        size_t i = s_esc_entries[i_esc].hash & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = (uint16_t) (i_esc + 1);
+    }
+
+    free(s_esc_slots);
+    s_esc_slots = slots;
+    s_esc_slots_cap = new_cap;
+}
+
+static const char *span_esc(const fmtline *const line,
+        const fmtline_span *const span, size_t *const len)
+{
+    if (span->esc & FMTLINE_ESC_LOCAL) {
+        const char *const esc =
+            local_escs(line) + (span->esc & ~FMTLINE_ESC_LOCAL);
+        *len = (unsigned char) esc[0];
+        return esc + 1;
+    }
+    const esc_entry *const e = &s_esc_entries[span->esc];
+    *len = e->len;
+    return e->bytes;
+}
+
+static const char *local_escs(const fmtline *const line) {
+    return fmtline_text(line) + line->text_len + 1 + LOCAL_SIZE_BYTES;
+}
+
+static void reserve(void **buf, size_t *const cap, size_t size) {
+    if (size <= *cap) return;
+
+    size_t new_cap = *cap == 0 ? 256 : *cap;
+    while (new_cap < size) new_cap *= 2;
+    void *new_buf = realloc(*buf, new_cap);
+    if (new_buf == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[fmtline reserve()] FATAL: out of memory.");
+        exit(23);
+    }
+    *buf = new_buf;
+    *cap = new_cap;
+}
@@ -0,0 +1,89 @@
+#include "framesched.h"
+
+#include <assert.h>
+
+#define US_PER_S 1000000
+
+static uint32_t s_dirty = 0;
+static bool s_urgent = false;
+static int s_max_fps = FRAMESCHED_DEFAULT_FPS;
+static uint64_t s_interval_us =
+    (US_PER_S + FRAMESCHED_DEFAULT_FPS - 1) / FRAMESCHED_DEFAULT_FPS;
+// When the last frame was drawn; nothing holds back the first one.
+static bool s_drawn = false;
+static uint64_t s_last_frame_us = 0;
+static framesched_stats s_stats = { 0 };
+
+void framesched_mark(uint32_t parts) {
+    assert((parts & ~(uint32_t) FRAME_DIRTY_ALL) == 0);
+    if (s_dirty != 0) s_stats.coalesced++;
+    s_dirty |= parts;
+    s_stats.marks++;
+}
+
+void framesched_mark_urgent(uint32_t parts) {
+    framesched_mark(parts);
+    s_urgent = true;
+}
+
+uint32_t framesched_take(uint64_t now_us) {
+    if (s_dirty == 0) return 0;
+    if (!s_urgent && s_drawn && now_us - s_last_frame_us < s_interval_us)
+        return 0;
+
+    uint32_t parts = s_dirty;
+    s_stats.frames++;
+    if (s_urgent) s_stats.urgent_frames++;
+    s_dirty = 0;
+    s_urgent = false;
+    s_drawn = true;
+    s_last_frame_us = now_us;
+    return parts;
+}
+
+uint32_t framesched_wait_ms(uint64_t now_us, uint32_t idle_ms) {
+    if (s_dirty == 0) return idle_ms;
+    if (s_urgent || !s_drawn) return 0;
+
+    uint64_t elapsed = now_us - s_last_frame_us;
+    if (elapsed >= s_interval_us) return 0;
+    return (uint32_t) ((s_interval_us - elapsed + 999) / 1000);
+}
+
+void framesched_frame_done(frame_outcome outcome) {
+    switch (outcome) {
+    case FRAME_WRITTEN:
+        s_stats.written++;
+        break;
+    case FRAME_WRITTEN_SYNCED:
+        s_stats.written++;
+        s_stats.synced++;
+        break;
+    case FRAME_UNCHANGED:
+        s_stats.unchanged++;
+        break;
+    case FRAME_DROPPED:
+        s_stats.dropped++;
+        break;
+    case FRAME_SKIPPED:
+        s_stats.skipped++;
+        break;
+    default:
+        assert(!"Invalid frame_outcome!");
+    }
+}
+
+void framesched_set_max_fps(int fps) {
+    assert(fps >= 1 && fps <= FRAMESCHED_MAX_FPS);
+    s_max_fps = fps;
+    // Rounded up, so the cap is never exceeded.
+    s_interval_us = (US_PER_S + fps - 1) / fps;
+}
+
+int framesched_get_max_fps(void) {
+    return s_max_fps;
+}
+
+const framesched_stats *framesched_get_stats(void) {
+    return &s_stats;
+}
@@ -1,7 +1,13 @@
+#define LOG_MODULE LOGMODULE_HANDLERS
+
 #include "handlers.h"
 
+#include "framesched.h"
+#include "latency.h"
 #include "log.h"
+#include "msgqueue.h"
 #include "msgutils.h"
+#include "nicktab.h"
 #include "screen_framework.h"
 #include "stringutils.h"
 #include "terminalutils.h"
@@ -9,6 +15,7 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // Max IRC message allowed is 512 including the CRLF delimiter. This macro value
@@ -23,66 +30,82 @@
 
 #define CHANNEL_PREFIXES "&#+!"
 
+// Largest sizes !mem accepts. Bigger values are clamped to these so that the
+// conversion to bytes can't overflow.
+#define MEM_CMD_MAX_MB (1024LL * 1024)
+#define MEM_CMD_MAX_HOT_KB (1024LL * 1024 * 1024)
+
 // IRC message handlers
-static bool handle_ircmsg_default(ircmsg *const ircm, const_str ts);
-static bool handle_ircmsg_privmsg(ircmsg *const ircm, const_str ts);
+static bool handle_ircmsg_default(ircmsg *const ircm, int64_t ts);
+static bool handle_ircmsg_privmsg(ircmsg *const ircm, int64_t ts);
 static bool handle_ircmsg_topic(ircmsg *const ircm);
+static bool handle_ircmsg_ping(ircmsg *const ircm);
 
 // Local command handlers
 static void handle_localcmd_channel(char *msg, SOCKET sock);
 static void handle_localcmd_join(char *msg, SOCKET sock);
 static void handle_localcmd_show(char *msg);
+static void handle_localcmd_mem(char *msg);
+static void handle_localcmd_search(char *msg);
+static void handle_localcmd_jump(char *msg);
+static void handle_localcmd_ts(char *msg);
+static void handle_localcmd_fps(char *msg);
+static void handle_localcmd_log(char *msg);
+static void handle_localcmd_stats(char *msg);
 
-// Screen formatters
 static char s_scrbuf[SCREENMSG_BUF_SIZE] = {0};
-static bool screenfmt_default(char *const buf, size_t bufsize,
-       const_str src, const_str cmd, const msglist *const params, const_str ts);
-static bool screenfmt_privmsg(char *const buf, size_t bufsize,
-       const_str from, const_str msg, const_str ts, bool self);
 
 // Utilities
 static int send_as_irc(SOCKET sock, const char* msg);
 static bool try_send_as_irc(SOCKET sock, const char* fmt, ...);
 
 
-static termutils_color s_color_ts = TERMUTILS_COLOR_BLUE;
-static termutils_color s_color_namebrackets = TERMUTILS_COLOR_DEFAULT;
-static termutils_color s_color_text_user = TERMUTILS_COLOR_DEFAULT;
-static termutils_color s_color_name_self = TERMUTILS_COLOR_CYAN_BRIGHT;
-static termutils_color s_color_name_user = TERMUTILS_COLOR_YELLOW;
-// static termutils_color s_color_name_op = TERMUTILS_COLOR_RED;
-static termutils_color s_color_name_server = TERMUTILS_COLOR_MAGENTA;
-
-static int s_color256_text_server = 245;
+// Results of the last !search, for !jump.
+static char s_search_screen[CHANNEL_NAME_MAXLEN] = {0};
+static screen_search_hit s_search_hits[SCREEN_SEARCH_MAX_HITS];
+static size_t s_n_search_hits = 0;
 
 /*****************************************************************************/
 /************************** IRCMSG HANDLER IMPLs *****************************/
 
-bool handle_ircmsg(ircmsg *const ircm, const_str ts) {
+bool handle_ircmsg(ircmsg *const ircm, int64_t ts) {
     if (strcmp(ircm->command, "PRIVMSG") == 0)
         return handle_ircmsg_privmsg(ircm, ts);
     // TODO: change this to detect number and make handle_ircmsg_numeric()
     if (strcmp(ircm->command, "332") == 0 || strcmp(ircm->command, "331") == 0)
         return handle_ircmsg_topic(ircm);
+    if (strcmp(ircm->command, "PING") == 0)
+        return handle_ircmsg_ping(ircm);
 
     return handle_ircmsg_default(ircm, ts);
 }
 
-static bool handle_ircmsg_default(ircmsg *const ircm, const_str ts) {
+static bool handle_ircmsg_default(ircmsg *const ircm, int64_t ts) {
     assert(ircm != NULL);
     assert(ircm->command != NULL);
 
-    bool success = screenfmt_default(s_scrbuf, sizeof(s_scrbuf), ircm->source,
-            ircm->command, &ircm->params, ts);
-
+    // (command) param param...
+    size_t n_bytes = 0;
+    int bytes = sprintf_s(s_scrbuf, sizeof(s_scrbuf), "(%s)", ircm->command);
+    bool success = bytes >= 0;
+    if (success) n_bytes += bytes;
+    struct msgnode *curr = ircm->params.head;
+    while (success && curr != NULL) {
+        bytes = sprintf_s(s_scrbuf + n_bytes, sizeof(s_scrbuf) - n_bytes,
+                " %s", curr->msg);
+        success = bytes >= 0;
+        if (success) n_bytes += bytes;
+        curr = curr->next;
+    }
 
     if (!success) {
-        log_fmt(LOGLEVEL_ERROR, "[%s] Could not screenfmt default. "
-              "command='%s', param.count=%d, ts='%s'",
-              "handle_ircmsg_default()", ircm->command, ircm->params.count, ts);
+        log_fmt(LOGLEVEL_ERROR, "[%s] Could not format default. "
+              "command='%s', param.count=%d",
+              "handle_ircmsg_default()", ircm->command, ircm->params.count);
     }
     else {
-        scrmgr_deliver_copy("home", s_scrbuf);
+        scrmgr_deliver_msg("home", SCREEN_MSG_SERVER, ts, ircm->source,
+                s_scrbuf);
     }
     
     return success;
@@ -100,143 +123,40 @@ static bool handle_ircmsg_topic(ircmsg *const ircm) {
     return scrmgr_set_topic(channel, topic);
 }
 
-static bool handle_ircmsg_privmsg(ircmsg *const ircm, const_str ts) {
+// Answers with the same token, through QUEUE_OUT; see the main loop for when
+// the answer goes out.
+static bool handle_ircmsg_ping(ircmsg *const ircm) {
+    // PING <token>
+    assert(ircm != NULL);
+    if (ircm->params.count < 1) return false;
+
+    const_str token = ircm->params.tail->msg;
+    if (strlen(token) + 8 > MAX_CMD_LEN) return false;
+    sprintf_s(s_scrbuf, sizeof(s_scrbuf), "PONG :%s", token);
+    msgqueue_pushback_copy(QUEUE_OUT, s_scrbuf);
+    return true;
+}
+
+static bool handle_ircmsg_privmsg(ircmsg *const ircm, int64_t ts) {
     // :source PRIVMSG <target>{,<target>} :<text>
     // TODO: debug asserts
     assert(ircm->params.count == 2);
-    char *bang = strstr(ircm->source, "!");
-    if (bang != NULL) *bang = '\0';
 
-    const_str from = ircm->source;
+    // The source is interned as nick + user@host, so it's passed whole.
     const_str to = ircm->params.head->msg;
     const_str msg = ircm->params.tail->msg;
-
-    bool success = screenfmt_privmsg(
-            s_scrbuf, sizeof(s_scrbuf), from, msg, ts, false);
-
-    if (!success) {
-        log_fmt(LOGLEVEL_ERROR, "[%s] Could not screenfmt privmsg. from='%s', "
-             "msg='%s', ts='%s'", "handle_ircmsg_privmsg()", from, to, msg, ts);
-    }
-    else {
-        scrmgr_deliver_copy(to, s_scrbuf);
-    }
-    
-    if (bang != NULL) *bang = '!'; // TODO: do we really need this?
-    return success;
-}
-
-
-
-/*****************************************************************************/
-/************************** SCREEN FORMAT IMPLs ******************************/
-
-static bool screenfmt_default(char *const buf, size_t bufsize,
-        const_str src, const_str cmd, const msglist *const params, const_str ts)
-{
-    size_t n_bytes = 0;
-    n_bytes += termutils_set_text_color_buf(buf, bufsize, s_color_ts);
-
-    int bytes = sprintf_s(buf + n_bytes, bufsize - n_bytes, "[%s] ", ts);
-    if (bytes < 0) return false;
-    n_bytes += bytes;
-    
-    n_bytes += termutils_set_text_color_buf(
-            buf + n_bytes, bufsize - n_bytes, s_color_name_server);
-    if (n_bytes >= bufsize) return false;
-    bytes = sprintf_s(buf + n_bytes, bufsize - n_bytes, "%s: ", src);
-    if (bytes < 0) return false;
-    n_bytes += bytes;
-
-    bytes = termutils_set_text_color_256_buf(
-            buf + n_bytes, bufsize - n_bytes, s_color256_text_server);
-    if (bytes < 0) return false;
-    n_bytes += bytes;
-    if (n_bytes >= bufsize) return false;
-
-    bytes = sprintf_s(buf + n_bytes, bufsize - n_bytes, "(%s)", cmd);
-    if (bytes < 0) return false;
-    n_bytes += bytes;
-
-    struct msgnode *curr = params->head;
-    while (curr != NULL) {
-        bytes = sprintf_s(buf + n_bytes, bufsize - n_bytes, " %s", curr->msg);
-        if (bytes < 0) return false;
-        n_bytes += bytes;
-        curr = curr->next;
-    }
-
-    n_bytes += termutils_reset_text_color_buf(buf + n_bytes, bufsize - n_bytes);
-    return n_bytes <= bufsize;
-}
-
-static bool screenfmt_privmsg(char *const buf, size_t bufsize,
-        const_str from, const_str msg, const_str ts, bool self)
-{
-    termutils_color color_name = self ? s_color_name_self : s_color_name_user;
-    // The size checking is strange here, but avoids a massive function. Since
-    // the termutils functions and sprintf_s() won't write anything that can't
-    // fit, we can plow through those and only check n_bytes before we write a
-    // character manually. We avoid adding -1 (from sprintf_s() failure) to
-    // n_bytes by simply returning false if we ever see it.
-    size_t n_bytes = 0;
-    n_bytes += termutils_set_text_color_buf(buf, bufsize, s_color_ts);
-
-    int bytes = sprintf_s(buf + n_bytes, bufsize - n_bytes, "[%s] ", ts);
-    if (bytes < 0) return false;
-    n_bytes += bytes;
-    
-    n_bytes += termutils_set_text_color_buf(
-            buf + n_bytes, bufsize - n_bytes, s_color_namebrackets);
-    if (n_bytes >= bufsize) return false;
-    buf[n_bytes++] = '<';
-
-    n_bytes += termutils_set_bold_buf(buf + n_bytes, bufsize - n_bytes, self);
-    n_bytes += termutils_set_text_color_buf(
-            buf + n_bytes, bufsize - n_bytes, color_name);
-    bytes = sprintf_s(buf + n_bytes, bufsize - n_bytes, "%s", from);
-    if (bytes < 0) return false;
-    n_bytes += bytes;
-
-    n_bytes += termutils_set_bold_buf(buf + n_bytes, bufsize - n_bytes, false);
-    n_bytes += termutils_set_text_color_buf(
-            buf + n_bytes, bufsize - n_bytes, s_color_namebrackets);
-    if (n_bytes >= bufsize) return false;
-    buf[n_bytes++] = '>';
-    n_bytes += termutils_set_text_color_buf(
-            buf + n_bytes, bufsize - n_bytes, s_color_text_user);
-    bytes = sprintf_s(buf + n_bytes, bufsize - n_bytes, " %s", msg);
-    if (bytes < 0) return false;
-    n_bytes += bytes;
-    n_bytes += termutils_reset_text_color_buf(buf + n_bytes, bufsize - n_bytes);
-
-    return n_bytes <= bufsize;
-}
-
-static bool screenfmt_privmsg_error(char *const buf, size_t bufsize,
-        const_str error_msg, const_str from, const_str msg, const_str ts)
-{
-    size_t n_bytes = 
-        termutils_set_text_color_buf(buf, bufsize, TERMUTILS_COLOR_RED);
-    int bytes = sprintf_s(buf + n_bytes, bufsize - n_bytes, "(%s) ", error_msg);
-    if (bytes < 0) return false;
-    n_bytes += bytes;
-
-    n_bytes += termutils_set_text_color_256_buf(buf, bufsize, 245);
-    bytes = sprintf_s(buf + n_bytes, bufsize - n_bytes, "[%s] <%s> %s",
-            ts, from, msg);
-    if (bytes < 0) return false;
-
+    scrmgr_deliver_msg(to, SCREEN_MSG_PRIVMSG, ts, ircm->source, msg);
     return true;
 }
 
 
+
 /*****************************************************************************/
 /************************* LOCALCMD HANDLER IMPLs ****************************/
 
 // Returns true if program should exit.
 // TODO: Remove nick param. Access from a query or state struct when needed
-bool handle_user_command(char *msg, const_str nick, SOCKET sock, const_str ts) {
+bool handle_user_command(char *msg, const_str nick, SOCKET sock, int64_t ts) {
     assert(msg != NULL);
     assert(sock != INVALID_SOCKET);
     log_fmt(LOGLEVEL_DEV, "[handle_user_command()] Processing '%s'", msg);
@@ -257,6 +177,20 @@ bool handle_user_command(char *msg, const_str nick, SOCKET sock, const_str ts) {
             handle_localcmd_join(msg, sock);
         if (strut_startswith(msg, "!show ") || strcmp(msg, "!show") == 0)
             handle_localcmd_show(msg);
+        if (strut_startswith(msg, "!mem ") || strcmp(msg, "!mem") == 0)
+            handle_localcmd_mem(msg);
+        if (strut_startswith(msg, "!search ") || strcmp(msg, "!search") == 0)
+            handle_localcmd_search(msg);
+        if (strut_startswith(msg, "!jump ") || strcmp(msg, "!jump") == 0)
+            handle_localcmd_jump(msg);
+        if (strut_startswith(msg, "!ts ") || strcmp(msg, "!ts") == 0)
+            handle_localcmd_ts(msg);
+        if (strut_startswith(msg, "!fps ") || strcmp(msg, "!fps") == 0)
+            handle_localcmd_fps(msg);
+        if (strut_startswith(msg, "!log ") || strcmp(msg, "!log") == 0)
+            handle_localcmd_log(msg);
+        if (strut_startswith(msg, "!stats ") || strcmp(msg, "!stats") == 0)
+            handle_localcmd_stats(msg);
         break;
     case '`':
         // TODO: Do we want to send this to a screenlog?
@@ -275,23 +209,9 @@ bool handle_user_command(char *msg, const_str nick, SOCKET sock, const_str ts) {
         bool send_success = try_send_as_irc(
                 sock, "PRIVMSG %s :%s", active_name, msg);
         
-        bool fmt_success = false;
-        if (send_success)
-            fmt_success = screenfmt_privmsg(s_scrbuf, sizeof(s_scrbuf),
-                                nick, msg, ts, true);
-        else
-            fmt_success = screenfmt_privmsg_error(s_scrbuf, sizeof(s_scrbuf),
-                                "Not Sent", nick, msg, ts);
-
-        if (!fmt_success) {
-            log_fmt(LOGLEVEL_ERROR, "[%s] Couldn't screenfmt privmsg. "
-                    "nick='%s', msg='%s', ts='%s'", "handle_ircmsg_privmsg()",
-                    nick, msg, ts);
-            scrmgr_deliver_copy(active_name, "<corrupted message>");
-        }
-        else {
-            scrmgr_deliver_copy(active_name, s_scrbuf);
-        }
+        scrmgr_deliver_msg(active_name,
+                send_success ? SCREEN_MSG_PRIVMSG_SELF : SCREEN_MSG_NOT_SENT,
+                ts, nick, msg);
     }
     return false;
 }
@@ -385,6 +305,273 @@ static void handle_localcmd_show(char *msg) {
     }
 }
 
+// Prints the scrollback memory used by each screen to the active screen.
+// '!mem max <MB>' sets the global scrollback budget, and
+// '!mem screen <MB> [<hot KB>|off]' the active screen's own cap and how much of
+// its newest scrollback is kept uncompressed ('off' to compress nothing).
+static void handle_localcmd_mem(char *msg) {
+    assert(msg != NULL);
+
+    const_str delim = " ";
+    char *next_tk;
+    const_str tk_cmd = strtok_s(msg, delim, &next_tk);
+    assert(strcmp(tk_cmd, "!mem") == 0);
+    const_str tk_action = strtok_s(NULL, delim, &next_tk);
+    const_str active_name = scrmgr_get_active_name();
+
+    if (tk_action != NULL && strcmp(tk_action, "max") == 0) {
+        const_str tk_mb = strtok_s(NULL, delim, &next_tk);
+        long long mb = tk_mb != NULL ? strtoll(tk_mb, NULL, 10) : 0;
+        if (mb <= 0) {
+            scrmgr_deliver_local_copy(
+                    active_name, "Usage: !mem max <megabytes>");
+            return;
+        }
+        if (mb > MEM_CMD_MAX_MB) mb = MEM_CMD_MAX_MB;
+        scrmgr_set_global_max_bytes(mb * 1024 * 1024);
+    }
+    else if (tk_action != NULL && strcmp(tk_action, "screen") == 0) {
+        const_str tk_mb = strtok_s(NULL, delim, &next_tk);
+        const_str tk_hot = strtok_s(NULL, delim, &next_tk);
+        long long mb = tk_mb != NULL ? strtoll(tk_mb, NULL, 10) : 0;
+        long long hot = SCREENLOG_DEFAULT_HOT_BYTES;
+        bool bad_hot = false;
+        if (tk_hot != NULL && strcmp(tk_hot, "off") == 0)
+            hot = SCREENLOG_HOT_UNLIMITED;
+        else if (tk_hot != NULL) {
+            long long hot_kb = strtoll(tk_hot, NULL, 10);
+            if (hot_kb > MEM_CMD_MAX_HOT_KB) hot_kb = MEM_CMD_MAX_HOT_KB;
+            bad_hot = hot_kb < 0;
+            hot = bad_hot ? 0 : hot_kb * 1024;
+        }
+        if (mb <= 0 || bad_hot) {
+            scrmgr_deliver_local_copy(active_name,
+                    "Usage: !mem screen <megabytes> [<hot kilobytes>|off]");
+            return;
+        }
+        if (mb > MEM_CMD_MAX_MB) mb = MEM_CMD_MAX_MB;
+        scrmgr_set_screen_limits(active_name, mb * 1024 * 1024, hot);
+    }
+
+    const double mb = 1024.0 * 1024.0;
+    sprintf_s(s_scrbuf, sizeof(s_scrbuf), "Scrollback: %.2f MB of %.2f MB",
+            scrmgr_get_total_mem_bytes() / mb,
+            scrmgr_get_global_max_bytes() / mb);
+    scrmgr_deliver_local_copy(active_name, s_scrbuf);
+
+    screen_mem_usage usage;
+    for (int i = 0; scrmgr_get_mem_usage(i, &usage); i++) {
+        sprintf_s(s_scrbuf, sizeof(s_scrbuf),
+                "  %c%d %-16s %10.2f KB %7d msgs %10.2f KB index",
+                usage.active ? '*' : ' ', i, usage.name,
+                usage.bytes / 1024.0, usage.n_msgs,
+                usage.index_bytes / 1024.0);
+        scrmgr_deliver_local_copy(active_name, s_scrbuf);
+        if (usage.n_cold_msgs == 0) continue;
+
+        sprintf_s(s_scrbuf, sizeof(s_scrbuf),
+                "      %d msgs compressed: %.2f KB from %.2f KB (%.1fx)",
+                usage.n_cold_msgs, usage.cold_bytes / 1024.0,
+                usage.cold_raw_bytes / 1024.0,
+                (double) usage.cold_raw_bytes / usage.cold_bytes);
+        scrmgr_deliver_local_copy(active_name, s_scrbuf);
+    }
+    sprintf_s(s_scrbuf, sizeof(s_scrbuf), "Nicks: %zu interned, %.2f KB",
+            nicktab_count(), nicktab_bytes() / 1024.0);
+    scrmgr_deliver_local_copy(active_name, s_scrbuf);
+}
+
+// Searches the active screen's history for lines containing every word given
+// and lists the hits, newest first, numbered for !jump.
+static void handle_localcmd_search(char *msg) {
+    assert(msg != NULL);
+
+    const_str active_name = scrmgr_get_active_name();
+    const char *query = msg + strlen("!search");
+    while (*query == ' ') query++;
+    if (*query == '\0') {
+        scrmgr_deliver_local_copy(active_name, "Usage: !search <words...>");
+        return;
+    }
+
+    LARGE_INTEGER freq, start, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    s_n_search_hits = scrmgr_search(
+            query, s_search_hits, SCREEN_SEARCH_MAX_HITS);
+    QueryPerformanceCounter(&end);
+    strcpy_s(s_search_screen, sizeof(s_search_screen), active_name);
+
+    double ms = (end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart;
+    sprintf_s(s_scrbuf, sizeof(s_scrbuf),
+            "Search '%s': %zu%s hit(s) in %.2f ms.%s", query, s_n_search_hits,
+            s_n_search_hits == SCREEN_SEARCH_MAX_HITS ? "+" : "", ms,
+            s_n_search_hits > 0 ? " Use !jump <n> to scroll to one." : "");
+    scrmgr_deliver_local_copy(active_name, s_scrbuf);
+
+    for (size_t i = 0; i < s_n_search_hits; i++) {
+        const screen_search_hit *const hit = &s_search_hits[i];
+        sprintf_s(s_scrbuf, sizeof(s_scrbuf), "  [%zu] %s", i + 1,
+                hit->available ? hit->preview : "<no longer in history>");
+        scrmgr_deliver_local_copy(active_name, s_scrbuf);
+    }
+}
+
+// Scrolls to hit <n> of the last !search, switching back to the screen it was
+// run on if needed.
+static void handle_localcmd_jump(char *msg) {
+    assert(msg != NULL);
+
+    const_str delim = " ";
+    char *next_tk;
+    const_str tk_cmd = strtok_s(msg, delim, &next_tk);
+    assert(strcmp(tk_cmd, "!jump") == 0);
+    const_str tk_n = strtok_s(NULL, delim, &next_tk);
+    long long n = tk_n != NULL ? strtoll(tk_n, NULL, 10) : 0;
+
+    const_str active_name = scrmgr_get_active_name();
+    if (n <= 0 || (size_t) n > s_n_search_hits) {
+        sprintf_s(s_scrbuf, sizeof(s_scrbuf), "Usage: !jump <n>, where <n> is "
+                "1 to %zu from the last !search.", s_n_search_hits);
+        scrmgr_deliver_local_copy(active_name, s_scrbuf);
+        return;
+    }
+
+    if (strcmp(active_name, s_search_screen) != 0 &&
+        !scrmgr_show_name(s_search_screen))
+    {
+        scrmgr_deliver_local_copy(active_name,
+                "The screen that search ran on is gone.");
+        return;
+    }
+
+    if (!scrmgr_scroll_to_seq(s_search_hits[n - 1].seq)) {
+        scrmgr_deliver_local_copy(s_search_screen,
+                "That line is no longer in history.");
+    }
+}
+
+// '!ts <time|date|full>' changes how timestamps are shown, everywhere at once.
+static void handle_localcmd_ts(char *msg) {
+    assert(msg != NULL);
+
+    const_str delim = " ";
+    char *next_tk;
+    const_str tk_cmd = strtok_s(msg, delim, &next_tk);
+    assert(strcmp(tk_cmd, "!ts") == 0);
+    const_str tk_format = strtok_s(NULL, delim, &next_tk);
+
+    const_str active_name = scrmgr_get_active_name();
+    if (tk_format != NULL && strcmp(tk_format, "time") == 0)
+        scrmgr_set_timestamp_format(TIMESTAMP_FORMAT_TIME_ONLY);
+    else if (tk_format != NULL && strcmp(tk_format, "date") == 0)
+        scrmgr_set_timestamp_format(TIMESTAMP_FORMAT_MONTH_DAY_TIME);
+    else if (tk_format != NULL && strcmp(tk_format, "full") == 0)
+        scrmgr_set_timestamp_format(TIMESTAMP_FORMAT_YEAR_MONTH_DAY_TIME);
+    else
+        scrmgr_deliver_local_copy(active_name, "Usage: !ts <time|date|full>");
+}
+
+// '!fps [<n>]' caps how many frames are drawn per second, and shows how many
+// have been.
+static void handle_localcmd_fps(char *msg) {
+    assert(msg != NULL);
+
+    const_str delim = " ";
+    char *next_tk;
+    const_str tk_cmd = strtok_s(msg, delim, &next_tk);
+    assert(strcmp(tk_cmd, "!fps") == 0);
+    const_str tk_fps = strtok_s(NULL, delim, &next_tk);
+
+    const_str active_name = scrmgr_get_active_name();
+    if (tk_fps != NULL) {
+        long long fps = strtoll(tk_fps, NULL, 10);
+        if (fps < 1 || fps > FRAMESCHED_MAX_FPS) {
+            sprintf_s(s_scrbuf, sizeof(s_scrbuf),
+                    "Usage: !fps [<1 to %d>]", FRAMESCHED_MAX_FPS);
+            scrmgr_deliver_local_copy(active_name, s_scrbuf);
+            return;
+        }
+        framesched_set_max_fps((int) fps);
+    }
+
+    const framesched_stats *const stats = framesched_get_stats();
+    sprintf_s(s_scrbuf, sizeof(s_scrbuf), "Drawing at most %d frames/s. "
+            "%llu frames drawn (%llu right away for input) for %llu changes, "
+            "%llu of them merged into a frame already due.",
+            framesched_get_max_fps(), (unsigned long long) stats->frames,
+            (unsigned long long) stats->urgent_frames,
+            (unsigned long long) stats->marks,
+            (unsigned long long) stats->coalesced);
+    scrmgr_deliver_local_copy(active_name, s_scrbuf);
+    sprintf_s(s_scrbuf, sizeof(s_scrbuf), "%llu frames written (%llu as "
+            "synchronized updates), %llu with nothing to write, %llu dropped, "
+            "%llu replaced by a newer one before being written.",
+            (unsigned long long) stats->written,
+            (unsigned long long) stats->synced,
+            (unsigned long long) stats->unchanged,
+            (unsigned long long) stats->dropped,
+            (unsigned long long) stats->skipped);
+    scrmgr_deliver_local_copy(active_name, s_scrbuf);
+}
+
+// '!log [<levels>]' changes what's logged, e.g. '!log parser=spam' for
+// everything the parser does, and shows each module's level.
+static void handle_localcmd_log(char *msg) {
+    assert(msg != NULL);
+    assert(strut_startswith(msg, "!log"));
+
+    const_str active_name = scrmgr_get_active_name();
+    const_str levels = msg + strlen("!log");
+    if (levels[strspn(levels, " ")] != '\0' && !log_set_levels(levels)) {
+        scrmgr_deliver_local_copy(active_name, "Usage: !log "
+                "[<level>|<module>=<level>]... with levels 'error', "
+                "'warning', 'info', 'dev' and 'spam' and modules 'general', "
+                "'parser', 'recv', 'screen' and 'handlers'");
+        return;
+    }
+
+    char desc[LOG_LEVELS_DESC_SIZE];
+    log_describe_levels(desc, sizeof(desc));
+    sprintf_s(s_scrbuf, sizeof(s_scrbuf), "Logging at %s.", desc);
+    scrmgr_deliver_local_copy(active_name, s_scrbuf);
+}
+
+// '!stats latency [reset]' shows how long lines take to get through each
+// stage, from recv() to the screen (see latency.h), and with 'reset' starts
+// counting again.
+static void handle_localcmd_stats(char *msg) {
+    assert(msg != NULL);
+
+    const_str delim = " ";
+    char *next_tk;
+    const_str tk_cmd = strtok_s(msg, delim, &next_tk);
+    assert(strcmp(tk_cmd, "!stats") == 0);
+    const_str tk_what = strtok_s(NULL, delim, &next_tk);
+    const_str tk_reset = strtok_s(NULL, delim, &next_tk);
+
+    const_str active_name = scrmgr_get_active_name();
+    if (tk_what == NULL || strcmp(tk_what, "latency") != 0 ||
+        (tk_reset != NULL && strcmp(tk_reset, "reset") != 0))
+    {
+        scrmgr_deliver_local_copy(active_name,
+                "Usage: !stats latency [reset]");
+        return;
+    }
+
+    // Shown before resetting, so a reset doesn't lose what it ends.
+    scrmgr_deliver_local_copy(active_name,
+            "Latency by stage, from recv() to the screen:");
+    for (int stage = 0; stage < LATENCY_N_STAGES; stage++) {
+        latency_describe((latency_stage) stage, s_scrbuf, sizeof(s_scrbuf));
+        scrmgr_deliver_local_copy(active_name, s_scrbuf);
+    }
+    if (tk_reset != NULL) {
+        latency_reset();
+        scrmgr_deliver_local_copy(active_name, "Latency stats reset.");
+    }
+}
+
 static void handle_localcmd_join(char *msg, SOCKET sock) {
     assert(msg != NULL);
     assert(sock != INVALID_SOCKET);
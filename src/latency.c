@@ -0,0 +1,235 @@
+#include "latency.h"
+
+#include "log.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// TODO: platform-specific code
+#include <windows.h>
+
+#define PENDING_INITIAL_CAP 256
+// Most lines waiting to be shown. If frames stop being shown, the oldest half
+// are forgotten once there are this many, uncounted.
+#define PENDING_MAX (64 * 1024)
+
+// A line in the active screen waiting for a frame to show it.
+typedef struct pending_line {
+    uint64_t t_recv;
+    uint64_t t_insert;
+    // The first frame composed with it, or 0 if none was yet.
+    uint64_t frame;
+} pending_line;
+
+static const char *const s_stage_names[LATENCY_N_STAGES] = {
+    "framing", "queued", "waiting", "parsing", "handling", "showing", "total"
+};
+
+static latency_hist s_hists[LATENCY_N_STAGES];
+
+// The message between latency_msg_begin() and latency_msg_end(), if
+// s_in_msg. Its handling hasn't begun while s_t_handle is 0.
+static bool s_in_msg = false;
+static bool s_inserted = false;
+static uint64_t s_t_recv = 0;
+static uint64_t s_t_parse = 0;
+static uint64_t s_t_handle = 0;
+
+// Oldest first. The first s_n_framed were composed into a frame.
+static pending_line *s_pending = NULL;
+static size_t s_n_pending = 0;
+static size_t s_cap_pending = 0;
+static size_t s_n_framed = 0;
+// The last frame composed.
+static uint64_t s_frame = 0;
+
+// Counts the time from 'from' to 'to' for 'stage'.
+static void record(latency_stage stage, uint64_t from, uint64_t to);
+
+static size_t bucket_of(uint64_t us);
+// The highest value counted in bucket 'i'.
+static uint64_t bucket_top(size_t i);
+
+static void push_pending(uint64_t t_recv, uint64_t t_insert);
+
+uint64_t latency_now_us(void) {
+    static LARGE_INTEGER freq = { 0 };
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return (uint64_t) (t.QuadPart / freq.QuadPart) * 1000000 +
+           (uint64_t) (t.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+}
+
+void latency_msg_begin(uint64_t t_recv, uint64_t t_submit,
+        uint64_t t_dequeue)
+{
+    assert(!s_in_msg);
+
+    uint64_t now = latency_now_us();
+    if (t_recv != 0) {
+        record(LATENCY_FRAMING, t_recv, t_submit);
+        record(LATENCY_QUEUED, t_submit, t_dequeue);
+    }
+    record(LATENCY_WAITING, t_dequeue, now);
+
+    s_in_msg = true;
+    s_inserted = false;
+    s_t_recv = t_recv;
+    s_t_parse = now;
+    s_t_handle = 0;
+}
+
+void latency_msg_parsed(void) {
+    assert(s_in_msg);
+    s_t_handle = latency_now_us();
+    record(LATENCY_PARSING, s_t_parse, s_t_handle);
+}
+
+void latency_msg_inserted(bool active) {
+    if (!s_in_msg || s_inserted || s_t_handle == 0) return;
+
+    uint64_t now = latency_now_us();
+    record(LATENCY_HANDLING, s_t_handle, now);
+    s_inserted = true;
+    if (active) push_pending(s_t_recv, now);
+}
+
+void latency_msg_end(void) {
+    assert(s_in_msg);
+    if (s_t_handle != 0 && !s_inserted)
+        record(LATENCY_HANDLING, s_t_handle, latency_now_us());
+    s_in_msg = false;
+}
+
+uint64_t latency_frame_composed(void) {
+    s_frame++;
+    for (size_t i = s_n_framed; i < s_n_pending; i++)
+        s_pending[i].frame = s_frame;
+    s_n_framed = s_n_pending;
+    return s_frame;
+}
+
+void latency_frame_shown(uint64_t frame, uint64_t t_shown) {
+    // Frames are composed in order, so the lines they show come first.
+    size_t n_shown = 0;
+    while (n_shown < s_n_framed && s_pending[n_shown].frame <= frame) {
+        const pending_line *const line = &s_pending[n_shown++];
+        record(LATENCY_SHOWING, line->t_insert, t_shown);
+        if (line->t_recv != 0)
+            record(LATENCY_TOTAL, line->t_recv, t_shown);
+    }
+    if (n_shown == 0) return;
+
+    memmove(s_pending, s_pending + n_shown,
+            (s_n_pending - n_shown) * sizeof(*s_pending));
+    s_n_pending -= n_shown;
+    s_n_framed -= n_shown;
+}
+
+void latency_reset(void) {
+    memset(s_hists, 0, sizeof(s_hists));
+}
+
+const latency_hist *latency_get_hist(latency_stage stage) {
+    assert(stage >= 0 && stage < LATENCY_N_STAGES);
+    return &s_hists[stage];
+}
+
+uint64_t latency_hist_percentile(const latency_hist *const hist, double p) {
+    assert(hist != NULL);
+    assert(p >= 0 && p <= 1);
+    if (hist->count == 0) return 0;
+
+    // The rank of the value wanted, counting from 1.
+    double exact = p * (double) hist->count;
+    uint64_t rank = (uint64_t) exact;
+    if ((double) rank < exact) rank++;
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen < rank) continue;
+        uint64_t top = bucket_top(i);
+        return top < hist->max_us ? top : hist->max_us;
+    }
+    return hist->max_us;
+}
+
+void latency_describe(latency_stage stage, char *const buf, size_t size) {
+    assert(buf != NULL);
+    const latency_hist *const hist = latency_get_hist(stage);
+    snprintf(buf, size, "%-8s %9llu  p50 %8.3f  p99 %8.3f  p999 %8.3f  "
+            "max %8.3f ms", s_stage_names[stage],
+            (unsigned long long) hist->count,
+            (double) latency_hist_percentile(hist, 0.5) / 1000,
+            (double) latency_hist_percentile(hist, 0.99) / 1000,
+            (double) latency_hist_percentile(hist, 0.999) / 1000,
+            (double) hist->max_us / 1000);
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static void record(latency_stage stage, uint64_t from, uint64_t to) {
+    // Stamps from different threads can be a tick out of order.
+    uint64_t us = to > from ? to - from : 0;
+    latency_hist *const hist = &s_hists[stage];
+    hist->count++;
+    if (us > hist->max_us) hist->max_us = us;
+    hist->buckets[bucket_of(us)]++;
+}
+
+static size_t bucket_of(uint64_t us) {
+    const uint64_t max = ((uint64_t) 1 << LATENCY_HIST_MAX_BITS) - 1;
+    if (us > max) us = max;
+    if (us < LATENCY_HIST_SUB_COUNT) return (size_t) us;
+
+    // Drop bits until what's left is one of the power of two's buckets.
+    int shift = 0;
+    while ((us >> shift) >= 2 * LATENCY_HIST_SUB_COUNT) shift++;
+    size_t sub = (size_t) (us >> shift) - LATENCY_HIST_SUB_COUNT;
+    return (size_t) (shift + 1) * LATENCY_HIST_SUB_COUNT + sub;
+}
+
+static uint64_t bucket_top(size_t i) {
+    assert(i < LATENCY_HIST_BUCKETS);
+    if (i < LATENCY_HIST_SUB_COUNT) return i;
+
+    int shift = (int) (i / LATENCY_HIST_SUB_COUNT) - 1;
+    uint64_t sub = i % LATENCY_HIST_SUB_COUNT + LATENCY_HIST_SUB_COUNT;
+    return (sub << shift) + ((uint64_t) 1 << shift) - 1;
+}
+
+static void push_pending(uint64_t t_recv, uint64_t t_insert) {
+    if (s_n_pending == PENDING_MAX) {
+        size_t n_dropped = PENDING_MAX / 2;
+        memmove(s_pending, s_pending + n_dropped,
+                (s_n_pending - n_dropped) * sizeof(*s_pending));
+        s_n_pending -= n_dropped;
+        s_n_framed = s_n_framed > n_dropped ? s_n_framed - n_dropped : 0;
+    }
+
+    if (s_n_pending == s_cap_pending) {
+        size_t new_cap = s_cap_pending == 0
+                ? PENDING_INITIAL_CAP : s_cap_pending * 2;
+        pending_line *pending = (pending_line *) realloc(s_pending,
+                new_cap * sizeof(*pending));
+        if (pending == NULL) {
+            // TODO: communicate fatal error
+            log(LOGLEVEL_ERROR, "[latency] FATAL: out of memory.");
+            exit(23);
+        }
+        s_pending = pending;
+        s_cap_pending = new_cap;
+    }
+
+    pending_line *const line = &s_pending[s_n_pending++];
+    line->t_recv = t_recv;
+    line->t_insert = t_insert;
+    line->frame = 0;
+}
@@ -0,0 +1,44 @@
+#include "lebytes.h"
+
+#include <assert.h>
+
+void lebytes_put_u16(char *const p, uint16_t v) {
+    assert(p != NULL);
+    p[0] = (char) (v & 0xFF);
+    p[1] = (char) (v >> 8);
+}
+
+void lebytes_put_u32(char *const p, uint32_t v) {
+    assert(p != NULL);
+    for (int i = 0; i < 4; i++) p[i] = (char) ((v >> (8 * i)) & 0xFF);
+}
+
+void lebytes_put_u64(char *const p, uint64_t v) {
+    assert(p != NULL);
+    for (int i = 0; i < 8; i++) p[i] = (char) ((v >> (8 * i)) & 0xFF);
+}
+
+uint16_t lebytes_get_u16(const char *const p) {
+    assert(p != NULL);
+    return (uint16_t) ((unsigned char) p[0] | (unsigned char) p[1] << 8);
+}
+
+uint32_t lebytes_get_u32(const char *const p) {
+    assert(p != NULL);
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = v << 8 | (unsigned char) p[i];
+    return v;
+}
+
+uint64_t lebytes_get_u64(const char *const p) {
+    assert(p != NULL);
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | (unsigned char) p[i];
+    return v;
+}
+
+bool lebytes_read_exact(FILE *const in, char *const buf, size_t len) {
+    assert(in != NULL);
+    assert(buf != NULL || len == 0);
+    return fread(buf, 1, len, in) == len;
+}
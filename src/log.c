@@ -1,89 +1,647 @@
 #include "log.h"
 
+#include "logbin.h"
 #include "terminalutils.h"
 
 #include <assert.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// TODO: platform-specific code
+#include <windows.h>
+
+// Threads that can have a ring at once: main, recv, render, and one to spare.
+// Lines from any more are dropped.
+#define LOG_MAX_THREADS 4
+
+// Lines each ring holds. Must be a power of 2.
+#define LOG_RING_RECORDS 256
+
+// How often the writer writes out the rings when nothing wakes it sooner.
+#define LOG_FLUSH_INTERVAL_MS 50
+
+// Keeps what one thread writes off the cache line another one does.
+#define LOG_CACHE_LINE 64
+
+// log_site.state
+#define SITE_NEW 0
+#define SITE_REGISTERING 1
+#define SITE_READY 2
+
+typedef struct log_record {
+    // When it was logged (QueryPerformanceCounter()), to merge the rings in
+    // order.
+    int64_t ticks;
+    loglevel severity;
+    // For the binary log, the call site and thread it came from, and 'data'
+    // holds 'len' bytes of arguments (see logbin.h). Otherwise NULL, and
+    // 'data' holds the line.
+    log_site *site;
+    uint32_t thread_id;
+    uint16_t len;
+    char data[LOG_RECORD_MAXLEN];
+} log_record;
+
+// A single-producer, single-consumer ring: only its thread adds to it, only
+// the writer takes from it. Each side owns one index and only reads the
+// other's, so neither needs a lock.
+typedef struct log_ring {
+    // Where the thread adds the next record. Only ever increases; the slot is
+    // the index modulo LOG_RING_RECORDS.
+    volatile LONG head;
+    char pad_head[LOG_CACHE_LINE - sizeof(LONG)];
+    // Where the writer takes the next record from.
+    volatile LONG tail;
+    char pad_tail[LOG_CACHE_LINE - sizeof(LONG)];
+    // Records the thread found no room for.
+    volatile LONG dropped;
+    log_record records[LOG_RING_RECORDS];
+} log_ring;
+
+volatile loglevel log_module_levels[LOGMODULE_COUNT] = {
+    LOGLEVEL_WARNING, LOGLEVEL_WARNING, LOGLEVEL_WARNING, LOGLEVEL_WARNING,
+    LOGLEVEL_WARNING
+};
+
+// Names log_set_levels() takes, by level (from LOGLEVEL_ERROR) and by module.
+static const char *const s_level_names[] = {
+    "error", "warning", "info", "dev", "spam"
+};
+static const char *const s_module_names[LOGMODULE_COUNT] = {
+    "general", "parser", "recv", "screen", "handlers"
+};
 
-static loglevel logger_level = LOGLEVEL_WARNING;
 static FILE *s_out = NULL;
 static bool s_initialized = false;
 
+// Whether s_out gets the binary format.
+static bool s_binary = false;
+// Call sites registered so far.
+static volatile LONG s_n_sites = 0;
+// For log(), and for lines formatted where they're logged after all because
+// their format can't be stored: one string argument.
+static log_site s_text_site = { 0 };
+
+// Whether lines go to the rings rather than straight to s_out.
+static volatile LONG s_async = 0;
+static HANDLE s_writer_thread = NULL;
+// Set to have the writer write out the rings now.
+static HANDLE s_wake = NULL;
+static volatile LONG s_stopping = 0;
+
+static log_ring *s_rings = NULL;
+// Rings handed out so far; may run past LOG_MAX_THREADS.
+static volatile LONG s_n_rings = 0;
+// Bumped each time the writer starts, so rings from a previous run are handed
+// out again rather than used.
+static LONG s_generation = 0;
+// Lines from threads that got no ring.
+static volatile LONG s_dropped_unringed = 0;
+// Drops already reported in the log.
+static uint64_t s_dropped_reported = 0;
+
+// The calling thread's ring, and the run it was handed out in.
+// TODO: platform-specific code
+static __declspec(thread) log_ring *t_ring = NULL;
+static __declspec(thread) LONG t_ring_generation = 0;
+static __declspec(thread) DWORD t_thread_id = 0;
+
 // Sets the text color/format and prints the prefix for the provided severity.
 // You still need to call termutils_reset_all() when you're done printing. Call
 // once per log message, even for the same severity.
-static void prepare_console(loglevel severity);
+static void prepare_console(FILE *const out, loglevel severity);
+
+// Writes one whole line at 'severity'.
+static void write_line(loglevel severity, const char *const text);
+
+// Writes a record, in whichever format the log is in.
+static void write_record(log_record *const rec);
+
+// Writes a line of the log's own, in whichever format the log is in.
+static void write_notice(loglevel severity, const char *const text);
+
+// Gives 'site' an id and works out what its format takes, if that wasn't
+// done yet.
+static void register_site(log_site *const site, const char *const fmt);
+
+// Parses one item of a log_set_levels() list, 'len' characters long.
+static bool parse_level_item(const char *const item, size_t len,
+        logmodule *const module, bool *const all, loglevel *const level);
+// Looks up a name 'len' characters long in 'names'. Returns its index, or -1.
+static int find_name(const char *const *const names, int n_names,
+        const char *const name, size_t len);
+
+// Sets when 'rec' was logged, at 'severity'.
+static void stamp_record(log_record *const rec, loglevel severity);
+
+// Fill in the rest of 'rec' with the line to log.
+static void fill_record_str(log_record *const rec, const char *const msg);
+static void fill_record_fmt(log_record *const rec, log_site *const site,
+        const char *const fmt_str, va_list fmt_args);
+
+// The calling thread's ring, or NULL if all are taken.
+static log_ring *this_thread_ring(void);
+
+// Claims a slot in the calling thread's ring. Returns NULL, counting the line
+// as dropped, if there's no room.
+static log_record *begin_record(loglevel severity);
+// Hands the record from begin_record() to the writer.
+static void commit_record(loglevel severity);
+
+static DWORD WINAPI thread_main_log_writer(LPVOID data);
+
+// Writes out everything in the rings, oldest first.
+static void drain_rings(void);
+
+static LONG load_acquire(volatile LONG *const p);
+static void store_release(volatile LONG *const p, LONG value);
 
 void log_init(FILE *const log_to) {
     set_log_file(log_to == NULL ? stdout : log_to);
     s_initialized = true;
 }
 
+void log_init_binary(FILE *const log_to) {
+    log_init(log_to);
+    s_binary = true;
+    register_site(&s_text_site, "%s");
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    logbin_write_header(s_out, freq.QuadPart);
+}
+
 void set_logger_level(loglevel severity) {
-    logger_level = severity;
+    for (int i = 0; i < LOGMODULE_COUNT; i++)
+        log_module_levels[i] = severity;
+}
+
+void log_set_module_level(logmodule module, loglevel level) {
+    assert(module >= 0 && module < LOGMODULE_COUNT);
+    log_module_levels[module] = level;
+}
+
+loglevel log_module_level(logmodule module) {
+    assert(module >= 0 && module < LOGMODULE_COUNT);
+    return log_module_levels[module];
+}
+
+bool log_set_levels(const char *const spec) {
+    assert(spec != NULL);
+
+    const char *const delims = ", ";
+    // Check every item before applying any.
+    bool any = false;
+    for (int pass = 0; pass < 2; pass++) {
+        const char *item = spec + strspn(spec, delims);
+        while (*item != '\0') {
+            size_t len = strcspn(item, delims);
+            logmodule module;
+            bool all;
+            loglevel level;
+            if (!parse_level_item(item, len, &module, &all, &level))
+                return false;
+            if (pass == 1 && all) set_logger_level(level);
+            else if (pass == 1) log_set_module_level(module, level);
+            any = true;
+            item += len;
+            item += strspn(item, delims);
+        }
+    }
+    return any;
+}
+
+void log_describe_levels(char *const buf, size_t bufsize) {
+    assert(buf != NULL);
+    assert(bufsize > 0);
+
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < LOGMODULE_COUNT; i++) {
+        int n = snprintf(buf + len, bufsize - len, "%s%s=%s",
+                i == 0 ? "" : ",", s_module_names[i],
+                s_level_names[log_module_levels[i] - LOGLEVEL_ERROR]);
+        // Cut short if it doesn't fit.
+        if (n < 0 || (size_t) n >= bufsize - len) return;
+        len += (size_t) n;
+    }
 }
 
 void set_log_file(FILE *const log_to) {
+    assert(!s_async);
+    // Each call site's format goes in a binary log once; a new file wouldn't
+    // have them.
+    assert(!s_binary);
     if (log_to == NULL) s_out = stdout;
     else s_out = log_to;
 }
 
-void log(loglevel severity, const char *const msg) {
+void log_msg(loglevel severity, const char *const msg) {
     assert(s_initialized);
-    if (logger_level < severity) return;
 
-    prepare_console(severity);
-    fprintf_s(s_out, "%s\n", msg);
+    if (!load_acquire(&s_async)) {
+        if (!s_binary) {
+            write_line(severity, msg);
+            return;
+        }
+        log_record rec;
+        stamp_record(&rec, severity);
+        fill_record_str(&rec, msg);
+        write_record(&rec);
+        return;
+    }
 
-    termutils_reset_all(s_out);
+    log_record *const rec = begin_record(severity);
+    if (rec == NULL) return;
+    fill_record_str(rec, msg);
+    commit_record(severity);
 }
 
-void log_fmt(loglevel severity, const char *const fmt_str, ...) {
+void log_fmt_at(log_site *const site, loglevel severity,
+        const char *const fmt_str, ...)
+{
     assert(s_initialized);
-    if (logger_level < severity) return;
+    assert(site != NULL);
 
     va_list fmt_args;
     va_start(fmt_args, fmt_str);
 
-    prepare_console(severity);
+    if (!load_acquire(&s_async)) {
+        if (!s_binary) {
+            prepare_console(s_out, severity);
+            vfprintf_s(s_out, fmt_str, fmt_args);
+            va_end(fmt_args);
+            fputs("\n", s_out);
+            termutils_reset_all(s_out);
+            return;
+        }
+        log_record rec;
+        stamp_record(&rec, severity);
+        fill_record_fmt(&rec, site, fmt_str, fmt_args);
+        va_end(fmt_args);
+        write_record(&rec);
+        return;
+    }
 
-    vfprintf_s(s_out, fmt_str, fmt_args);
+    log_record *const rec = begin_record(severity);
+    if (rec != NULL) {
+        fill_record_fmt(rec, site, fmt_str, fmt_args);
+        commit_record(severity);
+    }
     va_end(fmt_args);
-    fputs("\n", s_out);
-    termutils_reset_all(s_out);// TODO: might have to be before the newline...
 }
 
-static void prepare_console(loglevel severity) {
+bool log_start_writer(void) {
+    assert(s_initialized);
+    assert(!s_async);
+
+    s_rings = calloc(LOG_MAX_THREADS, sizeof(*s_rings));
+    if (s_rings == NULL) {
+        log(LOGLEVEL_ERROR, "[log] Out of memory for the log writer.");
+        return false;
+    }
+    s_n_rings = 0;
+    s_generation++;
+    s_dropped_unringed = 0;
+    s_dropped_reported = 0;
+    s_stopping = 0;
+
+    // Auto-reset: each wakeup is taken by the one wait it ends.
+    s_wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (s_wake != NULL) {
+        s_writer_thread = CreateThread(NULL, 0, thread_main_log_writer, NULL,
+                0, NULL);
+    }
+    if (s_writer_thread == NULL) {
+        log_fmt(LOGLEVEL_ERROR, "[log] Can't start the log writer (%lu).",
+                GetLastError());
+        if (s_wake != NULL) CloseHandle(s_wake);
+        s_wake = NULL;
+        free(s_rings);
+        s_rings = NULL;
+        return false;
+    }
+
+    store_release(&s_async, 1);
+    return true;
+}
+
+void log_stop_writer(void) {
+    if (!load_acquire(&s_async)) return;
+
+    store_release(&s_async, 0);
+    store_release(&s_stopping, 1);
+    SetEvent(s_wake);
+    WaitForSingleObject(s_writer_thread, INFINITE);
+
+    CloseHandle(s_writer_thread);
+    CloseHandle(s_wake);
+    s_writer_thread = s_wake = NULL;
+    free(s_rings);
+    s_rings = NULL;
+    fflush(s_out);
+}
+
+void log_write_text(FILE *const out, loglevel severity, const char *const text)
+{
+    assert(out != NULL);
+    assert(text != NULL);
+    prepare_console(out, severity);
+    fprintf_s(out, "%s\n", text);
+    termutils_reset_all(out);
+}
+
+uint64_t log_dropped_count(void) {
+    if (s_rings == NULL) return s_dropped_reported;
+
+    uint64_t dropped = (uint64_t) load_acquire(&s_dropped_unringed);
+    LONG n_rings = load_acquire(&s_n_rings);
+    if (n_rings > LOG_MAX_THREADS) n_rings = LOG_MAX_THREADS;
+    for (LONG i = 0; i < n_rings; i++)
+        dropped += (uint64_t) load_acquire(&s_rings[i].dropped);
+    return dropped;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static void prepare_console(FILE *const out, loglevel severity) {
     switch (severity) {
     case LOGLEVEL_ERROR:
-        termutils_set_text_color(TERMUTILS_COLOR_RED, s_out);
-        termutils_set_bold(true, s_out);
-        fputs("<ERROR>   ", s_out);
-        termutils_set_bold(false, s_out);
+        termutils_set_text_color(TERMUTILS_COLOR_RED, out);
+        termutils_set_bold(true, out);
+        fputs("<ERROR>   ", out);
+        termutils_set_bold(false, out);
         break;
     case LOGLEVEL_WARNING:
-        termutils_set_text_color(TERMUTILS_COLOR_YELLOW, s_out);
-        termutils_set_bold(true, s_out);
-        fputs("<WARNING> ", s_out);
-        termutils_set_bold(false, s_out);
+        termutils_set_text_color(TERMUTILS_COLOR_YELLOW, out);
+        termutils_set_bold(true, out);
+        fputs("<WARNING> ", out);
+        termutils_set_bold(false, out);
         break;
     case LOGLEVEL_INFO:
-        fputs("<INFO>    ", s_out);
+        fputs("<INFO>    ", out);
         break;
     case LOGLEVEL_DEV:
-        termutils_set_text_color_256(250, s_out); // Light gray
-        fputs("<DEV>     ", s_out);
+        termutils_set_text_color_256(250, out); // Light gray
+        fputs("<DEV>     ", out);
         break;
     case LOGLEVEL_SPAM:
-        termutils_set_text_color_256(239, s_out); // Dark gray
-        fputs("<spam>    ", s_out);
+        termutils_set_text_color_256(239, out); // Dark gray
+        fputs("<spam>    ", out);
         break;
     default:
-        termutils_set_text_color(TERMUTILS_COLOR_MAGENTA, s_out);
-        termutils_set_bold(true, s_out);
-        fputs("<UNKNOWN LOGLEVEL> ", s_out);
-        termutils_set_bold(false, s_out);
+        termutils_set_text_color(TERMUTILS_COLOR_MAGENTA, out);
+        termutils_set_bold(true, out);
+        fputs("<UNKNOWN LOGLEVEL> ", out);
+        termutils_set_bold(false, out);
     }
 }
+
+static void write_line(loglevel severity, const char *const text) {
+    log_write_text(s_out, severity, text);
+}
+
+static void write_record(log_record *const rec) {
+    log_site *const site = rec->site;
+    if (site == NULL) {
+        write_line(rec->severity, rec->data);
+        return;
+    }
+
+    if (!site->written) {
+        logbin_write_site(s_out, site->id, site->fmt);
+        site->written = true;
+    }
+    logbin_write_line(s_out, site->id, (uint8_t) rec->severity,
+            rec->thread_id, rec->ticks, rec->data, rec->len);
+}
+
+static void write_notice(loglevel severity, const char *const text) {
+    log_record rec;
+    stamp_record(&rec, severity);
+    fill_record_str(&rec, text);
+    write_record(&rec);
+}
+
+static void register_site(log_site *const site, const char *const fmt) {
+    if (load_acquire(&site->state) == SITE_READY) return;
+
+    if (InterlockedCompareExchange(&site->state, SITE_REGISTERING, SITE_NEW)
+        != SITE_NEW)
+    {
+        // Another thread got there first; it won't take long.
+        while (load_acquire(&site->state) != SITE_READY) Sleep(0);
+        return;
+    }
+
+    site->fmt = fmt;
+    site->binary = logbin_parse_format(fmt, &site->args) &&
+                   site->args.fixed_size <= LOG_RECORD_MAXLEN;
+    site->id = (uint32_t) InterlockedIncrement(&s_n_sites);
+    store_release(&site->state, SITE_READY);
+}
+
+static bool parse_level_item(const char *const item, size_t len,
+        logmodule *const module, bool *const all, loglevel *const level)
+{
+    const char *const eq = memchr(item, '=', len);
+    const char *const level_name = eq == NULL ? item : eq + 1;
+    int i_level = find_name(s_level_names, (int) (sizeof(s_level_names)
+                / sizeof(s_level_names[0])), level_name,
+            len - (size_t) (level_name - item));
+    if (i_level < 0) return false;
+    *level = (loglevel) (LOGLEVEL_ERROR + i_level);
+
+    *all = eq == NULL;
+    if (*all) return true;
+    int i_module = find_name(s_module_names, LOGMODULE_COUNT, item,
+            (size_t) (eq - item));
+    if (i_module < 0) return false;
+    *module = (logmodule) i_module;
+    return true;
+}
+
+static int find_name(const char *const *const names, int n_names,
+        const char *const name, size_t len)
+{
+    for (int i = 0; i < n_names; i++) {
+        if (strlen(names[i]) == len && strncmp(names[i], name, len) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void stamp_record(log_record *const rec, loglevel severity) {
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    rec->ticks = ticks.QuadPart;
+    rec->severity = severity;
+}
+
+static void fill_record_str(log_record *const rec, const char *const msg) {
+    if (s_binary) {
+        if (t_thread_id == 0) t_thread_id = GetCurrentThreadId();
+        rec->thread_id = t_thread_id;
+        rec->site = &s_text_site;
+        rec->len = (uint16_t) logbin_encode_str(msg, rec->data,
+                sizeof(rec->data));
+        return;
+    }
+
+    rec->site = NULL;
+    size_t len = strlen(msg);
+    if (len >= sizeof(rec->data)) len = sizeof(rec->data) - 1;
+    memcpy(rec->data, msg, len);
+    rec->data[len] = '\0';
+}
+
+static void fill_record_fmt(log_record *const rec, log_site *const site,
+        const char *const fmt_str, va_list fmt_args)
+{
+    if (!s_binary) {
+        rec->site = NULL;
+        // Cuts the line short if it doesn't fit.
+        vsnprintf(rec->data, sizeof(rec->data), fmt_str, fmt_args);
+        return;
+    }
+
+    register_site(site, fmt_str);
+    if (t_thread_id == 0) t_thread_id = GetCurrentThreadId();
+    rec->thread_id = t_thread_id;
+    if (site->binary) {
+        rec->site = site;
+        rec->len = (uint16_t) logbin_encode_args(&site->args, fmt_args,
+                rec->data, sizeof(rec->data));
+        return;
+    }
+
+    // Formatted here after all, and stored as a string.
+    char text[LOG_RECORD_MAXLEN];
+    vsnprintf(text, sizeof(text), fmt_str, fmt_args);
+    rec->site = &s_text_site;
+    rec->len = (uint16_t) logbin_encode_str(text, rec->data,
+            sizeof(rec->data));
+}
+
+static log_ring *this_thread_ring(void) {
+    if (t_ring_generation == s_generation) return t_ring;
+
+    t_ring_generation = s_generation;
+    LONG i = InterlockedIncrement(&s_n_rings) - 1;
+    t_ring = i < LOG_MAX_THREADS ? &s_rings[i] : NULL;
+    return t_ring;
+}
+
+static log_record *begin_record(loglevel severity) {
+    log_ring *const ring = this_thread_ring();
+    if (ring == NULL) {
+        InterlockedIncrement(&s_dropped_unringed);
+        return NULL;
+    }
+
+    // Only this thread changes head.
+    LONG head = ring->head;
+    if (head - load_acquire(&ring->tail) == LOG_RING_RECORDS) {
+        InterlockedIncrement(&ring->dropped);
+        // Likely asleep; get it to make room.
+        SetEvent(s_wake);
+        return NULL;
+    }
+
+    log_record *const rec = &ring->records[head & (LOG_RING_RECORDS - 1)];
+    stamp_record(rec, severity);
+    return rec;
+}
+
+static void commit_record(loglevel severity) {
+    log_ring *const ring = t_ring;
+    assert(ring != NULL);
+
+    LONG head = ring->head + 1;
+    store_release(&ring->head, head);
+
+    // Errors go out right away, in case they're the last thing logged. Half
+    // full, the writer gets a head start on the rest.
+    if (severity == LOGLEVEL_ERROR ||
+        head - load_acquire(&ring->tail) == LOG_RING_RECORDS / 2)
+    {
+        SetEvent(s_wake);
+    }
+}
+
+static DWORD WINAPI thread_main_log_writer(LPVOID data) {
+    (void) data;
+
+    bool stopping = false;
+    while (!stopping) {
+        WaitForSingleObject(s_wake, LOG_FLUSH_INTERVAL_MS);
+        // Read before draining, so a last line logged before the stop is
+        // still written.
+        stopping = load_acquire(&s_stopping) != 0;
+        drain_rings();
+    }
+    return 0;
+}
+
+static void drain_rings(void) {
+    LONG n_rings = load_acquire(&s_n_rings);
+    if (n_rings > LOG_MAX_THREADS) n_rings = LOG_MAX_THREADS;
+
+    // Only what's in the rings now; more may come while this writes.
+    LONG heads[LOG_MAX_THREADS];
+    for (LONG i = 0; i < n_rings; i++)
+        heads[i] = load_acquire(&s_rings[i].head);
+
+    bool wrote = false;
+    for (;;) {
+        // Oldest record at the front of any ring.
+        log_ring *oldest = NULL;
+        for (LONG i = 0; i < n_rings; i++) {
+            log_ring *const ring = &s_rings[i];
+            if (ring->tail == heads[i]) continue;
+            const log_record *const rec =
+                &ring->records[ring->tail & (LOG_RING_RECORDS - 1)];
+            if (oldest == NULL || rec->ticks <
+                oldest->records[oldest->tail & (LOG_RING_RECORDS - 1)].ticks)
+            {
+                oldest = ring;
+            }
+        }
+        if (oldest == NULL) break;
+
+        log_record *const rec =
+            &oldest->records[oldest->tail & (LOG_RING_RECORDS - 1)];
+        write_record(rec);
+        // Only now can the thread reuse the slot.
+        store_release(&oldest->tail, oldest->tail + 1);
+        wrote = true;
+    }
+
+    uint64_t dropped = log_dropped_count();
+    if (dropped != s_dropped_reported) {
+        char msg[64];
+        sprintf_s(msg, sizeof(msg), "[log] %llu lines dropped.",
+                (unsigned long long) (dropped - s_dropped_reported));
+        write_notice(LOGLEVEL_WARNING, msg);
+        s_dropped_reported = dropped;
+        wrote = true;
+    }
+
+    if (wrote) fflush(s_out);
+}
+
+static LONG load_acquire(volatile LONG *const p) {
+    LONG value = *p;
+    // TODO: platform-specific code
+    MemoryBarrier();
+    return value;
+}
+
+static void store_release(volatile LONG *const p, LONG value) {
+    MemoryBarrier();
+    *p = value;
+}
@@ -0,0 +1,319 @@
+#include "logbin.h"
+
+#include "lebytes.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static bool is_unsigned_conv(char conv);
+
+bool logbin_parse_format(const char *const fmt, logbin_format *const f) {
+    assert(fmt != NULL);
+    assert(f != NULL);
+
+    memset(f, 0, sizeof(*f));
+    const char *p = fmt;
+    while ((p = strchr(p, '%')) != NULL) {
+        logbin_spec s;
+        p = logbin_parse_spec(p + 1, &s);
+        if (s.conv == '%') continue;
+
+        int type = logbin_spec_arg_type(&s);
+        int n_stars = s.width_star + s.precision_star;
+        if (type < 0 || f->n_args + n_stars + 1 > LOGBIN_MAX_ARGS)
+            return false;
+
+        for (int i = 0; i < n_stars; i++) {
+            f->types[f->n_args++] = LOGBIN_ARG_INT;
+            f->fixed_size += logbin_arg_size(LOGBIN_ARG_INT);
+        }
+        if (type == LOGBIN_ARG_STR) {
+            f->str_precision[f->n_args] = (int16_t) s.precision;
+            f->str_precision_arg[f->n_args] = s.precision_star;
+            f->fixed_size += 2;
+        }
+        else f->fixed_size += logbin_arg_size(type);
+        f->types[f->n_args++] = (uint8_t) type;
+    }
+    return true;
+}
+
+size_t logbin_encode_args(const logbin_format *const f, va_list args,
+        char *const buf, size_t size)
+{
+    assert(f != NULL);
+    assert(buf != NULL);
+    assert(size >= f->fixed_size);
+
+    size_t len = 0;
+    // What's left for strings after every argument's fixed part.
+    size_t str_room = size - f->fixed_size;
+    int last_int = 0;
+    for (int i = 0; i < f->n_args; i++) {
+        switch (f->types[i]) {
+        case LOGBIN_ARG_INT:
+            last_int = va_arg(args, int);
+            lebytes_put_u32(buf + len, (uint32_t) last_int);
+            len += 4;
+            break;
+        case LOGBIN_ARG_LONG:
+            lebytes_put_u64(buf + len, (uint64_t) (int64_t) va_arg(args, long));
+            len += 8;
+            break;
+        case LOGBIN_ARG_ULONG:
+            lebytes_put_u64(buf + len, (uint64_t) va_arg(args, unsigned long));
+            len += 8;
+            break;
+        case LOGBIN_ARG_LLONG:
+            lebytes_put_u64(buf + len, (uint64_t) va_arg(args, long long));
+            len += 8;
+            break;
+        case LOGBIN_ARG_SIZE:
+            lebytes_put_u64(buf + len, (uint64_t) va_arg(args, size_t));
+            len += 8;
+            break;
+        case LOGBIN_ARG_DOUBLE: {
+            double d = va_arg(args, double);
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(bits));
+            lebytes_put_u64(buf + len, bits);
+            len += 8;
+            break;
+        }
+        case LOGBIN_ARG_PTR:
+            lebytes_put_u64(buf + len,
+                    (uint64_t) (uintptr_t) va_arg(args, void *));
+            len += 8;
+            break;
+        case LOGBIN_ARG_STR: {
+            const char *str = va_arg(args, const char *);
+            if (str == NULL) str = "(null)";
+            // The precision may be all that ends the string.
+            int precision = f->str_precision_arg[i] ? last_int
+                                                    : f->str_precision[i];
+            size_t max = str_room;
+            if (precision >= 0 && (size_t) precision < max)
+                max = (size_t) precision;
+            // Stops at the end of the string, so never reads past it.
+            const char *end = memchr(str, '\0', max);
+            size_t str_len = end != NULL ? (size_t) (end - str) : max;
+            str_room -= str_len;
+
+            lebytes_put_u16(buf + len, (uint16_t) str_len);
+            memcpy(buf + len + 2, str, str_len);
+            len += 2 + str_len;
+            break;
+        }
+        default:
+            assert(!"Invalid logbin_arg_type!");
+        }
+    }
+    return len;
+}
+
+size_t logbin_encode_str(const char *const str, char *const buf, size_t size)
+{
+    assert(str != NULL);
+    assert(buf != NULL);
+    assert(size >= 2);
+
+    size_t str_len = strlen(str);
+    if (str_len > size - 2) str_len = size - 2;
+    if (str_len > UINT16_MAX) str_len = UINT16_MAX;
+    lebytes_put_u16(buf, (uint16_t) str_len);
+    memcpy(buf + 2, str, str_len);
+    return 2 + str_len;
+}
+
+void logbin_write_header(FILE *const out, int64_t ticks_per_s) {
+    assert(out != NULL);
+    char buf[LOGBIN_MAGIC_LEN + 8];
+    memcpy(buf, LOGBIN_MAGIC, LOGBIN_MAGIC_LEN);
+    lebytes_put_u64(buf + LOGBIN_MAGIC_LEN, (uint64_t) ticks_per_s);
+    fwrite(buf, 1, sizeof(buf), out);
+}
+
+void logbin_write_site(FILE *const out, uint32_t site_id,
+        const char *const fmt)
+{
+    assert(out != NULL);
+    assert(fmt != NULL);
+
+    size_t fmt_len = strlen(fmt);
+    if (fmt_len > UINT16_MAX) fmt_len = UINT16_MAX;
+    char buf[7];
+    buf[0] = LOGBIN_REC_SITE;
+    lebytes_put_u32(buf + 1, site_id);
+    lebytes_put_u16(buf + 5, (uint16_t) fmt_len);
+    fwrite(buf, 1, sizeof(buf), out);
+    fwrite(fmt, 1, fmt_len, out);
+}
+
+void logbin_write_line(FILE *const out, uint32_t site_id, uint8_t level,
+        uint32_t thread_id, int64_t ticks, const char *const args,
+        size_t args_len)
+{
+    assert(out != NULL);
+    assert(args != NULL || args_len == 0);
+    assert(args_len <= UINT16_MAX);
+
+    char buf[20];
+    buf[0] = LOGBIN_REC_LINE;
+    lebytes_put_u32(buf + 1, site_id);
+    buf[5] = (char) level;
+    lebytes_put_u32(buf + 6, thread_id);
+    lebytes_put_u64(buf + 10, (uint64_t) ticks);
+    lebytes_put_u16(buf + 18, (uint16_t) args_len);
+    fwrite(buf, 1, sizeof(buf), out);
+    fwrite(args, 1, args_len, out);
+}
+
+bool logbin_read_header(FILE *const in, int64_t *const ticks_per_s) {
+    assert(in != NULL);
+    assert(ticks_per_s != NULL);
+
+    char buf[LOGBIN_MAGIC_LEN + 8];
+    if (!lebytes_read_exact(in, buf, sizeof(buf)) ||
+        memcmp(buf, LOGBIN_MAGIC, LOGBIN_MAGIC_LEN) != 0)
+    {
+        return false;
+    }
+    *ticks_per_s = (int64_t) lebytes_get_u64(buf + LOGBIN_MAGIC_LEN);
+    return true;
+}
+
+int logbin_read(FILE *const in, logbin_record *const rec, char *const buf,
+        size_t bufsize)
+{
+    assert(in != NULL);
+    assert(rec != NULL);
+    assert(buf != NULL);
+
+    int type = fgetc(in);
+    if (type == EOF) return 0;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->type = (char) type;
+    char head[19];
+    size_t head_len = type == LOGBIN_REC_SITE ? 6
+                    : type == LOGBIN_REC_LINE ? 19 : 0;
+    if (head_len == 0 || !lebytes_read_exact(in, head, head_len)) return -1;
+
+    rec->site_id = lebytes_get_u32(head);
+    if (type == LOGBIN_REC_LINE) {
+        rec->level = (uint8_t) head[4];
+        rec->thread_id = lebytes_get_u32(head + 5);
+        rec->ticks = (int64_t) lebytes_get_u64(head + 9);
+    }
+    rec->len = lebytes_get_u16(head + head_len - 2);
+    if (rec->len >= bufsize || !lebytes_read_exact(in, buf, rec->len))
+        return -1;
+    buf[rec->len] = '\0';
+    rec->data = buf;
+    return 1;
+}
+
+const char *logbin_parse_spec(const char *p, logbin_spec *const s) {
+    assert(p != NULL);
+    assert(s != NULL);
+
+    memset(s, 0, sizeof(*s));
+    s->precision = -1;
+
+    s->flags = p;
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL) p++;
+    if (*p == '*') {
+        s->width_star = true;
+        p++;
+    }
+    else while (*p >= '0' && *p <= '9') p++;
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            s->precision_star = true;
+            p++;
+        }
+        else {
+            s->precision = 0;
+            while (*p >= '0' && *p <= '9')
+                s->precision = s->precision * 10 + (*p++ - '0');
+        }
+    }
+    s->flags_len = (size_t) (p - s->flags);
+
+    if (p[0] == 'h') {
+        s->length = LOGBIN_LENGTH_SHORT;
+        p += p[1] == 'h' ? 2 : 1;
+    }
+    else if (p[0] == 'l' && p[1] == 'l') {
+        s->length = LOGBIN_LENGTH_LLONG;
+        p += 2;
+    }
+    else if (p[0] == 'l') {
+        s->length = LOGBIN_LENGTH_LONG;
+        p++;
+    }
+    else if (p[0] == 'I' && p[1] == '6' && p[2] == '4') {
+        s->length = LOGBIN_LENGTH_LLONG;
+        p += 3;
+    }
+    else if (p[0] == 'j') {
+        s->length = LOGBIN_LENGTH_LLONG;
+        p++;
+    }
+    else if (p[0] == 'z' || p[0] == 't') {
+        s->length = LOGBIN_LENGTH_SIZE;
+        p++;
+    }
+    else if (p[0] == 'L') {
+        s->length = LOGBIN_LENGTH_LDOUBLE;
+        p++;
+    }
+
+    s->conv = *p;
+    if (*p != '\0') p++;
+    return p;
+}
+
+int logbin_spec_arg_type(const logbin_spec *const s) {
+    assert(s != NULL);
+
+    switch (s->conv) {
+    case 'c':
+        // Not wide characters.
+        return s->length == LOGBIN_LENGTH_NONE ? LOGBIN_ARG_INT : -1;
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+        switch (s->length) {
+        case LOGBIN_LENGTH_NONE:
+        case LOGBIN_LENGTH_SHORT:
+            return LOGBIN_ARG_INT;
+        case LOGBIN_LENGTH_LONG:
+            return is_unsigned_conv(s->conv) ? LOGBIN_ARG_ULONG
+                                             : LOGBIN_ARG_LONG;
+        case LOGBIN_LENGTH_LLONG: return LOGBIN_ARG_LLONG;
+        case LOGBIN_LENGTH_SIZE: return LOGBIN_ARG_SIZE;
+        default: return -1;
+        }
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a':
+    case 'A':
+        return s->length == LOGBIN_LENGTH_NONE ? LOGBIN_ARG_DOUBLE : -1;
+    case 's':
+        return s->length == LOGBIN_LENGTH_NONE ? LOGBIN_ARG_STR : -1;
+    case 'p':
+        return LOGBIN_ARG_PTR;
+    default:
+        return -1;
+    }
+}
+
+size_t logbin_arg_size(int type) {
+    return type == LOGBIN_ARG_STR ? 2 : type == LOGBIN_ARG_INT ? 4 : 8;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static bool is_unsigned_conv(char conv) {
+    return conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o';
+}
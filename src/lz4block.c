@@ -0,0 +1,217 @@
+#include "lz4block.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define LZ4_MIN_MATCH 4
+// The last match must start at least this many bytes before the end of the
+// input, and the last this many bytes are always literals.
+#define LZ4_MFLIMIT 12
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_LOG 12
+#define LZ4_RUN_MASK 15
+// Short literal runs are copied with one fixed-size memcpy() when both buffers
+// have this much room left, which the compiler turns into a couple of moves.
+#define LZ4_FAST_LITERALS 16
+// Matches are copied this many bytes at a time when far enough back not to
+// overlap, possibly writing a few bytes past the end that the next sequence
+// overwrites.
+#define LZ4_FAST_MATCH_STEP 8
+
+static uint32_t read32(const uint8_t *const p);
+static uint32_t hash4(uint32_t seq);
+
+// Writes 'len' as LZ4's 255-run length extension, once the 4 bits in the
+// token are full.
+static bool write_len(uint8_t *const dst, size_t cap, size_t *const op,
+        size_t len);
+
+// Writes one sequence: the literals, then a match of 'match_len' bytes at
+// 'offset' back, or no match for the last sequence ('match_len' 0).
+static bool write_seq(uint8_t *const dst, size_t cap, size_t *const op,
+        const uint8_t *const lits, size_t n_lits,
+        size_t offset, size_t match_len);
+
+size_t lz4_compress_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+size_t lz4_compress(const uint8_t *const src, size_t n,
+        uint8_t *const dst, size_t dst_cap)
+{
+    assert(src != NULL || n == 0);
+    assert(dst != NULL);
+
+    // Positions of the last 4 bytes seen with each hash. A stale or colliding
+    // entry is caught by comparing the bytes.
+    uint32_t table[1 << LZ4_HASH_LOG];
+    memset(table, 0, sizeof(table));
+
+    size_t ip = 0, anchor = 0, op = 0;
+    while (n >= LZ4_MFLIMIT && ip + LZ4_MFLIMIT <= n) {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = hash4(seq);
+        size_t ref = table[h];
+        table[h] = (uint32_t) ip;
+        if (ref >= ip || ip - ref > LZ4_MAX_OFFSET ||
+            read32(src + ref) != seq)
+        {
+            ip++;
+            continue;
+        }
+
+        size_t len = LZ4_MIN_MATCH, len_max = n - LZ4_LAST_LITERALS - ip;
+        while (len < len_max && src[ref + len] == src[ip + len]) len++;
+        while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+            ip--;
+            ref--;
+            len++;
+        }
+
+        if (!write_seq(dst, dst_cap, &op, src + anchor, ip - anchor, ip - ref,
+                len))
+        {
+            return 0;
+        }
+        ip += len;
+        anchor = ip;
+        // Catch matches starting inside the one just taken.
+        if (ip >= 2 && ip + LZ4_MFLIMIT <= n) {
+            table[hash4(read32(src + ip - 2))] = (uint32_t) (ip - 2);
+        }
+    }
+
+    if (!write_seq(dst, dst_cap, &op, src + anchor, n - anchor, 0, 0)) return 0;
+    return op;
+}
+
+bool lz4_decompress(const uint8_t *const src, size_t n,
+        uint8_t *const dst, size_t raw_len)
+{
+    assert(src != NULL);
+    assert(dst != NULL || raw_len == 0);
+
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        uint8_t token = src[ip++];
+
+        size_t n_lits = token >> 4;
+        if (n_lits < LZ4_RUN_MASK && n - ip >= LZ4_FAST_LITERALS &&
+            raw_len - op >= LZ4_FAST_LITERALS)
+        {
+            memcpy(dst + op, src + ip, LZ4_FAST_LITERALS);
+        }
+        else {
+            if (n_lits == LZ4_RUN_MASK) {
+                uint8_t b;
+                do {
+                    if (ip >= n) return false;
+                    b = src[ip++];
+                    n_lits += b;
+                } while (b == 255);
+            }
+            if (n_lits > n - ip || n_lits > raw_len - op) return false;
+            memcpy(dst + op, src + ip, n_lits);
+        }
+        ip += n_lits;
+        op += n_lits;
+
+        // The last sequence has no match.
+        if (ip == n) break;
+
+        if (n - ip < 2) return false;
+        size_t offset = (size_t) src[ip] | ((size_t) src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        size_t len = token & LZ4_RUN_MASK;
+        if (len == LZ4_RUN_MASK) {
+            uint8_t b;
+            do {
+                if (ip >= n) return false;
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        len += LZ4_MIN_MATCH;
+        if (len > raw_len - op) return false;
+
+        uint8_t *const out = dst + op;
+        const uint8_t *const ref = out - offset;
+        if (offset >= LZ4_FAST_MATCH_STEP &&
+            raw_len - op >= len + LZ4_FAST_MATCH_STEP)
+        {
+            for (size_t i = 0; i < len; i += LZ4_FAST_MATCH_STEP)
+                memcpy(out + i, ref + i, LZ4_FAST_MATCH_STEP);
+        }
+        else if (offset >= len) {
+            memcpy(out, ref, len);
+        }
+        else {
+            // Overlapping: the match repeats bytes it's writing.
+            for (size_t i = 0; i < len; i++) out[i] = ref[i];
+        }
+        op += len;
+    }
+    return op == raw_len;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static uint32_t read32(const uint8_t *const p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash4(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+static bool write_len(uint8_t *const dst, size_t cap, size_t *const op,
+        size_t len)
+{
+    for (; len >= 255; len -= 255) {
+        if (*op >= cap) return false;
+        dst[(*op)++] = 255;
+    }
+    if (*op >= cap) return false;
+    dst[(*op)++] = (uint8_t) len;
+    return true;
+}
+
+static bool write_seq(uint8_t *const dst, size_t cap, size_t *const op,
+        const uint8_t *const lits, size_t n_lits,
+        size_t offset, size_t match_len)
+{
+    assert(match_len == 0 || match_len >= LZ4_MIN_MATCH);
+    assert(match_len == 0 || (offset > 0 && offset <= LZ4_MAX_OFFSET));
+
+    size_t ml = match_len == 0 ? 0 : match_len - LZ4_MIN_MATCH;
+    if (*op >= cap) return false;
+    dst[(*op)++] = (uint8_t) (
+        ((n_lits < LZ4_RUN_MASK ? n_lits : LZ4_RUN_MASK) << 4) |
+        (ml < LZ4_RUN_MASK ? ml : LZ4_RUN_MASK));
+
+    if (n_lits >= LZ4_RUN_MASK &&
+        !write_len(dst, cap, op, n_lits - LZ4_RUN_MASK))
+    {
+        return false;
+    }
+    if (n_lits > cap - *op) return false;
+    // 'lits' may be NULL for empty input, which memcpy() doesn't allow.
+    if (n_lits > 0) memcpy(dst + *op, lits, n_lits);
+    *op += n_lits;
+
+    if (match_len == 0) return true;
+
+    if (cap - *op < 2) return false;
+    dst[(*op)++] = (uint8_t) (offset & 0xFF);
+    dst[(*op)++] = (uint8_t) (offset >> 8);
+    if (ml >= LZ4_RUN_MASK && !write_len(dst, cap, op, ml - LZ4_RUN_MASK)) {
+        return false;
+    }
+    return true;
+}
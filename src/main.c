@@ -1,9 +1,17 @@
 #include "log.h"
+#include "capture.h"
+#include "framesched.h"
 #include "handlers.h"
+#include "latency.h"
 #include "msgqueue.h"
 #include "msgutils.h"
+#include "render.h"
+#include "renderthread.h"
 #include "screen_framework.h"
 #include "terminalutils.h"
+#include "termkeys.h"
+#include "termreply.h"
+#include "vtgrid.h"
 
 #include <assert.h>
 #include <share.h>
@@ -11,6 +19,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <winsock2.h>
 #include <ws2tcpip.h>
 
@@ -22,15 +31,7 @@
 // they need to reduce their message by as long as we can read it all.
 #define INPUT_BUF_LEN 1024 * 4
 
-// Needs to be large enough to hold all displayed characters plus all formatting
-// data from ANSI escape codes. The screen buff is re-used so there's little 
-// downside to severely overestimating this.
-// 512 columns, 128 rows, doubled for formatting space = 131kb
-// If you are displaying more text than that on a single screen, seek help.
-#define SCREEN_BUF_SIZE 512 * 128 * 2
-
-// The status line is a single line across the top of the screen. Same logic as
-// screen buf on the size, but only for one line.
+// The status line is a single line across the top of the screen.
 #define STATLINE_BUF_SIZE 512 * 2
 
 // Longest timestamp we'll write is: YYYY-MM-DD HH:MM:SS + \0.
@@ -41,7 +42,75 @@
 #define MAX_NICK_LEN 9
 #define MAX_CHANNEL_NAME_LEN 50
 
+// Most console input events read at once.
+#define INPUT_EVENTS_MAX 128
+// Most typed characters held back as a possible reply to a query; longer than
+// any reply looked for.
+#define HELD_KEYS_MAX 32
+// Most batches of answers waiting on different frames; past that, a batch is
+// added to the last one and waits for the later frame.
+#define HELD_SENDS_MAX 16
+// Answers to misc/floodserver.c's timing PINGs, which are held until the
+// lines received before them are on screen. Anything else is sent right away.
+#define TIMING_PONG_PREFIX "PONG :flood "
+
+// How long the terminal gets to say whether it supports synchronized output
+// before frames go out without it for good.
+#define SYNC_REPLY_TIMEOUT_US 2000000
+
 const_str logfile_name = "athena.log";
+// With the "binary" log format; see misc/logdecode.c to read it.
+const_str binlogfile_name = "athena.binlog";
+
+// Composes the UI. When frames are drawn on this thread, it also knows what
+// the terminal shows, so each frame only sends what changed.
+static renderer s_renderer;
+
+// Whether the render thread presents and writes frames (see renderthread.h),
+// rather than this one.
+static bool s_render_threaded = false;
+
+// Whether to send frames as synchronized updates (see vtgrid.h).
+static bool s_sync_output = false;
+
+// Size of the console window as of the last check.
+static int s_term_rows = 0;
+static int s_term_cols = 0;
+// Whether the console reported a resize (WINDOW_BUFFER_SIZE_EVENT) since the
+// size was last read. Set so that the first pass reads it.
+static bool s_term_resized = true;
+
+// The last frame composed, and the last one written, found unchanged or
+// dropped, by their latency_frame_composed() numbers; 0 for none yet.
+static uint64_t s_frame_composed = 0;
+static uint64_t s_frame_done = 0;
+
+// Timing answers taken from QUEUE_OUT, oldest first, each batch waiting for a
+// frame to be done with.
+typedef struct held_sends {
+    msglist msgs;
+    uint64_t frame;
+} held_sends;
+static held_sends s_held_sends[HELD_SENDS_MAX];
+static int s_n_held_sends = 0;
+
+// Whether the terminal was asked about synchronized output (DEC mode 2026) and
+// hasn't answered yet, and until when to wait. Until it says it supports the
+// mode, frames are written without it. Once the wait is over, a late answer is
+// still taken out of the input, but ignored.
+static bool s_sync_asked = false;
+static bool s_sync_timed_out = false;
+static uint64_t s_sync_deadline_us = 0;
+
+// Replies to queries arrive as typed characters, and may be split across
+// reads. From an ESC on, typed characters go through this decoder and are held
+// back from the input until it's known whether they are a reply; when they
+// aren't, they're let through in order.
+static termkeys_decoder s_reply_dec;
+static INPUT_RECORD s_held_keys[HELD_KEYS_MAX];
+static size_t s_n_held_keys = 0;
+// When the last held character arrived.
+static uint64_t s_held_key_us = 0;
 
 DWORD WINAPI thread_main_recv(LPVOID data);
 DWORD WINAPI thread_main_ui(LPVOID);
@@ -51,13 +120,46 @@ void DEBUG_print_addr_info(struct addrinfo* addr_info);
 // the active screen's UI state.
 static bool process_console_input(HANDLE h_stdin);
 
-// Orchestrates the drawing of the entire UI, including the active screen's
-// log w/ scroll, input buffer, the global status status bar, etc., all within
-// the current terminal width/height.
-static void draw_screen(HANDLE h_stdout,
-        char *const screenbuf, size_t screenbuf_size,
-        char *const statbuf, size_t statbuf_size,
-        char *const headbuf, size_t headbuf_size);
+// Maps a console input record to the key event it stands for. Returns false
+// for records that aren't one, such as key releases and mouse moves.
+static bool console_record_to_key(const INPUT_RECORD *const rec,
+        termkey_event *const ev);
+
+// Applies a key or wheel event to the active screen's UI state. Returns true
+// if it asks to quit.
+static bool apply_key(const termkey_event *const ev);
+
+// Feeds 'rec' to the reply decoder if it's a character that may be part of a
+// reply: an ESC, or anything typed after one. Returns true if it was taken,
+// either held back or swallowed with the reply it ended. Sets 'quit' if held
+// keys let through asked to quit.
+static bool take_reply_key(const INPUT_RECORD *const rec, bool *const quit);
+
+// Applies the first 'n' held keys to the UI state, in order. Returns true if
+// one asks to quit.
+static bool release_held_keys(size_t n);
+
+// Acts on the terminal's answer to the synchronized output query.
+static void set_sync_output(termreply_mode_status status);
+
+// Draws the parts of the UI in 'dirty' (FRAME_DIRTY_*) for the current
+// terminal width/height, and writes what changed to the console; or, with the
+// render thread running, composes the frame and hands it to that thread.
+static void draw_screen(HANDLE h_stdout, uint32_t dirty);
+
+// Reads the console window's size, after a resize was reported, and marks the
+// whole UI dirty if it changed.
+static void check_term_size(HANDLE h_stdout);
+
+// Sends what's waiting in QUEUE_OUT, except for timing answers, which are
+// held to be sent once the frame numbered 'frame' is done with.
+static void send_queued(SOCKET sock, uint64_t frame);
+
+// Sends the timing answers held for frames up to s_frame_done.
+static void send_held(SOCKET sock);
+
+// Sends every message in 'msgs' and frees them.
+static void send_msgs(SOCKET sock, msglist *const msgs);
 
 
 int main(int argc, char* argv[]) {
@@ -72,38 +174,35 @@ int main(int argc, char* argv[]) {
         return 23;
     }
     */
-    FILE *logfile = _fsopen(logfile_name, "w", _SH_DENYWR);
+    bool binlog = argc >= 7 && strcmp(argv[6], "binary") == 0;
+    const_str log_name = binlog ? binlogfile_name : logfile_name;
+    FILE *logfile = _fsopen(log_name, binlog ? "wb" : "w", _SH_DENYWR);
     if (logfile == NULL) {
-        printf("[main] Can't open '%s' for write.\n", logfile_name);
+        printf("[main] Can't open '%s' for write.\n", log_name);
         return 23;
     }
-    log_init(logfile);
+    if (binlog) log_init_binary(logfile);
+    else log_init(logfile);
 
     if (argc < 3) {
         log(LOGLEVEL_ERROR,
-                "Usage: client <hostname> <port> [loglevel=\"warning\"]");
+                "Usage: client <hostname> <port> "
+                "[loglevel=\"warning\"|e.g. \"warning,parser=spam\"] "
+                "[nick] [utf8] [logformat=\"text\"|\"binary\"] "
+                "[capture file]");
         return 23;
     }
 
+    set_logger_level(LOGLEVEL_WARNING);
     if (argc >= 4) {
-        if (strcmp(argv[3], "spam") == 0) {
-            set_logger_level(LOGLEVEL_SPAM);
-        } else if (strcmp(argv[3], "dev") == 0) {
-            set_logger_level(LOGLEVEL_DEV);
-        } else if (strcmp(argv[3], "info") == 0) {
-            set_logger_level(LOGLEVEL_INFO);
-        } else if (strcmp(argv[3], "warning") == 0) {
-            set_logger_level(LOGLEVEL_WARNING);
-        } else if (strcmp(argv[3], "error") == 0) {
-            set_logger_level(LOGLEVEL_ERROR);
-        } else {
-            set_logger_level(LOGLEVEL_WARNING);
+        if (!log_set_levels(argv[3])) {
             log_fmt(LOGLEVEL_WARNING, "Unknown loglevel '%s'. Options are "
-                    "'spam', 'dev', info', 'warning', and 'error'. Defaulting "
-                    "to 'warning'.", argv[3]);
+                    "'spam', 'dev', 'info', 'warning', and 'error', for every "
+                    "module or as e.g. 'parser=spam' for one of 'general', "
+                    "'parser', 'recv', 'screen' and 'handlers', separated by "
+                    "commas. Defaulting to 'warning'.", argv[3]);
         }
     } else {
-        set_logger_level(LOGLEVEL_WARNING);
         log_fmt(LOGLEVEL_WARNING, "No loglevel specified; set to 'warning'.");
     }
 
@@ -217,6 +316,14 @@ int main(int argc, char* argv[]) {
         log_fmt(LOGLEVEL_DEV, "[main] Sent: %s", send_buff[i]);
     }
 
+    // From here on, more than one thread logs, and none should wait on the
+    // file.
+    bool log_async = log_start_writer();
+
+    // Everything the server sends from here on, for misc/replay.c. Not
+    // capturing is no reason not to run.
+    if (argc >= 8) capture_start(argv[7]);
+
     DWORD recv_thread_id = 0;
     HANDLE h_recv_thread = CreateThread(
             NULL, 0, thread_main_recv, &sock, 0, &recv_thread_id);
@@ -227,6 +334,7 @@ int main(int argc, char* argv[]) {
     if (h_stdin == INVALID_HANDLE_VALUE || h_stdout == INVALID_HANDLE_VALUE) {
         log(LOGLEVEL_ERROR, "[main] GetStdHandle() returned invalid handle.");
         WSACleanup();
+        log_stop_writer();
         fclose(logfile);
         return 23;
     }
@@ -236,6 +344,7 @@ int main(int argc, char* argv[]) {
         log_fmt(LOGLEVEL_ERROR,
                 "[main] GetConsoleMode() failed (%lu).", GetLastError());
         WSACleanup();
+        log_stop_writer();
         fclose(logfile);
         return 23;
     }
@@ -243,19 +352,34 @@ int main(int argc, char* argv[]) {
     // Quick Edit mode seems to interfere with mouse input; before diabling it,
     // scroll events were coming in as key events for up/down arrow.
     // Note that ENABLE_EXTENDED_FLAGS must be enabled to disable Quick Edit.
-	DWORD new_mode = (ENABLE_MOUSE_INPUT | ENABLE_EXTENDED_FLAGS) &
-                     ~(ENABLE_QUICK_EDIT_MODE);
+    // Window input reports resizes, so the size is only read after one.
+	DWORD new_mode = (ENABLE_MOUSE_INPUT | ENABLE_WINDOW_INPUT |
+                      ENABLE_EXTENDED_FLAGS) & ~(ENABLE_QUICK_EDIT_MODE);
     if (!SetConsoleMode(h_stdin, new_mode)) {
         log_fmt(LOGLEVEL_ERROR,
                 "[main] SetConsoleMode() failed (%lu).", GetLastError());
         WSACleanup();
+        log_stop_writer();
         fclose(logfile);
         return 23;
     }
 
-    // Use alternative screen buffer
+    // Use alternative screen buffer. Frames are written straight to the
+    // console, so nothing can be left sitting in stdio's buffer.
     printf("\033[?1049h");
 
+    // Ask whether the terminal can show frames whole instead of as they're
+    // drawn. It answers through the input; see take_sync_reply().
+    char sync_query[TERMREPLY_QUERY_MAXLEN];
+    if (termreply_query_mode(sync_query, sizeof(sync_query),
+            TERMREPLY_MODE_SYNC_OUTPUT) > 0)
+    {
+        fputs(sync_query, stdout);
+        s_sync_asked = true;
+        s_sync_deadline_us = latency_now_us() + SYNC_REPLY_TIMEOUT_US;
+    }
+    fflush(stdout);
+
     // Failure here is not worth exiting over; there will just be no Unicode.
     DWORD prev_out_codepage = GetConsoleOutputCP();
     log_fmt(LOGLEVEL_INFO, "[main] prev_out_codepage=%lu", prev_out_codepage);
@@ -279,6 +403,13 @@ int main(int argc, char* argv[]) {
     } else log(LOGLEVEL_WARNING, "[main] Unicode disabled by default.");
 
     if (utf8) log(LOGLEVEL_WARNING, "[main] Unicode enabled.");
+    renderer_init(&s_renderer);
+    s_renderer.grid.utf8 = utf8;
+    // Writing to the console can take a while; better the render thread waits
+    // on it than message handling and input.
+    s_render_threaded = renderthread_start(h_stdout, utf8);
+    if (!s_render_threaded)
+        log(LOGLEVEL_WARNING, "[main] Drawing frames on the main thread.");
 
     char buf_hometopic[STATLINE_BUF_SIZE];
 // 0xF0 0x9F 0x9B 0x9C 
@@ -291,28 +422,35 @@ int main(int argc, char* argv[]) {
     scrmgr_set_topic("home", buf_hometopic);
 
     bool bye = false;
-    char drawbuf_screen[SCREEN_BUF_SIZE] = { 0 };
-    char drawbuf_statline[STATLINE_BUF_SIZE] = { 0 };
-    char drawbuf_header[STATLINE_BUF_SIZE] = { 0 };
 
     while (!bye) {
+        // Everything handled this iteration is stamped with the same time.
+        int64_t now = (int64_t) time(NULL);
         char timestamp_buf[TIMESTAMP_BUF_SIZE];
-        msgutils_get_timestamp(timestamp_buf, sizeof(timestamp_buf), false,
-                TIMESTAMP_FORMAT_TIME_ONLY);
+        msgutils_format_timestamp(timestamp_buf, sizeof(timestamp_buf), now,
+                false, TIMESTAMP_FORMAT_TIME_ONLY);
 
         // INCOMING msgs
         msglist msgs_in = msg_queue_takeall(QUEUE_IN);
+        uint64_t t_dequeue = latency_now_us();
         struct msgnode *curr_msgnode = msgs_in.head;
         while (curr_msgnode != NULL) {
             // TODO: Get all of the initial connection server msgs printable
             log_fmt(LOGLEVEL_DEV, "[main] [%s] SERVER SAYS: \"%s\"",
                     timestamp_buf, curr_msgnode->msg);
 
+            latency_msg_begin(curr_msgnode->t_recv, curr_msgnode->t_submit,
+                    t_dequeue);
             ircmsg *ircm = msgutils_ircmsg_parse(curr_msgnode->msg);
             curr_msgnode = curr_msgnode->next;
-            if (ircm == NULL) continue;
+            if (ircm == NULL) {
+                latency_msg_end();
+                continue;
+            }
  
-            handle_ircmsg(ircm, timestamp_buf);
+            latency_msg_parsed();
+            handle_ircmsg(ircm, now);
+            latency_msg_end();
             msgutils_ircmsg_free(ircm);
         }
  
@@ -326,24 +464,48 @@ int main(int argc, char* argv[]) {
             assert(msg != NULL);
             curr_msgnode = curr_msgnode->next;
 
-            bye = handle_user_command(msg, nick, sock, timestamp_buf);
+            bye = handle_user_command(msg, nick, sock, now);
             if (bye) break;
         }
         msglist_free(&msgs_ui);
 
         // Update the UI
         process_console_input(h_stdin);
+        if (s_term_resized) check_term_size(h_stdout);
 
-        draw_screen(h_stdout,
-                drawbuf_screen, sizeof(drawbuf_screen),
-                drawbuf_statline, sizeof(drawbuf_statline),
-                drawbuf_header, sizeof(drawbuf_header));
+        uint32_t dirty = framesched_take(latency_now_us());
+        if (dirty != 0) {
+            draw_screen(h_stdout, dirty);
+        }
+        if (s_render_threaded) s_frame_done = renderthread_report_outcomes();
+
+        // Timing answers go out once a frame with everything received before
+        // them has been written to the console, so misc/floodserver.c timing
+        // PING to PONG times how long lines take to reach the screen. That's
+        // the frame last composed, or if one is due but not yet composed, the
+        // next. Keepalives and everything else don't wait on the console.
+        uint64_t answer_frame = s_frame_composed;
+        if (framesched_wait_ms(latency_now_us(), UINT32_MAX) != UINT32_MAX)
+            answer_frame++;
+        send_queued(sock, answer_frame);
+        send_held(sock);
         
-        // TODO: if debug, or option?
-        fflush(logfile);
+        // The log writer flushes after each batch it writes.
+        if (!log_async) fflush(logfile);
+
+        // Sleep until there's input or the next frame is due. Incoming lines
+        // don't wake this, so while idle it still comes around once a frame
+        // interval to pick them up.
+        uint32_t idle_ms = 1000 / framesched_get_max_fps();
+        WaitForSingleObject(h_stdin, framesched_wait_ms(latency_now_us(),
+                idle_ms > 0 ? idle_ms : 1));
     }
 
     WaitForSingleObject(h_recv_thread, INFINITE);
+    capture_stop();
+
+    // The last frame goes out before anything else is written.
+    renderthread_stop();
 
     printf("\033[0m"); // Reset all formatting modes
     printf("\033[2J"); // Clear entire screen
@@ -362,9 +524,22 @@ int main(int argc, char* argv[]) {
     }
 
     printf("\033[?1049l"); // Return from alternative screen buffer
+
+    // Where each message's time went, left on the normal screen.
+    if (latency_get_hist(LATENCY_WAITING)->count > 0) {
+        printf("Latency by stage, from recv() to the screen:\n");
+        for (int stage = 0; stage < LATENCY_N_STAGES; stage++) {
+            char desc[LATENCY_DESC_SIZE];
+            latency_describe((latency_stage) stage, desc, sizeof(desc));
+            printf("%s\n", desc);
+            log_fmt(LOGLEVEL_INFO, "[main] %s", desc);
+        }
+    }
+    renderer_free(&s_renderer);
     
     closesocket(sock);
     WSACleanup();
+    log_stop_writer();
     fclose(logfile);
 
     return 0;
@@ -373,99 +548,330 @@ int main(int argc, char* argv[]) {
 // TODO: platform-specific code
 static bool process_console_input(HANDLE h_stdin) {
     bool user_quit = false;
-    screen_ui_state *const st = scrmgr_get_active_ui_state();
-    assert(st != NULL);
+
+    uint64_t now = latency_now_us();
+    if (s_sync_asked && !s_sync_timed_out && now > s_sync_deadline_us) {
+        s_sync_timed_out = true;
+        log(LOGLEVEL_INFO, "[main] No reply about synchronized output; "
+                "frames are written without it.");
+    }
+
+    // An ESC with nothing after it for a while was the Escape key.
+    if (s_n_held_keys > 0 &&
+        now - s_held_key_us >= TERMKEYS_ESC_TIMEOUT_MS * 1000)
+    {
+        termkey_event ev;
+        termkeys_flush(&s_reply_dec, &ev, 1);
+        if (release_held_keys(s_n_held_keys)) user_quit = true;
+    }
 
     // ReadConsoleInput blocks until it reads at least one input event, so we 
     // need to avoid calling it when there's nothing to read.
-    if (WaitForSingleObject(h_stdin, 0) != WAIT_OBJECT_0) return false;
+    if (WaitForSingleObject(h_stdin, 0) != WAIT_OBJECT_0) return user_quit;
 
-    // TODO: make irbuf size constant
-    static INPUT_RECORD irbuf[128];
+    static INPUT_RECORD irbuf[INPUT_EVENTS_MAX];
     DWORD n_events = 0;
-    ReadConsoleInput(h_stdin, irbuf, 128, &n_events);
-    for (DWORD i = 0; i < n_events; i++) {
-        if (irbuf[i].EventType == MOUSE_EVENT) {
-            MOUSE_EVENT_RECORD m = irbuf[i].Event.MouseEvent;
-            // Process the mouse event
-            if (!(m.dwEventFlags & MOUSE_WHEELED)) continue;
-
-            bool is_hiword_negative = HIWORD(m.dwButtonState) & 1<<15;
-
-            if (is_hiword_negative) {
-                st->scroll--;
-                if (st->scroll < 0) st->scroll = 0;
-            } else {
-                if (!st->scroll_at_top) st->scroll++;
-            }
+    ReadConsoleInput(h_stdin, irbuf, INPUT_EVENTS_MAX, &n_events);
 
+    for (DWORD i = 0; i < n_events; i++) {
+        // The alternate screen buffer is the size of the window, so a resize
+        // of either is reported as one of the buffer.
+        if (irbuf[i].EventType == WINDOW_BUFFER_SIZE_EVENT) {
+            s_term_resized = true;
             continue;
         }
 
-        if (irbuf[i].EventType != KEY_EVENT) continue;
+        // Replies to queries are taken out first, so they don't go in the
+        // input line (or quit, being led by an ESC).
+        if (s_sync_asked && take_reply_key(&irbuf[i], &user_quit)) continue;
+
+        termkey_event ev;
+        if (!console_record_to_key(&irbuf[i], &ev)) continue;
+        // Keys held back before this one came first.
+        if (s_n_held_keys > 0 && release_held_keys(s_n_held_keys))
+            user_quit = true;
+        // Don't stop at a quit; we want to reset the colors.
+        if (apply_key(&ev)) user_quit = true;
+    }
 
-        KEY_EVENT_RECORD k = irbuf[i].Event.KeyEvent;
-        if (!k.bKeyDown) continue;
-        if (k.wVirtualKeyCode == VK_BACK && st->i_inputbuf > 0)
-            st->inputbuf[--st->i_inputbuf] = '\0';
-        if (k.wVirtualKeyCode == VK_ESCAPE)
-            user_quit = true; // don't break; we want to reset the colors
-        if (k.wVirtualKeyCode == VK_RETURN && st->i_inputbuf > 0) {
-            msgqueue_pushback_copy(QUEUE_UI, st->inputbuf);
+    return user_quit;
+}
 
-            while (st->i_inputbuf > 0)
-                st->inputbuf[st->i_inputbuf--] = '\0';
+// TODO: platform-specific code
+static bool take_reply_key(const INPUT_RECORD *const rec, bool *const quit) {
+    if (rec->EventType != KEY_EVENT) return false;
+    const KEY_EVENT_RECORD *const k = &rec->Event.KeyEvent;
+    char c = k->uChar.AsciiChar;
+    // Key-up events are skipped like any other.
+    if (!k->bKeyDown || c == 0) return false;
+    if (!termkeys_pending(&s_reply_dec) && c != '\033') return false;
+
+    assert(s_n_held_keys < HELD_KEYS_MAX);
+    s_held_keys[s_n_held_keys++] = *rec;
+    s_held_key_us = latency_now_us();
+
+    // One byte ends at most one sequence.
+    termkey_event ev;
+    size_t n_events = termkeys_decode(&s_reply_dec, &c, 1, &ev, 1);
+    if (n_events > 0 && ev.kind == TERMKEY_MODE_REPORT) {
+        // Replies about other modes aren't keys either.
+        s_n_held_keys = 0;
+        if (ev.mode == TERMREPLY_MODE_SYNC_OUTPUT) set_sync_output(ev.status);
+        return true;
+    }
 
-            assert(st->i_inputbuf == 0);
-            st->inputbuf[st->i_inputbuf] = '\0';
-        }
-        else if (k.uChar.AsciiChar > 31 &&
-                 st->i_inputbuf < sizeof(st->inputbuf) - 1)
-        {
-            st->inputbuf[st->i_inputbuf++] = k.uChar.AsciiChar;
-        }
+    // Not a reply: they were keys after all. After a second ESC, the first
+    // was the Escape key, and the second may still start one.
+    size_t n_keys = s_n_held_keys;
+    if (termkeys_pending(&s_reply_dec)) {
+        if (n_events > 0) n_keys--;
+        // A sequence going on for longer than any reply.
+        else if (s_n_held_keys == HELD_KEYS_MAX)
+            termkeys_flush(&s_reply_dec, &ev, 1);
+        else n_keys = 0;
     }
+    if (n_keys > 0 && release_held_keys(n_keys)) *quit = true;
+    return true;
+}
 
-    return user_quit;
+// TODO: platform-specific code
+static bool release_held_keys(size_t n) {
+    assert(n <= s_n_held_keys);
+
+    bool quit = false;
+    for (size_t i = 0; i < n; i++) {
+        termkey_event ev;
+        if (!console_record_to_key(&s_held_keys[i], &ev)) continue;
+        if (apply_key(&ev)) quit = true;
+    }
+    memmove(s_held_keys, s_held_keys + n,
+            (s_n_held_keys - n) * sizeof(*s_held_keys));
+    s_n_held_keys -= n;
+    return quit;
 }
 
-static void draw_screen(HANDLE h_stdout,
-        char *const screenbuf, size_t screenbuf_size,
-        char *const statbuf, size_t statbuf_size,
-        char *const headbuf, size_t headbuf_size)
+static void set_sync_output(termreply_mode_status status) {
+    s_sync_asked = false;
+    if (s_sync_timed_out) {
+        log_fmt(LOGLEVEL_INFO, "[main] Late reply about synchronized output "
+                "(DECRPM %d) ignored.", (int) status);
+        return;
+    }
+
+    bool supported = status == TERMREPLY_MODE_SET ||
+                     status == TERMREPLY_MODE_RESET ||
+                     status == TERMREPLY_MODE_PERMANENTLY_SET;
+    s_sync_output = supported;
+    s_renderer.grid.sync_output = supported;
+    log_fmt(LOGLEVEL_INFO, "[main] Synchronized output %s (DECRPM %d).",
+            supported ? "supported" : "not supported", (int) status);
+}
+
+// TODO: platform-specific code
+static bool console_record_to_key(const INPUT_RECORD *const rec,
+        termkey_event *const ev)
 {
+    memset(ev, 0, sizeof(*ev));
+    if (rec->EventType == MOUSE_EVENT) {
+        const MOUSE_EVENT_RECORD *const m = &rec->Event.MouseEvent;
+        if (!(m->dwEventFlags & MOUSE_WHEELED)) return false;
+
+        bool is_hiword_negative = HIWORD(m->dwButtonState) & 1<<15;
+        ev->kind = is_hiword_negative ? TERMKEY_WHEEL_DOWN : TERMKEY_WHEEL_UP;
+        return true;
+    }
+
+    if (rec->EventType != KEY_EVENT) return false;
+    const KEY_EVENT_RECORD *const k = &rec->Event.KeyEvent;
+    if (!k->bKeyDown) return false;
+
+    switch (k->wVirtualKeyCode) {
+    case VK_BACK: ev->kind = TERMKEY_BACKSPACE; return true;
+    case VK_ESCAPE: ev->kind = TERMKEY_ESCAPE; return true;
+    case VK_PRIOR: ev->kind = TERMKEY_PAGE_UP; return true;
+    case VK_NEXT: ev->kind = TERMKEY_PAGE_DOWN; return true;
+    case VK_HOME: ev->kind = TERMKEY_HOME; return true;
+    case VK_END: ev->kind = TERMKEY_END; return true;
+    case VK_RETURN: ev->kind = TERMKEY_ENTER; return true;
+    default: break;
+    }
+    if (k->uChar.AsciiChar == 0) return false;
+    ev->kind = TERMKEY_CHAR;
+    ev->ch = k->uChar.AsciiChar;
+    return true;
+}
+
+static bool apply_key(const termkey_event *const ev) {
     screen_ui_state *const st = scrmgr_get_active_ui_state();
     assert(st != NULL);
 
+    switch (ev->kind) {
+    case TERMKEY_WHEEL_UP:
+        if (!st->scroll_at_top) st->scroll++;
+        framesched_mark_urgent(FRAME_DIRTY_LOG);
+        return false;
+    case TERMKEY_WHEEL_DOWN:
+        st->scroll--;
+        if (st->scroll < 0) st->scroll = 0;
+        framesched_mark_urgent(FRAME_DIRTY_LOG);
+        return false;
+    default:
+        break;
+    }
+
+    // Show what was typed right away, whatever the frame rate cap.
+    framesched_mark_urgent(FRAME_DIRTY_INPUT);
+    switch (ev->kind) {
+    case TERMKEY_BACKSPACE:
+        if (st->i_inputbuf > 0) st->inputbuf[--st->i_inputbuf] = '\0';
+        return false;
+    case TERMKEY_ESCAPE:
+        return true;
+    case TERMKEY_PAGE_UP: scrmgr_scroll_pages(1); return false;
+    case TERMKEY_PAGE_DOWN: scrmgr_scroll_pages(-1); return false;
+    case TERMKEY_HOME: scrmgr_scroll_home(); return false;
+    case TERMKEY_END: scrmgr_scroll_end(); return false;
+    case TERMKEY_ENTER:
+        if (st->i_inputbuf == 0) return false;
+        msgqueue_pushback_copy(QUEUE_UI, st->inputbuf);
+
+        while (st->i_inputbuf > 0)
+            st->inputbuf[st->i_inputbuf--] = '\0';
+
+        assert(st->i_inputbuf == 0);
+        st->inputbuf[st->i_inputbuf] = '\0';
+        return false;
+    case TERMKEY_CHAR:
+        if (ev->ch > 31 && st->i_inputbuf < sizeof(st->inputbuf) - 1)
+            st->inputbuf[st->i_inputbuf++] = ev->ch;
+        return false;
+    default:
+        return false;
+    }
+}
+
+static void check_term_size(HANDLE h_stdout) {
+    s_term_resized = false;
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(h_stdout, &csbi);
 
     int term_rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
     int term_cols = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+    if (term_rows == s_term_rows && term_cols == s_term_cols) return;
+
+    s_term_rows = term_rows;
+    s_term_cols = term_cols;
+    framesched_mark_urgent(FRAME_DIRTY_ALL);
+}
+
+// TODO: platform-specific code
+static void send_queued(SOCKET sock, uint64_t frame) {
+    msglist msgs = msg_queue_takeall(QUEUE_OUT);
+    if (msgs.count == 0) return;
+
+    // Timing answers are moved to their own list; the rest go now.
+    msglist timing = { .head = NULL, .tail = NULL, .count = 0 };
+    msglist now = { .head = NULL, .tail = NULL, .count = 0 };
+    struct msgnode *next = NULL;
+    for (struct msgnode *node = msgs.head; node != NULL; node = next) {
+        next = node->next;
+        node->next = NULL;
+        msglist *const to = strncmp(node->msg, TIMING_PONG_PREFIX,
+                strlen(TIMING_PONG_PREFIX)) == 0 ? &timing : &now;
+        if (to->tail != NULL) to->tail->next = node;
+        else to->head = node;
+        to->tail = node;
+        to->count++;
+    }
+    send_msgs(sock, &now);
+    if (timing.count == 0) return;
+
+    held_sends *last = s_n_held_sends > 0
+            ? &s_held_sends[s_n_held_sends - 1] : NULL;
+    if (last == NULL ||
+        (last->frame != frame && s_n_held_sends < HELD_SENDS_MAX))
+    {
+        last = &s_held_sends[s_n_held_sends++];
+        last->msgs = timing;
+        last->frame = frame;
+        return;
+    }
+
+    last->msgs.tail->next = timing.head;
+    last->msgs.tail = timing.tail;
+    last->msgs.count += timing.count;
+    last->frame = frame;
+}
+
+static void send_held(SOCKET sock) {
+    int n_sent = 0;
+    while (n_sent < s_n_held_sends &&
+           s_held_sends[n_sent].frame <= s_frame_done)
+    {
+        send_msgs(sock, &s_held_sends[n_sent++].msgs);
+    }
+    if (n_sent == 0) return;
+
+    memmove(s_held_sends, s_held_sends + n_sent,
+            (size_t) (s_n_held_sends - n_sent) * sizeof(*s_held_sends));
+    s_n_held_sends -= n_sent;
+}
+
+// TODO: platform-specific code
+static void send_msgs(SOCKET sock, msglist *const msgs) {
+    for (struct msgnode *node = msgs->head; node != NULL; node = node->next) {
+        char send_buf[INPUT_BUF_LEN];
+        int len = sprintf_s(send_buf, sizeof(send_buf), "%s\r\n", node->msg);
+        if (len < 0 || send(sock, send_buf, len, 0) == SOCKET_ERROR) {
+            log_fmt(LOGLEVEL_ERROR, "[main] send() failed: %lu",
+                    WSAGetLastError());
+            break;
+        }
+    }
+    msglist_free(msgs);
+}
+
+static void draw_screen(HANDLE h_stdout, uint32_t dirty) {
+    if (s_render_threaded) {
+        render_snapshot *const snap = renderthread_begin_frame();
+        renderer_compose(&s_renderer, dirty, s_term_rows, s_term_cols, snap);
+        snap->sync_output = s_sync_output;
+        snap->latency_frame = latency_frame_composed();
+        s_frame_composed = snap->latency_frame;
+        renderthread_publish();
+        return;
+    }
 
-    int tabs_len = screen_fmt_tabs(statbuf, statbuf_size, term_cols);
-    int header_len = screen_fmt_header(headbuf, headbuf_size, term_cols);
-
-    int rows_tabline = tabs_len / term_cols + 1;
-    int rows_header = header_len / term_cols + 1;
-    int rows_uiline = (strlen(st->prompt) + st->i_inputbuf - 1) / term_cols + 1;
-    int rows_screenbuf = term_rows - (rows_tabline + rows_header + rows_uiline);
-
-    screen_fmt_to_buf(screenbuf, screenbuf_size, rows_screenbuf, term_cols);
-
-    printf("\033 7" // Save cursor position
-            "\033[0m\033[2J" // Reset colors, erase screen
-            "\033[H\033[48;5;252m\033[2K" // Draw statline bg, lgray, top 
-            "\033[38;5;233m%s\033[0m" // Draw statline text, dark gray
-            "\033[1E%s" // One line down, print header txt
-            "\033[0m\033[1E%s" // Reset color, print buffer next line
-            "\033[%d;0H\033[48;5;27m\033[2K" // Draw input line blue bg
-            "\033[38;5;190m%s" // Draw prompt, yellow
-            "\033[38;5;15m%s" // Draw uibuf, white
-            "\033[0m" // Reset colors
-            "\033 8", // Restore cursor position
-            statbuf, headbuf, screenbuf, term_rows - (rows_uiline - 1),
-            st->prompt, st->inputbuf);
+    uint64_t latency_frame = latency_frame_composed();
+    s_frame_composed = latency_frame;
+    // Whatever becomes of it, it's done with by the time this returns.
+    s_frame_done = latency_frame;
+    size_t frame_len = 0;
+    const char *frame = renderer_draw(&s_renderer, dirty,
+            s_term_rows, s_term_cols, &frame_len);
+    if (frame_len == 0) {
+        framesched_frame_done(FRAME_UNCHANGED);
+        latency_frame_shown(latency_frame, latency_now_us());
+        return;
+    }
+
+    // The whole frame in one write.
+    // TODO: platform-specific code
+    DWORD written = 0;
+    if (!WriteFile(h_stdout, frame, (DWORD) frame_len, &written, NULL) ||
+        written != frame_len)
+    {
+        log_fmt(LOGLEVEL_ERROR, "[draw_screen] WriteFile() failed (%lu); "
+                "%lu of %zu bytes written.", GetLastError(), written,
+                frame_len);
+        // Whatever the terminal shows now, it's not the frame.
+        vtgrid_invalidate(&s_renderer.grid);
+        framesched_frame_done(FRAME_DROPPED);
+        return;
+    }
+    framesched_frame_done(s_renderer.grid.sync_output
+            ? FRAME_WRITTEN_SYNCED : FRAME_WRITTEN);
+    latency_frame_shown(latency_frame, latency_now_us());
 }
 
 DWORD WINAPI thread_main_recv(LPVOID data) {
@@ -478,69 +884,48 @@ DWORD WINAPI thread_main_recv(LPVOID data) {
                     RECV_BUF_LEN - i_buff_offset,
                     0)) > 0)
     {
+        uint64_t t_recv = latency_now_us();
+        capture_chunk_received(recv_buff + i_buff_offset,
+                (size_t) bytes_received);
         i_buff_offset += bytes_received;
-        if (i_buff_offset >= RECV_BUF_LEN) {
-            log(LOGLEVEL_ERROR, "[thread_main_recv] FATAL: Ran out of buffer.");
-            // TODO: communiate failure and clean up
-            return 23;
-        }
-
-        // Start at end of the unprocessed data and search backwards for \r\n
-        int i_last_delim = i_buff_offset;
-        bool delim_found = false;
-        while (!delim_found && --i_last_delim > 0) {
-            delim_found = recv_buff[i_last_delim - 1] == '\r' &&
-                          recv_buff[i_last_delim] == '\n';
-        }
-
-        log_fmt(LOGLEVEL_DEV, "[thread_main_recv] delim_found=%d, "
-                "i_last_delim=%d(%d), bytes_received=%d, i_buff_offset=%d",
-                delim_found, i_last_delim, recv_buff[i_last_delim],
-                bytes_received, i_buff_offset);
-
-        if (!delim_found)
-            continue;
 
         // Parse recv_buffer data into messages and build a msglist
         msglist msgs = { .head = NULL, .tail = NULL, .count = 0 };
-        size_t msg_start = 0;
-        for (int i = 0; i < i_last_delim; i++) {
-            if (!(recv_buff[i] == '\r' && recv_buff[i + 1] == '\n'))
-                continue;
-
-            // msglist msgs should be null terminated.
-            recv_buff[i] = '\0';
-            recv_buff[i + 1] = '\0';
-            msglist_pushback_copy(&msgs, &recv_buff[msg_start]);
+        msgutils_frame_msgs(recv_buff, &i_buff_offset, &msgs);
 
-            // Skip the two null terminators we wrote.
-            msg_start = i++ + 2;
+        // Only a full buffer with no CRLF in it leaves no room to go on.
+        if (i_buff_offset >= RECV_BUF_LEN) {
+            log_in(LOGMODULE_RECV, LOGLEVEL_ERROR,
+                    "[thread_main_recv] FATAL: Ran out of buffer.");
+            // TODO: communiate failure and clean up
+            return 23;
         }
 
         if (msgs.count > 0) {
+            // A message split across recv()s counts from its last part.
+            uint64_t t_submit = latency_now_us();
+            for (struct msgnode *node = msgs.head; node != NULL;
+                    node = node->next)
+            {
+                node->t_recv = t_recv;
+                node->t_submit = t_submit;
+            }
             msglist_submit(QUEUE_IN, &msgs);
-            log_fmt(LOGLEVEL_DEV, "[thread_main_recv] Submitted %d msgs to IN.",
-                    msgs.count);
+            log_fmt_in(LOGMODULE_RECV, LOGLEVEL_DEV,
+                    "[thread_main_recv] Submitted %d msgs to IN.", msgs.count);
         }
-
         assert(i_buff_offset < RECV_BUF_LEN);
-        assert(i_last_delim < i_buff_offset);
-
-        // Move any buffer data after the last delim to the beginning.
-        int copy_from = i_last_delim + 1, copy_to = 0;
-        while (copy_from < i_buff_offset) 
-            recv_buff[copy_to++] = recv_buff[copy_from++];
-        i_buff_offset = copy_to;
     }
 
     if (bytes_received < 0) {
-        log_fmt(LOGLEVEL_ERROR, "[thread_main_recv] recv() failed: %lu",
-                WSAGetLastError());
+        log_fmt_in(LOGMODULE_RECV, LOGLEVEL_ERROR,
+                "[thread_main_recv] recv() failed: %lu", WSAGetLastError());
         // TODO: Communicate failure and cleanup
         return 23;
     }
 
-    log(LOGLEVEL_WARNING, "[thread_main_recv] Server disconnected, apparently");
+    log_in(LOGMODULE_RECV, LOGLEVEL_WARNING,
+            "[thread_main_recv] Server disconnected, apparently");
 
     return 0;
 }
@@ -48,6 +48,7 @@ void msgqueue_pushback_copy(msg_queue_id queue_id, const_str msg) {
     strcpy_s(msgcpy, msg_size, msg);
     node->msg = msgcpy;
     node->next = NULL;
+    node->t_recv = node->t_submit = 0;
 
     msglist list = { .head = node, .tail = node, .count = 1 };
 
@@ -67,6 +68,7 @@ void msglist_pushback_take(msglist *list, char* msg) {
 
     node->msg = msg;
     node->next = NULL;
+    node->t_recv = node->t_submit = 0;
 
     if (list->head == NULL) {
         list->head = list->tail = node;
@@ -94,6 +96,7 @@ void msglist_pushback_copy(msglist *list, const char* msg) {
     strcpy_s(msgcpy, msg_size, msg);
     node->msg = msgcpy;
     node->next = NULL;
+    node->t_recv = node->t_submit = 0;
 
     if (list->head == NULL) {
         list->head = list->tail = node;
@@ -1,3 +1,5 @@
+#define LOG_MODULE LOGMODULE_PARSER
+
 #include "log.h"
 #include "msgqueue.h"
 #include "msgutils.h"
@@ -132,10 +134,61 @@ void msgutils_ircmsg_free(ircmsg *ircm) {
     free(ircm);
 }
 
+void msgutils_frame_msgs(char *const buf, int *const len, msglist *const msgs)
+{
+    assert(buf != NULL);
+    assert(len != NULL);
+    assert(msgs != NULL);
+
+    // Start at end of the unprocessed data and search backwards for \r\n
+    int i_last_delim = *len;
+    bool delim_found = false;
+    while (!delim_found && --i_last_delim > 0) {
+        delim_found = buf[i_last_delim - 1] == '\r' &&
+                      buf[i_last_delim] == '\n';
+    }
+
+    log_fmt_in(LOGMODULE_RECV, LOGLEVEL_DEV, "[msgutils_frame_msgs()] "
+            "delim_found=%d, i_last_delim=%d(%d), len=%d", delim_found,
+            i_last_delim, buf[i_last_delim], *len);
+
+    if (!delim_found)
+        return;
+
+    size_t msg_start = 0;
+    for (int i = 0; i < i_last_delim; i++) {
+        if (!(buf[i] == '\r' && buf[i + 1] == '\n'))
+            continue;
+
+        // msglist msgs should be null terminated.
+        buf[i] = '\0';
+        buf[i + 1] = '\0';
+        msglist_pushback_copy(msgs, &buf[msg_start]);
+
+        // Skip the two null terminators we wrote.
+        msg_start = i++ + 2;
+    }
+
+    assert(i_last_delim < *len);
+
+    // Move any buffer data after the last delim to the beginning.
+    int copy_from = i_last_delim + 1, copy_to = 0;
+    while (copy_from < *len)
+        buf[copy_to++] = buf[copy_from++];
+    *len = copy_to;
+}
+
 bool msgutils_get_timestamp(
         char *const buf, size_t bufsize, bool utc, timestamp_format format)
 {
-    time_t time_now = time(NULL);
+    return msgutils_format_timestamp(
+            buf, bufsize, (int64_t) time(NULL), utc, format);
+}
+
+bool msgutils_format_timestamp(char *const buf, size_t bufsize,
+        int64_t t, bool utc, timestamp_format format)
+{
+    time_t time_now = (time_t) t;
     struct tm tm_now;
     // TODO: platform-specific. Microsoft swaps the order of these parameters.
     // And returns errno_t instead of tm*. Thank you Microsoft! Very cool!
@@ -145,7 +198,7 @@ bool msgutils_get_timestamp(
 
     // if (ptm_now == NULL) {
     if (err != 0) {
-        log_fmt(LOGLEVEL_ERROR, "[get_timestamp()] %s returned %d.", 
+        log_fmt(LOGLEVEL_ERROR, "[format_timestamp()] %s returned %d.", 
                 utc ? "gmtime_s()" : "localtime_s()", err);
         return false;
     }
@@ -0,0 +1,299 @@
+#define LOG_MODULE LOGMODULE_SCREEN
+
+#include "nicktab.h"
+
+#include "log.h"
+#include "terminalutils.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NICKTAB_INITIAL_SLOTS 256
+#define NICK_COLOR_ESC_MAXLEN 16
+
+typedef struct nick_entry {
+    // NULL if the entry is free, in which case 'next_free' links it into the
+    // free list.
+    char *name;
+    char *userhost;
+    uint32_t len;
+    // Of the case-folded name.
+    uint32_t hash;
+    uint32_t refs;
+    uint32_t next_free;
+    uint8_t color_len;
+    char color_esc[NICK_COLOR_ESC_MAXLEN];
+} nick_entry;
+
+// 256-colour codes nicks are coloured from. Mid-brightness, so they read on
+// both dark and light backgrounds.
+static const int s_nick_palette[] = {
+    27, 33, 37, 40, 64, 70, 73, 93, 99, 105, 127, 129, 133, 136, 142, 160,
+    166, 169, 172, 178, 196, 202, 208, 214
+};
+
+// Entry 0 is NICKTAB_NONE. 's_slots' is an open-addressed hash of entry ids,
+// with 0 (which is never hashed) for empty.
+static nick_entry s_none = { 0 };
+static nick_entry *s_entries = &s_none;
+static size_t s_n_entries = 1;
+static size_t s_entries_cap = 0;
+static uint32_t s_free_head = 0;
+static size_t s_n_live = 0;
+static uint32_t *s_slots = NULL;
+static size_t s_slots_cap = 0;
+static int64_t s_bytes = 0;
+
+static uint32_t intern_n(const char *const name, size_t len);
+
+// rfc1459 case mapping.
+static char fold(char c);
+
+static uint32_t hash_name(const char *const name, size_t len);
+
+// Returns the slot of the entry for 'name', or the empty slot its probe ends
+// at if there isn't one.
+static size_t find_slot(const char *const name, size_t len, uint32_t hash);
+
+// Empties slot 'i', shifting later entries of the probe back so lookups never
+// hit a hole before the entry they're looking for.
+static void remove_slot(size_t i);
+
+static void grow_slots(void);
+
+static void set_userhost(nick_entry *const e, const char *const userhost);
+
+static void *realloc_or_die(void *ptr, size_t size);
+
+uint32_t nicktab_intern(const char *const name) {
+    if (name == NULL || name[0] == '\0') return NICKTAB_NONE;
+    return intern_n(name, strlen(name));
+}
+
+uint32_t nicktab_intern_source(const char *const source) {
+    if (source == NULL || source[0] == '\0') return NICKTAB_NONE;
+
+    const char *const bang = strchr(source, '!');
+    if (bang == NULL) return intern_n(source, strlen(source));
+    if (bang == source) return NICKTAB_NONE;
+
+    uint32_t id = intern_n(source, bang - source);
+    set_userhost(&s_entries[id], bang + 1);
+    return id;
+}
+
+void nicktab_ref(uint32_t id) {
+    if (id == NICKTAB_NONE) return;
+    assert(id < s_n_entries);
+    assert(s_entries[id].name != NULL);
+    s_entries[id].refs++;
+}
+
+void nicktab_release(uint32_t id) {
+    if (id == NICKTAB_NONE) return;
+    assert(id < s_n_entries);
+    nick_entry *const e = &s_entries[id];
+    assert(e->name != NULL);
+    assert(e->refs > 0);
+    if (--e->refs > 0) return;
+
+    size_t mask = s_slots_cap - 1, i = e->hash & mask;
+    while (s_slots[i] != id) i = (i + 1) & mask;
+    remove_slot(i);
+
+    s_bytes -= (int64_t) e->len + 1;
+    set_userhost(e, NULL);
+    free(e->name);
+    e->name = NULL;
+    e->next_free = s_free_head;
+    s_free_head = id;
+    s_n_live--;
+}
+
+const char *nicktab_name(uint32_t id) {
+    assert(id < s_n_entries);
+    assert(id == NICKTAB_NONE || s_entries[id].name != NULL);
+    return id == NICKTAB_NONE ? "" : s_entries[id].name;
+}
+
+size_t nicktab_len(uint32_t id) {
+    assert(id < s_n_entries);
+    return s_entries[id].len;
+}
+
+const char *nicktab_userhost(uint32_t id) {
+    assert(id < s_n_entries);
+    return s_entries[id].userhost != NULL ? s_entries[id].userhost : "";
+}
+
+const char *nicktab_color_esc(uint32_t id, size_t *const len) {
+    assert(id < s_n_entries);
+    assert(len != NULL);
+    *len = s_entries[id].color_len;
+    return s_entries[id].color_esc;
+}
+
+size_t nicktab_count(void) {
+    return s_n_live;
+}
+
+int64_t nicktab_bytes(void) {
+    return s_bytes;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static uint32_t intern_n(const char *const name, size_t len) {
+    assert(len > 0);
+    uint32_t hash = hash_name(name, len);
+    if (s_slots_cap > 0) {
+        size_t i = find_slot(name, len, hash);
+        if (s_slots[i] != 0) {
+            nick_entry *const e = &s_entries[s_slots[i]];
+            e->refs++;
+            // Same nick, maybe differently cased; show the latest. Case
+            // mapping never changes the length.
+            if (memcmp(e->name, name, len) != 0) memcpy(e->name, name, len);
+            return s_slots[i];
+        }
+    }
+
+    // Keep the load factor under 1/2 so probes stay short.
+    if ((s_n_live + 1) * 2 > s_slots_cap) grow_slots();
+
+    uint32_t id = s_free_head;
+    if (id != 0) {
+        s_free_head = s_entries[id].next_free;
+    }
+    else {
+        if (s_n_entries >= s_entries_cap) {
+            // The first growth moves the NONE entry off of its static storage.
+            size_t new_cap = s_entries_cap == 0 ? 64 : s_entries_cap * 2;
+            nick_entry *entries = (nick_entry *) realloc_or_die(
+                    s_entries_cap == 0 ? NULL : s_entries,
+                    new_cap * sizeof(*entries));
+            if (s_entries_cap == 0) entries[0] = s_none;
+            s_bytes += (int64_t) (new_cap - s_entries_cap) * sizeof(*entries);
+            s_entries = entries;
+            s_entries_cap = new_cap;
+        }
+        id = (uint32_t) s_n_entries++;
+    }
+
+    nick_entry *const e = &s_entries[id];
+    memset(e, 0, sizeof(*e));
+    e->name = (char *) realloc_or_die(NULL, len + 1);
+    memcpy(e->name, name, len);
+    e->name[len] = '\0';
+    e->len = (uint32_t) len;
+    e->hash = hash;
+    e->refs = 1;
+    int color = s_nick_palette[
+        hash % (sizeof(s_nick_palette) / sizeof(s_nick_palette[0]))];
+    e->color_len = (uint8_t) termutils_set_text_color_256_buf(
+            e->color_esc, sizeof(e->color_esc), color);
+    s_bytes += (int64_t) len + 1;
+    s_n_live++;
+
+    size_t i = find_slot(name, len, hash);
+    assert(s_slots[i] == 0);
+    s_slots[i] = id;
+    return id;
+}
+
+static char fold(char c) {
+    // A-Z and []\^ are the upper case of a-z and {}|~.
+    return (c >= 'A' && c <= '^') ? (char) (c + ('a' - 'A')) : c;
+}
+
+static uint32_t hash_name(const char *const name, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) fold(name[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t find_slot(const char *const name, size_t len, uint32_t hash) {
+    size_t mask = s_slots_cap - 1, i = hash & mask;
+    for (; s_slots[i] != 0; i = (i + 1) & mask) {
+        const nick_entry *const e = &s_entries[s_slots[i]];
+        if (e->hash != hash || e->len != len) continue;
+
+        size_t c = 0;
+        while (c < len && fold(e->name[c]) == fold(name[c])) c++;
+        if (c == len) break;
+    }
+    return i;
+}
+
+static void remove_slot(size_t i) {
+    size_t mask = s_slots_cap - 1;
+    for (size_t j = (i + 1) & mask; s_slots[j] != 0; j = (j + 1) & mask) {
+        // The entry at 'j' moves into the hole unless its home slot is
+        // cyclically in (i, j], since it has to stay at or after its home.
+        size_t home = s_entries[s_slots[j]].hash & mask;
+        bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+        if (stays) continue;
+        s_slots[i] = s_slots[j];
+        i = j;
+    }
+    s_slots[i] = 0;
+}
+
+static void grow_slots(void) {
+    size_t new_cap = s_slots_cap == 0 ? NICKTAB_INITIAL_SLOTS : s_slots_cap * 2;
+    uint32_t *slots = (uint32_t *) calloc(new_cap, sizeof(*slots));
+    if (slots == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[nicktab grow_slots()] FATAL: out of memory.");
+        exit(23);
+    }
+
+    size_t mask = new_cap - 1;
+    for (size_t id = 1; id < s_n_entries; id++) {
+        if (s_entries[id].name == NULL) continue;
+        size_t i = s_entries[id].hash & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = (uint32_t) id;
+    }
+    free(s_slots);
+    s_bytes += (int64_t) (new_cap - s_slots_cap) * sizeof(*slots);
+    s_slots = slots;
+    s_slots_cap = new_cap;
+}
+
+static void set_userhost(nick_entry *const e, const char *const userhost) {
+    if (userhost != NULL && e->userhost != NULL &&
+        strcmp(e->userhost, userhost) == 0)
+    {
+        return;
+    }
+
+    if (e->userhost != NULL) {
+        s_bytes -= (int64_t) strlen(e->userhost) + 1;
+        free(e->userhost);
+        e->userhost = NULL;
+    }
+    if (userhost != NULL && userhost[0] != '\0') {
+        size_t len = strlen(userhost);
+        e->userhost = (char *) realloc_or_die(NULL, len + 1);
+        memcpy(e->userhost, userhost, len + 1);
+        s_bytes += (int64_t) len + 1;
+    }
+}
+
+static void *realloc_or_die(void *ptr, size_t size) {
+    void *new_ptr = realloc(ptr, size);
+    if (new_ptr == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[nicktab] FATAL: out of memory.");
+        exit(23);
+    }
+    return new_ptr;
+}
@@ -0,0 +1,278 @@
+#include "posixterm.h"
+
+// TODO: platform-specific code
+#ifndef _WIN32
+
+#include "log.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define POSIXTERM_READ_BUF_SIZE 256
+
+// Size assumed if the terminal won't say.
+#define POSIXTERM_DEFAULT_ROWS 24
+#define POSIXTERM_DEFAULT_COLS 80
+
+// Mouse button reporting (1000), in the SGR encoding (1006), which has no
+// limit on coordinates and can't be confused with typed text.
+#define MOUSE_REPORTING_ON "\033[?1000h\033[?1006h"
+#define MOUSE_REPORTING_OFF "\033[?1006l\033[?1000l"
+
+static bool s_open = false;
+static struct termios s_prev_termios;
+static int s_prev_stdin_flags = 0;
+static struct sigaction s_prev_sigwinch;
+
+// The SIGWINCH handler sets the flag and writes a byte to the pipe, whose
+// read end is polled, so a resize wakes the main loop.
+static volatile sig_atomic_t s_resized = 0;
+static int s_winch_pipe[2] = { -1, -1 };
+
+// As of the last SIGWINCH, and as of the last posixterm_get_size().
+static int s_rows = 0;
+static int s_cols = 0;
+static int s_reported_rows = 0;
+static int s_reported_cols = 0;
+
+static termkeys_decoder s_decoder;
+
+static void on_sigwinch(int sig);
+static void read_size(void);
+static void drain_winch_pipe(void);
+// Reads what's there into the decoder, no more than can be stored as events.
+// Returns the number of events stored, or -1 if there was nothing to read.
+static int read_input(termkey_event *const events, size_t max_events);
+static bool set_nonblocking(int fd);
+
+bool posixterm_open(void) {
+    assert(!s_open);
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+        log(LOGLEVEL_ERROR, "[posixterm] stdin/stdout isn't a terminal.");
+        return false;
+    }
+    if (tcgetattr(STDIN_FILENO, &s_prev_termios) != 0) {
+        log_fmt(LOGLEVEL_ERROR, "[posixterm] tcgetattr() failed (%d).", errno);
+        return false;
+    }
+
+    if (pipe(s_winch_pipe) != 0) {
+        log_fmt(LOGLEVEL_ERROR, "[posixterm] pipe() failed (%d).", errno);
+        return false;
+    }
+    set_nonblocking(s_winch_pipe[0]);
+    set_nonblocking(s_winch_pipe[1]);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigwinch;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &sa, &s_prev_sigwinch);
+
+    // Keys as they're pressed, unechoed and untranslated. Output processing
+    // stays on, for anything else printing to the terminal. Ctrl+C etc. come
+    // through as characters, since the client quits on Escape.
+    struct termios raw = s_prev_termios;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) {
+        log_fmt(LOGLEVEL_ERROR, "[posixterm] tcsetattr() failed (%d).", errno);
+        sigaction(SIGWINCH, &s_prev_sigwinch, NULL);
+        close(s_winch_pipe[0]);
+        close(s_winch_pipe[1]);
+        s_winch_pipe[0] = s_winch_pipe[1] = -1;
+        return false;
+    }
+
+    // The terminal's stdin and stdout are usually the same open file, so this
+    // makes writes non-blocking too; posixterm_write() waits them out.
+    s_prev_stdin_flags = fcntl(STDIN_FILENO, F_GETFL);
+    set_nonblocking(STDIN_FILENO);
+
+    memset(&s_decoder, 0, sizeof(s_decoder));
+    s_resized = 0;
+    read_size();
+    s_reported_rows = s_reported_cols = 0;
+    s_open = true;
+
+    posixterm_write(MOUSE_REPORTING_ON, strlen(MOUSE_REPORTING_ON));
+    return true;
+}
+
+void posixterm_close(void) {
+    if (!s_open) return;
+
+    posixterm_write(MOUSE_REPORTING_OFF, strlen(MOUSE_REPORTING_OFF));
+    if (s_prev_stdin_flags != -1)
+        fcntl(STDIN_FILENO, F_SETFL, s_prev_stdin_flags);
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &s_prev_termios) != 0)
+        log_fmt(LOGLEVEL_ERROR, "[posixterm] tcsetattr() failed (%d); "
+                "previous terminal mode not restored.", errno);
+
+    sigaction(SIGWINCH, &s_prev_sigwinch, NULL);
+    close(s_winch_pipe[0]);
+    close(s_winch_pipe[1]);
+    s_winch_pipe[0] = s_winch_pipe[1] = -1;
+    s_open = false;
+}
+
+void posixterm_pollfds(struct pollfd *const fds) {
+    assert(s_open);
+    assert(fds != NULL);
+
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = s_winch_pipe[0];
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+}
+
+size_t posixterm_read_events(termkey_event *const events, size_t max_events) {
+    assert(s_open);
+    assert(events != NULL || max_events == 0);
+
+    size_t n_events = 0;
+    int n = 0;
+    while (n_events < max_events &&
+           (n = read_input(events + n_events, max_events - n_events)) >= 0)
+    {
+        n_events += (size_t) n;
+    }
+
+    // A lone ESC at the end may be the start of a sequence whose rest is still
+    // on its way, or the Escape key; give the rest a moment to arrive.
+    while (n_events < max_events && termkeys_pending(&s_decoder)) {
+        struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+        int ready = poll(&pfd, 1, TERMKEYS_ESC_TIMEOUT_MS);
+        if (ready < 0 && errno == EINTR) continue;
+
+        n = ready > 0 ? read_input(events + n_events, max_events - n_events)
+                      : -1;
+        if (n < 0) {
+            n_events += termkeys_flush(&s_decoder, events + n_events,
+                    max_events - n_events);
+            break;
+        }
+        n_events += (size_t) n;
+    }
+    return n_events;
+}
+
+bool posixterm_get_size(int *const rows, int *const cols) {
+    assert(s_open);
+    assert(rows != NULL);
+    assert(cols != NULL);
+
+    if (s_resized) {
+        // Cleared before reading, so a resize during the read isn't lost.
+        s_resized = 0;
+        drain_winch_pipe();
+        read_size();
+    }
+
+    *rows = s_rows;
+    *cols = s_cols;
+    bool changed = s_rows != s_reported_rows || s_cols != s_reported_cols;
+    s_reported_rows = s_rows;
+    s_reported_cols = s_cols;
+    return changed;
+}
+
+bool posixterm_write(const char *const buf, size_t len) {
+    assert(buf != NULL || len == 0);
+
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(STDOUT_FILENO, buf + written, len - written);
+        if (n > 0) {
+            written += (size_t) n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = { STDOUT_FILENO, POLLOUT, 0 };
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        log_fmt(LOGLEVEL_ERROR, "[posixterm] write() failed (%d); %zu of %zu "
+                "bytes written.", errno, written, len);
+        return false;
+    }
+    return true;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static void on_sigwinch(int sig) {
+    (void) sig;
+    int saved_errno = errno;
+    s_resized = 1;
+    // If the pipe is full, a wakeup is already pending.
+    ssize_t unused = write(s_winch_pipe[1], "", 1);
+    (void) unused;
+    errno = saved_errno;
+}
+
+static void read_size(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 &&
+        ws.ws_row > 0 && ws.ws_col > 0)
+    {
+        s_rows = ws.ws_row;
+        s_cols = ws.ws_col;
+        return;
+    }
+    log_fmt(LOGLEVEL_WARNING, "[posixterm] Can't get the terminal size (%d).",
+            errno);
+    if (s_rows == 0 || s_cols == 0) {
+        s_rows = POSIXTERM_DEFAULT_ROWS;
+        s_cols = POSIXTERM_DEFAULT_COLS;
+    }
+}
+
+static void drain_winch_pipe(void) {
+    char buf[64];
+    while (read(s_winch_pipe[0], buf, sizeof(buf)) > 0) { }
+}
+
+static int read_input(termkey_event *const events, size_t max_events) {
+    // A byte ends at most one event, so reading no more bytes than there's
+    // room for events never drops one. The rest wait in the terminal.
+    char buf[POSIXTERM_READ_BUF_SIZE];
+    size_t want = max_events < sizeof(buf) ? max_events : sizeof(buf);
+    if (want == 0) return -1;
+
+    ssize_t n;
+    do {
+        n = read(STDIN_FILENO, buf, want);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return -1;
+
+    return (int) termkeys_decode(&s_decoder, buf, (size_t) n, events,
+            max_events);
+}
+
+static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+#else
+
+// build.ps1 compiles every file in src\, and an empty translation unit is an
+// error there (C4206 under /Wall /WX).
+typedef int posixterm_unused_on_windows;
+
+#endif
@@ -0,0 +1,192 @@
+#define LOG_MODULE LOGMODULE_SCREEN
+
+#include "render.h"
+
+#include "framesched.h"
+#include "log.h"
+#include "screen_framework.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Needs to be large enough to hold all displayed characters plus all formatting
+// data from ANSI escape codes. The screen buff is re-used so there's little
+// downside to severely overestimating this.
+// 512 columns, 128 rows, doubled for formatting space = 131kb
+// If you are displaying more text than that on a single screen, seek help.
+#define SCREEN_BUF_SIZE 512 * 128 * 2
+
+// The status line is a single line across the top of the screen. Same logic as
+// screen buf on the size, but only for one line.
+#define STATLINE_BUF_SIZE 512 * 2
+
+static char *alloc_buf(size_t size);
+
+// Copies the null-terminated 'src' to 'dst', cutting it short to fit.
+static void copy_str(char *const dst, size_t dstsize, const char *const src);
+
+void renderer_init(renderer *const r) {
+    assert(r != NULL);
+    memset(r, 0, sizeof(*r));
+    r->screenbuf = alloc_buf(SCREEN_BUF_SIZE);
+    r->statbuf = alloc_buf(STATLINE_BUF_SIZE);
+    r->headbuf = alloc_buf(STATLINE_BUF_SIZE);
+    r->rows_screenbuf_drawn = -1;
+    render_snapshot_init(&r->snapshot);
+}
+
+void renderer_free(renderer *const r) {
+    assert(r != NULL);
+    vtgrid_free(&r->grid);
+    render_snapshot_free(&r->snapshot);
+    free(r->screenbuf);
+    free(r->statbuf);
+    free(r->headbuf);
+    memset(r, 0, sizeof(*r));
+}
+
+void render_snapshot_init(render_snapshot *const snap) {
+    assert(snap != NULL);
+    memset(snap, 0, sizeof(*snap));
+    snap->screenbuf = alloc_buf(SCREEN_BUF_SIZE);
+    snap->statbuf = alloc_buf(STATLINE_BUF_SIZE);
+    snap->headbuf = alloc_buf(STATLINE_BUF_SIZE);
+}
+
+void render_snapshot_free(render_snapshot *const snap) {
+    assert(snap != NULL);
+    free(snap->screenbuf);
+    free(snap->statbuf);
+    free(snap->headbuf);
+    memset(snap, 0, sizeof(*snap));
+}
+
+void renderer_compose(renderer *const r, uint32_t dirty,
+        int term_rows, int term_cols, render_snapshot *const snap)
+{
+    assert(r != NULL);
+    assert(r->screenbuf != NULL);
+    assert(term_rows > 0 && term_cols > 0);
+    assert(snap != NULL);
+    assert(snap->screenbuf != NULL);
+
+    screen_ui_state *const st = scrmgr_get_active_ui_state();
+    assert(st != NULL);
+
+    // The tab bar and header change only on events like a join or a new
+    // topic, which bump their versions; a frame for anything else, even one
+    // with everything dirty, reuses them.
+    uint32_t tabs_version = screen_tabs_version();
+    uint32_t header_version = screen_header_version();
+    if (tabs_version != r->tabs_version || term_cols != r->status_cols) {
+        r->tabs_len = screen_fmt_tabs(r->statbuf, STATLINE_BUF_SIZE,
+                term_cols);
+        r->tabs_version = tabs_version;
+    }
+    if (header_version != r->header_version || term_cols != r->status_cols) {
+        r->header_len = screen_fmt_header(r->headbuf, STATLINE_BUF_SIZE,
+                term_cols);
+        r->header_version = header_version;
+    }
+    r->status_cols = term_cols;
+
+    int rows_tabline = r->tabs_len / term_cols + 1;
+    int rows_header = r->header_len / term_cols + 1;
+    int rows_uiline = (strlen(st->prompt) + st->i_inputbuf - 1) / term_cols + 1;
+    int rows_screenbuf = term_rows - (rows_tabline + rows_header + rows_uiline);
+
+    // The log also moves when the lines around it take more or fewer rows.
+    if ((dirty & FRAME_DIRTY_LOG) || rows_screenbuf != r->rows_screenbuf_drawn)
+    {
+        screen_fmt_to_buf(r->screenbuf, SCREEN_BUF_SIZE, rows_screenbuf,
+                term_cols);
+        r->rows_screenbuf_drawn = rows_screenbuf;
+    }
+
+    snap->term_rows = term_rows;
+    snap->term_cols = term_cols;
+    snap->rows_tabline = rows_tabline;
+    snap->rows_header = rows_header;
+    snap->rows_screenbuf = rows_screenbuf;
+    snap->rows_uiline = rows_uiline;
+    copy_str(snap->statbuf, STATLINE_BUF_SIZE, r->statbuf);
+    copy_str(snap->headbuf, STATLINE_BUF_SIZE, r->headbuf);
+    copy_str(snap->screenbuf, SCREEN_BUF_SIZE, r->screenbuf);
+    copy_str(snap->prompt, sizeof(snap->prompt), st->prompt);
+    copy_str(snap->inputbuf, sizeof(snap->inputbuf), st->inputbuf);
+}
+
+const char *render_present(vtgrid *const g, const render_snapshot *const snap,
+        size_t *const len)
+{
+    assert(g != NULL);
+    assert(snap != NULL);
+    assert(len != NULL);
+
+    int term_rows = snap->term_rows;
+    int term_cols = snap->term_cols;
+    if (term_rows != g->rows || term_cols != g->cols)
+        vtgrid_resize(g, term_rows, term_cols);
+    g->sync_output = snap->sync_output;
+
+    vtgrid_begin(g);
+    // Statline: light gray bg across the top, dark gray text
+    vtgrid_puts(g, "\033[48;5;252m\033[2K\033[38;5;233m");
+    vtgrid_puts(g, snap->statbuf);
+    // Reset color, header on the next line, then the buffer on the next
+    vtgrid_puts(g, "\033[0m\033[1E");
+    vtgrid_puts(g, snap->headbuf);
+    vtgrid_puts(g, "\033[0m\033[1E");
+    vtgrid_puts(g, snap->screenbuf);
+    // New lines push the log up as a block; let the terminal move it.
+    int log_top = snap->rows_tabline + snap->rows_header;
+    vtgrid_set_scroll_region(g, log_top, log_top + snap->rows_screenbuf);
+
+    // Input line: blue bg, yellow prompt, white uibuf
+    char goto_uiline[32];
+    sprintf_s(goto_uiline, sizeof(goto_uiline), "\033[%d;1H",
+            term_rows - (snap->rows_uiline - 1));
+    vtgrid_puts(g, goto_uiline);
+    vtgrid_puts(g, "\033[48;5;27m\033[2K\033[38;5;190m");
+    vtgrid_puts(g, snap->prompt);
+    vtgrid_puts(g, "\033[38;5;15m");
+    vtgrid_puts(g, snap->inputbuf);
+    vtgrid_puts(g, "\033[0m");
+    // Leave the cursor where the next typed character goes.
+    vtgrid_set_cursor(g, g->row, g->col);
+
+    // Only what changed since the last frame, if anything.
+    return vtgrid_present(g, len);
+}
+
+const char *renderer_draw(renderer *const r, uint32_t dirty,
+        int term_rows, int term_cols, size_t *const len)
+{
+    assert(r != NULL);
+    renderer_compose(r, dirty, term_rows, term_cols, &r->snapshot);
+    r->snapshot.sync_output = r->grid.sync_output;
+    return render_present(&r->grid, &r->snapshot, len);
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static char *alloc_buf(size_t size) {
+    // Zeroed, so parts not formatted yet draw as nothing.
+    char *buf = calloc(size, 1);
+    if (buf == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[render] FATAL: out of memory.");
+        exit(23);
+    }
+    return buf;
+}
+
+static void copy_str(char *const dst, size_t dstsize, const char *const src) {
+    size_t len = strlen(src);
+    if (len >= dstsize) len = dstsize - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
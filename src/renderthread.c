@@ -0,0 +1,225 @@
+#define LOG_MODULE LOGMODULE_SCREEN
+
+#include "renderthread.h"
+
+#include "framesched.h"
+#include "latency.h"
+#include "log.h"
+#include "vtgrid.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+// TODO: platform-specific code
+#include <windows.h>
+
+#define N_SNAPSHOTS 3
+
+static bool s_running = false;
+static HANDLE s_thread = NULL;
+static HANDLE s_out = NULL;
+
+// Guards everything below it. Held only long enough to swap indices or count
+// an outcome, never while composing, presenting or writing.
+static HANDLE s_mtx = NULL;
+// Set when a snapshot is published or the thread is asked to stop.
+static HANDLE s_wake = NULL;
+
+static render_snapshot s_snapshots[N_SNAPSHOTS];
+// Which snapshot the main thread composes into, which one waits to be
+// presented (if s_has_pending), and which one the render thread presents.
+static int s_i_composing = 0;
+static int s_i_pending = 1;
+static int s_i_presenting = 2;
+static bool s_has_pending = false;
+static bool s_stopping = false;
+// Outcomes not yet reported to framesched.
+static uint32_t s_outcomes[FRAME_N_OUTCOMES];
+// The last frame shown (written, or with nothing to write), and when, if
+// s_has_shown; not yet reported to latency.h either.
+static bool s_has_shown = false;
+static uint64_t s_shown_frame = 0;
+static uint64_t s_shown_us = 0;
+// The last frame presented, whatever became of it, or 0 if none was yet.
+static uint64_t s_done_frame = 0;
+
+// Only the render thread touches this, once started.
+static vtgrid s_grid;
+
+static DWORD WINAPI thread_main_render(LPVOID data);
+
+// Presents the snapshot at s_i_presenting and writes it to the console.
+static frame_outcome present_and_write(void);
+
+static void lock(void);
+static void unlock(void);
+
+bool renderthread_start(HANDLE h_out, bool utf8) {
+    assert(!s_running);
+
+    memset(&s_grid, 0, sizeof(s_grid));
+    s_grid.utf8 = utf8;
+    for (int i = 0; i < N_SNAPSHOTS; i++)
+        render_snapshot_init(&s_snapshots[i]);
+    s_i_composing = 0;
+    s_i_pending = 1;
+    s_i_presenting = 2;
+    s_has_pending = false;
+    s_stopping = false;
+    memset(s_outcomes, 0, sizeof(s_outcomes));
+    s_has_shown = false;
+    s_done_frame = 0;
+    s_out = h_out;
+
+    s_mtx = CreateMutex(NULL, FALSE, NULL);
+    // Auto-reset: each wakeup is taken by the one wait it ends.
+    s_wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (s_mtx != NULL && s_wake != NULL) {
+        s_thread = CreateThread(NULL, 0, thread_main_render, NULL, 0, NULL);
+    }
+    if (s_thread == NULL) {
+        log_fmt(LOGLEVEL_ERROR, "[renderthread] Can't start the render thread "
+                "(%lu).", GetLastError());
+        if (s_mtx != NULL) CloseHandle(s_mtx);
+        if (s_wake != NULL) CloseHandle(s_wake);
+        s_mtx = s_wake = NULL;
+        for (int i = 0; i < N_SNAPSHOTS; i++)
+            render_snapshot_free(&s_snapshots[i]);
+        return false;
+    }
+
+    s_running = true;
+    return true;
+}
+
+void renderthread_stop(void) {
+    if (!s_running) return;
+
+    lock();
+    s_stopping = true;
+    unlock();
+    SetEvent(s_wake);
+    WaitForSingleObject(s_thread, INFINITE);
+
+    CloseHandle(s_thread);
+    CloseHandle(s_wake);
+    CloseHandle(s_mtx);
+    s_thread = s_wake = s_mtx = NULL;
+    vtgrid_free(&s_grid);
+    for (int i = 0; i < N_SNAPSHOTS; i++)
+        render_snapshot_free(&s_snapshots[i]);
+    s_running = false;
+}
+
+render_snapshot *renderthread_begin_frame(void) {
+    assert(s_running);
+    // Only renderthread_publish() changes this, on this same thread.
+    return &s_snapshots[s_i_composing];
+}
+
+void renderthread_publish(void) {
+    assert(s_running);
+
+    lock();
+    // The render thread hasn't got to the last one; this one replaces it.
+    if (s_has_pending) s_outcomes[FRAME_SKIPPED]++;
+    int i = s_i_pending;
+    s_i_pending = s_i_composing;
+    s_i_composing = i;
+    s_has_pending = true;
+    unlock();
+    SetEvent(s_wake);
+}
+
+uint64_t renderthread_report_outcomes(void) {
+    assert(s_running);
+
+    uint32_t outcomes[FRAME_N_OUTCOMES];
+    lock();
+    memcpy(outcomes, s_outcomes, sizeof(outcomes));
+    memset(s_outcomes, 0, sizeof(s_outcomes));
+    bool has_shown = s_has_shown;
+    uint64_t shown_frame = s_shown_frame;
+    uint64_t shown_us = s_shown_us;
+    s_has_shown = false;
+    uint64_t done_frame = s_done_frame;
+    unlock();
+
+    for (int outcome = 0; outcome < FRAME_N_OUTCOMES; outcome++) {
+        for (uint32_t n = 0; n < outcomes[outcome]; n++)
+            framesched_frame_done((frame_outcome) outcome);
+    }
+    if (has_shown) latency_frame_shown(shown_frame, shown_us);
+    return done_frame;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static DWORD WINAPI thread_main_render(LPVOID data) {
+    (void) data;
+
+    bool stopping = false;
+    while (!stopping) {
+        WaitForSingleObject(s_wake, INFINITE);
+
+        // Anything published before the stop is still presented.
+        bool has_pending = true;
+        while (has_pending) {
+            lock();
+            has_pending = s_has_pending;
+            if (has_pending) {
+                int i = s_i_presenting;
+                s_i_presenting = s_i_pending;
+                s_i_pending = i;
+                s_has_pending = false;
+            }
+            stopping = s_stopping;
+            unlock();
+            if (!has_pending) break;
+
+            frame_outcome outcome = present_and_write();
+            uint64_t now = latency_now_us();
+            lock();
+            s_outcomes[outcome]++;
+            s_done_frame = s_snapshots[s_i_presenting].latency_frame;
+            if (outcome != FRAME_DROPPED) {
+                s_has_shown = true;
+                s_shown_frame = s_snapshots[s_i_presenting].latency_frame;
+                s_shown_us = now;
+            }
+            unlock();
+        }
+    }
+    return 0;
+}
+
+static frame_outcome present_and_write(void) {
+    size_t frame_len = 0;
+    const char *frame = render_present(&s_grid,
+            &s_snapshots[s_i_presenting], &frame_len);
+    if (frame_len == 0) return FRAME_UNCHANGED;
+
+    // The whole frame in one write.
+    DWORD written = 0;
+    if (!WriteFile(s_out, frame, (DWORD) frame_len, &written, NULL) ||
+        written != frame_len)
+    {
+        log_fmt(LOGLEVEL_ERROR, "[renderthread] WriteFile() failed (%lu); "
+                "%lu of %zu bytes written.", GetLastError(), written,
+                frame_len);
+        // Whatever the terminal shows now, it's not the frame.
+        vtgrid_invalidate(&s_grid);
+        return FRAME_DROPPED;
+    }
+    return s_grid.sync_output ? FRAME_WRITTEN_SYNCED : FRAME_WRITTEN;
+}
+
+static void lock(void) {
+    WaitForSingleObject(s_mtx, INFINITE);
+}
+
+static void unlock(void) {
+    ReleaseMutex(s_mtx);
+}
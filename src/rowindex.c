@@ -0,0 +1,185 @@
+#define LOG_MODULE LOGMODULE_SCREEN
+
+#include "rowindex.h"
+
+#include "log.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWIDX_INITIAL_CAP 256
+
+// Number of rows an entry with 'vislen' visible characters takes up.
+static int64_t rows_for(size_t vislen, int cols);
+
+// Rebuilds 'tree' in O(cap) from 'vislen' and 'cols'.
+static void rebuild_tree(rowindex *const idx);
+
+// Makes room for at least one more slot at the back, either by sliding the live
+// slots down over the evicted ones or by growing the arrays.
+static void make_room(rowindex *const idx);
+
+static void tree_add(rowindex *const idx, size_t slot, int64_t delta);
+
+void rowidx_free(rowindex *const idx) {
+    assert(idx != NULL);
+    free(idx->tree);
+    free(idx->vislen);
+    free(idx->items);
+    memset(idx, 0, sizeof(*idx));
+}
+
+size_t rowidx_count(const rowindex *const idx) {
+    assert(idx->end >= idx->first);
+    return idx->end - idx->first;
+}
+
+void rowidx_append(rowindex *const idx, void *item, size_t vislen) {
+    assert(idx != NULL);
+    if (idx->end == idx->cap) make_room(idx);
+    assert(idx->end < idx->cap);
+
+    size_t slot = idx->end++;
+    idx->items[slot] = item;
+    idx->vislen[slot] = vislen;
+
+    int64_t rows = rows_for(vislen, idx->cols);
+    tree_add(idx, slot, rows);
+    idx->total_rows += rows;
+}
+
+void rowidx_evict_front(rowindex *const idx) {
+    assert(idx != NULL);
+    assert(idx->first < idx->end);
+
+    size_t slot = idx->first++;
+    int64_t rows = rows_for(idx->vislen[slot], idx->cols);
+    tree_add(idx, slot, -rows);
+    idx->total_rows -= rows;
+    idx->items[slot] = NULL;
+    idx->vislen[slot] = 0;
+
+    assert(idx->total_rows >= 0);
+
+    // Keep slot numbers small when the index drains completely.
+    if (idx->first == idx->end) idx->first = idx->end = 0;
+}
+
+void rowidx_set_cols(rowindex *const idx, int cols) {
+    assert(idx != NULL);
+    assert(cols > 0);
+    if (idx->cols == cols) return;
+
+    idx->cols = cols;
+    rebuild_tree(idx);
+}
+
+void rowidx_refresh(rowindex *const idx) {
+    assert(idx != NULL);
+    rebuild_tree(idx);
+}
+
+void *rowidx_find_row(const rowindex *const idx, int64_t row,
+        int64_t *const row_in_item)
+{
+    assert(idx != NULL);
+    if (row < 0 || row >= idx->total_rows) return NULL;
+
+    size_t step = 1;
+    while (step * 2 <= idx->cap) step *= 2;
+
+    // Standard Fenwick descent: find the last position whose prefix sum is
+    // still <= row. The entry containing 'row' is the next one.
+    size_t pos = 0;
+    int64_t rem = row;
+    for (; step > 0; step /= 2) {
+        if (pos + step <= idx->cap && idx->tree[pos + step] <= rem) {
+            pos += step;
+            rem -= idx->tree[pos];
+        }
+    }
+
+    // 'pos' is a 1-based count of slots skipped, so it's the 0-based slot.
+    assert(pos >= idx->first && pos < idx->end);
+    if (row_in_item != NULL) *row_in_item = rem;
+    return idx->items[pos];
+}
+
+int64_t rowidx_rows_before(const rowindex *const idx, size_t n) {
+    assert(idx != NULL);
+    assert(n <= rowidx_count(idx));
+
+    int64_t sum = 0;
+    for (size_t i = idx->first + n; i > 0; i -= i & (~i + 1))
+        sum += idx->tree[i];
+    return sum;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static int64_t rows_for(size_t vislen, int cols) {
+    // Nothing has been rendered yet, so there's no width to wrap to. Count
+    // one row per entry until the first rowidx_set_cols().
+    if (cols <= 0) return vislen > 0 ? 1 : 0;
+    return vislen / cols + (vislen % cols == 0 ? 0 : 1);
+}
+
+static void rebuild_tree(rowindex *const idx) {
+    if (idx->cap == 0) return;
+
+    idx->total_rows = 0;
+    memset(idx->tree, 0, (idx->cap + 1) * sizeof(*idx->tree));
+    for (size_t slot = idx->first; slot < idx->end; slot++) {
+        int64_t rows = rows_for(idx->vislen[slot], idx->cols);
+        idx->tree[slot + 1] = rows;
+        idx->total_rows += rows;
+    }
+
+    // Linear-time construction: push each node's sum into its parent.
+    for (size_t i = 1; i <= idx->cap; i++) {
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= idx->cap) idx->tree[parent] += idx->tree[i];
+    }
+}
+
+static void make_room(rowindex *const idx) {
+    size_t n_live = rowidx_count(idx);
+
+    // Plenty of dead slots at the front; slide everything down instead of
+    // growing. This amortizes to O(1) per eviction.
+    if (idx->first > 0 && idx->first >= idx->cap / 2) {
+        memmove(idx->items, idx->items + idx->first,
+                n_live * sizeof(*idx->items));
+        memmove(idx->vislen, idx->vislen + idx->first,
+                n_live * sizeof(*idx->vislen));
+        idx->first = 0;
+        idx->end = n_live;
+        rebuild_tree(idx);
+        return;
+    }
+
+    size_t new_cap = idx->cap == 0 ? ROWIDX_INITIAL_CAP : idx->cap * 2;
+    void **items = (void **) realloc(idx->items, new_cap * sizeof(*items));
+    size_t *vislen = (size_t *) realloc(idx->vislen, new_cap * sizeof(*vislen));
+    int64_t *tree = (int64_t *) realloc(idx->tree,
+            (new_cap + 1) * sizeof(*tree));
+    if (items == NULL || vislen == NULL || tree == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[rowindex make_room()] FATAL: out of memory.");
+        exit(23);
+    }
+
+    idx->items = items;
+    idx->vislen = vislen;
+    idx->tree = tree;
+    idx->cap = new_cap;
+    rebuild_tree(idx);
+}
+
+static void tree_add(rowindex *const idx, size_t slot, int64_t delta) {
+    if (delta == 0) return;
+    for (size_t i = slot + 1; i <= idx->cap; i += i & (~i + 1))
+        idx->tree[i] += delta;
+}
@@ -1,10 +1,22 @@
+#define LOG_MODULE LOGMODULE_SCREEN
+
 #include "screen_framework.h"
 
+#include "coldstore.h"
+#include "fmtline.h"
+#include "framesched.h"
+#include "latency.h"
 #include "log.h"
+#include "nicktab.h"
+#include "rowindex.h"
+#include "scrrecord.h"
+#include "searchindex.h"
+#include "spillstore.h"
 #include "stringutils.h"
 #include "terminalutils.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -19,10 +31,18 @@
 
 #define DEFAULT_PROMPT "> "
 
-// This is just a string holder. Timestamp, author info, formatting, etc. should
-// all be interpolated into the string already. 
+// Most lines from outside the hot list that can be shown at once; see
+// screenlog_history_window().
+#define SCREENLOG_HISTORY_WINDOW_MAX 512
+
+// Tab names longer than this are cut short and end in "..".
+#define TAB_NAME_ABBREV_OVER 10
+#define TAB_NAME_ABBREV_LEN (TAB_NAME_ABBREV_OVER - 3)
+
+// Only the message's parts are kept; the timestamp, nick and colours are put
+// together when it's drawn. See scrrecord.h.
 typedef struct screenlog_node {
-    char *msg;
+    scrrec rec;
     struct screenlog_node *prev;
     struct screenlog_node *next;
 } screenlog_node;
@@ -31,25 +51,51 @@ typedef struct screenlog_list {
     screenlog_node *head;
     screenlog_node *tail;
     int n_msgs;
-    int curr_size_bytes;
-    int max_size_bytes;
+    // Of the nodes only; see screenlog_bytes() for the screen's total.
+    int64_t curr_size_bytes;
+    // Cap on the nodes plus 'cold'.
+    int64_t max_size_bytes;
+    // Once the nodes take more than this, the oldest are sealed into 'cold'
+    // a block at a time. SCREENLOG_HOT_UNLIMITED keeps everything as nodes.
+    int64_t hot_max_bytes;
+    // Wrapped row counts of every node, oldest first, for scroll positioning.
+    rowindex rows;
+    // Compressed lines older than 'head', still in memory.
+    coldstore cold;
+    // Where evicted lines go, to be read back when scrolling past 'cold'.
+    spillstore spill;
+    // Full-text index of the searchable lines delivered this session, keyed
+    // by sequence number. Lines keep their number when spilled, so hits in
+    // spilled history can still be scrolled to. Counted in the global total
+    // but not in 'max_size_bytes', which it's kept under on its own.
+    searchindex search;
+    // Sequence number of the next line pushed, of the oldest line in memory
+    // (the oldest in 'cold', if any), and of 'head'.
+    uint32_t next_seq;
+    uint32_t head_seq;
+    uint32_t hot_seq;
+    // Spill record index minus sequence number for this session's lines, set
+    // on the first eviction. Spill failures are permanent, so this holds for
+    // every line that made it to disk.
+    int64_t spill_base;
+    bool spill_base_set;
 } screenlog_list;
 
 typedef struct screen {
     char topic[SCREEN_DISPLAY_TEXT_MAXLEN];
+    // 'topic' compiled for display, or NULL if it hasn't been drawn yet.
+    fmtline *topic_line;
     screenlog_list scrlog;
     screen_ui_state ui_state;
     char name[CHANNEL_NAME_MAXLEN];
     bool unread;
+    // Ticks of the scrollback clock (see s_scrlog_clock) when the screen was
+    // last shown and last received a message. Used to pick eviction victims
+    // when the global scrollback budget is exceeded.
+    uint64_t last_viewed;
+    uint64_t last_activity;
 } screen;
 
-typedef struct format_toggles {
-    bool bold;
-    bool italic;
-    bool underline;
-    bool striketh;
-} format_toggles;
-
 
 /************************ INTERNAL SCR MGMT **********************************/
 static void internal__set_active(size_t i_scr);
@@ -59,9 +105,13 @@ static int internal__find_open_slot(void);
 static int internal__find_screen(const_str find_name);
 static int internal__find_screen_startswith(const_str prefix);
 
+// For when something screen_fmt_tabs() or screen_fmt_header() shows changed:
+// bumps its version and marks it dirty.
+static void internal__tabs_changed(void);
+static void internal__header_changed(void);
+
 
 /************************** BUF FMT UTILITIES ********************************/
-static void format_toggles_clear(format_toggles *const toggles);
 static bool is_digit(char c);
 
 // Returns the offset index up to which the provided message could be printed
@@ -79,91 +129,158 @@ static size_t calc_screen_offset(
         size_t *const n_visible_chars,
         char *const replaybuf, size_t replaybuf_size);
 
-// Looks at the char in src at i_src and writes to buf at i_buf accordingly.
-// If there's nothing special about src[i_src], this simply writes one char.
-// If src[i_src] is an IRC format control character, this function will write
-// the ANSI escape sequences to match the format specification.
-// This function will modify the passed-in index pointers for both the buffer
-// and the source string according to what it processes, so no incrementing by
-// the caller is necessary.
-// The format_toggles pointer is required to track the context, since many IRC
-// formatting options work as toggles. All toggles should be set back to false
-// after each message, in case the message did not explicitly toggle it off.
-static size_t translate_src_char_to_buf(
-        char *const buf, size_t *const i_buf, size_t bufsize,
-        const char *const src, size_t *const i_src, size_t srclen,
-        format_toggles *const togs);
-        
-static int num_lines(char *msg, int cols);
-static size_t strlen_on_screen(const char *msg);
+// Rows a line 'width' columns wide takes up when wrapped to 'cols' columns.
+static int num_lines(size_t width, int cols);
 
+// Columns the tab of the screen in slot 'i_scr' takes up, and writes it to
+// 'buf', returning the number of bytes written.
+static int tab_width(size_t i_scr);
+static size_t fmt_tab(char *buf, size_t bufsize, size_t i_scr);
 
+// Writes all of 'rec' to 'spill'. Spilled lines are stored as fully decorated
+// ANSI strings, drawn with the theme and timestamp format at the time.
+static void spill_append_line(
+        spillstore *const spill, const scrrec *const rec);
 
 
 /********************* INTERNAL SCREENLOG API ********************************/
 // This is extremely costly because it traverses the entire list twice (forward
-// and backward). Only for use validating the screenlog list code during dev.
+// and backward). Only for use validating the screenlog list code during dev:
+// define SCREENLOG_DEBUG_VALIDATE to compile the calls in.
+#ifdef SCREENLOG_DEBUG_VALIDATE
 static void DEBUG_validate_screenlog_list(const screenlog_list *const scrlog);
+#endif
+
+// Passes ownership of the record's body to the screenlog_list, which will free
+// it when appropriate. Callers should not free the body or continue accessing
+// it after passing.
+static void screenlog_push_take(screenlog_list *const scrlog,
+        const scrrec *const rec);
 
-// Copies the provided string for use in the new log entry. Use if you need your
-// string after calling this or if passing a stack-allocated char[].
-static void screenlog_push_copy(screenlog_list *const scrlog, const_str msg);
+// Bytes held by the screen's nodes and cold blocks together.
+static int64_t screenlog_bytes(const screenlog_list *const scrlog);
 
-// Passes ownership of the provided string to the screenlog_list, which will 
-// free it when appropriate. Callers should not free the string, continue
-// accessing the string after passing, or pass a stack-allocated char[].
-static void screenlog_push_take(screenlog_list *const scrlog, char *const msg);
+// Seals the oldest nodes into cold blocks while the nodes are a whole block
+// over the screen's hot budget. The newest node is never sealed.
+static void screenlog_seal_cold(screenlog_list *const scrlog);
 
 // Removes the least possible number of messages from the back (oldest) of the
-// list to free at least the specified number of bytes.
+// log to free at least the specified number of bytes. Cold blocks, being the
+// oldest, go first, and whole.
 static void screenlog_evict_min_to_free(
-        screenlog_list *const scrlog, int free_bytes);
+        screenlog_list *const scrlog, int64_t free_bytes);
+
+// Drops lines that can't be read back any more (evicted with the spill
+// disabled, or deleted from it) from the screen's search index, once they make
+// up half of what it covers, so the rebuild is paid for by the lines since.
+static void screenlog_index_prune_dead(screenlog_list *const scrlog);
+
+// Builds a temporary chain of nodes over history older than 'head' (cold
+// blocks, then spilled history), starting with the line that holds the row
+// 'rows_back' rows above 'head' and ending with enough lines to fill
+// 'buf_rows' rows, with the last one linked to 'head'. The nodes and their
+// lines, copied out of cold blocks or compiled from the mapped segment files,
+// are only valid until the next call. Returns NULL if there are fewer rows
+// than 'rows_back', with the number there are in 'history_rows'.
+static screenlog_node *screenlog_history_window(screenlog_list *const scrlog,
+        int64_t rows_back, int buf_rows, int cols,
+        int64_t *const rows_into_msg, int64_t *const history_rows);
+
+// Drops lines older than 'min_seq' from the screen's search index, keeping the
+// global total in step.
+static void screenlog_index_prune(screenlog_list *const scrlog,
+        uint32_t min_seq);
+
+// Drops the older half of the lines the screen's search index covers until it
+// takes no more than 'max_bytes'.
+static void screenlog_index_trim(screenlog_list *const scrlog,
+        int64_t max_bytes);
+
+// Evicts from the coldest screens, then trims the biggest search indexes,
+// until the total size of all screenlogs is within the global budget. See
+// scrmgr_set_global_max_bytes().
+static void screenlog_enforce_global_max(void);
+
+// Copies the visible text of the line with sequence number 'seq', from memory
+// or the spill, to 'buf', truncating to fit. Returns false if it was evicted
+// without being spilled.
+static bool screenlog_get_seq_text(screenlog_list *const scrlog, uint32_t seq,
+        char *const buf, size_t bufsize);
+
+static void internal__deliver(const_str deliver_to_name,
+        screen_msg_kind kind, int64_t ts, const_str from, const_str text,
+        bool searchable);
 
 
 /***************************** STATIC VARS ***********************************/
 static screen s_scr_home = {
     .topic = {"Not Connected"},
-    .scrlog = { .max_size_bytes = SCREENLOG_DEFAULT_MAX_BYTES },
+    .scrlog = {
+        .max_size_bytes = SCREENLOG_DEFAULT_MAX_BYTES,
+        .hot_max_bytes = SCREENLOG_DEFAULT_HOT_BYTES,
+        // Same as spill_init(&spill, "home").
+        .spill = { .dir = SPILL_ROOT_DIR "\\home" }
+    },
     .ui_state = {
         .prompt = "> ",
         .inputbuf = {0}, 
         .i_inputbuf = 0,
         .scroll = 0,
-        .scroll_at_top = true
+        .scroll_at_top = true,
+        .rows_visible = 0
     },
     .name = "home",
-    .unread = false
+    .unread = false,
+    .last_viewed = 0,
+    .last_activity = 0
 };
 
 static screen* s_scrslots[N_SCRSLOTS] = { &s_scr_home };
 
 static screen *s_scr_active = &s_scr_home;
 
-// Used for capturing the skipped ANSI escape sequences for formatting when 
-// printing a partial wrapped message so they can be replayed in order.
-static char s_replaybuf[SCREENMSG_BUF_SIZE] = { 0 };
+// Sum of screenlog_bytes() and search index bytes across every screenlog, and
+// the cap on that sum.
+static int64_t s_scrlog_total_bytes = 0;
+static int64_t s_scrlog_global_max_bytes = SCREENLOG_GLOBAL_MAX_BYTES;
+
+// Logical clock ticked on every delivery and screen switch. Only the ordering
+// of its values matters, so there's no need for a real timestamp.
+static uint64_t s_scrlog_clock = 0;
+
+// Bumped whenever the tab bar or the header would be drawn differently. Start
+// at 1 so a caller's zeroed "last seen" version is never current.
+static uint32_t s_tabs_version = 1;
+static uint32_t s_header_version = 1;
+
+// Scratch space for writing a line out as an ANSI string to spill it.
+static char *s_spillbuf = NULL;
+static size_t s_spillbuf_size = 0;
 
 
 /*****************************************************************************/
 /****************************** SCREENLOG IMPLs ******************************/
 
-static void screenlog_push_copy(screenlog_list *const scrlog, const_str msg) {
+static void screenlog_push_take(screenlog_list *const scrlog,
+        const scrrec *const rec)
+{
     assert(scrlog != NULL);
-    assert(msg != NULL);
+    assert(rec != NULL);
+    assert(rec->body != NULL);
 
-    // TODO: debug mode only!
+#ifdef SCREENLOG_DEBUG_VALIDATE
     DEBUG_validate_screenlog_list(scrlog);
+#endif
 
     // TODO: Change OOM asserts to proper failure/abort
-    screenlog_node *new_node = 
+    screenlog_node *new_node =
         (screenlog_node *) malloc(sizeof(screenlog_node));
     assert(new_node != NULL);
 
-    size_t msg_bytes = (strlen(msg) + 1) * sizeof(char);
-    new_node->msg = (char *) malloc(msg_bytes);
-    assert(new_node->msg != NULL);
-
-    strcpy_s(new_node->msg, msg_bytes, msg);
+    new_node->rec = *rec;
+    int64_t msg_bytes = (int64_t) fmtline_size(rec->body);
+    rowidx_append(&scrlog->rows, new_node, scrrec_width(rec));
+    scrlog->next_seq++;
 
     new_node->next = NULL;
     if (scrlog->tail != NULL) {
@@ -173,84 +290,149 @@ static void screenlog_push_copy(screenlog_list *const scrlog, const_str msg) {
         scrlog->tail = new_node;
         scrlog->n_msgs++;
         scrlog->curr_size_bytes += msg_bytes;
-        int bytes_left = scrlog->max_size_bytes - scrlog->curr_size_bytes;
+        s_scrlog_total_bytes += msg_bytes;
+        // Sealing shrinks what's sealed, so it may leave nothing to evict.
+        screenlog_seal_cold(scrlog);
+        int64_t bytes_left = scrlog->max_size_bytes - screenlog_bytes(scrlog);
         if (bytes_left < 0)
             screenlog_evict_min_to_free(scrlog, 0 - bytes_left);
     }
     else {
         assert(scrlog->head == NULL);
-        assert((int) msg_bytes > 0);
-        assert(scrlog->max_size_bytes >= (int) msg_bytes);
+        assert(scrlog->max_size_bytes >= msg_bytes);
         new_node->prev = NULL;
         scrlog->head = new_node;
         scrlog->tail = new_node;
         scrlog->n_msgs = 1;
         scrlog->curr_size_bytes = msg_bytes;
+        s_scrlog_total_bytes += msg_bytes;
     }
 
+#ifdef SCREENLOG_DEBUG_VALIDATE
     DEBUG_validate_screenlog_list(scrlog);
+#endif
 }
 
-static void screenlog_push_take(screenlog_list *const scrlog, char *const msg) {
-    assert(scrlog != NULL);
-    assert(msg != NULL);
+static int64_t screenlog_bytes(const screenlog_list *const scrlog) {
+    return scrlog->curr_size_bytes + scrlog->cold.bytes;
+}
 
-    // TODO: debug mode only!
-    DEBUG_validate_screenlog_list(scrlog);
+static void screenlog_seal_cold(screenlog_list *const scrlog) {
+    assert(scrlog != NULL);
+    if (scrlog->hot_max_bytes == SCREENLOG_HOT_UNLIMITED) return;
+
+    static scrrec *s_seal_recs = NULL;
+    static size_t s_seal_recs_cap = 0;
+
+    while (scrlog->curr_size_bytes - scrlog->hot_max_bytes >=
+           COLD_BLOCK_RAW_BYTES)
+    {
+        screenlog_node *curr = scrlog->head;
+        size_t n = 0;
+        int64_t sealed_bytes = 0;
+        while (curr != scrlog->tail && sealed_bytes < COLD_BLOCK_RAW_BYTES) {
+            if (n == s_seal_recs_cap) {
+                size_t new_cap =
+                    s_seal_recs_cap == 0 ? 256 : s_seal_recs_cap * 2;
+                scrrec *new_recs = (scrrec *) realloc(
+                        s_seal_recs, new_cap * sizeof(*s_seal_recs));
+                if (new_recs == NULL) {
+                    // TODO: communicate fatal error
+                    log(LOGLEVEL_ERROR,
+                            "[screenlog_seal_cold()] FATAL: out of memory.");
+                    exit(23);
+                }
+                s_seal_recs = new_recs;
+                s_seal_recs_cap = new_cap;
+            }
+            s_seal_recs[n++] = curr->rec;
+            sealed_bytes += fmtline_size(curr->rec.body);
 
-    // TODO: Change OOM asserts to proper failure/abort
-    screenlog_node *new_node =
-        (screenlog_node *) malloc(sizeof(screenlog_node));
-    assert(new_node != NULL);
+            screenlog_node *const sealed = curr;
+            curr = curr->next;
+            curr->prev = NULL;
+            rowidx_evict_front(&scrlog->rows);
+            free(sealed);
+        }
+        if (n == 0) break;
 
-    new_node->msg = msg;
+        scrlog->head = curr;
+        scrlog->n_msgs -= (int) n;
+        scrlog->curr_size_bytes -= sealed_bytes;
 
-    new_node->next = NULL;
-    if (scrlog->tail != NULL) {
-        assert(scrlog->head != NULL);
-        new_node->prev = scrlog->tail;
-        scrlog->tail->next = new_node;
-        scrlog->tail = new_node;
-        scrlog->n_msgs++;
-        scrlog->curr_size_bytes += strlen(new_node->msg) + 1;
-        int bytes_left = scrlog->max_size_bytes - scrlog->curr_size_bytes;
-        if (bytes_left < 0)
-            screenlog_evict_min_to_free(scrlog, 0 - bytes_left);
-    }
-    else {
-        assert(scrlog->head == NULL);
-        new_node->prev = NULL;
-        scrlog->head = new_node;
-        scrlog->tail = new_node;
-        scrlog->n_msgs = 1;
-        scrlog->curr_size_bytes = strlen(new_node->msg) + 1;
+        // The block takes over the bodies and nick references.
+        int64_t cold_before = scrlog->cold.bytes;
+        cold_seal(&scrlog->cold, scrlog->hot_seq, s_seal_recs, n);
+        scrlog->hot_seq += (uint32_t) n;
+        s_scrlog_total_bytes += scrlog->cold.bytes - cold_before - sealed_bytes;
     }
 
-    DEBUG_validate_screenlog_list(scrlog);
+    assert(s_scrlog_total_bytes >= 0);
 }
 
 static void screenlog_evict_min_to_free(
-        screenlog_list *const scrlog, int free_bytes)
+        screenlog_list *const scrlog, int64_t free_bytes)
 {
     assert(scrlog != NULL);
     assert(scrlog->head != NULL);
     assert(scrlog->tail != NULL);
     assert(free_bytes > 0);
-    assert(free_bytes <= scrlog->curr_size_bytes);
+    assert(free_bytes <= screenlog_bytes(scrlog));
 
+#ifdef SCREENLOG_DEBUG_VALIDATE
     DEBUG_validate_screenlog_list(scrlog);
+#endif
+
+    if (!scrlog->spill_base_set) {
+        scrlog->spill_base =
+            spill_count(&scrlog->spill) - (int64_t) scrlog->head_seq;
+        scrlog->spill_base_set = true;
+    }
+
+    // Cold blocks hold the oldest lines.
+    coldstore *const cold = &scrlog->cold;
+    int64_t freed_bytes = 0;
+    while (freed_bytes < free_bytes && cold_count_blocks(cold) > 0) {
+        size_t n = 0;
+        const scrrec *const recs = cold_get_block(cold, 0, &n);
+        for (size_t i = 0; i < n; i++) {
+            // Keep the spill's numbering in step even if the block is lost.
+            if (recs != NULL) spill_append_line(&scrlog->spill, &recs[i]);
+            else spill_append(&scrlog->spill, "", 0);
+        }
+
+        int64_t cold_before = cold->bytes;
+        cold_drop_front(cold);
+        scrlog->head_seq += (uint32_t) n;
+        freed_bytes += cold_before - cold->bytes;
+        s_scrlog_total_bytes -= cold_before - cold->bytes;
+    }
+    if (freed_bytes >= free_bytes) {
+        screenlog_index_prune_dead(scrlog);
+#ifdef SCREENLOG_DEBUG_VALIDATE
+        DEBUG_validate_screenlog_list(scrlog);
+#endif
+        return;
+    }
 
     screenlog_node *curr = scrlog->head, *evictme = NULL;
-    int freed_bytes = 0, evicted_nodes = 0;
+    int64_t freed_hot_bytes = 0;
+    int evicted_nodes = 0;
     while (freed_bytes < free_bytes) {
         assert (curr != NULL);
         evictme = curr;
         curr = curr->next;
 
-        size_t msg_bytes = strlen(evictme->msg) + 1;
+        size_t msg_bytes = fmtline_size(evictme->rec.body);
+        spill_append_line(&scrlog->spill, &evictme->rec);
+        nicktab_release(evictme->rec.nick);
+        rowidx_evict_front(&scrlog->rows);
+        scrlog->head_seq++;
+        scrlog->hot_seq++;
 
-        free(evictme->msg);
+        free(evictme->rec.body);
         freed_bytes += msg_bytes;
+        freed_hot_bytes += msg_bytes;
 
         free(evictme);
         evicted_nodes++;
@@ -258,17 +440,256 @@ static void screenlog_evict_min_to_free(
         if (curr)
             curr->prev = NULL;
     }
-    scrlog->curr_size_bytes -= freed_bytes;
+    scrlog->curr_size_bytes -= freed_hot_bytes;
+    s_scrlog_total_bytes -= freed_hot_bytes;
     scrlog->n_msgs -= evicted_nodes;
     scrlog->head = curr;
     if (curr == NULL) scrlog->tail = curr;
 
     assert(scrlog->curr_size_bytes >= 0);
     assert(scrlog->n_msgs >= 0);
+    assert(s_scrlog_total_bytes >= 0);
+    screenlog_index_prune_dead(scrlog);
 
+#ifdef SCREENLOG_DEBUG_VALIDATE
     DEBUG_validate_screenlog_list(scrlog);
+#endif
+}
+
+static void screenlog_index_prune_dead(screenlog_list *const scrlog) {
+    // Without a spill, nothing older than 'head_seq' can be read back; with
+    // one, nothing older than what it kept.
+    int64_t floor = scrlog->head_seq;
+    if (!scrlog->spill.disabled) {
+        if (!scrlog->spill_base_set) return;
+        int64_t first = spill_first(&scrlog->spill) - scrlog->spill_base;
+        if (first < floor) floor = first;
+    }
+    int64_t min_id = scrlog->search.min_id;
+    if (floor <= min_id || floor - min_id < scrlog->next_seq - floor) return;
+    screenlog_index_prune(scrlog, (uint32_t) floor);
 }
 
+static screenlog_node *screenlog_history_window(screenlog_list *const scrlog,
+        int64_t rows_back, int buf_rows, int cols,
+        int64_t *const rows_into_msg, int64_t *const history_rows)
+{
+    // Only as many lines as could possibly be on screen at once.
+    static screenlog_node s_window_nodes[SCREENLOG_HISTORY_WINDOW_MAX];
+    static int s_n_window_nodes = 0;
+
+    // Lines from the previous window are done with.
+    for (int i = 0; i < s_n_window_nodes; i++)
+        free(s_window_nodes[i].rec.body);
+    s_n_window_nodes = 0;
+
+    if (history_rows != NULL) *history_rows = 0;
+
+    // The row is either in a cold block or, further back, in the spill.
+    coldstore *const cold = &scrlog->cold;
+    spillstore *const spill = &scrlog->spill;
+    size_t i_block = 0, i_line = 0;
+    int64_t rec = 0;
+    bool from_spill = !cold_find_row_from_end(
+            cold, cols, rows_back, &i_block, &i_line, rows_into_msg);
+    if (from_spill) {
+        int64_t cold_rows = cold_total_rows(cold, cols), spill_rows = 0;
+        bool found = false;
+        if (spill_count(spill) > 0) {
+            spill_begin_read(spill);
+            found = spill_find_row_from_end(spill, cols, rows_back - cold_rows,
+                    &rec, rows_into_msg, &spill_rows);
+        }
+        if (!found) {
+            if (history_rows != NULL) *history_rows = cold_rows + spill_rows;
+            return NULL;
+        }
+    }
+
+    int64_t rows_needed = *rows_into_msg + buf_rows, rows_gathered = 0;
+    int n_nodes = 0;
+    int64_t n_recs = from_spill ? spill_count(spill) : 0;
+    while (rec < n_recs && n_nodes < SCREENLOG_HISTORY_WINDOW_MAX &&
+           rows_gathered < rows_needed)
+    {
+        size_t vislen = 0;
+        const char *msg = spill_get(spill, rec++, &vislen);
+        if (msg == NULL) break;
+
+        screenlog_node *const node = &s_window_nodes[n_nodes];
+        // Spilled lines are already decorated.
+        memset(&node->rec, 0, sizeof(node->rec));
+        node->rec.kind = SCREEN_MSG_TEXT;
+        node->rec.body = fmtline_compile(msg);
+        node->prev = n_nodes > 0 ? &s_window_nodes[n_nodes - 1] : NULL;
+        if (n_nodes > 0) s_window_nodes[n_nodes - 1].next = node;
+        n_nodes++;
+        s_n_window_nodes = n_nodes;
+        rows_gathered += vislen / cols + (vislen % cols ? 1 : 0);
+    }
+
+    // Cold lines are copied out, since a later block may push this one out of
+    // the decompressed cache while the window is still in use.
+    size_t n_blocks = cold_count_blocks(cold);
+    for (size_t b = from_spill ? 0 : i_block; b < n_blocks; b++) {
+        if (n_nodes >= SCREENLOG_HISTORY_WINDOW_MAX ||
+            rows_gathered >= rows_needed)
+        {
+            break;
+        }
+
+        size_t n_lines = 0;
+        const scrrec *const recs = cold_get_block(cold, b, &n_lines);
+        if (recs == NULL) break;
+
+        size_t line = (!from_spill && b == i_block) ? i_line : 0;
+        for (; line < n_lines && n_nodes < SCREENLOG_HISTORY_WINDOW_MAX &&
+               rows_gathered < rows_needed; line++)
+        {
+            size_t size = fmtline_size(recs[line].body);
+            fmtline *const body = (fmtline *) malloc(size);
+            if (body == NULL) {
+                // TODO: communicate fatal error
+                log(LOGLEVEL_ERROR,
+                        "[screenlog_history_window()] FATAL: out of memory.");
+                exit(23);
+            }
+            memcpy(body, recs[line].body, size);
+
+            screenlog_node *const node = &s_window_nodes[n_nodes];
+            node->rec = recs[line];
+            node->rec.body = body;
+            node->prev = n_nodes > 0 ? &s_window_nodes[n_nodes - 1] : NULL;
+            if (n_nodes > 0) s_window_nodes[n_nodes - 1].next = node;
+            n_nodes++;
+            s_n_window_nodes = n_nodes;
+            rows_gathered += num_lines(scrrec_width(&node->rec), cols);
+        }
+    }
+    if (n_nodes == 0) return NULL;
+
+    s_window_nodes[n_nodes - 1].next = scrlog->head;
+    return &s_window_nodes[0];
+}
+
+static bool screenlog_get_seq_text(screenlog_list *const scrlog, uint32_t seq,
+        char *const buf, size_t bufsize)
+{
+    if (seq >= scrlog->next_seq) return false;
+    if (seq >= scrlog->hot_seq) {
+        size_t i_row = scrlog->rows.first + (size_t) (seq - scrlog->hot_seq);
+        const screenlog_node *const node =
+                (screenlog_node *) scrlog->rows.items[i_row];
+        scrrec_copy_text(&node->rec, buf, bufsize);
+        return true;
+    }
+    if (seq >= scrlog->head_seq) {
+        const scrrec *const rec = cold_get_seq(&scrlog->cold, seq);
+        if (rec == NULL) return false;
+        scrrec_copy_text(rec, buf, bufsize);
+        return true;
+    }
+    if (!scrlog->spill_base_set) return false;
+
+    spill_begin_read(&scrlog->spill);
+    const char *msg = spill_get(&scrlog->spill, scrlog->spill_base + seq, NULL);
+    if (msg == NULL) return false;
+
+    scrrec rec = { 0 };
+    rec.kind = SCREEN_MSG_TEXT;
+    rec.body = fmtline_compile(msg);
+    scrrec_copy_text(&rec, buf, bufsize);
+    free(rec.body);
+    return true;
+}
+
+static void screenlog_index_prune(screenlog_list *const scrlog,
+        uint32_t min_seq)
+{
+    int64_t bytes_before = scrlog->search.bytes;
+    srchidx_prune(&scrlog->search, min_seq);
+    s_scrlog_total_bytes -= bytes_before - scrlog->search.bytes;
+    assert(s_scrlog_total_bytes >= 0);
+}
+
+static void screenlog_index_trim(screenlog_list *const scrlog,
+        int64_t max_bytes)
+{
+    assert(max_bytes >= 0);
+    while (scrlog->search.bytes > max_bytes) {
+        // 'next_seq' itself may already be indexed, ahead of its push.
+        uint32_t min_id = scrlog->search.min_id;
+        uint32_t end = scrlog->next_seq + 1;
+        assert(min_id < end);
+        screenlog_index_prune(scrlog, min_id + (end - min_id + 1) / 2);
+    }
+}
+
+static void screenlog_enforce_global_max(void) {
+    while (s_scrlog_total_bytes > s_scrlog_global_max_bytes) {
+        // The coldest screen is the one viewed least recently; between screens
+        // viewed equally long ago (e.g., never), the quieter one goes first.
+        // The active screen is only touched once everything else is at its
+        // reserve, and then only down to the reserve too.
+        screen *victim = NULL;
+        for (int i = 0; i < N_SCRSLOTS; i++) {
+            screen *const scr = s_scrslots[i];
+            if (scr == NULL || scr == s_scr_active) continue;
+            if (screenlog_bytes(&scr->scrlog) <= SCREENLOG_RESERVE_BYTES)
+                continue;
+            if (victim == NULL ||
+                scr->last_viewed < victim->last_viewed ||
+                (scr->last_viewed == victim->last_viewed &&
+                 scr->last_activity < victim->last_activity))
+            {
+                victim = scr;
+            }
+        }
+        if (victim == NULL &&
+            screenlog_bytes(&s_scr_active->scrlog) > SCREENLOG_RESERVE_BYTES)
+        {
+            victim = s_scr_active;
+        }
+        if (victim == NULL) {
+            // Then the biggest index, which only costs search hits on lines
+            // that are mostly out of memory already.
+            screen *biggest = NULL;
+            for (int i = 0; i < N_SCRSLOTS; i++) {
+                screen *const scr = s_scrslots[i];
+                if (scr == NULL || scr->scrlog.search.bytes == 0) continue;
+                if (biggest == NULL || scr->scrlog.search.bytes >
+                                       biggest->scrlog.search.bytes)
+                {
+                    biggest = scr;
+                }
+            }
+            if (biggest != NULL) {
+                int64_t over = s_scrlog_total_bytes - s_scrlog_global_max_bytes;
+                int64_t keep = biggest->scrlog.search.bytes - over;
+                screenlog_index_trim(&biggest->scrlog, keep > 0 ? keep : 0);
+                continue;
+            }
+
+            // Every screen is down to its reserve; the budget is simply too
+            // small for the number of open screens.
+            log_fmt(LOGLEVEL_WARNING, "[screenlog_enforce_global_max] Over "
+                    "budget (%lld > %lld) with every screen at its reserve.",
+                    (long long) s_scrlog_total_bytes,
+                    (long long) s_scrlog_global_max_bytes);
+            return;
+        }
+
+        screenlog_list *const scrlog = &victim->scrlog;
+        if (victim == s_scr_active) framesched_mark(FRAME_DIRTY_LOG);
+        int64_t over = s_scrlog_total_bytes - s_scrlog_global_max_bytes;
+        int64_t above_reserve =
+            screenlog_bytes(scrlog) - SCREENLOG_RESERVE_BYTES;
+        screenlog_evict_min_to_free(
+                scrlog, over < above_reserve ? over : above_reserve);
+    }
+}
+
+#ifdef SCREENLOG_DEBUG_VALIDATE
 static void DEBUG_validate_screenlog_list(const screenlog_list *const scrlog) {
     assert(scrlog != NULL);
 
@@ -299,9 +720,10 @@ static void DEBUG_validate_screenlog_list(const screenlog_list *const scrlog) {
 
     // Now actually validate the values...
     screenlog_node *curr = scrlog->head, *last = scrlog->head;
-    int actual_size_bytes = 0, actual_n_msgs = 0;
+    int64_t actual_size_bytes = 0;
+    int actual_n_msgs = 0;
     while (curr != NULL) {
-        actual_size_bytes += strlen(curr->msg) + 1;
+        actual_size_bytes += fmtline_size(curr->rec.body);
         actual_n_msgs++;
         last = curr;
         curr = curr->next;
@@ -314,7 +736,7 @@ static void DEBUG_validate_screenlog_list(const screenlog_list *const scrlog) {
     curr = last = scrlog->tail;
     actual_size_bytes = actual_n_msgs = 0;
     while (curr != NULL) {
-        actual_size_bytes += strlen(curr->msg) + 1;
+        actual_size_bytes += fmtline_size(curr->rec.body);
         actual_n_msgs++;
         last = curr;
         curr = curr->prev;
@@ -322,7 +744,20 @@ static void DEBUG_validate_screenlog_list(const screenlog_list *const scrlog) {
     assert(last == scrlog->head);
     assert(actual_size_bytes == scrlog->curr_size_bytes);
     assert(actual_n_msgs == scrlog->n_msgs);
+
+    // The row index should track the list one-to-one, oldest first.
+    assert(rowidx_count(&scrlog->rows) == (size_t) scrlog->n_msgs);
+    if (scrlog->head != NULL) {
+        assert(scrlog->rows.items[scrlog->rows.first] == scrlog->head);
+        assert(scrlog->rows.items[scrlog->rows.end - 1] == scrlog->tail);
+    }
+
+    // Every line since the oldest in memory is either cold or a node.
+    assert(scrlog->hot_seq - scrlog->head_seq == scrlog->cold.n_lines);
+    assert(scrlog->next_seq - scrlog->hot_seq == (uint32_t) scrlog->n_msgs);
+    assert(scrlog->cold.n_lines == 0 || scrlog->head != NULL);
 }
+#endif
 
 
 
@@ -350,14 +785,40 @@ bool scrmgr_create_or_switch(const_str channel_name) {
 }
 
 void scrmgr_deliver_copy(const_str deliver_to_name, const_str msg) {
-    int i_scr = internal__find_screen(deliver_to_name);
-    assert(i_scr >= -1);
-    assert(i_scr < N_SCRSLOTS);
+    internal__deliver(deliver_to_name, SCREEN_MSG_TEXT, 0, NULL, msg, true);
+}
 
-    screen *const deliver_scr = (i_scr != -1 ? s_scrslots[i_scr] : &s_scr_home);
-    screenlog_push_copy(&deliver_scr->scrlog, msg);
-    
-    if (deliver_scr != s_scr_active) deliver_scr->unread = true;
+void scrmgr_deliver_local_copy(const_str deliver_to_name, const_str msg) {
+    internal__deliver(deliver_to_name, SCREEN_MSG_TEXT, 0, NULL, msg, false);
+}
+
+void scrmgr_deliver_msg(const_str deliver_to_name, screen_msg_kind kind,
+        int64_t ts, const_str from, const_str text)
+{
+    internal__deliver(deliver_to_name, kind, ts, from, text, true);
+}
+
+void scrmgr_set_timestamp_format(timestamp_format format) {
+    scrrec_set_timestamp_format(format);
+
+    // Every decorated line's width may have changed, so its row count too.
+    for (int i = 0; i < N_SCRSLOTS; i++) {
+        if (s_scrslots[i] == NULL) continue;
+        rowindex *const rows = &s_scrslots[i]->scrlog.rows;
+        for (size_t slot = rows->first; slot < rows->end; slot++) {
+            const screenlog_node *const node =
+                (const screenlog_node *) rows->items[slot];
+            rows->vislen[slot] = scrrec_width(&node->rec);
+        }
+        rowidx_refresh(rows);
+
+        // The widths are kept encoded, so their size may change too.
+        coldstore *const cold = &s_scrslots[i]->scrlog.cold;
+        int64_t cold_before = cold->bytes;
+        cold_refresh_widths(cold);
+        s_scrlog_total_bytes += cold->bytes - cold_before;
+    }
+    framesched_mark(FRAME_DIRTY_LOG);
 }
 
 screen_ui_state *const scrmgr_get_active_ui_state(void) {
@@ -368,6 +829,109 @@ const_str scrmgr_get_active_name(void) {
     return s_scr_active->name;
 }
 
+void scrmgr_scroll_to_row(int64_t row) {
+    screen_ui_state *const st = &s_scr_active->ui_state;
+    screenlog_list *const scrlog = &s_scr_active->scrlog;
+
+    // Rows are counted from the oldest line in memory, cold ones included.
+    // Without a width there's nothing drawn to count cold rows against yet.
+    int64_t total_rows = scrlog->rows.total_rows;
+    if (scrlog->rows.cols > 0)
+        total_rows += cold_total_rows(&scrlog->cold, scrlog->rows.cols);
+
+    // screen_fmt_to_buf() clamps this to the valid range on the next frame.
+    int64_t scroll = total_rows - row - st->rows_visible;
+    if (scroll < 0) scroll = 0;
+    st->scroll = scroll > INT_MAX ? INT_MAX : (int) scroll;
+    framesched_mark(FRAME_DIRTY_LOG);
+}
+
+size_t scrmgr_search(const_str query, screen_search_hit *const hits,
+        size_t max_hits)
+{
+    assert(query != NULL);
+    assert(hits != NULL);
+
+    static uint32_t s_seqs[SCREEN_SEARCH_MAX_HITS];
+    if (max_hits > SCREEN_SEARCH_MAX_HITS) max_hits = SCREEN_SEARCH_MAX_HITS;
+
+    screenlog_list *const scrlog = &s_scr_active->scrlog;
+    size_t n_hits = srchidx_query(&scrlog->search, query, s_seqs, max_hits);
+    for (size_t i = 0; i < n_hits; i++) {
+        hits[i].seq = s_seqs[i];
+        hits[i].available = screenlog_get_seq_text(scrlog, s_seqs[i],
+                hits[i].preview, sizeof(hits[i].preview));
+        if (!hits[i].available) hits[i].preview[0] = '\0';
+    }
+    return n_hits;
+}
+
+bool scrmgr_scroll_to_seq(uint32_t seq) {
+    screenlog_list *const scrlog = &s_scr_active->scrlog;
+    screen_ui_state *const st = &s_scr_active->ui_state;
+    if (seq >= scrlog->next_seq) return false;
+
+    if (seq >= scrlog->hot_seq) {
+        int64_t row = rowidx_rows_before(&scrlog->rows, seq - scrlog->hot_seq);
+        if (scrlog->rows.cols > 0)
+            row += cold_total_rows(&scrlog->cold, scrlog->rows.cols);
+        scrmgr_scroll_to_row(row);
+        return true;
+    }
+
+    // In cold or spilled history: every node plus the older rows from this
+    // line on are below the top of the view.
+    int cols = scrlog->rows.cols;
+    if (cols <= 0) return false;
+    if (seq >= scrlog->head_seq) {
+        int64_t cold_rows = cold_rows_from(&scrlog->cold, cols, seq);
+        if (cold_rows == 0) return false;
+
+        int64_t scroll = scrlog->rows.total_rows + cold_rows - st->rows_visible;
+        if (scroll < 0) scroll = 0;
+        st->scroll = scroll > INT_MAX ? INT_MAX : (int) scroll;
+        framesched_mark(FRAME_DIRTY_LOG);
+        return true;
+    }
+    if (!scrlog->spill_base_set) return false;
+    int64_t rec = scrlog->spill_base + seq;
+    if (rec < 0 || rec >= spill_count(&scrlog->spill)) return false;
+
+    spill_begin_read(&scrlog->spill);
+    int64_t spill_rows = spill_rows_from(&scrlog->spill, cols, rec);
+    if (spill_rows == 0) return false;
+
+    int64_t scroll = scrlog->rows.total_rows +
+        cold_total_rows(&scrlog->cold, cols) + spill_rows - st->rows_visible;
+    if (scroll < 0) scroll = 0;
+    st->scroll = scroll > INT_MAX ? INT_MAX : (int) scroll;
+    framesched_mark(FRAME_DIRTY_LOG);
+    return true;
+}
+
+void scrmgr_scroll_pages(int n_pages) {
+    screen_ui_state *const st = &s_scr_active->ui_state;
+
+    // Keep one row of overlap so the reader doesn't lose their place.
+    int page = st->rows_visible > 1 ? st->rows_visible - 1 : 1;
+    int64_t scroll = (int64_t) st->scroll + (int64_t) page * n_pages;
+    if (scroll < 0) scroll = 0;
+    st->scroll = scroll > INT_MAX ? INT_MAX : (int) scroll;
+    framesched_mark(FRAME_DIRTY_LOG);
+}
+
+void scrmgr_scroll_home(void) {
+    // screen_fmt_to_buf() pins this to the oldest row, spilled history
+    // included.
+    s_scr_active->ui_state.scroll = INT_MAX;
+    framesched_mark(FRAME_DIRTY_LOG);
+}
+
+void scrmgr_scroll_end(void) {
+    s_scr_active->ui_state.scroll = 0;
+    framesched_mark(FRAME_DIRTY_LOG);
+}
+
 bool scrmgr_show_index(int i_scr) {
     if (i_scr < 0 || i_scr >= N_SCRSLOTS) {
         log_fmt(LOGLEVEL_ERROR, "[scrmgr_show_index] Invalid index: %d", i_scr);
@@ -421,15 +985,140 @@ bool scrmgr_set_topic(const_str scr_name, const_str topic) {
     assert(i_scr < N_SCRSLOTS);
 
     screen *scr = s_scrslots[i_scr];
+    free(scr->topic_line);
+    scr->topic_line = NULL;
+    if (scr == s_scr_active) internal__header_changed();
     return strcpy_s(scr->topic, sizeof(scr->topic), topic) == 0;
 }
 
+bool scrmgr_get_mem_usage(int i_scr, screen_mem_usage *const usage) {
+    assert(usage != NULL);
+    if (i_scr < 0 || i_scr >= N_SCRSLOTS || s_scrslots[i_scr] == NULL)
+        return false;
+
+    const screen *const scr = s_scrslots[i_scr];
+    usage->name = scr->name;
+    usage->bytes = screenlog_bytes(&scr->scrlog);
+    usage->max_bytes = scr->scrlog.max_size_bytes;
+    usage->hot_max_bytes = scr->scrlog.hot_max_bytes;
+    usage->n_msgs = scr->scrlog.n_msgs + (int) scr->scrlog.cold.n_lines;
+    usage->n_cold_msgs = (int) scr->scrlog.cold.n_lines;
+    usage->cold_bytes = scr->scrlog.cold.bytes;
+    usage->cold_raw_bytes = scr->scrlog.cold.raw_bytes;
+    usage->index_bytes = scr->scrlog.search.bytes;
+    usage->active = scr == s_scr_active;
+    return true;
+}
+
+int64_t scrmgr_get_total_mem_bytes(void) {
+    return s_scrlog_total_bytes;
+}
+
+int64_t scrmgr_get_global_max_bytes(void) {
+    return s_scrlog_global_max_bytes;
+}
+
+void scrmgr_set_global_max_bytes(int64_t max_bytes) {
+    assert(max_bytes > 0);
+    s_scrlog_global_max_bytes = max_bytes;
+    screenlog_enforce_global_max();
+}
+
+bool scrmgr_set_screen_limits(const_str scr_name, int64_t max_bytes,
+        int64_t hot_max_bytes)
+{
+    assert(max_bytes > 0);
+    assert(hot_max_bytes >= 0 || hot_max_bytes == SCREENLOG_HOT_UNLIMITED);
+
+    int i_scr = internal__find_screen(scr_name);
+    if (i_scr < 0) {
+        log_fmt(LOGLEVEL_WARNING,
+                "[scrmgr_set_screen_limits] No screen with name '%s'",
+                scr_name);
+        return false;
+    }
+    assert(i_scr < N_SCRSLOTS);
+
+    screenlog_list *const scrlog = &s_scrslots[i_scr]->scrlog;
+    scrlog->max_size_bytes = max_bytes;
+    scrlog->hot_max_bytes = hot_max_bytes;
+    screenlog_seal_cold(scrlog);
+    if (scrlog->search.bytes > max_bytes)
+        screenlog_index_trim(scrlog, max_bytes / 2);
+
+    // Keep at least the newest line, like a push would.
+    int64_t over = screenlog_bytes(scrlog) - max_bytes;
+    if (over > 0 && scrlog->tail != NULL) {
+        int64_t newest = (int64_t) fmtline_size(scrlog->tail->rec.body);
+        int64_t evictable = screenlog_bytes(scrlog) - newest;
+        if (over > evictable) over = evictable;
+        if (over > 0) screenlog_evict_min_to_free(scrlog, over);
+    }
+#ifdef SCREENLOG_DEBUG_VALIDATE
+    DEBUG_validate_screenlog_list(scrlog);
+#endif
+    if (s_scrslots[i_scr] == s_scr_active) framesched_mark(FRAME_DIRTY_LOG);
+    return true;
+}
+
 /*****************************************************************************/
 /*********************** INTERNAL SCR MGMT IMPLs *****************************/
 
+static void internal__deliver(const_str deliver_to_name,
+        screen_msg_kind kind, int64_t ts, const_str from, const_str text,
+        bool searchable)
+{
+    int i_scr = internal__find_screen(deliver_to_name);
+    assert(i_scr >= -1);
+    assert(i_scr < N_SCRSLOTS);
+
+    screen *const deliver_scr = (i_scr != -1 ? s_scrslots[i_scr] : &s_scr_home);
+    screenlog_list *const scrlog = &deliver_scr->scrlog;
+    deliver_scr->last_activity = ++s_scrlog_clock;
+
+    // Index before pushing, since the push may evict and spill this very line
+    // if it's bigger than the screen's cap.
+    scrrec rec = { 0 };
+    rec.ts = ts;
+    rec.body = fmtline_compile(text);
+    rec.nick = nicktab_intern_source(from);
+    rec.kind = (uint8_t) kind;
+    if (searchable) {
+        int64_t index_before = scrlog->search.bytes;
+        if (rec.nick != NICKTAB_NONE)
+            srchidx_add(&scrlog->search, scrlog->next_seq,
+                    nicktab_name(rec.nick));
+        srchidx_add(&scrlog->search, scrlog->next_seq, fmtline_text(rec.body));
+        s_scrlog_total_bytes += scrlog->search.bytes - index_before;
+        // Past the screen's cap, go down to half of it so the rebuild isn't
+        // paid again a few lines later.
+        if (scrlog->search.bytes > scrlog->max_size_bytes)
+            screenlog_index_trim(scrlog, scrlog->max_size_bytes / 2);
+    }
+    screenlog_push_take(scrlog, &rec);
+    screenlog_enforce_global_max();
+    latency_msg_inserted(deliver_scr == s_scr_active);
+    
+    // Only the tab shows anything of a screen that isn't active, and only
+    // whether it has unread lines.
+    if (deliver_scr == s_scr_active) {
+        framesched_mark(FRAME_DIRTY_LOG);
+    }
+    else if (!deliver_scr->unread) {
+        deliver_scr->unread = true;
+        internal__tabs_changed();
+    }
+}
+
 static void internal__set_active(size_t i_scr) {
+    // The screen being left was just looked at, too.
+    s_scr_active->last_viewed = ++s_scrlog_clock;
     s_scr_active = s_scrslots[i_scr];
     s_scr_active->unread = false;
+    s_scr_active->last_viewed = ++s_scrlog_clock;
+    s_tabs_version++;
+    s_header_version++;
+    framesched_mark(FRAME_DIRTY_ALL);
 }
 
 static void internal__create_screen_at(size_t i_scr, const_str name) {
@@ -440,10 +1129,14 @@ static void internal__create_screen_at(size_t i_scr, const_str name) {
     screen *new_screen = (screen *) calloc(1, sizeof(screen));
     strcpy_s(new_screen->name, sizeof(new_screen->name), name);
     new_screen->scrlog.max_size_bytes = SCREENLOG_DEFAULT_MAX_BYTES;
+    new_screen->scrlog.hot_max_bytes = SCREENLOG_DEFAULT_HOT_BYTES;
+    spill_init(&new_screen->scrlog.spill, name);
     new_screen->ui_state.prompt = DEFAULT_PROMPT;
     new_screen->unread = false;
+    new_screen->last_viewed = new_screen->last_activity = ++s_scrlog_clock;
 
     s_scrslots[i_scr] = new_screen;
+    internal__tabs_changed();
 }
 
 static int internal__find_open_slot(void) {
@@ -484,73 +1177,102 @@ static int internal__find_screen_startswith(const_str prefix) {
     return i_found;
 }
 
+static void internal__tabs_changed(void) {
+    s_tabs_version++;
+    framesched_mark(FRAME_DIRTY_TABS);
+}
+
+static void internal__header_changed(void) {
+    s_header_version++;
+    framesched_mark(FRAME_DIRTY_HEADER);
+}
+
 /*****************************************************************************/
 /***************************** PUB FMT API ***********************************/
 
+uint32_t screen_tabs_version(void) {
+    return s_tabs_version;
+}
+
+uint32_t screen_header_version(void) {
+    return s_header_version;
+}
+
 int screen_fmt_header(char *buf, size_t bufsize, int term_cols) {
     UNREFERENCED_PARAMETER(term_cols);
 
-    const_str topic = s_scr_active->topic;
-    size_t n_vis_chars = strlen_on_screen(topic);
-    // TODO: instead, take offset_end return and only draw to there
-//     calc_screen_offset(topic, 1, term_cols, &n_vis_chars, NULL, 0);
-
+    // Compiled the first time it's drawn after being set.
+    if (s_scr_active->topic_line == NULL)
+        s_scr_active->topic_line = fmtline_compile(s_scr_active->topic);
+    const fmtline *const topic = s_scr_active->topic_line;
+    // TODO: instead, only draw up to term_cols
 
-    format_toggles toggles = { 0 };
-    size_t topic_len = strlen(topic);
-    size_t i_topic = 0, i_buf = 0;
-    while (topic[i_topic] != '\0')
-        translate_src_char_to_buf(
-              buf, &i_buf, bufsize, topic, &i_topic, topic_len, &toggles);
+    size_t i_buf = fmtline_render(topic, 0, topic->text_len, buf, bufsize - 1);
     buf[i_buf] = '\0';
 
-    return n_vis_chars;
+    return (int) topic->text_len;
 }
 
 int screen_fmt_tabs(char *buf, size_t bufsize, int term_cols) {
-    UNREFERENCED_PARAMETER(term_cols);
+    assert(buf != NULL);
+    assert(bufsize > 0);
+    assert(term_cols > 0);
     // TODO: change formatting type for very small values of term_cols, down to
     // just returning an empty string.
-    
-    // TODO: Calculate this based on term_cols. Can be step-function
-    size_t abbrev_over = 10;
-    size_t i_cutoff = abbrev_over - 3; // -1 to index, -2 for periods..
-    
-    size_t i_scr = 0, i_buf = 0;
-    while (s_scrslots[i_scr] != NULL) {
-        screen *const scr = s_scrslots[i_scr];
-        if (strlen(scr->name) <= abbrev_over) {
-            if (scr->unread)
-                i_buf += sprintf_s(buf + i_buf, bufsize - i_buf,
-                      "\033[1m %zu %s \033[22m|", i_scr, scr->name);
-            else if (scr == s_scr_active)
-                // TODO: parameterize statline bg color...
-                i_buf += sprintf_s(buf + i_buf, bufsize - i_buf,
-                      "\033[42m %zu %s \033[48;5;252m|", i_scr, scr->name);
-            else
-                i_buf += sprintf_s(buf + i_buf, bufsize - i_buf,
-                      " %zu %s |", i_scr, scr->name);
-        }
-        else {
-            char tmp = scr->name[i_cutoff];
-            scr->name[i_cutoff] = '\0';
-            if (scr->unread)
-                i_buf += sprintf_s(buf + i_buf, bufsize - i_buf,
-                      "\033[1m %zu %s..\033[22m |", i_scr, scr->name);
-            else if (scr == s_scr_active)
-                // TODO: parameterize statline bg color...
-                i_buf += sprintf_s(buf + i_buf, bufsize - i_buf,
-                      "\033[42m %zu %s.. \033[48;5;252m|", i_scr, scr->name);
-            else
-                i_buf += sprintf_s(buf + i_buf, bufsize - i_buf,
-                      " %zu %s.. |", i_scr, scr->name);
-            scr->name[i_cutoff] = tmp;
+
+    // Tabs are laid out only as far as they fit on one row, short of the last
+    // column, which would wrap.
+    int widths[N_SCRSLOTS];
+    size_t n_tabs = 0, i_active = 0;
+    int total_width = 0;
+    while (n_tabs < N_SCRSLOTS && s_scrslots[n_tabs] != NULL) {
+        if (s_scrslots[n_tabs] == s_scr_active) i_active = n_tabs;
+        widths[n_tabs] = tab_width(n_tabs);
+        total_width += widths[n_tabs];
+        n_tabs++;
+    }
+
+    // If they don't all fit, show the slice around the active tab that does,
+    // with a '<' or '>' where more tabs are cut off.
+    size_t first = 0, last = n_tabs;
+    int max_width = term_cols - 1;
+    if (total_width > max_width) {
+        first = i_active;
+        last = i_active + 1;
+        int width = widths[i_active];
+        // Room for both markers, in case both are needed.
+        int room = max_width - 2;
+        bool grew = true;
+        while (grew) {
+            grew = false;
+            if (last < n_tabs && width + widths[last] <= room) {
+                width += widths[last++];
+                grew = true;
+            }
+            if (first > 0 && width + widths[first - 1] <= room) {
+                width += widths[--first];
+                grew = true;
+            }
         }
+    }
 
-        i_scr++;
+    size_t i_buf = 0;
+    int width = 0;
+    if (first > 0 && i_buf + 1 < bufsize) {
+        buf[i_buf++] = '<';
+        width++;
+    }
+    for (size_t i_scr = first; i_scr < last; i_scr++) {
+        i_buf += fmt_tab(buf + i_buf, bufsize - i_buf, i_scr);
+        width += widths[i_scr];
+    }
+    if (last < n_tabs && i_buf + 1 < bufsize) {
+        buf[i_buf++] = '>';
+        width++;
     }
+    buf[i_buf] = '\0';
 
-    return i_buf;
+    return width;
 }
 
 int screen_fmt_to_buf(char *buf, size_t bufsize, int buf_rows, int term_cols) {
@@ -559,6 +1281,10 @@ int screen_fmt_to_buf(char *buf, size_t bufsize, int buf_rows, int term_cols) {
     assert(buf_rows > 0);
     assert(term_cols > 0);
 
+    screen_ui_state *const st = &s_scr_active->ui_state;
+    assert(st != NULL);
+    st->rows_visible = buf_rows;
+
     screenlog_list list = s_scr_active->scrlog;
     if (list.head == NULL) {
         assert(list.tail == NULL);
@@ -566,74 +1292,70 @@ int screen_fmt_to_buf(char *buf, size_t bufsize, int buf_rows, int term_cols) {
         return 0;
     }
 
-    screen_ui_state *const st = &s_scr_active->ui_state;
-    assert(st != NULL);
-
-    int rows_skipped = 0;
-    size_t msg_offset_start = 0;
-    screenlog_node *curr_node = list.tail;
-    while (rows_skipped < st->scroll && curr_node != NULL) {
-        rows_skipped += num_lines(curr_node->msg, term_cols);
-        curr_node = curr_node->prev;
-    }
-    // Account for the partial message we'll write at the end, if one fits.
-    int rows_used = rows_skipped - st->scroll;
-    while (curr_node != NULL && rows_used < buf_rows) {
-        assert(curr_node != NULL);
-        assert(curr_node->msg != NULL);
-        int msg_rows = num_lines(curr_node->msg, term_cols);
-
-        if (rows_used + msg_rows <= buf_rows) {
-            rows_used += msg_rows;
-            // ONLY go to the previous message if there are rows left
-            if (rows_used < buf_rows) curr_node = curr_node->prev;
-            continue;
+    // Find the first visible row by counting down from the newest one. The row
+    // index makes this O(log n) no matter how far back we're scrolled.
+    rowindex *const rows = &s_scr_active->scrlog.rows;
+    rowidx_set_cols(rows, term_cols);
+    if (st->scroll < 0) st->scroll = 0;
+
+    int64_t rows_into_msg = 0;
+    screenlog_node *curr_node = NULL;
+
+    // Rows from the bottom of the log up to the top of the message area. If
+    // that reaches past the nodes, the view starts in cold or spilled history.
+    int64_t rows_above = (int64_t) st->scroll + buf_rows;
+    int64_t history_rows = 0;
+    if (rows_above > rows->total_rows) {
+        curr_node = screenlog_history_window(&s_scr_active->scrlog,
+                rows_above - rows->total_rows, buf_rows, term_cols,
+                &rows_into_msg, &history_rows);
+        if (curr_node == NULL && history_rows > 0) {
+            // Scrolled past the oldest row there is; pin to the very top.
+            curr_node = screenlog_history_window(&s_scr_active->scrlog,
+                    history_rows, buf_rows, term_cols, &rows_into_msg, NULL);
+            assert(curr_node != NULL);
+            st->scroll = (int) (history_rows + rows->total_rows - buf_rows);
+            st->scroll_at_top = true;
         }
-
-        int rows_left = buf_rows - rows_used;
-        msg_offset_start = calc_screen_offset(
-                    curr_node->msg, msg_rows - rows_left, term_cols,
-                    NULL,
-                    s_replaybuf, sizeof(s_replaybuf));
-        rows_used += rows_left;
-        assert(rows_used == buf_rows);
-        // Keep curr_node in place because we start from there
+        else st->scroll_at_top = false;
     }
 
     if (curr_node == NULL) {
-        curr_node = list.head;
-        st->scroll_at_top = true;
+        int64_t max_scroll = rows->total_rows - buf_rows;
+        if (max_scroll < 0) max_scroll = 0;
         // If the window is widened, this brings down scroll accordingly
-        st->scroll =
-            rows_used + rows_skipped - (rows_skipped - st->scroll) - buf_rows;
+        if (st->scroll > max_scroll) st->scroll = (int) max_scroll;
+        st->scroll_at_top = st->scroll == max_scroll;
+
+        int64_t first_row = rows->total_rows - st->scroll - buf_rows;
+        if (first_row < 0) first_row = 0;
+
+        curr_node = (screenlog_node *) rowidx_find_row(
+                rows, first_row, &rows_into_msg);
+        if (curr_node == NULL) {
+            // Only empty messages; nothing takes up a row.
+            buf[0] = '\0';
+            return 0;
+        }
     }
-    else st->scroll_at_top = false;
-
-
-    // First, write any ANSI or IRC format sequences we skipped.
-    format_toggles toggles = { 0 };
-    size_t i_buf = 0, i_rebuf = 0;
-    size_t rebuf_len = strlen(s_replaybuf);
-    assert(rebuf_len == 0 || rebuf_len < msg_offset_start);
-    while (s_replaybuf[i_rebuf] != '\0')
-        translate_src_char_to_buf(
-              buf, &i_buf, bufsize, s_replaybuf, &i_rebuf, rebuf_len, &toggles);
-    s_replaybuf[0] = '\0';
-
-
-    // Then write the first msg from the offset.
-    // We're going to replace newlines in msgs for now (so we can see if the
-    // server sends many and if we need to keep them. Probably should.)
-    // We also write newlines instead of null terms (except the final one) since
-    // the buffer will be printed as one string.
-    char *msg = curr_node->msg;
-    size_t i_msg = msg_offset_start;
-    size_t msglen = strlen(msg);
-    assert(i_msg < msglen);
-    int rows_filled_in_buf = num_lines(&msg[i_msg], term_cols);
-    while (msg[i_msg] != '\0')
-        translate_src_char_to_buf(
-                buf, &i_buf, bufsize, msg, &i_msg, msglen, &toggles);
+
+    // The first visible message may be partially scrolled off the top, and if
+    // it's taller than the whole area, off the bottom too. scrrec_render()
+    // replays the formatting of the part that's scrolled off.
+    const scrrec *rec = &curr_node->rec;
+    size_t start = (size_t) rows_into_msg * term_cols;
+    size_t end = scrrec_width(rec);
+    int rows_filled_in_buf = num_lines(end, term_cols) - (int) rows_into_msg;
+    if (rows_filled_in_buf > buf_rows) {
+        end = start + (size_t) buf_rows * term_cols;
+        rows_filled_in_buf = buf_rows;
+    }
+    assert(start < end);
+
+    // Each message is its decoration followed by a straight copy of its
+    // compiled text runs and escapes. We write newlines instead of null terms
+    // (except the final one) since the buffer will be printed as one string.
+    size_t i_buf = scrrec_render(rec, start, end, buf, bufsize);
     i_buf += termutils_reset_all_buf(buf + i_buf, bufsize - (i_buf + 1));
     buf[i_buf++] = '\n';
 
@@ -641,33 +1363,19 @@ int screen_fmt_to_buf(char *buf, size_t bufsize, int buf_rows, int term_cols) {
     while (curr_node != NULL && rows_filled_in_buf < buf_rows) {
         // We should never have a display buffer too small to hold the highest
         // possible number of characters that could appear on the screen.
-        msg = curr_node->msg;
-        msglen = strlen(msg);
-        assert(i_buf + msglen < bufsize);
-        int msg_rows = num_lines(msg, term_cols);
-        i_msg = 0;
-        format_toggles_clear(&toggles);
+        rec = &curr_node->rec;
+        assert(i_buf + scrrec_ansi_len(rec) < bufsize);
+        size_t width = scrrec_width(rec);
+        int msg_rows = num_lines(width, term_cols);
         if (rows_filled_in_buf + msg_rows > buf_rows) {
-            size_t n_visible_chars = 0;
-            size_t msg_offset_end = calc_screen_offset(
-                  msg, buf_rows - rows_filled_in_buf, term_cols,
-                  &n_visible_chars, NULL, 0);
-
-            while (i_msg < msg_offset_end && msg[i_msg] != '\0') 
-                translate_src_char_to_buf(
-                        buf, &i_buf, bufsize, msg, &i_msg, msglen, &toggles);
+            end = (size_t) (buf_rows - rows_filled_in_buf) * term_cols;
+            i_buf += scrrec_render(rec, 0, end, buf + i_buf, bufsize - i_buf);
 
             buf[i_buf++] = '\0'; // This is the last message
-
-            rows_filled_in_buf += 
-                n_visible_chars / term_cols
-                + (n_visible_chars % term_cols == 0 ? 0 : 1);
-            assert(rows_filled_in_buf == buf_rows);
-            continue;
+            rows_filled_in_buf = buf_rows;
+            break;
         }
-        while (msg[i_msg] != '\0')
-            translate_src_char_to_buf(
-                    buf, &i_buf, bufsize, msg, &i_msg, msglen, &toggles);
+        i_buf += scrrec_render(rec, 0, width, buf + i_buf, bufsize - i_buf);
 
         i_buf += termutils_reset_all_buf(buf + i_buf, bufsize - (i_buf + 1));
         buf[i_buf++] = '\n';
@@ -678,9 +1386,6 @@ int screen_fmt_to_buf(char *buf, size_t bufsize, int buf_rows, int term_cols) {
     // take up a line in the screen buffer
     buf[i_buf - 1] = '\0';
 
-    // Don't accrue scroll when it's not doing anything.
-    if (rows_filled_in_buf < buf_rows) st->scroll = 0;
-
     return rows_filled_in_buf;
 }
 
@@ -741,206 +1446,71 @@ size_t screen_DEBUG_char_details_buf(
 /*****************************************************************************/
 /*************************** INTERNAL FMT UTIL *******************************/
 
-#define IRC_FMT_BOLD 0x02
-#define IRC_FMT_ITALIC 0x1D
-#define IRC_FMT_UNDERLINE 0x1F
-#define IRC_FMT_STRIKETH 0x1E
-#define IRC_FMT_RESET 0x0F
-#define IRC_FMT_COLOR 0x03
-#define IRC_FMT_COLOR_HEX 0x04
-#define IRC_FMT_COLOR_REV 0x16
-
-const unsigned int irc_to_ansi256_color[] = {
-    [0] =  7, [1] =232, [2] =  4, [3] =  2, [4] =  1, [5] = 94, [6] = 93,
-    [7] =214, [8] =  3, [9] = 82, [10]=  6, [11]= 51, [12]= 33, [13]=201, 
-    [14]=243, [15]=253
-};
-
 const char irc_ctrl_chars[] = {
     IRC_FMT_BOLD, IRC_FMT_ITALIC, IRC_FMT_UNDERLINE, IRC_FMT_STRIKETH,
     IRC_FMT_RESET, IRC_FMT_COLOR, IRC_FMT_COLOR_HEX, IRC_FMT_COLOR_REV
 };
 
-static void format_toggles_clear(format_toggles *const toggles) {
-    toggles->bold = false;
-    toggles->italic = false;
-    toggles->underline = false;
-    toggles->striketh = false;
-}
-
 static bool is_digit(char c) {
     return c >= '0' && c <= '9';
 }
 
-static size_t translate_src_char_to_buf(
-        char *const buf, size_t *const i_buf, size_t bufsize,
-        const char *const src, size_t *const i_src, size_t srclen,
-        format_toggles *const togs)
-{
-    assert(i_buf != NULL);
-    assert(buf != NULL);
-    assert(i_src != NULL);
-    assert(src != NULL);
-    assert(togs != NULL);
-    assert(bufsize > *i_buf + 1);
-    assert(srclen > *i_src);
-
-    size_t n_written = 0;
-    size_t n_read = 1;
-    size_t maxlen = bufsize - (*i_buf + 1);
-    char *wbuf = buf + *i_buf;
-    switch(src[*i_src]) {
-    case IRC_FMT_COLOR:
-        size_t max_inc = srclen - (*i_src + 1), curr_inc = 1;
-        int color1 = -1, color2 = -1;
-        do {
-            char c = src[*i_src + curr_inc];
-            if (is_digit(c)) {
-                color1 = (int)c - (int)'0';
-                n_read++;
-            }
-            else break;
-
-            if (++curr_inc > max_inc) break;
-
-            c = src[*i_src + curr_inc];
-            if (is_digit(c)) {
-                color1 *= 10;
-                color1 += (int)c - (int)'0';
-                n_read++;
-                c = src[*i_src + ++curr_inc];
-            }
-            if (c != ',' || ++curr_inc > max_inc) break;
-
-            c = src[*i_src + curr_inc];
-            if (is_digit(c)) {
-                color2 = (int)c - (int)'0';
-                n_read += 2; // Include the comma if it was a delimiter
-            }
-            else break;
-
-            if (++curr_inc > max_inc) break;
+static int num_lines(size_t width, int cols) {
+    return width / cols + (width % cols == 0 ? 0 : 1);
+}
 
-            c = src[*i_src + curr_inc];
-            if (is_digit(c)) {
-                color2 *= 10;
-                color2 += (int)c - (int)'0';
-                n_read++;
-            }
-        } while (0);
-        assert(color1 < 100);
-        assert(color2 < 100);
-
-        // TODO: fix this when the full ANSI color map array is filled out
-        if (color1 < 0) {
-            n_written = termutils_reset_text_color_buf(wbuf, maxlen);
-            n_written += termutils_reset_bg_color_buf(
-                    wbuf + n_written, maxlen - n_written);
-        }
-        else {
-            int ansi256 = color1 > 15 ? 141 : irc_to_ansi256_color[color1];
-            assert(ansi256 < 256);
-            n_written = termutils_set_text_color_256_buf(wbuf, maxlen, ansi256);
-            if (color2 >= 0) {
-                ansi256 = color2 > 15 ? 82 : irc_to_ansi256_color[color2];
-                assert(ansi256 < 256);
-                n_written += termutils_set_bg_color_256_buf(
-                        wbuf + n_written, maxlen - n_written, ansi256);
-            }
-        }
-        break;
-    case IRC_FMT_BOLD:
-        togs->bold = !togs->bold;
-        n_written = termutils_set_bold_buf(wbuf, maxlen, togs->bold);
-        break;
-    case IRC_FMT_ITALIC:
-        togs->italic = !togs->italic;
-        n_written = termutils_set_italic_buf(wbuf, maxlen, togs->italic);
-        break;
-    case IRC_FMT_UNDERLINE:
-        togs->underline = !togs->underline;
-        n_written = termutils_set_underline_buf(wbuf, maxlen, togs->underline);
-        break;
-    case IRC_FMT_STRIKETH:
-        togs->striketh = !togs->striketh;
-        n_written = termutils_set_striketh_buf(wbuf, maxlen, togs->striketh);
-        break;
-    case IRC_FMT_RESET:
-        togs->bold = togs->italic = togs->underline = togs->striketh = false;
-        n_written = termutils_reset_all_buf(wbuf, maxlen);
-        break;
-    default:
-        buf[*i_buf] = src[*i_src];
-        if (buf[*i_buf] == '\n') buf[*i_buf] = '_';
-        n_written = 1;
-    }
-    assert(n_written > 0);
-    *i_buf += n_written;
-    *i_src += n_read;
-    assert(n_written < maxlen);
-    assert(*i_src <= srclen);
+static int tab_width(size_t i_scr) {
+    const screen *const scr = s_scrslots[i_scr];
+    size_t name_len = strlen(scr->name);
+    if (name_len > TAB_NAME_ABBREV_OVER) name_len = TAB_NAME_ABBREV_LEN + 2;
 
-    return n_written;
+    int digits = 1;
+    for (size_t n = i_scr; n >= 10; n /= 10) digits++;
+    // " N name |"
+    return digits + (int) name_len + 4;
 }
 
-static int num_lines(char *msg, int cols) {
-    size_t len = strlen_on_screen(msg);
-    return len / cols + (len % cols == 0 ? 0 : 1);
+static size_t fmt_tab(char *buf, size_t bufsize, size_t i_scr) {
+    const screen *const scr = s_scrslots[i_scr];
+    // Long names are cut short without touching the name itself.
+    bool abbrev = strlen(scr->name) > TAB_NAME_ABBREV_OVER;
+    int name_len = abbrev ? TAB_NAME_ABBREV_LEN : (int) strlen(scr->name);
+    const char *const dots = abbrev ? ".." : "";
+
+    int n = 0;
+    if (scr->unread)
+        n = sprintf_s(buf, bufsize, "\033[1m %zu %.*s%s%s\033[22m%s|",
+                i_scr, name_len, scr->name, dots, abbrev ? "" : " ",
+                abbrev ? " " : "");
+    else if (scr == s_scr_active)
+        // TODO: parameterize statline bg color...
+        n = sprintf_s(buf, bufsize, "\033[42m %zu %.*s%s \033[48;5;252m|",
+                i_scr, name_len, scr->name, dots);
+    else
+        n = sprintf_s(buf, bufsize, " %zu %.*s%s |",
+                i_scr, name_len, scr->name, dots);
+    return n > 0 ? (size_t) n : 0;
 }
 
-// The asserts are aggressive here to catch any unterminated ANSI esc sequences.
-static size_t strlen_on_screen(const char *msg) {
-    const_str logpfx = "strlen_on_screen()";
-    size_t msglen = strlen(msg);
-    size_t on_screen_len = 0;
-    for (size_t i = 0; i < msglen; i++) {
-        // Shouldn't see \r\n here. If it's a delimiter, the parser should have
-        // excluded it; if it's in the middle of the message, it should have
-        // repalced it in-line.
-        assert(msg[i] != '\r');
-        assert(msg[i] != '\n');
-        assert(msg[i] != '\0');
-
-        // We expect control characters (other than NUL, CR, LF) because they're
-        // used for message formatting within IRC messages.
-        if (msg[i] < ' ' && msg[i] != ESC[0] && msg[i] != IRC_FMT_COLOR)
-            continue;
-
-        // Fast-forward through ANSI escapes
-        while (msg[i] == ESC[0]) {
-            while (msg[i++] != 'm' && i < msglen) {
-                if (msg[i] < ' ') 
-                    log_fmt(LOGLEVEL_ERROR,
-                            "[%s] Ctrl char in ASCII seq at index %zu: (%d)\n"
-                            "Msg: '%s'",
-                            logpfx, i, (int)msg[i], msg);
-
-                // Within an ANSI escape, we do not expect control characters.
-                assert(msg[i] >= ' ');
-            }
-        }
-        // Fast-forward through IRC color formatting
-        while (msg[i] == IRC_FMT_COLOR && msg[++i] != '\0') {
-            if (is_digit(msg[i])) i++;
-            else continue;
-            if (is_digit(msg[i])) i++;
-
-            if (msg[i] == ',') i++;
-            else continue;
-
-            if (is_digit(msg[i])) i++;
-            else {
-                i--; // Un-count the comma if it wasn't a delim
-                continue;
-            }
-            if (is_digit(msg[i])) i++;
+static void spill_append_line(
+        spillstore *const spill, const scrrec *const rec)
+{
+    size_t size = scrrec_ansi_len(rec) + 1;
+    if (size > s_spillbuf_size) {
+        char *new_buf = (char *) realloc(s_spillbuf, size);
+        if (new_buf == NULL) {
+            // TODO: communicate fatal error
+            log(LOGLEVEL_ERROR, "[spill_append_line()] FATAL: out of memory.");
+            exit(23);
         }
-        assert(msg[i] != '\r');
-        assert(msg[i] != '\n');
-        if (msg[i] >= ' ') on_screen_len++;
+        s_spillbuf = new_buf;
+        s_spillbuf_size = size;
     }
 
-    return on_screen_len;
+    size_t width = scrrec_width(rec);
+    size_t len = scrrec_render(rec, 0, width, s_spillbuf, s_spillbuf_size);
+    s_spillbuf[len] = '\0';
+    spill_append(spill, s_spillbuf, width);
 }
 
 static size_t calc_screen_offset(
@@ -0,0 +1,342 @@
+#include "scrrecord.h"
+
+#include "nicktab.h"
+#include "terminalutils.h"
+#include "vtstyle.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Most pieces the decoration before a message's text is made of.
+#define PREFIX_MAX_SEGS 5
+
+// Formatted timestamps, by the low bits of the time. Lines drawn together are
+// nearly always from a handful of seconds, so this makes formatting them cheap
+// enough to do every frame. Must be a power of two.
+#define TS_CACHE_SIZE 64
+// "[YYYY-MM-DD HH:MM:SS] " + \0
+#define TS_TEXT_MAXLEN 32
+
+#define THEME_ESC_MAXLEN VTSTYLE_SGR_MAXLEN
+
+// A run of the decoration: an escape, then text.
+typedef struct prefix_seg {
+    const char *esc;
+    size_t esc_len;
+    const char *text;
+    size_t text_len;
+} prefix_seg;
+
+typedef struct ts_cache_entry {
+    int64_t ts;
+    bool valid;
+    size_t len;
+    char text[TS_TEXT_MAXLEN];
+} ts_cache_entry;
+
+typedef enum theme_esc {
+    THEME_ESC_NONE,
+    THEME_ESC_TS,
+    THEME_ESC_NAMEBRACKETS,
+    THEME_ESC_NAME_SELF,
+    // Closes THEME_ESC_NAME_SELF, back to THEME_ESC_NAMEBRACKETS.
+    THEME_ESC_NAME_SELF_END,
+    THEME_ESC_TEXT_USER,
+    THEME_ESC_NAME_SERVER,
+    THEME_ESC_TEXT_SERVER,
+    THEME_ESC_NOT_SENT,
+    THEME_ESC_TEXT_NOT_SENT,
+    N_THEME_ESCS
+} theme_esc;
+
+static termutils_color s_color_ts = TERMUTILS_COLOR_BLUE;
+static termutils_color s_color_namebrackets = TERMUTILS_COLOR_DEFAULT;
+static termutils_color s_color_text_user = TERMUTILS_COLOR_DEFAULT;
+static termutils_color s_color_name_self = TERMUTILS_COLOR_CYAN_BRIGHT;
+// static termutils_color s_color_name_op = TERMUTILS_COLOR_RED;
+static termutils_color s_color_name_server = TERMUTILS_COLOR_MAGENTA;
+static termutils_color s_color_not_sent = TERMUTILS_COLOR_RED;
+
+static int s_color256_text_server = 245;
+static int s_color256_text_not_sent = 245;
+
+// The theme's escapes, written out on first use.
+static char s_theme_escs[N_THEME_ESCS][THEME_ESC_MAXLEN];
+static size_t s_theme_esc_lens[N_THEME_ESCS];
+static bool s_theme_ready = false;
+
+static timestamp_format s_ts_format = TIMESTAMP_FORMAT_TIME_ONLY;
+static ts_cache_entry s_ts_cache[TS_CACHE_SIZE];
+
+static void build_theme(void);
+
+// Sets the theme escape 'esc' to what takes the style 'from' to 'to'.
+static void set_theme_esc(theme_esc esc, const vtstyle *const from,
+        const vtstyle *const to);
+static uint32_t theme_color(termutils_color color);
+
+// Fills 'segs' with the decoration 'rec' is drawn with and returns how many
+// there are, which is 0 for plain text.
+static size_t build_prefix(const scrrec *const rec, prefix_seg *const segs);
+
+static prefix_seg make_seg(theme_esc esc, const char *const text, size_t len);
+
+// Returns "[<timestamp>] " for 'ts' in the current format.
+static const char *ts_text(int64_t ts, size_t *const len);
+
+// Characters a timestamp takes in 'format'. Every format is fixed-width.
+static size_t ts_width(timestamp_format format);
+
+void scrrec_set_timestamp_format(timestamp_format format) {
+    s_ts_format = format;
+    memset(s_ts_cache, 0, sizeof(s_ts_cache));
+}
+
+size_t scrrec_width(const scrrec *const rec) {
+    assert(rec != NULL);
+    assert(rec->body != NULL);
+
+    prefix_seg segs[PREFIX_MAX_SEGS];
+    size_t n_segs = build_prefix(rec, segs), width = rec->body->text_len;
+    for (size_t i = 0; i < n_segs; i++) width += segs[i].text_len;
+    return width;
+}
+
+size_t scrrec_ansi_len(const scrrec *const rec) {
+    assert(rec != NULL);
+    assert(rec->body != NULL);
+
+    prefix_seg segs[PREFIX_MAX_SEGS];
+    size_t n_segs = build_prefix(rec, segs);
+    size_t len = fmtline_ansi_len(rec->body);
+    for (size_t i = 0; i < n_segs; i++)
+        len += segs[i].esc_len + segs[i].text_len;
+    return len;
+}
+
+size_t scrrec_render(const scrrec *const rec, size_t start, size_t end,
+        char *const buf, size_t bufsize)
+{
+    assert(rec != NULL);
+    assert(rec->body != NULL);
+    assert(buf != NULL);
+
+    prefix_seg segs[PREFIX_MAX_SEGS];
+    size_t n_segs = build_prefix(rec, segs);
+    size_t prefix_width = 0, prefix_bytes = 0;
+    for (size_t i = 0; i < n_segs; i++) {
+        prefix_width += segs[i].text_len;
+        prefix_bytes += segs[i].esc_len + segs[i].text_len;
+    }
+    size_t width = prefix_width + rec->body->text_len;
+    assert(start <= end);
+    assert(end <= width);
+    assert(bufsize >= prefix_bytes);
+
+    size_t i_buf = 0, col = 0;
+    for (size_t i = 0; i < n_segs; i++) {
+        const prefix_seg *const seg = &segs[i];
+        // Escapes before 'start' are replayed, and one at 'end' is only
+        // written if that's the end of the line, same as fmtline_render().
+        if (col < end || end == width) {
+            memcpy(buf + i_buf, seg->esc, seg->esc_len);
+            i_buf += seg->esc_len;
+        }
+        size_t from = start > col ? start : col;
+        size_t to = end < col + seg->text_len ? end : col + seg->text_len;
+        if (from < to) {
+            memcpy(buf + i_buf, seg->text + (from - col), to - from);
+            i_buf += to - from;
+        }
+        col += seg->text_len;
+    }
+
+    if (end > prefix_width || end == width) {
+        i_buf += fmtline_render(rec->body,
+                start > prefix_width ? start - prefix_width : 0,
+                end - prefix_width, buf + i_buf, bufsize - i_buf);
+    }
+    return i_buf;
+}
+
+void scrrec_copy_text(const scrrec *const rec, char *const buf, size_t bufsize)
+{
+    assert(rec != NULL);
+    assert(buf != NULL);
+    assert(bufsize > 0);
+
+    prefix_seg segs[PREFIX_MAX_SEGS];
+    size_t n_segs = build_prefix(rec, segs), len = 0;
+    for (size_t i = 0; i <= n_segs && len < bufsize - 1; i++) {
+        // The body is the last piece.
+        const char *text = i < n_segs ? segs[i].text : fmtline_text(rec->body);
+        size_t text_len = i < n_segs ? segs[i].text_len : rec->body->text_len;
+        if (text_len > bufsize - 1 - len) text_len = bufsize - 1 - len;
+        memcpy(buf + len, text, text_len);
+        len += text_len;
+    }
+    buf[len] = '\0';
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static void build_theme(void) {
+    // Each escape changes the style the piece before it leaves (see
+    // build_prefix()) in one sequence, and is empty if nothing changes. Lines
+    // start in the default style. The brackets and the server's text can
+    // follow a timestamp or a nick, whose colours differ, so they set their
+    // own colour whatever was there.
+    const vtstyle line_start = { VTCOLOR_DEFAULT, VTCOLOR_DEFAULT, 0 };
+    const vtstyle any = { VTCOLOR_UNKNOWN, VTCOLOR_DEFAULT, 0 };
+    const vtstyle ts = { theme_color(s_color_ts), VTCOLOR_DEFAULT, 0 };
+    const vtstyle brackets = {
+        theme_color(s_color_namebrackets), VTCOLOR_DEFAULT, 0
+    };
+    const vtstyle self = {
+        theme_color(s_color_name_self), VTCOLOR_DEFAULT, VTATTR_BOLD
+    };
+    const vtstyle text_user = {
+        theme_color(s_color_text_user), VTCOLOR_DEFAULT, 0
+    };
+    const vtstyle name_server = {
+        theme_color(s_color_name_server), VTCOLOR_DEFAULT, 0
+    };
+    const vtstyle text_server = {
+        VTCOLOR_256 | (uint32_t) s_color256_text_server, VTCOLOR_DEFAULT, 0
+    };
+    const vtstyle not_sent = {
+        theme_color(s_color_not_sent), VTCOLOR_DEFAULT, 0
+    };
+    const vtstyle text_not_sent = {
+        VTCOLOR_256 | (uint32_t) s_color256_text_not_sent, VTCOLOR_DEFAULT, 0
+    };
+
+    s_theme_esc_lens[THEME_ESC_NONE] = 0;
+    set_theme_esc(THEME_ESC_TS, &line_start, &ts);
+    set_theme_esc(THEME_ESC_NAMEBRACKETS, &any, &brackets);
+    set_theme_esc(THEME_ESC_NAME_SELF, &brackets, &self);
+    set_theme_esc(THEME_ESC_NAME_SELF_END, &self, &brackets);
+    set_theme_esc(THEME_ESC_TEXT_USER, &brackets, &text_user);
+    set_theme_esc(THEME_ESC_NAME_SERVER, &ts, &name_server);
+    set_theme_esc(THEME_ESC_TEXT_SERVER, &any, &text_server);
+    set_theme_esc(THEME_ESC_NOT_SENT, &line_start, &not_sent);
+    set_theme_esc(THEME_ESC_TEXT_NOT_SENT, &not_sent, &text_not_sent);
+
+    s_theme_ready = true;
+}
+
+static void set_theme_esc(theme_esc esc, const vtstyle *const from,
+        const vtstyle *const to)
+{
+    s_theme_esc_lens[esc] = vtstyle_sgr(from, to, s_theme_escs[esc]);
+}
+
+static uint32_t theme_color(termutils_color color) {
+    // The basic and bright colours are the first 16 of the 256-colour table,
+    // in the same order.
+    if (color == TERMUTILS_COLOR_DEFAULT) return VTCOLOR_DEFAULT;
+    return VTCOLOR_256 | (uint32_t) color;
+}
+
+static size_t build_prefix(const scrrec *const rec, prefix_seg *const segs) {
+    if (rec->kind == SCREEN_MSG_TEXT) return 0;
+    if (!s_theme_ready) build_theme();
+
+    size_t ts_len = 0, n = 0;
+    const char *const ts = ts_text(rec->ts, &ts_len);
+    const char *const nick = nicktab_name(rec->nick);
+    size_t nick_len = nicktab_len(rec->nick);
+
+    switch (rec->kind) {
+    case SCREEN_MSG_SERVER:
+        // [ts] source: text
+        segs[n++] = make_seg(THEME_ESC_TS, ts, ts_len);
+        if (nick_len > 0) {
+            segs[n++] = make_seg(THEME_ESC_NAME_SERVER, nick, nick_len);
+            segs[n++] = make_seg(THEME_ESC_NONE, ": ", 2);
+        }
+        segs[n++] = make_seg(THEME_ESC_TEXT_SERVER, "", 0);
+        break;
+    case SCREEN_MSG_PRIVMSG:
+    case SCREEN_MSG_PRIVMSG_SELF: {
+        // [ts] <nick> text
+        bool self = rec->kind == SCREEN_MSG_PRIVMSG_SELF;
+        segs[n++] = make_seg(THEME_ESC_TS, ts, ts_len);
+        segs[n++] = make_seg(THEME_ESC_NAMEBRACKETS, "<", 1);
+        if (self) {
+            segs[n++] = make_seg(THEME_ESC_NAME_SELF, nick, nick_len);
+        }
+        else {
+            // Everyone else gets their own colour, cached with the nick.
+            size_t color_len = 0;
+            const char *const color = nicktab_color_esc(rec->nick, &color_len);
+            prefix_seg seg = { color, color_len, nick, nick_len };
+            segs[n++] = seg;
+        }
+        segs[n++] = make_seg(self ? THEME_ESC_NAME_SELF_END
+                : THEME_ESC_NAMEBRACKETS, ">", 1);
+        segs[n++] = make_seg(THEME_ESC_TEXT_USER, " ", 1);
+        break;
+    }
+    case SCREEN_MSG_NOT_SENT:
+        // (Not Sent) [ts] <nick> text, all but the label greyed out.
+        segs[n++] = make_seg(THEME_ESC_NOT_SENT, "(Not Sent) ", 11);
+        segs[n++] = make_seg(THEME_ESC_TEXT_NOT_SENT, ts, ts_len);
+        segs[n++] = make_seg(THEME_ESC_NONE, "<", 1);
+        segs[n++] = make_seg(THEME_ESC_NONE, nick, nick_len);
+        segs[n++] = make_seg(THEME_ESC_NONE, "> ", 2);
+        break;
+    default:
+        assert(!"Invalid screen_msg_kind!");
+    }
+    assert(n <= PREFIX_MAX_SEGS);
+    return n;
+}
+
+static prefix_seg make_seg(theme_esc esc, const char *const text, size_t len)
+{
+    prefix_seg seg = {
+        s_theme_escs[esc], s_theme_esc_lens[esc], text, len
+    };
+    return seg;
+}
+
+static const char *ts_text(int64_t ts, size_t *const len) {
+    ts_cache_entry *const e =
+        &s_ts_cache[(uint64_t) ts & (TS_CACHE_SIZE - 1)];
+    if (!e->valid || e->ts != ts) {
+        char stamp[TS_TEXT_MAXLEN];
+        size_t width = ts_width(s_ts_format);
+        // Widths must not change between calls, or row counts would be off.
+        if (!msgutils_format_timestamp(
+                    stamp, sizeof(stamp), ts, false, s_ts_format) ||
+            strlen(stamp) != width)
+        {
+            memset(stamp, '?', width);
+            stamp[width] = '\0';
+        }
+        e->text[0] = '[';
+        memcpy(e->text + 1, stamp, width);
+        memcpy(e->text + 1 + width, "] ", 3);
+        e->len = width + 3;
+        e->ts = ts;
+        e->valid = true;
+    }
+    *len = e->len;
+    return e->text;
+}
+
+static size_t ts_width(timestamp_format format) {
+    switch (format) {
+    case TIMESTAMP_FORMAT_YEAR_MONTH_DAY_TIME: return 19;
+    case TIMESTAMP_FORMAT_MONTH_DAY_TIME: return 14;
+    case TIMESTAMP_FORMAT_TIME_ONLY: return 8;
+    case TIMESTAMP_FORMAT_YEAR_MONTH_DAY_NOTIME: return 10;
+    case TIMESTAMP_FORMAT_MONTH_DAY_NOTIME: return 5;
+    default:
+        assert(!"Invalid timestamp_format!");
+        return 0;
+    }
+}
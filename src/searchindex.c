@@ -0,0 +1,291 @@
+#define LOG_MODULE LOGMODULE_SCREEN
+
+#include "searchindex.h"
+
+#include "log.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SRCHIDX_INITIAL_SLOTS 1024
+#define SRCHIDX_EMPTY UINT32_MAX
+
+// Reads the next token from 'text' starting at '*i', folding case and
+// truncating to SRCHIDX_TOKEN_MAXLEN. Returns the token length (0 at the end of
+// the text); tokens of one character are skipped.
+static size_t next_token(const char *const text, size_t *const i,
+        char *const tok);
+
+static uint32_t hash_token(const char *const tok, size_t len);
+
+// Returns the slot for 'tok', which is either its existing slot or the empty
+// slot it would go in.
+static srchidx_slot *find_slot(const searchindex *const idx,
+        const char *const tok, size_t len, uint32_t hash);
+
+static srchidx_slot *insert_token(searchindex *const idx,
+        const char *const tok, size_t len, uint32_t hash);
+
+static void grow_slots(searchindex *const idx);
+
+static bool posting_contains(const srchidx_posting *const p, uint32_t id);
+
+// Index of the first id in 'p' that isn't below 'id'.
+static uint32_t posting_lower_bound(const srchidx_posting *const p,
+        uint32_t id);
+
+static void *realloc_or_die(void *ptr, size_t size);
+
+void srchidx_free(searchindex *const idx) {
+    assert(idx != NULL);
+    for (size_t i = 0; i < idx->cap_slots; i++)
+        free(idx->slots[i].posting.ids);
+    free(idx->slots);
+    free(idx->keys);
+    memset(idx, 0, sizeof(*idx));
+}
+
+void srchidx_add(searchindex *const idx, uint32_t id, const char *const text) {
+    assert(idx != NULL);
+    assert(text != NULL);
+
+    char tok[SRCHIDX_TOKEN_MAXLEN + 1];
+    size_t i = 0, len = 0;
+    while ((len = next_token(text, &i, tok)) > 0) {
+        uint32_t hash = hash_token(tok, len);
+        srchidx_slot *slot = find_slot(idx, tok, len, hash);
+        if (slot == NULL || slot->key == SRCHIDX_EMPTY)
+            slot = insert_token(idx, tok, len, hash);
+
+        srchidx_posting *const p = &slot->posting;
+        assert(p->n == 0 || p->ids[p->n - 1] <= id);
+        // The same word twice in one line only needs one posting.
+        if (p->n > 0 && p->ids[p->n - 1] == id) continue;
+
+        if (p->n == p->cap) {
+            uint32_t new_cap = p->cap == 0 ? 4 : p->cap * 2;
+            p->ids = (uint32_t *) realloc_or_die(
+                    p->ids, new_cap * sizeof(*p->ids));
+            idx->bytes += (int64_t) (new_cap - p->cap) * sizeof(*p->ids);
+            p->cap = new_cap;
+        }
+        p->ids[p->n++] = id;
+    }
+}
+
+void srchidx_prune(searchindex *const idx, uint32_t min_id) {
+    assert(idx != NULL);
+    if (min_id <= idx->min_id) return;
+
+    // Postings move to the new table as they are; only their ids before
+    // 'min_id' are cut off the front.
+    searchindex pruned = { 0 };
+    pruned.min_id = min_id;
+    for (size_t i = 0; i < idx->cap_slots; i++) {
+        srchidx_slot *const old = &idx->slots[i];
+        if (old->key == SRCHIDX_EMPTY) continue;
+
+        srchidx_posting p = old->posting;
+        uint32_t n_drop = posting_lower_bound(&p, min_id);
+        if (n_drop == p.n) {
+            free(p.ids);
+            continue;
+        }
+        if (n_drop > 0) {
+            p.n -= n_drop;
+            memmove(p.ids, p.ids + n_drop, p.n * sizeof(*p.ids));
+            p.ids = (uint32_t *) realloc_or_die(p.ids, p.n * sizeof(*p.ids));
+            p.cap = p.n;
+        }
+
+        const char *const tok = idx->keys + old->key;
+        srchidx_slot *const slot =
+            insert_token(&pruned, tok, strlen(tok), old->hash);
+        slot->posting = p;
+        pruned.bytes += (int64_t) p.cap * sizeof(*p.ids);
+    }
+
+    free(idx->slots);
+    free(idx->keys);
+    *idx = pruned;
+}
+
+size_t srchidx_query(const searchindex *const idx, const char *const query,
+        uint32_t *const hits, size_t max_hits)
+{
+    assert(idx != NULL);
+    assert(query != NULL);
+    assert(hits != NULL);
+
+    const srchidx_posting *lists[SRCHIDX_QUERY_MAX_TOKENS];
+    size_t n_lists = 0;
+
+    char tok[SRCHIDX_TOKEN_MAXLEN + 1];
+    size_t i = 0, len = 0;
+    while (n_lists < SRCHIDX_QUERY_MAX_TOKENS &&
+           (len = next_token(query, &i, tok)) > 0)
+    {
+        const srchidx_slot *const slot =
+            find_slot(idx, tok, len, hash_token(tok, len));
+        // A token that appears nowhere means no line has them all.
+        if (slot == NULL || slot->key == SRCHIDX_EMPTY) return 0;
+        lists[n_lists++] = &slot->posting;
+    }
+    if (n_lists == 0) return 0;
+
+    // Drive the intersection from the rarest token, newest lines first, and
+    // binary search the others. O(k log n) for k candidates.
+    size_t i_rarest = 0;
+    for (size_t l = 1; l < n_lists; l++)
+        if (lists[l]->n < lists[i_rarest]->n) i_rarest = l;
+
+    const srchidx_posting *const rarest = lists[i_rarest];
+    size_t n_hits = 0;
+    for (uint32_t k = rarest->n; k > 0 && n_hits < max_hits; k--) {
+        uint32_t id = rarest->ids[k - 1];
+        bool in_all = true;
+        for (size_t l = 0; l < n_lists && in_all; l++)
+            if (l != i_rarest) in_all = posting_contains(lists[l], id);
+        if (in_all) hits[n_hits++] = id;
+    }
+    return n_hits;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static size_t next_token(const char *const text, size_t *const i,
+        char *const tok)
+{
+    for (;;) {
+        // Skip separators.
+        unsigned char c;
+        while ((c = (unsigned char) text[*i]) != '\0') {
+            bool word_char = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                || (c >= '0' && c <= '9') || c >= 0x80;
+            if (word_char) break;
+            (*i)++;
+        }
+        if (text[*i] == '\0') return 0;
+
+        size_t len = 0;
+        while ((c = (unsigned char) text[*i]) != '\0') {
+            bool word_char = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                || (c >= '0' && c <= '9') || c >= 0x80;
+            if (!word_char) break;
+            if (len < SRCHIDX_TOKEN_MAXLEN) {
+                tok[len++] = (c >= 'A' && c <= 'Z') ? (char) (c + 32)
+                                                    : (char) c;
+            }
+            (*i)++;
+        }
+        tok[len] = '\0';
+        if (len > 1) return len;
+    }
+}
+
+static uint32_t hash_token(const char *const tok, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) tok[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static srchidx_slot *find_slot(const searchindex *const idx,
+        const char *const tok, size_t len, uint32_t hash)
+{
+    if (idx->cap_slots == 0) return NULL;
+
+    size_t mask = idx->cap_slots - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        srchidx_slot *const slot = &idx->slots[i];
+        if (slot->key == SRCHIDX_EMPTY) return slot;
+        if (slot->hash == hash &&
+            strncmp(idx->keys + slot->key, tok, len) == 0 &&
+            idx->keys[slot->key + len] == '\0')
+        {
+            return slot;
+        }
+    }
+}
+
+static srchidx_slot *insert_token(searchindex *const idx,
+        const char *const tok, size_t len, uint32_t hash)
+{
+    // Keep the load factor under 1/2 so probes stay short.
+    if ((idx->n_tokens + 1) * 2 > idx->cap_slots) grow_slots(idx);
+
+    if (idx->keys_len + len + 1 > idx->keys_cap) {
+        size_t new_cap = idx->keys_cap == 0 ? 4096 : idx->keys_cap * 2;
+        while (idx->keys_len + len + 1 > new_cap) new_cap *= 2;
+        idx->keys = (char *) realloc_or_die(idx->keys, new_cap);
+        idx->bytes += (int64_t) (new_cap - idx->keys_cap);
+        idx->keys_cap = new_cap;
+    }
+
+    srchidx_slot *const slot = find_slot(idx, tok, len, hash);
+    assert(slot != NULL && slot->key == SRCHIDX_EMPTY);
+    slot->key = (uint32_t) idx->keys_len;
+    slot->hash = hash;
+    memcpy(idx->keys + idx->keys_len, tok, len);
+    idx->keys[idx->keys_len + len] = '\0';
+    idx->keys_len += len + 1;
+    idx->n_tokens++;
+    return slot;
+}
+
+static void grow_slots(searchindex *const idx) {
+    size_t old_cap = idx->cap_slots;
+    srchidx_slot *const old_slots = idx->slots;
+
+    idx->cap_slots = old_cap == 0 ? SRCHIDX_INITIAL_SLOTS : old_cap * 2;
+    idx->slots = (srchidx_slot *) realloc_or_die(
+            NULL, idx->cap_slots * sizeof(*idx->slots));
+    for (size_t i = 0; i < idx->cap_slots; i++) {
+        idx->slots[i].key = SRCHIDX_EMPTY;
+        idx->slots[i].posting.ids = NULL;
+        idx->slots[i].posting.n = idx->slots[i].posting.cap = 0;
+    }
+    idx->bytes += (int64_t) (idx->cap_slots - old_cap) * sizeof(*idx->slots);
+
+    // Rehash. Token bytes stay where they are in the arena.
+    size_t mask = idx->cap_slots - 1;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old_slots[i].key == SRCHIDX_EMPTY) continue;
+        size_t j = old_slots[i].hash & mask;
+        while (idx->slots[j].key != SRCHIDX_EMPTY) j = (j + 1) & mask;
+        idx->slots[j] = old_slots[i];
+    }
+    free(old_slots);
+}
+
+static bool posting_contains(const srchidx_posting *const p, uint32_t id) {
+    uint32_t lo = posting_lower_bound(p, id);
+    return lo < p->n && p->ids[lo] == id;
+}
+
+static uint32_t posting_lower_bound(const srchidx_posting *const p,
+        uint32_t id)
+{
+    uint32_t lo = 0, hi = p->n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (p->ids[mid] < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void *realloc_or_die(void *ptr, size_t size) {
+    void *new_ptr = realloc(ptr, size);
+    if (new_ptr == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[searchindex] FATAL: out of memory.");
+        exit(23);
+    }
+    return new_ptr;
+}
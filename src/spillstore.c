@@ -0,0 +1,697 @@
+#define LOG_MODULE LOGMODULE_SCREEN
+
+#include "spillstore.h"
+
+#include "log.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <share.h>
+#include <stdlib.h>
+#include <string.h>
+
+// [u32 size][u32 vislen] precedes every record's bytes.
+#define SPILL_REC_HEADER_BYTES 8
+// Each record's entry in the widths file.
+#define SPILL_WIDTH_BYTES 4
+
+typedef struct spill_index_entry {
+    uint32_t seg;
+    uint32_t offset;
+    int64_t first_rec;
+} spill_index_entry;
+
+// Creates the directory (if needed), loads the block index, and opens the
+// newest segment for appending. Sets 'disabled' on failure.
+static void spill_open(spillstore *const sp);
+
+// Scans the records of the block starting at 'offset' in segment 'seg' and
+// returns how many complete records it holds (at most SPILL_BLOCK_RECS).
+// 'end_offset' receives the offset just past the last complete record.
+static uint32_t count_block_recs(spillstore *const sp, uint32_t seg,
+        uint32_t offset, uint32_t *const end_offset);
+
+// Opens the widths file, first writing it again from the segments if it
+// doesn't hold exactly one width per record, e.g. because it predates the
+// store or the client didn't exit cleanly. Sets 'disabled' on failure.
+static void open_widths(spillstore *const sp);
+
+// Reads the widths of records 'first' to 'first + n'. False if they can't be
+// read.
+static bool read_widths(spillstore *const sp, int64_t first, uint32_t n,
+        uint32_t *const widths);
+
+// FNV-1a, of 'name' lowercased.
+static uint32_t hash_name(const char *const name);
+
+// Starts appending to segment 'seg', dropping the oldest segments if that
+// makes more than SPILL_MAX_SEGMENTS. False if the store got disabled.
+static bool start_segment(spillstore *const sp, uint32_t seg);
+
+// Rewrites the index and widths files without the blocks in segments before
+// 'seg', then deletes those segments. Sets 'disabled' on failure.
+static void drop_segments_before(spillstore *const sp, uint32_t seg);
+
+// Deletes segment files before 'seg', newest first, stopping at the first
+// that isn't there.
+static void delete_segments_before(spillstore *const sp, uint32_t seg);
+static void push_block(spillstore *const sp, uint32_t seg, uint32_t offset,
+        int64_t first_rec);
+static int64_t block_rows(spillstore *const sp, size_t i_block, int cols);
+
+// Binary search for the block holding record 'rec'.
+static size_t find_block(const spillstore *const sp, int64_t rec);
+
+// Returns a view of segment 'seg' that covers at least 'min_size' bytes,
+// mapping or remapping it if necessary. NULL if it can't be mapped.
+static spill_view *get_view(spillstore *const sp, uint32_t seg,
+        uint64_t min_size);
+static void unmap_view(spill_view *const v);
+
+static void seg_path(const spillstore *const sp, uint32_t seg,
+        char *const buf, size_t bufsize);
+
+void spill_init(spillstore *const sp, const char *const name) {
+    assert(sp != NULL);
+    assert(name != NULL);
+    memset(sp, 0, sizeof(*sp));
+
+    // IRC names are case-insensitive and can contain characters that aren't
+    // valid in file names, so normalize them. Replacing or cutting off
+    // characters could make two names one, so then a hash of the name tells
+    // them apart; '~' can't come from a name, so these can't clash with one
+    // that needed no changes.
+    char safe[SPILL_PATH_MAXLEN / 2];
+    bool changed = false;
+    size_t i = 0;
+    for (; name[i] != '\0' && i < sizeof(safe) - 1; i++) {
+        unsigned char c = (unsigned char) name[i];
+        bool keep = isalnum(c) || c == '#' || c == '-' || c == '.';
+        safe[i] = keep ? (char) tolower(c) : '_';
+        if (!keep) changed = true;
+    }
+    safe[i] = '\0';
+    if (name[i] != '\0') changed = true;
+
+    if (changed) {
+        sprintf_s(sp->dir, sizeof(sp->dir), "%s\\%s~%08x", SPILL_ROOT_DIR,
+                safe, hash_name(name));
+    } else {
+        sprintf_s(sp->dir, sizeof(sp->dir), "%s\\%s", SPILL_ROOT_DIR, safe);
+    }
+}
+
+void spill_close(spillstore *const sp) {
+    assert(sp != NULL);
+    for (int i = 0; i < SPILL_MAX_VIEWS; i++) unmap_view(&sp->views[i]);
+    if (sp->seg_out != NULL) fclose(sp->seg_out);
+    if (sp->idx_out != NULL) fclose(sp->idx_out);
+    if (sp->wid_out != NULL) fclose(sp->wid_out);
+    if (sp->wid_in != NULL) fclose(sp->wid_in);
+    free(sp->blocks);
+    sp->seg_out = sp->idx_out = sp->wid_out = sp->wid_in = NULL;
+    sp->blocks = NULL;
+    sp->n_blocks = sp->cap_blocks = 0;
+    sp->opened = false;
+}
+
+void spill_append(spillstore *const sp, const char *const msg, size_t vislen) {
+    assert(sp != NULL);
+    assert(msg != NULL);
+    if (!sp->opened) spill_open(sp);
+    if (sp->disabled) return;
+
+    uint32_t size = (uint32_t) strlen(msg) + 1;
+    uint32_t header[2] = { size, (uint32_t) vislen };
+
+    if (!sp->block_open ||
+        sp->blocks[sp->n_blocks - 1].n_recs >= SPILL_BLOCK_RECS)
+    {
+        // Blocks never span segments, so this is the only place a new
+        // segment gets started.
+        if (sp->seg_out_size + SPILL_REC_HEADER_BYTES + size >
+                SPILL_SEGMENT_MAX_BYTES && sp->seg_out_size > 0)
+        {
+            if (!start_segment(sp, sp->seg_out_num + 1)) return;
+        }
+
+        spill_index_entry entry = {
+            .seg = sp->seg_out_num,
+            .offset = sp->seg_out_size,
+            .first_rec = sp->n_recs
+        };
+        if (fwrite(&entry, sizeof(entry), 1, sp->idx_out) != 1) {
+            log_fmt(LOGLEVEL_ERROR, "[spill_append] Index write failed for "
+                    "'%s'; disabling history spill.", sp->dir);
+            sp->disabled = true;
+            return;
+        }
+        push_block(sp, entry.seg, entry.offset, entry.first_rec);
+        sp->block_open = true;
+    }
+
+    if (fwrite(header, sizeof(header), 1, sp->seg_out) != 1 ||
+        fwrite(msg, 1, size, sp->seg_out) != size ||
+        fwrite(&header[1], SPILL_WIDTH_BYTES, 1, sp->wid_out) != 1)
+    {
+        log_fmt(LOGLEVEL_ERROR, "[spill_append] Segment write failed for "
+                "'%s'; disabling history spill.", sp->dir);
+        sp->disabled = true;
+        return;
+    }
+
+    sp->seg_out_size += SPILL_REC_HEADER_BYTES + size;
+    spill_block *const b = &sp->blocks[sp->n_blocks - 1];
+    b->n_recs++;
+    // Keep any computed row count current rather than recounting the block.
+    if (b->rows_cols > 0)
+        b->rows += vislen / b->rows_cols + (vislen % b->rows_cols ? 1 : 0);
+    sp->n_recs++;
+}
+
+int64_t spill_count(spillstore *const sp) {
+    assert(sp != NULL);
+    if (!sp->opened) spill_open(sp);
+    return sp->n_recs;
+}
+
+int64_t spill_first(spillstore *const sp) {
+    assert(sp != NULL);
+    if (!sp->opened) spill_open(sp);
+    return sp->first_rec;
+}
+
+void spill_begin_read(spillstore *const sp) {
+    assert(sp != NULL);
+    if (!sp->opened) spill_open(sp);
+    if (sp->disabled) return;
+
+    // Readers map the files independently, so make sure everything appended
+    // so far has reached them.
+    fflush(sp->seg_out);
+    fflush(sp->idx_out);
+    fflush(sp->wid_out);
+
+    // Remap a stale view of the segment being written now, rather than in
+    // the middle of the batch where it would invalidate returned pointers.
+    for (int i = 0; i < SPILL_MAX_VIEWS; i++) {
+        spill_view *const v = &sp->views[i];
+        if (v->base != NULL && v->seg == sp->seg_out_num &&
+            v->size < sp->seg_out_size)
+        {
+            unmap_view(v);
+        }
+    }
+}
+
+bool spill_find_row_from_end(spillstore *const sp, int cols, int64_t rows_back,
+        int64_t *const rec, int64_t *const row_in_rec,
+        int64_t *const total_rows)
+{
+    assert(sp != NULL);
+    assert(cols > 0);
+    assert(rows_back > 0);
+
+    // Walk whole blocks back from the newest until the target is inside one.
+    int64_t acc = 0;
+    size_t i_block = sp->n_blocks;
+    int64_t rows = 0;
+    while (i_block > 0) {
+        rows = block_rows(sp, i_block - 1, cols);
+        if (acc + rows >= rows_back) break;
+        acc += rows;
+        i_block--;
+    }
+    if (i_block == 0) {
+        if (total_rows != NULL) *total_rows = acc;
+        return false;
+    }
+    i_block--;
+
+    // Now go forward through the block's records to the one holding the row.
+    int64_t row_in_block = rows - (rows_back - acc);
+    const spill_block *const b = &sp->blocks[i_block];
+    int64_t first_rec = b->first_rec;
+    uint32_t widths[SPILL_BLOCK_RECS];
+    uint32_t n_widths = read_widths(sp, first_rec, b->n_recs, widths)
+            ? b->n_recs : 0;
+    for (uint32_t i = 0; i < n_widths; i++) {
+        int64_t rec_rows = widths[i] / cols + (widths[i] % cols ? 1 : 0);
+        if (row_in_block < rec_rows) {
+            *rec = first_rec + i;
+            *row_in_rec = row_in_block;
+            return true;
+        }
+        row_in_block -= rec_rows;
+    }
+
+    // Only reachable if a segment went missing from under us.
+    if (total_rows != NULL) *total_rows = acc;
+    return false;
+}
+
+int64_t spill_rows_from(spillstore *const sp, int cols, int64_t rec) {
+    assert(sp != NULL);
+    assert(cols > 0);
+    if (sp->disabled || rec < sp->first_rec || rec >= sp->n_recs) return 0;
+
+    // Whole blocks after the one holding 'rec', then its tail record by
+    // record.
+    size_t i_block = find_block(sp, rec);
+    int64_t rows = 0;
+    for (size_t i = i_block + 1; i < sp->n_blocks; i++)
+        rows += block_rows(sp, i, cols);
+
+    const spill_block *const b = &sp->blocks[i_block];
+    uint32_t n = (uint32_t) (b->first_rec + b->n_recs - rec);
+    uint32_t widths[SPILL_BLOCK_RECS];
+    if (!read_widths(sp, rec, n, widths)) return rows;
+    for (uint32_t i = 0; i < n; i++)
+        rows += widths[i] / cols + (widths[i] % cols ? 1 : 0);
+    return rows;
+}
+
+const char *spill_get(spillstore *const sp, int64_t rec, size_t *const vislen) {
+    assert(sp != NULL);
+    if (sp->disabled || rec < sp->first_rec || rec >= sp->n_recs) return NULL;
+
+    const spill_block *const b = &sp->blocks[find_block(sp, rec)];
+
+    spill_view *v = get_view(sp, b->seg, b->offset);
+    if (v == NULL) return NULL;
+
+    // Hop over record headers until we reach 'rec'. At most
+    // SPILL_BLOCK_RECS - 1 hops.
+    uint64_t offset = b->offset;
+    uint32_t header[2];
+    for (int64_t i = b->first_rec; ; i++) {
+        if (offset + SPILL_REC_HEADER_BYTES > v->size) {
+            v = get_view(sp, b->seg, offset + SPILL_REC_HEADER_BYTES);
+            if (v == NULL) return NULL;
+        }
+        memcpy(header, v->base + offset, sizeof(header));
+        if (i == rec) break;
+        offset += SPILL_REC_HEADER_BYTES + header[0];
+    }
+
+    uint64_t end = offset + SPILL_REC_HEADER_BYTES + header[0];
+    if (end > v->size) {
+        v = get_view(sp, b->seg, end);
+        if (v == NULL) return NULL;
+    }
+
+    const char *msg = v->base + offset + SPILL_REC_HEADER_BYTES;
+    assert(header[0] > 0 && msg[header[0] - 1] == '\0');
+    if (vislen != NULL) *vislen = header[1];
+    return msg;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static void spill_open(spillstore *const sp) {
+    sp->opened = true;
+
+    // Fails harmlessly if the directories already exist.
+    CreateDirectoryA(SPILL_ROOT_DIR, NULL);
+    CreateDirectoryA(sp->dir, NULL);
+
+    char path[SPILL_PATH_MAXLEN];
+    sprintf_s(path, sizeof(path), "%s\\index", sp->dir);
+
+    // Load whatever index a previous session left behind. Each block's record
+    // count is the gap to the next block's first record; only the last block
+    // has to be counted from the segment itself.
+    FILE *idx_in = _fsopen(path, "rb", _SH_DENYNO);
+    if (idx_in != NULL) {
+        spill_index_entry entry;
+        while (fread(&entry, sizeof(entry), 1, idx_in) == 1) {
+            if (sp->n_blocks > 0) {
+                spill_block *const prev = &sp->blocks[sp->n_blocks - 1];
+                prev->n_recs = (uint32_t) (entry.first_rec - prev->first_rec);
+            }
+            push_block(sp, entry.seg, entry.offset, entry.first_rec);
+        }
+        fclose(idx_in);
+    }
+    if (sp->n_blocks > 0) {
+        sp->first_rec = sp->blocks[0].first_rec;
+        // Left behind if the client stopped in the middle of dropping them.
+        delete_segments_before(sp, sp->blocks[0].seg);
+    }
+
+    sp->idx_out = _fsopen(path, "ab", _SH_DENYNO);
+    if (sp->idx_out == NULL) {
+        log_fmt(LOGLEVEL_WARNING, "[spill_open] Can't open '%s'; history "
+                "will not be kept for this screen.", path);
+        sp->disabled = true;
+        return;
+    }
+
+    uint32_t seg = 0, seg_end = 0;
+    if (sp->n_blocks > 0) {
+        spill_block *const last = &sp->blocks[sp->n_blocks - 1];
+        last->n_recs = count_block_recs(sp, last->seg, last->offset, &seg_end);
+        sp->n_recs = last->first_rec + last->n_recs;
+        seg = last->seg;
+
+        // If the client didn't exit cleanly the segment may end in a torn
+        // record. Never append after one; start a fresh segment instead.
+        const spill_view *const v = get_view(sp, seg, 0);
+        if (v == NULL || v->size != seg_end) {
+            seg++;
+            seg_end = 0;
+        }
+    }
+
+    open_widths(sp);
+    if (sp->disabled) return;
+
+    // Unmap anything mapped while loading; its size will soon be stale.
+    for (int i = 0; i < SPILL_MAX_VIEWS; i++) unmap_view(&sp->views[i]);
+
+    if (!start_segment(sp, seg)) return;
+    assert(sp->seg_out_size == seg_end);
+
+    if (sp->n_recs > 0)
+        log_fmt(LOGLEVEL_INFO, "[spill_open] Loaded %lld lines of history "
+                "from '%s'.", (long long) sp->n_recs, sp->dir);
+}
+
+static uint32_t count_block_recs(spillstore *const sp, uint32_t seg,
+        uint32_t offset, uint32_t *const end_offset)
+{
+    *end_offset = offset;
+    spill_view *v = get_view(sp, seg, offset);
+    if (v == NULL) return 0;
+
+    uint32_t n = 0;
+    uint64_t pos = offset;
+    uint32_t header[2];
+    while (n < SPILL_BLOCK_RECS && pos + SPILL_REC_HEADER_BYTES <= v->size) {
+        memcpy(header, v->base + pos, sizeof(header));
+        if (header[0] == 0 ||
+            pos + SPILL_REC_HEADER_BYTES + header[0] > v->size) break;
+        pos += SPILL_REC_HEADER_BYTES + header[0];
+        n++;
+    }
+    *end_offset = (uint32_t) pos;
+    return n;
+}
+
+static void open_widths(spillstore *const sp) {
+    char path[SPILL_PATH_MAXLEN];
+    sprintf_s(path, sizeof(path), "%s\\widths", sp->dir);
+
+    int64_t n_widths = 0;
+    FILE *in = _fsopen(path, "rb", _SH_DENYNO);
+    if (in != NULL) {
+        _fseeki64(in, 0, SEEK_END);
+        n_widths = _ftelli64(in) / SPILL_WIDTH_BYTES;
+        fclose(in);
+    }
+
+    if (n_widths != sp->n_recs - sp->first_rec) {
+        FILE *out = _fsopen(path, "wb", _SH_DENYNO);
+        bool ok = out != NULL;
+        for (int64_t rec = sp->first_rec; ok && rec < sp->n_recs; rec++) {
+            size_t vislen = 0;
+            if (spill_get(sp, rec, &vislen) == NULL) vislen = 0;
+            uint32_t width = (uint32_t) vislen;
+            ok = fwrite(&width, SPILL_WIDTH_BYTES, 1, out) == 1;
+        }
+        if (out != NULL && fclose(out) != 0) ok = false;
+        if (!ok) {
+            log_fmt(LOGLEVEL_WARNING, "[spill open_widths] Can't write '%s'; "
+                    "history will not be kept for this screen.", path);
+            sp->disabled = true;
+            return;
+        }
+        if (sp->n_recs > 0)
+            log_fmt(LOGLEVEL_INFO, "[spill open_widths] Rewrote the widths of "
+                    "%lld lines in '%s'.",
+                    (long long) (sp->n_recs - sp->first_rec), sp->dir);
+    }
+
+    sp->wid_out = _fsopen(path, "ab", _SH_DENYNO);
+    sp->wid_in = _fsopen(path, "rb", _SH_DENYNO);
+    if (sp->wid_out == NULL || sp->wid_in == NULL) {
+        log_fmt(LOGLEVEL_WARNING, "[spill open_widths] Can't open '%s'; "
+                "history will not be kept for this screen.", path);
+        sp->disabled = true;
+    }
+}
+
+static bool read_widths(spillstore *const sp, int64_t first, uint32_t n,
+        uint32_t *const widths)
+{
+    assert(n <= SPILL_BLOCK_RECS);
+    if (sp->disabled) return false;
+    if (n == 0) return true;
+    int64_t pos = (first - sp->first_rec) * SPILL_WIDTH_BYTES;
+    return _fseeki64(sp->wid_in, pos, SEEK_SET) == 0 &&
+           fread(widths, SPILL_WIDTH_BYTES, n, sp->wid_in) == n;
+}
+
+static uint32_t hash_name(const char *const name) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; name[i] != '\0'; i++) {
+        h ^= (uint32_t) tolower((unsigned char) name[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool start_segment(spillstore *const sp, uint32_t seg) {
+    if (sp->seg_out != NULL) fclose(sp->seg_out);
+
+    char path[SPILL_PATH_MAXLEN];
+    seg_path(sp, seg, path, sizeof(path));
+    sp->seg_out = _fsopen(path, "ab", _SH_DENYNO);
+    if (sp->seg_out == NULL) {
+        log_fmt(LOGLEVEL_WARNING, "[spill start_segment] Can't open '%s'; "
+                "history will not be kept for this screen.", path);
+        sp->disabled = true;
+        return false;
+    }
+
+    fseek(sp->seg_out, 0, SEEK_END);
+    sp->seg_out_num = seg;
+    sp->seg_out_size = (uint32_t) ftell(sp->seg_out);
+
+    if (sp->n_blocks > 0 && seg - sp->blocks[0].seg >= SPILL_MAX_SEGMENTS)
+        drop_segments_before(sp, seg + 1 - SPILL_KEEP_SEGMENTS);
+    return !sp->disabled;
+}
+
+static void drop_segments_before(spillstore *const sp, uint32_t seg) {
+    size_t n_drop = 0;
+    while (n_drop < sp->n_blocks && sp->blocks[n_drop].seg < seg) n_drop++;
+    int64_t new_first = n_drop < sp->n_blocks
+        ? sp->blocks[n_drop].first_rec : sp->n_recs;
+
+    // The index goes first. If the client stops before the rest is done, the
+    // next open rewrites the widths from the segments, and deletes the
+    // segments older than the index's first block.
+    char path[SPILL_PATH_MAXLEN], tmp_path[SPILL_PATH_MAXLEN];
+    sprintf_s(path, sizeof(path), "%s\\index", sp->dir);
+    sprintf_s(tmp_path, sizeof(tmp_path), "%s\\index.tmp", sp->dir);
+    FILE *out = _fsopen(tmp_path, "wb", _SH_DENYNO);
+    bool ok = out != NULL;
+    for (size_t i = n_drop; ok && i < sp->n_blocks; i++) {
+        spill_index_entry entry = {
+            .seg = sp->blocks[i].seg,
+            .offset = sp->blocks[i].offset,
+            .first_rec = sp->blocks[i].first_rec
+        };
+        ok = fwrite(&entry, sizeof(entry), 1, out) == 1;
+    }
+    if (out != NULL && fclose(out) != 0) ok = false;
+    fclose(sp->idx_out);
+    sp->idx_out = NULL;
+    if (ok) ok = MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING);
+    if (ok) ok = (sp->idx_out = _fsopen(path, "ab", _SH_DENYNO)) != NULL;
+    if (!ok) {
+        log_fmt(LOGLEVEL_ERROR, "[spill drop_segments_before] Can't rewrite "
+                "'%s'; disabling history spill.", path);
+        sp->disabled = true;
+        return;
+    }
+
+    // Then the widths, keeping those from 'new_first' on.
+    sprintf_s(path, sizeof(path), "%s\\widths", sp->dir);
+    sprintf_s(tmp_path, sizeof(tmp_path), "%s\\widths.tmp", sp->dir);
+    fflush(sp->wid_out);
+    out = _fsopen(tmp_path, "wb", _SH_DENYNO);
+    ok = out != NULL && _fseeki64(sp->wid_in,
+            (new_first - sp->first_rec) * SPILL_WIDTH_BYTES, SEEK_SET) == 0;
+    char buf[1024 * 16];
+    size_t n = 0;
+    while (ok && (n = fread(buf, 1, sizeof(buf), sp->wid_in)) > 0)
+        ok = fwrite(buf, 1, n, out) == n;
+    if (ferror(sp->wid_in)) ok = false;
+    if (out != NULL && fclose(out) != 0) ok = false;
+    fclose(sp->wid_out);
+    fclose(sp->wid_in);
+    sp->wid_out = sp->wid_in = NULL;
+    if (ok) ok = MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING);
+    if (ok) {
+        sp->wid_out = _fsopen(path, "ab", _SH_DENYNO);
+        sp->wid_in = _fsopen(path, "rb", _SH_DENYNO);
+        ok = sp->wid_out != NULL && sp->wid_in != NULL;
+    }
+    if (!ok) {
+        log_fmt(LOGLEVEL_ERROR, "[spill drop_segments_before] Can't rewrite "
+                "'%s'; disabling history spill.", path);
+        sp->disabled = true;
+        return;
+    }
+
+    memmove(sp->blocks, sp->blocks + n_drop,
+            (sp->n_blocks - n_drop) * sizeof(*sp->blocks));
+    sp->n_blocks -= n_drop;
+    sp->first_rec = new_first;
+    delete_segments_before(sp, seg);
+    log_fmt(LOGLEVEL_INFO, "[spill drop_segments_before] Kept history from "
+            "line %lld on in '%s'.", (long long) new_first, sp->dir);
+}
+
+static void delete_segments_before(spillstore *const sp, uint32_t seg) {
+    // A mapped file can't be deleted.
+    for (int i = 0; i < SPILL_MAX_VIEWS; i++) {
+        if (sp->views[i].base != NULL && sp->views[i].seg < seg)
+            unmap_view(&sp->views[i]);
+    }
+
+    char path[SPILL_PATH_MAXLEN];
+    for (uint32_t s = seg; s > 0; s--) {
+        seg_path(sp, s - 1, path, sizeof(path));
+        if (!DeleteFileA(path)) break;
+    }
+}
+
+static void push_block(spillstore *const sp, uint32_t seg, uint32_t offset,
+        int64_t first_rec)
+{
+    if (sp->n_blocks == sp->cap_blocks) {
+        size_t new_cap = sp->cap_blocks == 0 ? 64 : sp->cap_blocks * 2;
+        spill_block *blocks = (spill_block *) realloc(
+                sp->blocks, new_cap * sizeof(*blocks));
+        if (blocks == NULL) {
+            // TODO: communicate fatal error
+            log(LOGLEVEL_ERROR, "[spill push_block] FATAL: out of memory.");
+            exit(23);
+        }
+        sp->blocks = blocks;
+        sp->cap_blocks = new_cap;
+    }
+
+    spill_block *const b = &sp->blocks[sp->n_blocks++];
+    b->seg = seg;
+    b->offset = offset;
+    b->first_rec = first_rec;
+    b->n_recs = 0;
+    b->rows_cols = 0;
+    b->rows = 0;
+}
+
+static int64_t block_rows(spillstore *const sp, size_t i_block, int cols) {
+    spill_block *const b = &sp->blocks[i_block];
+    if (b->rows_cols == cols) return b->rows;
+
+    // Only the block's widths are read to do this, not its records.
+    uint32_t widths[SPILL_BLOCK_RECS];
+    if (!read_widths(sp, b->first_rec, b->n_recs, widths)) return 0;
+    int64_t rows = 0;
+    for (uint32_t i = 0; i < b->n_recs; i++)
+        rows += widths[i] / cols + (widths[i] % cols ? 1 : 0);
+
+    b->rows_cols = cols;
+    b->rows = rows;
+    return rows;
+}
+
+static size_t find_block(const spillstore *const sp, int64_t rec) {
+    assert(sp->n_blocks > 0);
+    size_t lo = 0, hi = sp->n_blocks - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (sp->blocks[mid].first_rec <= rec) lo = mid;
+        else hi = mid - 1;
+    }
+    assert(rec >= sp->blocks[lo].first_rec);
+    assert(rec < sp->blocks[lo].first_rec + sp->blocks[lo].n_recs);
+    return lo;
+}
+
+static spill_view *get_view(spillstore *const sp, uint32_t seg,
+        uint64_t min_size)
+{
+    spill_view *lru = &sp->views[0], *found = NULL;
+    for (int i = 0; i < SPILL_MAX_VIEWS; i++) {
+        spill_view *const v = &sp->views[i];
+        if (v->base != NULL && v->seg == seg) found = v;
+        if (v->base == NULL || v->last_used < lru->last_used) lru = v;
+    }
+    if (found != NULL && found->size >= min_size) {
+        found->last_used = ++sp->view_clock;
+        return found;
+    }
+
+    // Either not mapped, or mapped before the segment grew this far.
+    spill_view *const v = found != NULL ? found : lru;
+    unmap_view(v);
+
+    char path[SPILL_PATH_MAXLEN];
+    seg_path(sp, seg, path, sizeof(path));
+    v->h_file = CreateFileA(path, GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (v->h_file == INVALID_HANDLE_VALUE) {
+        v->h_file = NULL;
+        return NULL;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(v->h_file, &size) || size.QuadPart == 0 ||
+        (uint64_t) size.QuadPart < min_size)
+    {
+        // Empty files can't be mapped, and a short file means the data isn't
+        // there at all.
+        unmap_view(v);
+        return NULL;
+    }
+
+    v->h_map = CreateFileMappingA(v->h_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (v->h_map != NULL) {
+        v->base = (const char *) MapViewOfFile(v->h_map, FILE_MAP_READ,
+                0, 0, 0);
+    }
+    if (v->base == NULL) {
+        log_fmt(LOGLEVEL_ERROR, "[spill get_view] Can't map '%s' (%lu).",
+                path, GetLastError());
+        unmap_view(v);
+        return NULL;
+    }
+
+    v->size = (uint64_t) size.QuadPart;
+    v->seg = seg;
+    v->last_used = ++sp->view_clock;
+    return v;
+}
+
+static void unmap_view(spill_view *const v) {
+    if (v->base != NULL) UnmapViewOfFile(v->base);
+    if (v->h_map != NULL) CloseHandle(v->h_map);
+    if (v->h_file != NULL) CloseHandle(v->h_file);
+    v->base = NULL;
+    v->h_map = NULL;
+    v->h_file = NULL;
+    v->size = 0;
+}
+
+static void seg_path(const spillstore *const sp, uint32_t seg,
+        char *const buf, size_t bufsize)
+{
+    sprintf_s(buf, bufsize, "%s\\%06u.seg", sp->dir, seg);
+}
@@ -8,6 +8,8 @@
 
 // ESC"[38;5;255m". Last value is 0-255, and the rest is static. 
 #define ESC_SEQ_COLOR_256_MAX_LEN 11
+// The same with any int in place of the 0-255, e.g. ESC"[38;5;-2147483648m".
+#define ESC_SEQ_COLOR_ANY_MAX_LEN 19
 
 // color_str refers to a hex string or a color name. The longest color names are
 // "yellow" and "purple", shorter than "#FFFFFF".
@@ -16,88 +18,129 @@
 // ESC"]12;#FFFFFF"ESC. 
 #define ESC_SEQ_CURSOR_COLOR_MAX_LEN (6 + MAX_COLOR_STR_LEN)
 
+// An escape sequence and its length, known at compile time, so writing one is
+// a bounds check and a memcpy().
+typedef struct esc_seq {
+    const char *str;
+    size_t len;
+} esc_seq;
+
+#define SEQ(str) { str, sizeof(str) - 1 }
+
+// SEQ_256() lists 'seq'(n) for n from 0 to 255, pasting the digits together
+// so each sequence is spelled out by the preprocessor.
+#define SEQ_FG_256(n) SEQ(ESC"[38;5;" #n "m"),
+#define SEQ_BG_256(n) SEQ(ESC"[48;5;" #n "m"),
+#define SEQ_10(seq, tens) \
+    seq(tens##0) seq(tens##1) seq(tens##2) seq(tens##3) seq(tens##4) \
+    seq(tens##5) seq(tens##6) seq(tens##7) seq(tens##8) seq(tens##9)
+#define SEQ_256(seq) \
+    SEQ_10(seq, ) SEQ_10(seq, 1) SEQ_10(seq, 2) SEQ_10(seq, 3) \
+    SEQ_10(seq, 4) SEQ_10(seq, 5) SEQ_10(seq, 6) SEQ_10(seq, 7) \
+    SEQ_10(seq, 8) SEQ_10(seq, 9) SEQ_10(seq, 10) SEQ_10(seq, 11) \
+    SEQ_10(seq, 12) SEQ_10(seq, 13) SEQ_10(seq, 14) SEQ_10(seq, 15) \
+    SEQ_10(seq, 16) SEQ_10(seq, 17) SEQ_10(seq, 18) SEQ_10(seq, 19) \
+    SEQ_10(seq, 20) SEQ_10(seq, 21) SEQ_10(seq, 22) SEQ_10(seq, 23) \
+    SEQ_10(seq, 24) \
+    seq(250) seq(251) seq(252) seq(253) seq(254) seq(255)
+
+static const esc_seq SEQS_TEXT_COLOR_256[256] = { SEQ_256(SEQ_FG_256) };
+static const esc_seq SEQS_BG_COLOR_256[256] = { SEQ_256(SEQ_BG_256) };
+
+// Indexed by termutils_color.
+static const esc_seq SEQS_TEXT_COLOR[] = {
+    SEQ(ESC"[30m"), SEQ(ESC"[31m"), SEQ(ESC"[32m"), SEQ(ESC"[33m"),
+    SEQ(ESC"[34m"), SEQ(ESC"[35m"), SEQ(ESC"[36m"), SEQ(ESC"[37m"),
+    SEQ(ESC"[90m"), SEQ(ESC"[91m"), SEQ(ESC"[92m"), SEQ(ESC"[93m"),
+    SEQ(ESC"[94m"), SEQ(ESC"[95m"), SEQ(ESC"[96m"), SEQ(ESC"[97m"),
+    SEQ(ESC"[39m")
+};
+static const esc_seq SEQS_BG_COLOR[] = {
+    SEQ(ESC"[40m"), SEQ(ESC"[41m"), SEQ(ESC"[42m"), SEQ(ESC"[43m"),
+    SEQ(ESC"[44m"), SEQ(ESC"[45m"), SEQ(ESC"[46m"), SEQ(ESC"[47m"),
+    SEQ(ESC"[100m"), SEQ(ESC"[101m"), SEQ(ESC"[102m"), SEQ(ESC"[103m"),
+    SEQ(ESC"[104m"), SEQ(ESC"[105m"), SEQ(ESC"[106m"), SEQ(ESC"[107m"),
+    SEQ(ESC"[49m")
+};
+#define N_BASIC_COLORS (sizeof(SEQS_TEXT_COLOR) / sizeof(SEQS_TEXT_COLOR[0]))
+
+// Indexed by whether the mode is being turned on.
+static const esc_seq SEQS_BOLD[2] = { SEQ(ESC"[22m"), SEQ(ESC"[1m") };
+static const esc_seq SEQS_FAINT[2] = { SEQ(ESC"[22m"), SEQ(ESC"[2m") };
+static const esc_seq SEQS_ITALIC[2] = { SEQ(ESC"[23m"), SEQ(ESC"[3m") };
+static const esc_seq SEQS_UNDERLINE[2] = { SEQ(ESC"[24m"), SEQ(ESC"[4m") };
+static const esc_seq SEQS_BLINKING[2] = { SEQ(ESC"[25m"), SEQ(ESC"[5m") };
+static const esc_seq SEQS_INVERSE[2] = { SEQ(ESC"[27m"), SEQ(ESC"[7m") };
+static const esc_seq SEQS_HIDDEN[2] = { SEQ(ESC"[28m"), SEQ(ESC"[8m") };
+static const esc_seq SEQS_STRIKETH[2] = { SEQ(ESC"[29m"), SEQ(ESC"[9m") };
+
+static const esc_seq SEQ_RESET_ALL = SEQ(ESC"[0m");
+static const esc_seq SEQ_RESET_CURSOR_COLOR = SEQ(ESC"]112\x07");
+
+// Writes 'seq' to 'buf', including null term, if it's shorter than 'maxlen'.
+// Returns number of chars written, not including the null term, or 0 if 'seq'
+// could not be written.
+static size_t write_seq(
+        char *const buf, size_t maxlen, const esc_seq *const seq);
+
 // Writes 'str' to 'buf', including null term, if strlen(str) is less than
 // 'maxlen'. Returns number of chars written, not including the null term, or 0
 // if 'str' could not be written.
 static size_t write_if_fits(
         char *const buf, size_t maxlen, const char *const str);
 
+// Returns the sequence for 'color' in 'seqs', or NULL if it's invalid.
+static const esc_seq *basic_color_seq(
+        const esc_seq *const seqs, termutils_color color);
+
+// Writes a 256-colour escape for an index outside 0-255, which has no table
+// entry, with the number printed as it is, like it always was.
+static size_t write_color_256_fallback(
+        char *const buf, size_t maxlen, bool bg, int color_code);
+
 size_t termutils_set_bold_buf(char *const buf, size_t maxlen, bool on) {
-    return write_if_fits(buf, maxlen, on ? ESC"[1m" : ESC"[22m");
+    return write_seq(buf, maxlen, &SEQS_BOLD[on]);
 }
 
 size_t termutils_set_faint_buf(char *const buf, size_t maxlen, bool on) {
-    return write_if_fits(buf, maxlen, on ? ESC"[2m" : ESC"[22m");
+    return write_seq(buf, maxlen, &SEQS_FAINT[on]);
 }
 
 size_t termutils_set_italic_buf(char *const buf, size_t maxlen, bool on) {
-    return write_if_fits(buf, maxlen, on ? "\033[3m" : "\033[23m");
+    return write_seq(buf, maxlen, &SEQS_ITALIC[on]);
 }
 
 size_t termutils_set_underline_buf(char *const buf, size_t maxlen, bool on) {
-    return write_if_fits(buf, maxlen, on ? "\033[4m" : "\033[24m");
+    return write_seq(buf, maxlen, &SEQS_UNDERLINE[on]);
 }
 
 size_t termutils_set_blinking_buf(char *const buf, size_t maxlen, bool on) {
-    return write_if_fits(buf, maxlen, on ? "\033[5m" : "\033[25m");
+    return write_seq(buf, maxlen, &SEQS_BLINKING[on]);
 }
 
 size_t termutils_set_inverse_buf(char *const buf, size_t maxlen, bool on) {
-    return write_if_fits(buf, maxlen, on ? "\033[7m" : "\033[27m");
+    return write_seq(buf, maxlen, &SEQS_INVERSE[on]);
 }
 
 size_t termutils_set_hidden_buf(char *const buf, size_t maxlen, bool on) {
-    return write_if_fits(buf, maxlen, on ? "\033[8m" : "\033[28m");
+    return write_seq(buf, maxlen, &SEQS_HIDDEN[on]);
 }
 
 size_t termutils_set_striketh_buf(char *const buf, size_t maxlen, bool on) {
-    return write_if_fits(buf, maxlen, on ? "\033[9m" : "\033[29m");
+    return write_seq(buf, maxlen, &SEQS_STRIKETH[on]);
 }
 
 size_t termutils_set_text_color_buf(
         char *const buf, size_t maxlen, termutils_color color)
 {
-    switch (color) {
-    case TERMUTILS_COLOR_BLACK:
-        return write_if_fits(buf, maxlen, "\033[30m");
-    case TERMUTILS_COLOR_RED:
-        return write_if_fits(buf, maxlen, "\033[31m");
-    case TERMUTILS_COLOR_GREEN:
-        return write_if_fits(buf, maxlen, "\033[32m");
-    case TERMUTILS_COLOR_YELLOW:
-        return write_if_fits(buf, maxlen, "\033[33m");
-    case TERMUTILS_COLOR_BLUE:
-        return write_if_fits(buf, maxlen, "\033[34m");
-    case TERMUTILS_COLOR_MAGENTA:
-        return write_if_fits(buf, maxlen, "\033[35m");
-    case TERMUTILS_COLOR_CYAN:
-        return write_if_fits(buf, maxlen, "\033[36m\0");
-    case TERMUTILS_COLOR_WHITE:
-        return write_if_fits(buf, maxlen, "\033[37m");
-    case TERMUTILS_COLOR_BLACK_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[90m");
-    case TERMUTILS_COLOR_RED_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[91m");
-    case TERMUTILS_COLOR_GREEN_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[92m");
-    case TERMUTILS_COLOR_YELLOW_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[93m");
-    case TERMUTILS_COLOR_BLUE_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[94m");
-    case TERMUTILS_COLOR_MAGENTA_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[95m");
-    case TERMUTILS_COLOR_CYAN_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[96m");
-    case TERMUTILS_COLOR_WHITE_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[97m");
-    case TERMUTILS_COLOR_DEFAULT:
-        return write_if_fits(buf, maxlen, "\033[39m");
-    default:
+    const esc_seq *const seq = basic_color_seq(SEQS_TEXT_COLOR, color);
+    if (seq == NULL) {
 #ifdef TERMUTILS_DEBUG_ASSERT
         assert(!"[set_text_color()] Invalid TERMUTILS_COLOR");
 #endif
-        return false;
+        return 0;
     }
+    return write_seq(buf, maxlen, seq);
 }
 
 size_t termutils_set_text_color_256_buf(
@@ -109,65 +152,27 @@ size_t termutils_set_text_color_256_buf(
     assert(maxlen > ESC_SEQ_COLOR_256_MAX_LEN);
 #endif
     if (maxlen <= ESC_SEQ_COLOR_256_MAX_LEN) return 0;
+    if (color_code < 0 || color_code > 255)
+        return write_color_256_fallback(buf, maxlen, false, color_code);
 
-    char seq[ESC_SEQ_COLOR_256_MAX_LEN + 1];
-    int len = sprintf_s(seq, sizeof(seq), ESC"[38;5;%dm", color_code);
-
-#ifdef TERMUTILS_DEBUG_ASSERT
-    assert(len <= ESC_SEQ_COLOR_256_MAX_LEN);
-#endif
-    if (len > (int) maxlen) return 0;
-    return write_if_fits(buf, maxlen, seq);
+    return write_seq(buf, maxlen, &SEQS_TEXT_COLOR_256[color_code]);
 }
 
 size_t termutils_reset_text_color_buf(char *const buf, size_t maxlen) {
-    return write_if_fits(buf, maxlen, "\033[39m");
+    return write_seq(buf, maxlen, &SEQS_TEXT_COLOR[TERMUTILS_COLOR_DEFAULT]);
 }
 
 size_t termutils_set_bg_color_buf(
         char *const buf, size_t maxlen, termutils_color color)
 {
-    switch (color) {
-    case TERMUTILS_COLOR_BLACK:
-        return write_if_fits(buf, maxlen, "\033[40m");
-    case TERMUTILS_COLOR_RED:
-        return write_if_fits(buf, maxlen, "\033[41m");
-    case TERMUTILS_COLOR_GREEN:
-        return write_if_fits(buf, maxlen, "\033[42m");
-    case TERMUTILS_COLOR_YELLOW:
-        return write_if_fits(buf, maxlen, "\033[43m");
-    case TERMUTILS_COLOR_BLUE:
-        return write_if_fits(buf, maxlen, "\033[44m");
-    case TERMUTILS_COLOR_MAGENTA:
-        return write_if_fits(buf, maxlen, "\033[45m");
-    case TERMUTILS_COLOR_CYAN:
-        return write_if_fits(buf, maxlen, "\033[46m");
-    case TERMUTILS_COLOR_WHITE:
-        return write_if_fits(buf, maxlen, "\033[47m");
-    case TERMUTILS_COLOR_BLACK_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[100m");
-    case TERMUTILS_COLOR_RED_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[101m");
-    case TERMUTILS_COLOR_GREEN_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[102m");
-    case TERMUTILS_COLOR_YELLOW_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[103m");
-    case TERMUTILS_COLOR_BLUE_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[104m");
-    case TERMUTILS_COLOR_MAGENTA_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[105m");
-    case TERMUTILS_COLOR_CYAN_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[106m");
-    case TERMUTILS_COLOR_WHITE_BRIGHT:
-        return write_if_fits(buf, maxlen, "\033[107m");
-    case TERMUTILS_COLOR_DEFAULT:
-        return write_if_fits(buf, maxlen, "\033[49m");
-    default:
+    const esc_seq *const seq = basic_color_seq(SEQS_BG_COLOR, color);
+    if (seq == NULL) {
 #ifdef TERMUTILS_DEBUG_ASSERT
         assert(!"[set_bg_color()] Invalid TERMUTILS_COLOR");
 #endif
-        return false;
+        return 0;
     }
+    return write_seq(buf, maxlen, seq);
 }
 
 size_t termutils_set_bg_color_256_buf(
@@ -179,23 +184,18 @@ size_t termutils_set_bg_color_256_buf(
     assert(maxlen > ESC_SEQ_COLOR_256_MAX_LEN);
 #endif
     if (maxlen <= ESC_SEQ_COLOR_256_MAX_LEN) return 0;
+    if (color_code < 0 || color_code > 255)
+        return write_color_256_fallback(buf, maxlen, true, color_code);
 
-    char seq[ESC_SEQ_COLOR_256_MAX_LEN + 1];
-    int len = sprintf_s(seq, sizeof(seq), ESC"[48;5;%dm", color_code);
-
-#ifdef TERMUTILS_DEBUG_ASSERT
-    assert(len <= ESC_SEQ_COLOR_256_MAX_LEN);
-#endif
-    if (len > (int) maxlen) return 0;
-    return write_if_fits(buf, maxlen, seq);
+    return write_seq(buf, maxlen, &SEQS_BG_COLOR_256[color_code]);
 }
 
 size_t termutils_reset_bg_color_buf(char *const buf, size_t maxlen) {
-    return write_if_fits(buf, maxlen, "\033[49m");
+    return write_seq(buf, maxlen, &SEQS_BG_COLOR[TERMUTILS_COLOR_DEFAULT]);
 }
 
 size_t termutils_reset_all_buf(char *const buf, size_t maxlen) {
-    return write_if_fits(buf, maxlen, "\033[0m");
+    return write_seq(buf, maxlen, &SEQ_RESET_ALL);
 }
 
 size_t termutils_set_cursor_color_buf(
@@ -218,187 +218,95 @@ size_t termutils_set_cursor_color_buf(
 }
 
 size_t termutils_reset_cursor_color_buf(char *const buf, size_t maxlen) {
-    return write_if_fits(buf, maxlen, "\x1b]112\x07");
+    return write_seq(buf, maxlen, &SEQ_RESET_CURSOR_COLOR);
 }
 
 void termutils_set_bold(bool on, FILE *const out) {
-    fputs(on ? "\033[1m" : "\033[22m", out);
+    fputs(SEQS_BOLD[on].str, out);
 }
 
 void termutils_set_faint(bool on, FILE *const out) {
-    fputs(on ? "\033[2m" : "\033[22m", out);
+    fputs(SEQS_FAINT[on].str, out);
 }
 
 void termutils_set_italic(bool on, FILE *const out) {
-    fputs(on ? "\033[3m" : "\033[23m", out);
+    fputs(SEQS_ITALIC[on].str, out);
 }
 
 void termutils_set_underline(bool on, FILE *const out) {
-    fputs(on ? "\033[4m" : "\033[24m", out);
+    fputs(SEQS_UNDERLINE[on].str, out);
 }
 
 void termutils_set_blinking(bool on, FILE *const out) {
-    fputs(on ? "\033[5m" : "\033[25m", out);
+    fputs(SEQS_BLINKING[on].str, out);
 }
 
 void termutils_set_inverse(bool on, FILE *const out) {
-    fputs(on ? "\033[7m" : "\033[27m", out);
+    fputs(SEQS_INVERSE[on].str, out);
 }
 
 void termutils_set_hidden(bool on, FILE *const out) {
-    fputs(on ? "\033[8m" : "\033[28m", out);
+    fputs(SEQS_HIDDEN[on].str, out);
 }
 
 void termutils_set_striketh(bool on, FILE *const out) {
-    fputs(on ? "\033[9m" : "\033[29m", out);
+    fputs(SEQS_STRIKETH[on].str, out);
 }
 
 void termutils_set_text_color(termutils_color color, FILE *const out) {
-    switch (color) {
-    case TERMUTILS_COLOR_BLACK:
-        fputs("\033[30m", out);
-        break;
-    case TERMUTILS_COLOR_RED:
-        fputs("\033[31m", out);
-        break;
-    case TERMUTILS_COLOR_GREEN:
-        fputs("\033[32m", out);
-        break;
-    case TERMUTILS_COLOR_YELLOW:
-        fputs("\033[33m", out);
-        break;
-    case TERMUTILS_COLOR_BLUE:
-        fputs("\033[34m", out);
-        break;
-    case TERMUTILS_COLOR_MAGENTA:
-        fputs("\033[35m", out);
-        break;
-    case TERMUTILS_COLOR_CYAN:
-        fputs("\033[36m\0", out);
-        break;
-    case TERMUTILS_COLOR_WHITE:
-        fputs("\033[37m", out);
-        break;
-    case TERMUTILS_COLOR_BLACK_BRIGHT:
-        fputs("\033[90m", out);
-        break;
-    case TERMUTILS_COLOR_RED_BRIGHT:
-        fputs("\033[91m", out);
-        break;
-    case TERMUTILS_COLOR_GREEN_BRIGHT:
-        fputs("\033[92m", out);
-        break;
-    case TERMUTILS_COLOR_YELLOW_BRIGHT:
-        fputs("\033[93m", out);
-        break;
-    case TERMUTILS_COLOR_BLUE_BRIGHT:
-        fputs("\033[94m", out);
-        break;
-    case TERMUTILS_COLOR_MAGENTA_BRIGHT:
-        fputs("\033[95m", out);
-        break;
-    case TERMUTILS_COLOR_CYAN_BRIGHT:
-        fputs("\033[96m", out);
-        break;
-    case TERMUTILS_COLOR_WHITE_BRIGHT:
-        fputs("\033[97m", out);
-        break;
-    case TERMUTILS_COLOR_DEFAULT:
-        fputs("\033[39m", out);
-        break;
-    default:
+    const esc_seq *const seq = basic_color_seq(SEQS_TEXT_COLOR, color);
+    if (seq == NULL) {
 #ifdef TERMUTILS_DEBUG_ASSERT
         assert(!"[set_text_color()] Invalid TERMUTILS_COLOR");
 #endif
         return;
     }
+    fputs(seq->str, out);
 }
 
 void termutils_set_text_color_256(int color_code, FILE *const out) {
 #ifdef TERMUTILS_DEBUG_ASSERT
     assert(color_code >= 0 && color_code <= 255);
 #endif
-    fprintf_s(out, "\033[38;5;%dm", color_code);
+    if (color_code < 0 || color_code > 255) {
+        fprintf_s(out, ESC"[38;5;%dm", color_code);
+        return;
+    }
+    fputs(SEQS_TEXT_COLOR_256[color_code].str, out);
 }
 
 void termutils_reset_text_color(FILE *const out) {
-    fputs("\033[39m", out);
+    fputs(SEQS_TEXT_COLOR[TERMUTILS_COLOR_DEFAULT].str, out);
 }
 
 void termutils_set_bg_color(termutils_color color, FILE *const out) {
-    switch (color) {
-    case TERMUTILS_COLOR_BLACK:
-        fputs("\033[40m", out);
-        break;
-    case TERMUTILS_COLOR_RED:
-        fputs("\033[41m", out);
-        break;
-    case TERMUTILS_COLOR_GREEN:
-        fputs("\033[42m", out);
-        break;
-    case TERMUTILS_COLOR_YELLOW:
-        fputs("\033[43m", out);
-        break;
-    case TERMUTILS_COLOR_BLUE:
-        fputs("\033[44m", out);
-        break;
-    case TERMUTILS_COLOR_MAGENTA:
-        fputs("\033[45m", out);
-        break;
-    case TERMUTILS_COLOR_CYAN:
-        fputs("\033[46m", out);
-        break;
-    case TERMUTILS_COLOR_WHITE:
-        fputs("\033[47m", out);
-        break;
-    case TERMUTILS_COLOR_BLACK_BRIGHT:
-        fputs("\033[100m", out);
-        break;
-    case TERMUTILS_COLOR_RED_BRIGHT:
-        fputs("\033[101m", out);
-        break;
-    case TERMUTILS_COLOR_GREEN_BRIGHT:
-        fputs("\033[102m", out);
-        break;
-    case TERMUTILS_COLOR_YELLOW_BRIGHT:
-        fputs("\033[103m", out);
-        break;
-    case TERMUTILS_COLOR_BLUE_BRIGHT:
-        fputs("\033[104m", out);
-        break;
-    case TERMUTILS_COLOR_MAGENTA_BRIGHT:
-        fputs("\033[105m", out);
-        break;
-    case TERMUTILS_COLOR_CYAN_BRIGHT:
-        fputs("\033[106m", out);
-        break;
-    case TERMUTILS_COLOR_WHITE_BRIGHT:
-        fputs("\033[107m", out);
-        break;
-    case TERMUTILS_COLOR_DEFAULT:
-        fputs("\033[49m", out);
-        break;
-    default:
+    const esc_seq *const seq = basic_color_seq(SEQS_BG_COLOR, color);
+    if (seq == NULL) {
 #ifdef TERMUTILS_DEBUG_ASSERT
         assert(!"[set_bg_color()] Invalid TERMUTILS_COLOR");
 #endif
         return;
     }
+    fputs(seq->str, out);
 }
 
 void termutils_set_bg_color_256(int color_code, FILE *const out) {
 #ifdef TERMUTILS_DEBUG_ASSERT
     assert(color_code >= 0 && color_code <= 255);
 #endif
-    fprintf_s(out, "\033[48;5;%dm", color_code);
+    if (color_code < 0 || color_code > 255) {
+        fprintf_s(out, ESC"[48;5;%dm", color_code);
+        return;
+    }
+    fputs(SEQS_BG_COLOR_256[color_code].str, out);
 }
 
 void termutils_reset_bg_color(FILE *const out) {
-    fputs("\033[49m", out);
+    fputs(SEQS_BG_COLOR[TERMUTILS_COLOR_DEFAULT].str, out);
 }
 
 void termutils_reset_all(FILE *const out) {
-    fputs("\033[0m", out);
+    fputs(SEQ_RESET_ALL.str, out);
 }
 
 void termutils_set_cursor_color(const char* color_str, FILE *const out) {
@@ -406,7 +314,26 @@ void termutils_set_cursor_color(const char* color_str, FILE *const out) {
 }
 
 void termutils_reset_cursor_color(FILE *const out) {
-    fprintf_s(out, "\x1b]112\x07");
+    fputs(SEQ_RESET_CURSOR_COLOR.str, out);
+}
+
+static size_t write_seq(
+        char *const buf, size_t maxlen, const esc_seq *const seq)
+{
+    assert(buf != NULL);
+    assert(seq != NULL);
+
+    if (seq->len >= maxlen) return 0;
+    memcpy(buf, seq->str, seq->len + 1);
+
+    return seq->len;
+}
+
+static const esc_seq *basic_color_seq(
+        const esc_seq *const seqs, termutils_color color)
+{
+    if ((unsigned) color >= N_BASIC_COLORS) return NULL;
+    return &seqs[color];
 }
 
 static size_t write_if_fits(
@@ -422,3 +349,13 @@ static size_t write_if_fits(
 
     return len;
 }
+
+static size_t write_color_256_fallback(
+        char *const buf, size_t maxlen, bool bg, int color_code)
+{
+    char seq[ESC_SEQ_COLOR_ANY_MAX_LEN + 1];
+    if (bg) sprintf_s(seq, sizeof(seq), ESC"[48;5;%dm", color_code);
+    else sprintf_s(seq, sizeof(seq), ESC"[38;5;%dm", color_code);
+
+    return write_if_fits(buf, maxlen, seq);
+}
@@ -0,0 +1,241 @@
+#include "termkeys.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define ESC_BYTE 0x1B
+#define DEL_BYTE 0x7F
+
+// Largest parameter value kept; bigger ones are clamped to it.
+#define TERMKEYS_MAX_PARAM_VALUE 99999
+
+// SGR mouse button codes: wheel events have this bit set, and the low bits say
+// which way. Shift, Alt and Ctrl add 4, 8 and 16; motion adds 32.
+#define MOUSE_WHEEL_BIT 64
+#define MOUSE_MODIFIER_BITS (4 | 8 | 16 | 32)
+
+typedef struct event_sink {
+    termkey_event *events;
+    size_t max_events;
+    size_t n_events;
+} event_sink;
+
+// Returns the event stored, or NULL if there's no more room.
+static termkey_event *emit(event_sink *const sink, termkey_kind kind, char ch,
+        bool alt);
+
+// Handles a byte outside of any sequence; 'alt' if an ESC came before it.
+static void ground_byte(termkeys_decoder *const dec, event_sink *const sink,
+        unsigned char c, bool alt);
+static void csi_byte(termkeys_decoder *const dec, event_sink *const sink,
+        unsigned char c);
+static void ss3_byte(termkeys_decoder *const dec, event_sink *const sink,
+        unsigned char c);
+static void start_csi(termkeys_decoder *const dec);
+
+// Emits whatever the complete CSI sequence that ended in 'final' stands for,
+// if anything.
+static void dispatch_csi(const termkeys_decoder *const dec,
+        event_sink *const sink, unsigned char final);
+
+// The key "ESC [ <p> ~" stands for, or -1 for none.
+static int tilde_key(int p);
+// The key a final byte stands for in "ESC [ A", "ESC O A" and the like, or -1.
+static int letter_key(unsigned char final);
+
+size_t termkeys_decode(termkeys_decoder *const dec, const char *const s,
+        size_t len, termkey_event *const events, size_t max_events)
+{
+    assert(dec != NULL);
+    assert(s != NULL || len == 0);
+    assert(events != NULL || max_events == 0);
+
+    event_sink sink = { events, max_events, 0 };
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char) s[i];
+        switch (dec->state) {
+        case TERMKEYS_GROUND:
+            ground_byte(dec, &sink, c, false);
+            break;
+        case TERMKEYS_ESC:
+            if (c == '[') start_csi(dec);
+            else if (c == 'O') dec->state = TERMKEYS_SS3;
+            else if (c == ESC_BYTE) {
+                // The first ESC was the Escape key; this one starts anew.
+                emit(&sink, TERMKEY_ESCAPE, 0, false);
+            }
+            else {
+                dec->state = TERMKEYS_GROUND;
+                ground_byte(dec, &sink, c, true);
+            }
+            break;
+        case TERMKEYS_CSI:
+            csi_byte(dec, &sink, c);
+            break;
+        case TERMKEYS_SS3:
+            ss3_byte(dec, &sink, c);
+            break;
+        }
+    }
+    return sink.n_events;
+}
+
+size_t termkeys_flush(termkeys_decoder *const dec,
+        termkey_event *const events, size_t max_events)
+{
+    assert(dec != NULL);
+    assert(events != NULL || max_events == 0);
+
+    event_sink sink = { events, max_events, 0 };
+    if (dec->state == TERMKEYS_ESC) emit(&sink, TERMKEY_ESCAPE, 0, false);
+    dec->state = TERMKEYS_GROUND;
+    return sink.n_events;
+}
+
+bool termkeys_pending(const termkeys_decoder *const dec) {
+    assert(dec != NULL);
+    return dec->state != TERMKEYS_GROUND;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static termkey_event *emit(event_sink *const sink, termkey_kind kind, char ch,
+        bool alt)
+{
+    if (sink->n_events == sink->max_events) return NULL;
+    termkey_event *const ev = &sink->events[sink->n_events++];
+    memset(ev, 0, sizeof(*ev));
+    ev->kind = kind;
+    ev->ch = ch;
+    ev->alt = alt;
+    return ev;
+}
+
+static void ground_byte(termkeys_decoder *const dec, event_sink *const sink,
+        unsigned char c, bool alt)
+{
+    if (c == ESC_BYTE) dec->state = TERMKEYS_ESC;
+    // Raw mode leaves Enter as CR; a pasted LF counts the same.
+    else if (c == '\r' || c == '\n') emit(sink, TERMKEY_ENTER, 0, alt);
+    else if (c == '\t') emit(sink, TERMKEY_TAB, 0, alt);
+    else if (c == DEL_BYTE || c == '\b') emit(sink, TERMKEY_BACKSPACE, 0, alt);
+    // Other control characters (Ctrl+letter) aren't bound to anything.
+    else if (c >= 0x20) emit(sink, TERMKEY_CHAR, (char) c, alt);
+}
+
+static void csi_byte(termkeys_decoder *const dec, event_sink *const sink,
+        unsigned char c)
+{
+    if (c >= '0' && c <= '9') {
+        if (dec->n_params < TERMKEYS_MAX_PARAMS) {
+            int *const p = &dec->params[dec->n_params];
+            *p = *p * 10 + (c - '0');
+            if (*p > TERMKEYS_MAX_PARAM_VALUE) *p = TERMKEYS_MAX_PARAM_VALUE;
+        }
+        dec->param_started = true;
+    }
+    else if (c == ';' || c == ':') {
+        if (dec->n_params < TERMKEYS_MAX_PARAMS) dec->n_params++;
+        if (dec->n_params < TERMKEYS_MAX_PARAMS) dec->params[dec->n_params] = 0;
+        dec->param_started = false;
+    }
+    else if (c >= '<' && c <= '?') {
+        dec->private_marker = (char) c;
+    }
+    else if (c >= 0x20 && c <= 0x2F) {
+        dec->intermediate = (char) c;
+    }
+    else if (c >= 0x40 && c <= 0x7E) {
+        if (dec->param_started && dec->n_params < TERMKEYS_MAX_PARAMS)
+            dec->n_params++;
+        dec->state = TERMKEYS_GROUND;
+        dispatch_csi(dec, sink, c);
+    }
+    else if (c == ESC_BYTE) {
+        // Cut short by the start of another.
+        dec->state = TERMKEYS_ESC;
+    }
+    // Any other control character in a sequence is ignored, like terminals
+    // do.
+}
+
+static void ss3_byte(termkeys_decoder *const dec, event_sink *const sink,
+        unsigned char c)
+{
+    dec->state = TERMKEYS_GROUND;
+    int key = letter_key(c);
+    if (key >= 0) emit(sink, (termkey_kind) key, 0, false);
+}
+
+static void start_csi(termkeys_decoder *const dec) {
+    dec->state = TERMKEYS_CSI;
+    memset(dec->params, 0, sizeof(dec->params));
+    dec->n_params = 0;
+    dec->param_started = false;
+    dec->private_marker = 0;
+    dec->intermediate = 0;
+}
+
+static void dispatch_csi(const termkeys_decoder *const dec,
+        event_sink *const sink, unsigned char final)
+{
+    int p0 = dec->n_params > 0 ? dec->params[0] : 0;
+
+    if (dec->private_marker == '<') {
+        // SGR mouse: "ESC [ < button ; col ; row M" on press, 'm' on release.
+        // Only the wheel is of interest, and it has no release.
+        int button = p0 & ~MOUSE_MODIFIER_BITS;
+        if (final != 'M' || !(button & MOUSE_WHEEL_BIT)) return;
+        if (button == MOUSE_WHEEL_BIT) emit(sink, TERMKEY_WHEEL_UP, 0, false);
+        else if (button == (MOUSE_WHEEL_BIT | 1)) {
+            emit(sink, TERMKEY_WHEEL_DOWN, 0, false);
+        }
+        return;
+    }
+
+    if (dec->private_marker == '?') {
+        // DECRPM: "ESC [ ? mode ; status $ y".
+        if (final != 'y' || dec->intermediate != '$' || dec->n_params < 2)
+            return;
+        int status = dec->params[1];
+        if (status > TERMREPLY_MODE_PERMANENTLY_RESET) return;
+        termkey_event *const ev = emit(sink, TERMKEY_MODE_REPORT, 0, false);
+        if (ev != NULL) {
+            ev->mode = p0;
+            ev->status = (termreply_mode_status) status;
+        }
+        return;
+    }
+
+    if (dec->private_marker != 0 || dec->intermediate != 0) return;
+
+    // A second parameter is 1 + the modifiers held: Shift 1, Alt 2, Ctrl 4.
+    bool alt = dec->n_params > 1 && ((dec->params[1] - 1) & 2);
+    int key = final == '~' ? tilde_key(p0) : letter_key(final);
+    if (key >= 0) emit(sink, (termkey_kind) key, 0, alt);
+}
+
+static int tilde_key(int p) {
+    switch (p) {
+    case 1: case 7: return TERMKEY_HOME;
+    case 2: return TERMKEY_INSERT;
+    case 3: return TERMKEY_DELETE;
+    case 4: case 8: return TERMKEY_END;
+    case 5: return TERMKEY_PAGE_UP;
+    case 6: return TERMKEY_PAGE_DOWN;
+    default: return -1;
+    }
+}
+
+static int letter_key(unsigned char final) {
+    switch (final) {
+    case 'A': return TERMKEY_UP;
+    case 'B': return TERMKEY_DOWN;
+    case 'C': return TERMKEY_RIGHT;
+    case 'D': return TERMKEY_LEFT;
+    case 'H': return TERMKEY_HOME;
+    case 'F': return TERMKEY_END;
+    default: return -1;
+    }
+}
@@ -0,0 +1,12 @@
+#include "termreply.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+size_t termreply_query_mode(char *const buf, size_t bufsize, int mode) {
+    assert(buf != NULL);
+    assert(mode >= 0);
+
+    int len = sprintf_s(buf, bufsize, "\033[?%d$p", mode);
+    return len > 0 ? (size_t) len : 0;
+}
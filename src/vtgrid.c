@@ -0,0 +1,790 @@
+#define LOG_MODULE LOGMODULE_SCREEN
+
+#include "vtgrid.h"
+
+#include "log.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ESC '\033'
+
+// Most parameters of one CSI sequence looked at. SGR with more than this is
+// cut short.
+#define VTGRID_MAX_PARAMS 16
+
+// An unchanged run of at most this many cells between two changed ones is
+// printed again rather than jumped over: a cursor move costs about as much.
+#define VTGRID_MAX_GAP 4
+
+// A row whose new content ends in at least this many blank cells of one style
+// has them cleared with EL instead of printed.
+#define VTGRID_MIN_EL 4
+
+// Output reserved per cell when the grid is sized. A full repaint of chat
+// text takes about 1-2 bytes a cell and one with a colour change every few
+// cells several times that, so this covers all but the busiest frames without
+// reallocating.
+#define VTGRID_OUT_BYTES_PER_CELL 12
+
+// Begin and end synchronized update (DEC private mode 2026).
+#define SYNC_BEGIN "\033[?2026h"
+#define SYNC_END "\033[?2026l"
+#define SYNC_LEN (sizeof(SYNC_BEGIN) - 1)
+
+static const vtstyle DEFAULT_STYLE = { VTCOLOR_DEFAULT, VTCOLOR_DEFAULT, 0 };
+
+static void *realloc_or_die(void *ptr, size_t size);
+
+static bool cell_eq(const vtcell *const a, const vtcell *const b);
+static bool cell_is_blank(const vtcell *const c);
+static void blank_cells(vtcell *const cells, size_t n, uint32_t bg);
+
+// Columns taken by the character 'cp': 2 for East Asian wide and emoji
+// ranges, otherwise 1.
+static int char_width(uint32_t cp);
+
+/////////////////////////////// Writing a frame ///////////////////////////////
+
+// Handles the escape sequence starting at s[i] (an ESC) and returns the index
+// just past it.
+static size_t write_escape(vtgrid *const g, const char *const s, size_t len,
+        size_t i);
+static void apply_csi(vtgrid *const g, char final, const int *const params,
+        int n_params);
+static void erase_cells(vtgrid *const g, int row, int from, int to);
+
+// Moves the back buffer's rows [top, bottom) up by 'n' rows (down if
+// negative), blanking the rows left behind with 'bg'.
+static void shift_rows(vtcell *const cells, int cols, int top, int bottom,
+        int n, uint32_t bg);
+static void put_char(vtgrid *const g, const char *const ch, int n, int width);
+
+// Writes the run of single-byte characters starting at s[i], as far as the
+// current row goes, and returns the index just past it.
+static size_t write_text(vtgrid *const g, const char *const s, size_t len,
+        size_t i);
+static void new_line(vtgrid *const g);
+
+////////////////////////////// Presenting a frame /////////////////////////////
+
+static void out_put(vtgrid *const g, const char *const s, size_t n);
+static void out_uint(vtgrid *const g, unsigned v);
+static void move_to(vtgrid *const g, int row, int col);
+static void set_pen(vtgrid *const g, const vtstyle *const style);
+
+// Returns how many rows the content of the scroll region moved up (positive)
+// or down (negative) since the front buffer, if it moved as a block and
+// scrolling it saves redrawing rows; otherwise 0.
+static int find_shift(const vtgrid *const g);
+
+// Scrolls the terminal's copy of the scroll region by 'n' rows (see
+// find_shift()) and shifts the front buffer to match.
+static void scroll_region(vtgrid *const g, int n);
+
+static size_t fmt_uint(unsigned v, char *const buf);
+
+// Prints the back buffer's cell at 'col' of 'row', which is where the
+// terminal's cursor is, and returns the column after it.
+static int emit_cell(vtgrid *const g, int row, int col);
+static void present_row(vtgrid *const g, int row);
+
+void vtgrid_free(vtgrid *const g) {
+    assert(g != NULL);
+    free(g->front);
+    free(g->back);
+    free(g->out);
+    memset(g, 0, sizeof(*g));
+}
+
+void vtgrid_resize(vtgrid *const g, int rows, int cols) {
+    assert(g != NULL);
+    assert(rows > 0 && cols > 0);
+    if (rows == g->rows && cols == g->cols && g->front != NULL) return;
+
+    size_t n = (size_t) rows * cols;
+    g->front = realloc_or_die(g->front, n * sizeof(vtcell));
+    g->back = realloc_or_die(g->back, n * sizeof(vtcell));
+    g->rows = rows;
+    g->cols = cols;
+    blank_cells(g->back, n, VTCOLOR_DEFAULT);
+    if (g->out_cap < n * VTGRID_OUT_BYTES_PER_CELL) {
+        g->out_cap = n * VTGRID_OUT_BYTES_PER_CELL;
+        g->out = realloc_or_die(g->out, g->out_cap);
+    }
+    g->row = g->col = 0;
+    g->wrap_pending = false;
+    g->margin_top = 0;
+    g->margin_bottom = rows;
+    g->scroll_top = g->scroll_bottom = 0;
+    g->cursor_row = g->cursor_col = -1;
+    vtgrid_invalidate(g);
+}
+
+void vtgrid_invalidate(vtgrid *const g) {
+    assert(g != NULL);
+    g->front_valid = false;
+}
+
+void vtgrid_begin(vtgrid *const g) {
+    assert(g != NULL);
+    assert(g->back != NULL);
+    blank_cells(g->back, (size_t) g->rows * g->cols, VTCOLOR_DEFAULT);
+    g->row = g->col = 0;
+    g->wrap_pending = false;
+    g->pen = DEFAULT_STYLE;
+    g->margin_top = 0;
+    g->margin_bottom = g->rows;
+    g->scroll_top = g->scroll_bottom = 0;
+    g->cursor_row = g->cursor_col = -1;
+}
+
+void vtgrid_write(vtgrid *const g, const char *const s, size_t len) {
+    assert(g != NULL);
+    assert(g->back != NULL);
+    assert(s != NULL || len == 0);
+
+    size_t i = 0;
+    while (i < len) {
+        unsigned char c = (unsigned char) s[i];
+        if (c == ESC) {
+            i = write_escape(g, s, len, i);
+        }
+        else if (c == '\n') {
+            new_line(g);
+            i++;
+        }
+        else if (c == '\r') {
+            g->col = 0;
+            g->wrap_pending = false;
+            i++;
+        }
+        else if (c < 0x20 || c == 0x7F) {
+            i++;
+        }
+        else if (c < 0x80 || !g->utf8) {
+            i = write_text(g, s, len, i);
+        }
+        else {
+            // Decode one UTF-8 sequence. A malformed one is shown by the
+            // terminal as a single replacement character, so it's taken as
+            // one narrow cell of U+FFFD.
+            int n = c >= 0xF0 && c < 0xF8 ? 4 :
+                    c >= 0xE0 ? 3 :
+                    c >= 0xC0 ? 2 : 1;
+            uint32_t cp = n == 4 ? c & 0x07 : n == 3 ? c & 0x0F : c & 0x1F;
+            bool ok = n > 1 && i + n <= len;
+            for (int k = 1; ok && k < n; k++) {
+                unsigned char cc = (unsigned char) s[i + k];
+                ok = (cc & 0xC0) == 0x80;
+                cp = (cp << 6) | (cc & 0x3F);
+            }
+            if (ok) {
+                put_char(g, s + i, n, char_width(cp));
+                i += n;
+            }
+            else {
+                put_char(g, "\xEF\xBF\xBD", 3, 1);
+                i++;
+            }
+        }
+    }
+}
+
+void vtgrid_puts(vtgrid *const g, const char *const s) {
+    assert(s != NULL);
+    vtgrid_write(g, s, strlen(s));
+}
+
+void vtgrid_set_scroll_region(vtgrid *const g, int top, int bottom) {
+    assert(g != NULL);
+    assert(top >= 0 && top <= bottom);
+    g->scroll_top = top;
+    g->scroll_bottom = bottom < g->rows ? bottom : g->rows;
+}
+
+void vtgrid_set_cursor(vtgrid *const g, int row, int col) {
+    assert(g != NULL);
+    g->cursor_row = row;
+    g->cursor_col = col;
+}
+
+const char *vtgrid_present(vtgrid *const g, size_t *const len) {
+    assert(g != NULL);
+    assert(g->back != NULL);
+    assert(len != NULL);
+
+    g->out_len = 0;
+    g->stats.last_cells = 0;
+    // Taken back out if nothing changed.
+    if (g->sync_output) out_put(g, SYNC_BEGIN, SYNC_LEN);
+    const size_t frame_start = g->out_len;
+    if (!g->front_valid) {
+        // Start over from a cleared screen, which the front buffer then
+        // describes exactly.
+        out_put(g, "\033[0m\033[2J", 8);
+        g->term_pen = DEFAULT_STYLE;
+        g->term_row = -1;
+        blank_cells(g->front, (size_t) g->rows * g->cols, VTCOLOR_DEFAULT);
+        g->front_valid = true;
+    }
+
+    int shift = find_shift(g);
+    if (shift != 0) scroll_region(g, shift);
+
+    for (int row = 0; row < g->rows; row++) present_row(g, row);
+
+    if (g->cursor_row >= 0 && g->cursor_row < g->rows &&
+        g->cursor_col >= 0 && g->cursor_col < g->cols)
+    {
+        move_to(g, g->cursor_row, g->cursor_col);
+    }
+
+    if (g->sync_output) {
+        if (g->out_len == frame_start) g->out_len = 0;
+        else out_put(g, SYNC_END, SYNC_LEN);
+    }
+
+    // The frame just presented is now what the terminal shows. The old front
+    // buffer is blanked by the next vtgrid_begin().
+    vtcell *const tmp = g->front;
+    g->front = g->back;
+    g->back = tmp;
+
+    g->stats.frames++;
+    g->stats.bytes += g->out_len;
+    g->stats.cells += g->stats.last_cells;
+    g->stats.last_bytes = g->out_len;
+    *len = g->out_len;
+    return g->out;
+}
+
+uint64_t vtgrid_hash(const vtgrid *const g) {
+    assert(g != NULL);
+
+    // FNV-1a, over the fields a byte at a time so byte order doesn't matter.
+    uint64_t h = 14695981039346656037ull;
+    uint32_t size[2] = { (uint32_t) g->rows, (uint32_t) g->cols };
+    for (int i = 0; i < 2; i++) {
+        for (int b = 0; b < 32; b += 8) {
+            h = (h ^ ((size[i] >> b) & 0xFF)) * 1099511628211ull;
+        }
+    }
+    size_t n = g->back != NULL ? (size_t) g->rows * g->cols : 0;
+    for (size_t i = 0; i < n; i++) {
+        const vtcell *const c = &g->back[i];
+        for (int k = 0; k < 4; k++) {
+            h = (h ^ (uint8_t) c->ch[k]) * 1099511628211ull;
+        }
+        uint32_t fields[3] = { c->style.fg, c->style.bg, c->style.attrs };
+        for (int f = 0; f < 3; f++) {
+            for (int b = 0; b < 32; b += 8) {
+                h = (h ^ ((fields[f] >> b) & 0xFF)) * 1099511628211ull;
+            }
+        }
+    }
+    return h;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static void *realloc_or_die(void *ptr, size_t size) {
+    void *new_ptr = realloc(ptr, size);
+    if (new_ptr == NULL) {
+        // TODO: communicate fatal error
+        log(LOGLEVEL_ERROR, "[vtgrid] FATAL: out of memory.");
+        exit(23);
+    }
+    return new_ptr;
+}
+
+static bool cell_eq(const vtcell *const a, const vtcell *const b) {
+    // vtcell has no padding, so this compares exactly its fields.
+    return memcmp(a, b, sizeof(vtcell)) == 0;
+}
+
+static bool cell_is_blank(const vtcell *const c) {
+    return c->ch[0] == ' ' && c->ch[1] == '\0' &&
+           c->style.fg == VTCOLOR_DEFAULT && c->style.attrs == 0;
+}
+
+static void blank_cells(vtcell *const cells, size_t n, uint32_t bg) {
+    if (n == 0) return;
+    memset(&cells[0], 0, sizeof(vtcell));
+    cells[0].ch[0] = ' ';
+    cells[0].style.bg = bg;
+    // Copying in doubling chunks is several times faster than a cell at a
+    // time, and this runs over the whole grid every frame.
+    for (size_t done = 1; done < n; done *= 2) {
+        size_t chunk = done < n - done ? done : n - done;
+        memcpy(cells + done, cells, chunk * sizeof(vtcell));
+    }
+}
+
+static int char_width(uint32_t cp) {
+    // The ranges terminals agree are wide; anything else is drawn in one cell.
+    static const uint32_t WIDE[][2] = {
+        { 0x1100, 0x115F }, { 0x2E80, 0x303E }, { 0x3041, 0x33FF },
+        { 0x3400, 0x4DBF }, { 0x4E00, 0x9FFF }, { 0xA000, 0xA4CF },
+        { 0xAC00, 0xD7A3 }, { 0xF900, 0xFAFF }, { 0xFE30, 0xFE4F },
+        { 0xFF00, 0xFF60 }, { 0xFFE0, 0xFFE6 }, { 0x1F300, 0x1F64F },
+        { 0x1F900, 0x1F9FF }, { 0x20000, 0x3FFFD }
+    };
+    if (cp < WIDE[0][0]) return 1;
+    for (size_t i = 0; i < sizeof(WIDE) / sizeof(WIDE[0]); i++) {
+        if (cp < WIDE[i][0]) return 1;
+        if (cp <= WIDE[i][1]) return 2;
+    }
+    return 1;
+}
+
+static size_t write_escape(vtgrid *const g, const char *const s, size_t len,
+        size_t i)
+{
+    assert(s[i] == ESC);
+    i++;
+    if (i >= len) return i;
+
+    if (s[i] == ']') {
+        // OSC: runs to BEL or ST (ESC \).
+        for (i++; i < len; i++) {
+            if (s[i] == '\a') return i + 1;
+            if (s[i] == ESC && i + 1 < len && s[i + 1] == '\\') return i + 2;
+        }
+        return i;
+    }
+    if (s[i] != '[') {
+        // Two-character escapes (and "ESC 7" style ones with a space in
+        // between). None of them affect the cells.
+        if (s[i] == ' ' && i + 1 < len) return i + 2;
+        return i + 1;
+    }
+
+    // CSI: parameter bytes, intermediate bytes, then the final byte.
+    int params[VTGRID_MAX_PARAMS];
+    int n_params = 0;
+    int cur = -1;
+    bool private_mode = false;
+    for (i++; i < len; i++) {
+        unsigned char c = (unsigned char) s[i];
+        if (c >= '0' && c <= '9') {
+            cur = (cur < 0 ? 0 : cur) * 10 + (c - '0');
+            if (cur > 99999) cur = 99999;
+        }
+        else if (c == ';' || c == ':') {
+            if (n_params < VTGRID_MAX_PARAMS) params[n_params++] = cur;
+            cur = -1;
+        }
+        else if (c >= 0x3C && c <= 0x3F) {
+            private_mode = true;
+        }
+        else if (c >= 0x40 && c <= 0x7E) {
+            if (n_params < VTGRID_MAX_PARAMS) params[n_params++] = cur;
+            if (!private_mode) apply_csi(g, (char) c, params, n_params);
+            return i + 1;
+        }
+        else if (c < 0x20 || c > 0x2F) {
+            // Not a valid sequence; give up on it here.
+            return i;
+        }
+    }
+    return i;
+}
+
+static void apply_csi(vtgrid *const g, char final, const int *const params,
+        int n_params)
+{
+    // Missing parameters are -1; most sequences take them as 1.
+    int p1 = params[0] > 0 ? params[0] : 1;
+    int p2 = n_params > 1 && params[1] > 0 ? params[1] : 1;
+
+    switch (final) {
+    case 'm':
+        vtstyle_apply_sgr(&g->pen, params, n_params);
+        break;
+    case 'H':
+    case 'f':
+        g->row = p1 <= g->rows ? p1 - 1 : g->rows - 1;
+        g->col = p2 <= g->cols ? p2 - 1 : g->cols - 1;
+        g->wrap_pending = false;
+        break;
+    case 'G':
+        g->col = p1 <= g->cols ? p1 - 1 : g->cols - 1;
+        g->wrap_pending = false;
+        break;
+    case 'C':
+        g->col = g->col + p1 < g->cols ? g->col + p1 : g->cols - 1;
+        g->wrap_pending = false;
+        break;
+    case 'E':
+        g->row = g->row + p1 < g->rows ? g->row + p1 : g->rows - 1;
+        g->col = 0;
+        g->wrap_pending = false;
+        break;
+    case 'r':
+        // Margins of one row or an inverted range are ignored, as terminals
+        // do.
+        p2 = n_params > 1 && params[1] > 0 && params[1] <= g->rows ?
+             params[1] : g->rows;
+        if (p1 >= p2) break;
+        g->margin_top = p1 - 1;
+        g->margin_bottom = p2;
+        g->row = g->col = 0;
+        g->wrap_pending = false;
+        break;
+    case 'S':
+        shift_rows(g->back, g->cols, g->margin_top, g->margin_bottom, p1,
+                g->pen.bg);
+        break;
+    case 'T':
+        shift_rows(g->back, g->cols, g->margin_top, g->margin_bottom, -p1,
+                g->pen.bg);
+        break;
+    case 'K':
+        if (params[0] <= 0) erase_cells(g, g->row, g->col, g->cols);
+        else if (params[0] == 1) erase_cells(g, g->row, 0, g->col + 1);
+        else if (params[0] == 2) erase_cells(g, g->row, 0, g->cols);
+        break;
+    case 'J':
+        if (params[0] <= 0) {
+            erase_cells(g, g->row, g->col, g->cols);
+            for (int r = g->row + 1; r < g->rows; r++)
+                erase_cells(g, r, 0, g->cols);
+        }
+        else if (params[0] == 1) {
+            for (int r = 0; r < g->row; r++) erase_cells(g, r, 0, g->cols);
+            erase_cells(g, g->row, 0, g->col + 1);
+        }
+        else if (params[0] == 2 || params[0] == 3) {
+            for (int r = 0; r < g->rows; r++) erase_cells(g, r, 0, g->cols);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void erase_cells(vtgrid *const g, int row, int from, int to) {
+    assert(row >= 0 && row < g->rows);
+    if (from < 0) from = 0;
+    if (to > g->cols) to = g->cols;
+    if (from >= to) return;
+    // Erased cells take the pen's background, as terminals with background
+    // colour erase do.
+    blank_cells(g->back + (size_t) row * g->cols + from, to - from, g->pen.bg);
+    g->wrap_pending = false;
+}
+
+static void shift_rows(vtcell *const cells, int cols, int top, int bottom,
+        int n, uint32_t bg)
+{
+    assert(top >= 0 && top <= bottom);
+    int height = bottom - top;
+    int by = n < 0 ? -n : n;
+    if (by > height) by = height;
+    int kept = height - by;
+    vtcell *const region = cells + (size_t) top * cols;
+    size_t row_cells = (size_t) cols;
+
+    if (n > 0) {
+        memmove(region, region + by * row_cells,
+                kept * row_cells * sizeof(vtcell));
+        blank_cells(region + kept * row_cells, by * row_cells, bg);
+    }
+    else if (n < 0) {
+        memmove(region + by * row_cells, region,
+                kept * row_cells * sizeof(vtcell));
+        blank_cells(region, by * row_cells, bg);
+    }
+}
+
+static void put_char(vtgrid *const g, const char *const ch, int n, int width) {
+    assert(n >= 1 && n <= 4);
+    if (g->wrap_pending) {
+        g->row++;
+        g->col = 0;
+        g->wrap_pending = false;
+    }
+    if (width == 2 && g->col == g->cols - 1) {
+        // A wide character doesn't fit in the last column, so the terminal
+        // wraps it to the next row.
+        if (g->row < g->rows) erase_cells(g, g->row, g->col, g->cols);
+        g->row++;
+        g->col = 0;
+    }
+    if (g->row >= g->rows) return;
+
+    vtcell *const cell = g->back + (size_t) g->row * g->cols + g->col;
+    memset(cell->ch, 0, sizeof(cell->ch));
+    memcpy(cell->ch, ch, n);
+    cell->style = g->pen;
+    if (width == 2 && g->cols > 1) {
+        memset(cell[1].ch, 0, sizeof(cell[1].ch));
+        cell[1].style = g->pen;
+    }
+
+    g->col += width;
+    if (g->col >= g->cols) {
+        g->col = g->cols - 1;
+        g->wrap_pending = true;
+    }
+}
+
+static size_t write_text(vtgrid *const g, const char *const s, size_t len,
+        size_t i)
+{
+    // The first character may wrap or be dropped; put_char() handles that.
+    put_char(g, s + i, 1, 1);
+    i++;
+    if (g->wrap_pending || g->row >= g->rows) return i;
+
+    const vtstyle pen = g->pen;
+    vtcell *const row = g->back + (size_t) g->row * g->cols;
+    int col = g->col;
+    // Leave the last column to put_char(), which sets up the wrap.
+    while (i < len && col < g->cols - 1) {
+        unsigned char c = (unsigned char) s[i];
+        if (c < 0x20 || c == 0x7F || (c >= 0x80 && g->utf8)) break;
+        vtcell *const cell = &row[col++];
+        cell->ch[0] = (char) c;
+        cell->ch[1] = cell->ch[2] = cell->ch[3] = '\0';
+        cell->style = pen;
+        i++;
+    }
+    g->col = col;
+    return i;
+}
+
+static void new_line(vtgrid *const g) {
+    // A newline right after the last column was written just ends the row
+    // the wrap already left.
+    g->row++;
+    g->col = 0;
+    g->wrap_pending = false;
+}
+
+static void out_put(vtgrid *const g, const char *const s, size_t n) {
+    if (g->out_len + n > g->out_cap) {
+        size_t cap = g->out_cap;
+        while (cap < g->out_len + n) cap *= 2;
+        g->out = realloc_or_die(g->out, cap);
+        g->out_cap = cap;
+    }
+    memcpy(g->out + g->out_len, s, n);
+    g->out_len += n;
+}
+
+static void out_uint(vtgrid *const g, unsigned v) {
+    char buf[16];
+    out_put(g, buf, fmt_uint(v, buf));
+}
+
+static void move_to(vtgrid *const g, int row, int col) {
+    if (g->term_row == row && g->term_col == col) return;
+
+    if (g->term_row == row && col == 0) {
+        out_put(g, "\r", 1);
+    }
+    else if (g->term_row == row && col > g->term_col) {
+        out_put(g, "\033[", 2);
+        if (col - g->term_col > 1) out_uint(g, col - g->term_col);
+        out_put(g, "C", 1);
+    }
+    else if (g->term_row == row) {
+        out_put(g, "\033[", 2);
+        if (col > 0) out_uint(g, col + 1);
+        out_put(g, "G", 1);
+    }
+    else if (g->term_row >= 0 && row == g->term_row + 1 && col == 0) {
+        out_put(g, "\r\n", 2);
+    }
+    else {
+        out_put(g, "\033[", 2);
+        if (row > 0 || col > 0) out_uint(g, row + 1);
+        if (col > 0) {
+            out_put(g, ";", 1);
+            out_uint(g, col + 1);
+        }
+        out_put(g, "H", 1);
+    }
+    g->term_row = row;
+    g->term_col = col;
+}
+
+static void set_pen(vtgrid *const g, const vtstyle *const style) {
+    char seq[VTSTYLE_SGR_MAXLEN];
+    out_put(g, seq, vtstyle_sgr(&g->term_pen, style, seq));
+    g->term_pen = *style;
+}
+
+static int find_shift(const vtgrid *const g) {
+    const int top = g->scroll_top, height = g->scroll_bottom - g->scroll_top;
+    if (height < 2) return 0;
+
+    const int cols = g->cols;
+    const size_t row_bytes = sizeof(vtcell) * cols;
+    const vtcell *const front = g->front + (size_t) top * cols;
+    const vtcell *const back = g->back + (size_t) top * cols;
+
+    // Rows that would be redrawn as things stand.
+    int changed = 0;
+    for (int i = 0; i < height; i++) {
+        if (memcmp(front + (size_t) i * cols, back + (size_t) i * cols,
+                   row_bytes) != 0)
+        {
+            changed++;
+        }
+    }
+    if (changed == 0) return 0;
+
+    // Moving by 'n' leaves the 'n' rows scrolled in to draw, plus any kept row
+    // that doesn't line up with its new content (e.g., the log's last row was
+    // blank before and isn't now). Take the move that leaves the fewest, if
+    // that's fewer than drawing the changed rows where they are. Rows rarely
+    // repeat, so most comparisons fail within their first few cells.
+    int best_n = 0, best_cost = changed;
+    for (int n = 1; n < height && n < best_cost; n++) {
+        for (int dir = 1; dir >= -1; dir -= 2) {
+            int cost = n;
+            for (int i = 0; i < height - n && cost < best_cost; i++) {
+                int i_back = dir > 0 ? i : i + n;
+                int i_front = dir > 0 ? i + n : i;
+                if (memcmp(back + (size_t) i_back * cols,
+                           front + (size_t) i_front * cols, row_bytes) != 0)
+                {
+                    cost++;
+                }
+            }
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_n = dir * n;
+            }
+        }
+    }
+    return best_n;
+}
+
+static void scroll_region(vtgrid *const g, int n) {
+    // The rows scrolled in take the pen's background, so make it the
+    // default, as the front buffer will have them.
+    set_pen(g, &DEFAULT_STYLE);
+
+    out_put(g, "\033[", 2);
+    out_uint(g, g->scroll_top + 1);
+    out_put(g, ";", 1);
+    out_uint(g, g->scroll_bottom);
+    out_put(g, "r\033[", 3);
+    out_uint(g, n > 0 ? n : -n);
+    out_put(g, n > 0 ? "S" : "T", 1);
+    // Back to the whole screen, which also homes the cursor.
+    out_put(g, "\033[r", 3);
+    g->term_row = -1;
+
+    shift_rows(g->front, g->cols, g->scroll_top, g->scroll_bottom, n,
+            VTCOLOR_DEFAULT);
+    g->stats.scrolls++;
+}
+
+static size_t fmt_uint(unsigned v, char *const buf) {
+    char tmp[16];
+    size_t n = 0;
+    do {
+        tmp[n++] = (char) ('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    for (size_t i = 0; i < n; i++) buf[i] = tmp[n - 1 - i];
+    return n;
+}
+
+static int emit_cell(vtgrid *const g, int row, int col) {
+    const vtcell *const cell = g->back + (size_t) row * g->cols + col;
+    // The right half of a wide character was drawn along with its left half.
+    if (cell->ch[0] == '\0') return col + 1;
+
+    set_pen(g, &cell->style);
+    size_t n = 1;
+    while (n < sizeof(cell->ch) && cell->ch[n] != '\0') n++;
+    out_put(g, cell->ch, n);
+    g->stats.last_cells++;
+
+    int width = col + 1 < g->cols && cell[1].ch[0] == '\0' ? 2 : 1;
+    if (col + width >= g->cols || (unsigned char) cell->ch[0] >= 0x80) {
+        // Past the last column the cursor is left pending a wrap, and how far
+        // a non-ASCII character moves it is up to the terminal's idea of its
+        // width. Either way, make the next move an absolute one.
+        g->term_row = -1;
+    }
+    else {
+        g->term_col = col + width;
+    }
+    return col + width;
+}
+
+static void present_row(vtgrid *const g, int row) {
+    const vtcell *const front = g->front + (size_t) row * g->cols;
+    const vtcell *const back = g->back + (size_t) row * g->cols;
+    const int cols = g->cols;
+    if (memcmp(front, back, sizeof(vtcell) * cols) == 0) return;
+
+    // Where the row's trailing run of same-style blank cells begins.
+    int blank_from = cols;
+    while (blank_from > 0 && cell_is_blank(&back[blank_from - 1]) &&
+           back[blank_from - 1].style.bg == back[cols - 1].style.bg)
+    {
+        blank_from--;
+    }
+
+    int col = 0;
+    while (col < cols) {
+        if (cell_eq(&front[col], &back[col])) {
+            col++;
+            continue;
+        }
+        // Redraw a wide character as a whole.
+        if (back[col].ch[0] == '\0' && col > 0) col--;
+
+        if (col >= blank_from && cols - col >= VTGRID_MIN_EL) {
+            move_to(g, row, col);
+            set_pen(g, &back[col].style);
+            out_put(g, "\033[K", 3);
+            g->stats.last_cells += cols - col;
+            return;
+        }
+
+        move_to(g, row, col);
+        while (col < cols) {
+            if (cell_eq(&front[col], &back[col])) {
+                int gap = 1;
+                while (col + gap < cols &&
+                       cell_eq(&front[col + gap], &back[col + gap]))
+                {
+                    gap++;
+                }
+                if (col + gap == cols || gap > VTGRID_MAX_GAP) {
+                    col += gap;
+                    break;
+                }
+            }
+            if (col >= blank_from && cols - col >= VTGRID_MIN_EL) break;
+
+            // Most cells are ASCII in the style just used; those are a byte.
+            const vtcell *const cell = &back[col];
+            if ((unsigned char) cell->ch[0] < 0x80 && cell->ch[1] == '\0' &&
+                cell->ch[0] != '\0' && col + 1 < cols &&
+                g->out_len < g->out_cap &&
+                vtstyle_eq(&cell->style, &g->term_pen))
+            {
+                g->out[g->out_len++] = cell->ch[0];
+                g->stats.last_cells++;
+                g->term_col = ++col;
+                continue;
+            }
+            col = emit_cell(g, row, col);
+            // A non-ASCII character leaves the cursor somewhere uncertain;
+            // move explicitly before the next one.
+            if (g->term_row != row && col < cols) move_to(g, row, col);
+        }
+    }
+}
@@ -0,0 +1,226 @@
+#include "vtstyle.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Most parameters of one SGR sequence looked at; the rest are ignored.
+#define VTSTYLE_MAX_PARAMS 16
+
+typedef struct sgr_code {
+    uint32_t attr;
+    uint8_t on;
+    uint8_t off;
+} sgr_code;
+
+static const sgr_code SGR_CODES[] = {
+    { VTATTR_BOLD, 1, 22 },
+    { VTATTR_DIM, 2, 22 },
+    { VTATTR_ITALIC, 3, 23 },
+    { VTATTR_UNDERLINE, 4, 24 },
+    { VTATTR_BLINK, 5, 25 },
+    { VTATTR_REVERSE, 7, 27 },
+    { VTATTR_HIDDEN, 8, 28 },
+    { VTATTR_STRIKE, 9, 29 }
+};
+#define N_SGR_CODES (sizeof(SGR_CODES) / sizeof(SGR_CODES[0]))
+
+static const vtstyle DEFAULT_STYLE = { VTCOLOR_DEFAULT, VTCOLOR_DEFAULT, 0 };
+
+// Writes the SGR parameters that take the terminal from 'from' to 'to' into
+// 'buf', without the "\033[" and "m". Returns their length.
+static size_t sgr_delta(const vtstyle *const from, const vtstyle *const to,
+        char *const buf);
+static size_t sgr_color(uint32_t color, bool bg, char *const buf);
+static size_t fmt_uint(unsigned v, char *const buf);
+
+bool vtstyle_eq(const vtstyle *const a, const vtstyle *const b) {
+    return a->fg == b->fg && a->bg == b->bg && a->attrs == b->attrs;
+}
+
+void vtstyle_apply_sgr(vtstyle *const style, const int *const params,
+        int n_params)
+{
+    assert(style != NULL);
+    assert(params != NULL || n_params == 0);
+
+    for (int i = 0; i < n_params; i++) {
+        int p = params[i] < 0 ? 0 : params[i];
+        if (p == 0) {
+            *style = DEFAULT_STYLE;
+        }
+        else if (p == 38 || p == 48) {
+            uint32_t *const color = p == 38 ? &style->fg : &style->bg;
+            if (i + 2 < n_params && params[i + 1] == 5) {
+                *color = VTCOLOR_256 | (uint32_t) (params[i + 2] & 0xFF);
+                i += 2;
+            }
+            else if (i + 4 < n_params && params[i + 1] == 2) {
+                *color = VTCOLOR_RGB |
+                         (uint32_t) (params[i + 2] & 0xFF) << 16 |
+                         (uint32_t) (params[i + 3] & 0xFF) << 8 |
+                         (uint32_t) (params[i + 4] & 0xFF);
+                i += 4;
+            }
+            else {
+                // Malformed; the rest of the sequence can't be trusted.
+                return;
+            }
+        }
+        else if (p >= 30 && p <= 37) style->fg = VTCOLOR_256 | (p - 30);
+        else if (p >= 90 && p <= 97) style->fg = VTCOLOR_256 | (p - 90 + 8);
+        else if (p == 39) style->fg = VTCOLOR_DEFAULT;
+        else if (p >= 40 && p <= 47) style->bg = VTCOLOR_256 | (p - 40);
+        else if (p >= 100 && p <= 107) style->bg = VTCOLOR_256 | (p - 100 + 8);
+        else if (p == 49) style->bg = VTCOLOR_DEFAULT;
+        else {
+            for (size_t k = 0; k < N_SGR_CODES; k++) {
+                if (p == SGR_CODES[k].on) style->attrs |= SGR_CODES[k].attr;
+                else if (p == SGR_CODES[k].off) {
+                    style->attrs &= ~SGR_CODES[k].attr;
+                }
+            }
+        }
+    }
+}
+
+bool vtstyle_apply_escape(vtstyle *const style, const char *const esc,
+        size_t len)
+{
+    assert(style != NULL);
+    assert(esc != NULL || len == 0);
+
+    if (len < 3 || esc[0] != '\033' || esc[1] != '[' || esc[len - 1] != 'm')
+        return false;
+
+    int params[VTSTYLE_MAX_PARAMS];
+    int n_params = 0;
+    int cur = -1;
+    for (size_t i = 2; i < len - 1; i++) {
+        char c = esc[i];
+        if (c >= '0' && c <= '9') {
+            cur = (cur < 0 ? 0 : cur) * 10 + (c - '0');
+            if (cur > 99999) cur = 99999;
+        }
+        else if (c == ';' || c == ':') {
+            if (n_params < VTSTYLE_MAX_PARAMS) params[n_params++] = cur;
+            cur = -1;
+        }
+        else {
+            return false;
+        }
+    }
+    if (n_params < VTSTYLE_MAX_PARAMS) params[n_params++] = cur;
+
+    vtstyle_apply_sgr(style, params, n_params);
+    return true;
+}
+
+size_t vtstyle_sgr(const vtstyle *const from, const vtstyle *const to,
+        char *const buf)
+{
+    assert(from != NULL);
+    assert(to != NULL);
+    assert(buf != NULL);
+
+    char delta[VTSTYLE_SGR_MAXLEN * 2], reset[VTSTYLE_SGR_MAXLEN * 2];
+    size_t delta_len = sgr_delta(from, to, delta);
+    if (delta_len == 0) return 0;
+
+    // A reset would also clear the colours 'to' leaves alone.
+    const char *params = delta;
+    size_t params_len = delta_len;
+    if (to->fg != VTCOLOR_UNKNOWN && to->bg != VTCOLOR_UNKNOWN) {
+        reset[0] = '0';
+        size_t reset_len = 1;
+        if (!vtstyle_eq(to, &DEFAULT_STYLE)) {
+            reset[reset_len++] = ';';
+            reset_len += sgr_delta(&DEFAULT_STYLE, to, reset + reset_len);
+        }
+        if (reset_len < delta_len) {
+            params = reset;
+            params_len = reset_len;
+        }
+    }
+
+    assert(params_len + 3 <= VTSTYLE_SGR_MAXLEN);
+    buf[0] = '\033';
+    buf[1] = '[';
+    memcpy(buf + 2, params, params_len);
+    buf[2 + params_len] = 'm';
+    return params_len + 3;
+}
+
+/*****************************************************************************/
+/***************************** INTERNAL IMPLs ********************************/
+
+static size_t sgr_delta(const vtstyle *const from, const vtstyle *const to,
+        char *const buf)
+{
+    size_t len = 0;
+    uint32_t off = from->attrs & ~to->attrs;
+    uint32_t on = to->attrs & ~from->attrs;
+    // Bold and dim are turned off together.
+    if (off & (VTATTR_BOLD | VTATTR_DIM)) {
+        on |= to->attrs & (VTATTR_BOLD | VTATTR_DIM);
+    }
+
+    bool intensity_off = false;
+    for (size_t k = 0; k < N_SGR_CODES; k++) {
+        const sgr_code *const code = &SGR_CODES[k];
+        if (!(off & code->attr)) continue;
+        if (code->attr & (VTATTR_BOLD | VTATTR_DIM)) {
+            if (intensity_off) continue;
+            intensity_off = true;
+        }
+        if (len > 0) buf[len++] = ';';
+        len += fmt_uint(code->off, buf + len);
+    }
+    for (size_t k = 0; k < N_SGR_CODES; k++) {
+        if (!(on & SGR_CODES[k].attr)) continue;
+        if (len > 0) buf[len++] = ';';
+        len += fmt_uint(SGR_CODES[k].on, buf + len);
+    }
+    if (to->fg != VTCOLOR_UNKNOWN && from->fg != to->fg) {
+        if (len > 0) buf[len++] = ';';
+        len += sgr_color(to->fg, false, buf + len);
+    }
+    if (to->bg != VTCOLOR_UNKNOWN && from->bg != to->bg) {
+        if (len > 0) buf[len++] = ';';
+        len += sgr_color(to->bg, true, buf + len);
+    }
+    return len;
+}
+
+static size_t sgr_color(uint32_t color, bool bg, char *const buf) {
+    if (color == VTCOLOR_DEFAULT) return fmt_uint(bg ? 49 : 39, buf);
+
+    if (color & VTCOLOR_256) {
+        unsigned i = color & 0xFF;
+        if (i < 8) return fmt_uint((bg ? 40 : 30) + i, buf);
+        if (i < 16) return fmt_uint((bg ? 100 : 90) + i - 8, buf);
+        size_t len = fmt_uint(bg ? 48 : 38, buf);
+        memcpy(buf + len, ";5;", 3);
+        len += 3;
+        return len + fmt_uint(i, buf + len);
+    }
+
+    size_t len = fmt_uint(bg ? 48 : 38, buf);
+    memcpy(buf + len, ";2;", 3);
+    len += 3;
+    len += fmt_uint((color >> 16) & 0xFF, buf + len);
+    buf[len++] = ';';
+    len += fmt_uint((color >> 8) & 0xFF, buf + len);
+    buf[len++] = ';';
+    return len + fmt_uint(color & 0xFF, buf + len);
+}
+
+static size_t fmt_uint(unsigned v, char *const buf) {
+    char tmp[16];
+    size_t n = 0;
+    do {
+        tmp[n++] = (char) ('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    for (size_t i = 0; i < n; i++) buf[i] = tmp[n - 1 - i];
+    return n;
+}